@@ -10,13 +10,23 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/slab.h>
 #include <linux/usb.h>
+#include <linux/usb/video.h>
+#include <linux/kfifo.h>
+#include <linux/workqueue.h>
 #include <linux/videodev2.h>
+#include <linux/uvcvideo.h>
+#include <asm/unaligned.h>
+#include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
+#include <media/v4l2-event.h>
 #include <media/v4l2-ioctl.h>
 #include <media/videobuf2-v4l2.h>
 #include <media/videobuf2-vmalloc.h>
 
+#include "camera_uapi.h"
+
 #define DRIVER_NAME "imx6ull_camera"
 #define DRIVER_VERSION "1.0.0"
 
@@ -24,9 +34,37 @@
 #define MAX_BUFFERS 4
 #define MIN_BUFFERS 2
 
+/* Metadata buffers: struct uvc_meta_buf blocks, one per distinct header */
+#define CAMERA_META_BUF_SIZE    4096
+#define CAMERA_META_HEADER_MAX  12      /* bmHeaderInfo + PTS + SCR */
+
 /* Supported formats */
 #define CAMERA_FORMAT_MJPEG V4L2_PIX_FMT_MJPEG
 #define CAMERA_FORMAT_YUYV  V4L2_PIX_FMT_YUYV
+static_assert(CAMERA_FORMAT_GREY == V4L2_PIX_FMT_GREY);   /* camera_uapi.h */
+
+/* USB streaming parameters */
+#define CAMERA_MAX_URBS         8
+#define CAMERA_ISOC_URBS        5
+#define CAMERA_ISOC_PACKETS     32      /* Packets per isochronous URB */
+#define CAMERA_BULK_URBS        4
+#define CAMERA_BULK_URB_MIN     (64 * 1024)
+#define CAMERA_BULK_URB_MAX     (512 * 1024)
+#define CAMERA_CTRL_TIMEOUT     1000    /* ms */
+#define CAMERA_MAX_PENDING_URBS 8       /* Power of two, >= CAMERA_MAX_URBS */
+
+/* Descriptor limits */
+#define CAMERA_MAX_UVC_FORMATS  4
+#define CAMERA_MAX_UVC_FRAMES   16
+
+/* Uncompressed formats can be decimated by 2 or 4 during payload copy */
+#define CAMERA_MAX_DECIMATION   4
+
+/* Slice mode, see camera_uapi.h */
+#define CAMERA_SLICE_EVENTS     32      /* Per-subscriber event queue depth */
+static_assert(CAMERA_CID_USER_BASE == V4L2_CID_USER_BASE + 0x1f00);
+static_assert(CAMERA_EVENT_SLICE == V4L2_EVENT_PRIVATE_START + 1);
+static_assert(sizeof(struct camera_slice_event) <= sizeof(((struct v4l2_event *)0)->u.data));
 
 /* Device states */
 enum camera_state {
@@ -36,6 +74,28 @@ enum camera_state {
     CAMERA_STATE_ERROR
 };
 
+/* USB transfer type used by the VideoStreaming interface */
+enum camera_transfer_mode {
+    CAMERA_XFER_ISOC = 0,
+    CAMERA_XFER_BULK,
+};
+
+/* Frame descriptor parsed from the VideoStreaming interface */
+struct camera_uvc_frame {
+    u8 index;               /* bFrameIndex */
+    u16 width;
+    u16 height;
+    u32 interval;           /* dwDefaultFrameInterval, 100 ns units */
+};
+
+/* Format descriptor parsed from the VideoStreaming interface */
+struct camera_uvc_format {
+    u8 index;               /* bFormatIndex */
+    u32 fourcc;
+    struct camera_uvc_frame frames[CAMERA_MAX_UVC_FRAMES];
+    int num_frames;
+};
+
 /* Buffer structure */
 struct camera_buffer {
     struct vb2_v4l2_buffer vb;
@@ -44,6 +104,70 @@ struct camera_buffer {
     size_t size;
 };
 
+/* A completed URB, with the time and USB frame it completed at */
+struct camera_pending_urb {
+    struct urb *urb;
+    u64 ns;
+    u16 sof;
+};
+
+/* USB streaming context */
+struct camera_streaming {
+    struct usb_interface *intf;         /* VideoStreaming interface */
+    enum camera_transfer_mode mode;
+    struct usb_host_endpoint *endpoint;
+    int altsetting;
+    struct urb *urbs[CAMERA_MAX_URBS];
+    u8 *transfer_buffer[CAMERA_MAX_URBS];
+    int num_urbs;
+    int urb_size;
+
+    /*
+     * Completed URBs waiting for the decode work. At least one URB always
+     * stays with the host controller; if decoding falls that far behind,
+     * completions are resubmitted unread and the frame is marked bad.
+     */
+    DECLARE_KFIFO(pending, struct camera_pending_urb, CAMERA_MAX_PENDING_URBS);
+    spinlock_t pending_lock;            /* Serializes producers */
+    u64 urb_ns;                         /* Completion of the URB being decoded */
+    u16 urb_sof;
+    struct work_struct decode_work;
+    atomic_t overrun;
+    u32 overruns;
+
+    /* Negotiated with VS_PROBE/VS_COMMIT */
+    u32 src_fourcc;                     /* Format the camera sends */
+    u32 src_width;
+    u32 src_height;
+    u32 src_bytesperline;
+    u32 max_payload;                    /* dwMaxPayloadTransferSize */
+    u32 max_frame_size;                 /* dwMaxVideoFrameSize */
+
+    /* Capture format differs from src_fourcc, convert line by line */
+    bool convert;
+    u32 decimation;                     /* 1, 2 or 4 */
+    u8 *line_buf;                       /* Source line split across payloads */
+
+    /* Bulk payloads may span several URBs */
+    u32 bulk_payload_size;
+    u8 bulk_header_flags;
+    bool bulk_in_payload;
+    bool bulk_skip_payload;
+
+    /* Frame assembly */
+    struct camera_buffer *cur_buf;
+    size_t frame_pos;                   /* Bytes received from the camera */
+    bool frame_error;
+    bool in_frame;                      /* Between the first payload and EOF */
+    bool skip_frame;                    /* No buffer was available */
+    int last_fid;
+    u32 sequence;
+
+    /* Slice events, slice_lines latched at frame start */
+    u32 slice_lines;
+    u32 slice_next;                     /* Lines complete at the next event */
+};
+
 /* Main device structure */
 struct camera_device {
     struct v4l2_device v4l2_dev;
@@ -64,10 +188,31 @@ struct camera_device {
     struct v4l2_format format;
     struct v4l2_streamparm parm;
     
+    /* Controls */
+    struct v4l2_ctrl_handler ctrl_handler;
+    u32 slice_lines;                    /* 0: slice events disabled */
+    
+    /* UVC descriptors */
+    u16 uvc_version;                    /* bcdUVC */
+    struct camera_uvc_format uvc_formats[CAMERA_MAX_UVC_FORMATS];
+    int num_uvc_formats;
+
     /* USB streaming */
-    struct usb_host_endpoint *streaming_ep;
-    struct urb *urbs[MAX_BUFFERS];
-    int num_urbs;
+    struct camera_streaming streaming;
+    struct workqueue_struct *workqueue;
+
+    /*
+     * Metadata node. Buffers follow the image buffers frame by frame and
+     * carry the same sequence number and timestamp.
+     */
+    struct video_device *meta_vdev;
+    struct vb2_queue meta_queue;
+    struct list_head meta_buf_list;     /* Protected by buf_lock */
+    struct camera_buffer *cur_meta;     /* Protected by buf_lock */
+    bool meta_streaming;                /* Protected by buf_lock */
+    size_t meta_pos;
+    u8 meta_last[CAMERA_META_HEADER_MAX];
+    u8 meta_last_len;
     
     /* Statistics */
     atomic_t frames_received;
@@ -90,9 +235,60 @@ static struct v4l2_fmtdesc formats[] = {
         .flags = 0,
         .description = "YUYV 4:2:2",
         .pixelformat = V4L2_PIX_FMT_YUYV,
+    },
+    {
+        .index = 2,
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .flags = 0,
+        .description = "8-bit Greyscale",
+        .pixelformat = V4L2_PIX_FMT_GREY,
     }
 };
 
+/* Format requested from the camera for a capture format */
+static inline u32 camera_uvc_fourcc(u32 pixelformat)
+{
+    return pixelformat == V4L2_PIX_FMT_GREY ? V4L2_PIX_FMT_YUYV : pixelformat;
+}
+
+static inline u32 camera_max_decimation(u32 fourcc)
+{
+    return fourcc == V4L2_PIX_FMT_YUYV ? CAMERA_MAX_DECIMATION : 1;
+}
+
+/* Decimated YUYV lines must still hold whole macropixels */
+static inline bool camera_can_decimate(const struct camera_uvc_frame *frame, u32 factor)
+{
+    return !(frame->width % (2 * factor)) && !(frame->height % factor);
+}
+
+static bool camera_uvc_format_has_size(const struct camera_uvc_format *fmt,
+                                       u32 width, u32 height)
+{
+    int i;
+
+    for (i = 0; i < fmt->num_frames; i++)
+        if (fmt->frames[i].width == width && fmt->frames[i].height == height)
+            return true;
+
+    return false;
+}
+
+/* GREY is converted from YUYV, so only a YUYV camera can offer it */
+static bool camera_format_supported(struct camera_device *dev, u32 pixelformat)
+{
+    int i;
+
+    if (pixelformat != V4L2_PIX_FMT_GREY)
+        return true;
+
+    for (i = 0; i < dev->num_uvc_formats; i++)
+        if (dev->uvc_formats[i].fourcc == V4L2_PIX_FMT_YUYV)
+            return true;
+
+    return false;
+}
+
 /* Supported frame sizes */
 static struct v4l2_frmsizeenum frame_sizes[] = {
     { .index = 0, .pixel_format = V4L2_PIX_FMT_MJPEG,
@@ -117,6 +313,17 @@ MODULE_DEVICE_TABLE(usb, camera_id_table);
 /* Forward declarations */
 static int camera_probe(struct usb_interface *intf, const struct usb_device_id *id);
 static void camera_disconnect(struct usb_interface *intf);
+static int camera_try_fmt(struct file *file, void *priv, struct v4l2_format *f);
+static int camera_init_streaming(struct camera_device *dev);
+static void camera_stop_usb_streaming(struct camera_device *dev);
+static void camera_return_all_buffers(struct camera_device *dev,
+                                     enum vb2_buffer_state state);
+static const struct camera_uvc_frame *camera_nearest_uvc_frame(struct camera_device *dev,
+                                                               u32 fourcc, u32 width,
+                                                               u32 height, u8 *format_index);
+static const struct camera_uvc_frame *camera_nearest_size(struct camera_device *dev,
+                                                          u32 pixelformat, u32 *width,
+                                                          u32 *height, u32 *factor);
 
 /* USB driver structure */
 static struct usb_driver camera_driver = {
@@ -136,12 +343,17 @@ static int camera_querycap(struct file *file, void *priv,
 {
     struct camera_device *dev = video_drvdata(file);
     
+    struct video_device *vdev = video_devdata(file);
+    
     strscpy(cap->driver, DRIVER_NAME, sizeof(cap->driver));
     strscpy(cap->card, "IMX6ULL Camera", sizeof(cap->card));
     usb_make_path(dev->udev, cap->bus_info, sizeof(cap->bus_info));
     
-    cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
-    cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+    /* Shared by the image and metadata nodes */
+    cap->device_caps = vdev->device_caps;
+    cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_META_CAPTURE |
+                        V4L2_CAP_READWRITE | V4L2_CAP_STREAMING |
+                        V4L2_CAP_DEVICE_CAPS;
     
     return 0;
 }
@@ -150,11 +362,64 @@ static int camera_querycap(struct file *file, void *priv,
 static int camera_enum_fmt(struct file *file, void *priv,
                           struct v4l2_fmtdesc *f)
 {
-    if (f->index >= ARRAY_SIZE(formats))
-        return -EINVAL;
+    struct camera_device *dev = video_drvdata(file);
+    u32 index = 0;
+    int i;
     
-    *f = formats[f->index];
-    return 0;
+    for (i = 0; i < ARRAY_SIZE(formats); i++) {
+        if (!camera_format_supported(dev, formats[i].pixelformat))
+            continue;
+        
+        if (index++ == f->index) {
+            *f = formats[i];
+            f->index = index - 1;
+            return 0;
+        }
+    }
+    
+    return -EINVAL;
+}
+
+/* Enumerate advertised frame sizes plus their decimated variants */
+static int camera_enum_framesizes(struct file *file, void *priv,
+                                  struct v4l2_frmsizeenum *fsize)
+{
+    struct camera_device *dev = video_drvdata(file);
+    u32 fourcc = camera_uvc_fourcc(fsize->pixel_format);
+    u32 index = 0;
+    u32 factor;
+    int i, j;
+
+    for (i = 0; i < dev->num_uvc_formats; i++) {
+        const struct camera_uvc_format *fmt = &dev->uvc_formats[i];
+
+        if (fmt->fourcc != fourcc)
+            continue;
+
+        for (j = 0; j < fmt->num_frames; j++) {
+            const struct camera_uvc_frame *frame = &fmt->frames[j];
+
+            for (factor = 1; factor <= camera_max_decimation(fourcc); factor <<= 1) {
+                u32 width = frame->width / factor;
+                u32 height = frame->height / factor;
+
+                /* Skip sizes the camera already provides natively */
+                if (factor > 1 && (!camera_can_decimate(frame, factor) ||
+                                   camera_uvc_format_has_size(fmt, width, height)))
+                    continue;
+
+                if (index++ != fsize->index)
+                    continue;
+
+                fsize->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+                fsize->discrete.width = width;
+                fsize->discrete.height = height;
+                return 0;
+            }
+        }
+    }
+
+    return -EINVAL;
 }
 
 /* Get current format */
@@ -181,34 +446,71 @@ static int camera_s_fmt(struct file *file, void *priv,
     if (ret)
         return ret;
     
+    /* Tell other listeners (e.g. a second process) the frame layout changed */
+    if (f->fmt.pix.width != dev->format.fmt.pix.width ||
+        f->fmt.pix.height != dev->format.fmt.pix.height ||
+        f->fmt.pix.pixelformat != dev->format.fmt.pix.pixelformat) {
+        static const struct v4l2_event ev = {
+            .type = V4L2_EVENT_SOURCE_CHANGE,
+            .u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION,
+        };
+
+        v4l2_event_queue(dev->vdev, &ev);
+    }
+    
     dev->format = *f;
     return 0;
 }
 
+/* Subscribe to frame-sync, source-change and slice events */
+static int camera_subscribe_event(struct v4l2_fh *fh,
+                                  const struct v4l2_event_subscription *sub)
+{
+    switch (sub->type) {
+    case V4L2_EVENT_FRAME_SYNC:
+        return v4l2_event_subscribe(fh, sub, 2, NULL);
+    case V4L2_EVENT_SOURCE_CHANGE:
+        return v4l2_src_change_event_subscribe(fh, sub);
+    case CAMERA_EVENT_SLICE:
+        return v4l2_event_subscribe(fh, sub, CAMERA_SLICE_EVENTS, NULL);
+    default:
+        return -EINVAL;
+    }
+}
+
 /* Try format */
 static int camera_try_fmt(struct file *file, void *priv,
                          struct v4l2_format *f)
 {
+    struct camera_device *dev = video_drvdata(file);
     struct v4l2_pix_format *pix = &f->fmt.pix;
     
     /* Validate pixel format */
-    if (pix->pixelformat != V4L2_PIX_FMT_MJPEG &&
-        pix->pixelformat != V4L2_PIX_FMT_YUYV) {
+    if ((pix->pixelformat != V4L2_PIX_FMT_MJPEG &&
+         pix->pixelformat != V4L2_PIX_FMT_YUYV &&
+         pix->pixelformat != V4L2_PIX_FMT_GREY) ||
+        !camera_format_supported(dev, pix->pixelformat)) {
         pix->pixelformat = V4L2_PIX_FMT_MJPEG;
     }
     
-    /* Clamp dimensions */
-    pix->width = clamp(pix->width, 160U, 1280U);
-    pix->height = clamp(pix->height, 120U, 720U);
-    
-    /* Align to 16-byte boundary for better performance */
-    pix->width = ALIGN(pix->width, 16);
-    pix->height = ALIGN(pix->height, 2);
+    /* Snap to a size the camera (or decimation) provides, VS_COMMIT rejects others */
+    if (!camera_nearest_size(dev, pix->pixelformat, &pix->width, &pix->height, NULL)) {
+        /* Clamp dimensions */
+        pix->width = clamp(pix->width, 160U, 1280U);
+        pix->height = clamp(pix->height, 120U, 720U);
+        
+        /* Align to 16-byte boundary for better performance */
+        pix->width = ALIGN(pix->width, 16);
+        pix->height = ALIGN(pix->height, 2);
+    }
     
     /* Calculate bytes per line and image size */
     if (pix->pixelformat == V4L2_PIX_FMT_YUYV) {
         pix->bytesperline = pix->width * 2;
         pix->sizeimage = pix->bytesperline * pix->height;
+    } else if (pix->pixelformat == V4L2_PIX_FMT_GREY) {
+        pix->bytesperline = pix->width;
+        pix->sizeimage = pix->bytesperline * pix->height;
     } else {
         pix->bytesperline = 0; /* Compressed format */
         pix->sizeimage = pix->width * pix->height; /* Estimate */
@@ -292,6 +594,7 @@ static int camera_start_streaming(struct vb2_queue *q, unsigned int count)
     ret = camera_init_streaming(dev);
     if (ret) {
         dev_err(&dev->udev->dev, "Failed to start streaming: %d\n", ret);
+        camera_return_all_buffers(dev, VB2_BUF_STATE_QUEUED);
         return ret;
     }
     
@@ -315,7 +618,8 @@ static void camera_stop_streaming(struct vb2_queue *q)
     /* Return all buffers */
     camera_return_all_buffers(dev, VB2_BUF_STATE_ERROR);
     
-    dev->state = CAMERA_STATE_CONNECTED;
+    if (dev->state != CAMERA_STATE_DISCONNECTED)
+        dev->state = CAMERA_STATE_CONNECTED;
 }
 
 /* Videobuf2 operations structure */
@@ -336,6 +640,7 @@ static const struct v4l2_ioctl_ops camera_ioctl_ops = {
     .vidioc_g_fmt_vid_cap = camera_g_fmt,
     .vidioc_s_fmt_vid_cap = camera_s_fmt,
     .vidioc_try_fmt_vid_cap = camera_try_fmt,
+    .vidioc_enum_framesizes = camera_enum_framesizes,
     
     .vidioc_reqbufs = vb2_ioctl_reqbufs,
     .vidioc_querybuf = vb2_ioctl_querybuf,
@@ -343,6 +648,9 @@ static const struct v4l2_ioctl_ops camera_ioctl_ops = {
     .vidioc_dqbuf = vb2_ioctl_dqbuf,
     .vidioc_streamon = vb2_ioctl_streamon,
     .vidioc_streamoff = vb2_ioctl_streamoff,
+    
+    .vidioc_subscribe_event = camera_subscribe_event,
+    .vidioc_unsubscribe_event = v4l2_event_unsubscribe,
 };
 
 /* V4L2 file operations */
@@ -356,6 +664,56 @@ static const struct v4l2_file_operations camera_fops = {
     .mmap = vb2_fop_mmap,
 };
 
+/*
+ * Controls
+ */
+
+static int camera_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+    struct camera_device *dev = container_of(ctrl->handler, struct camera_device,
+                                             ctrl_handler);
+
+    switch (ctrl->id) {
+    case CAMERA_CID_SLICE_LINES:
+        /* Picked up by the data path at the next frame */
+        WRITE_ONCE(dev->slice_lines, ctrl->val);
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static const struct v4l2_ctrl_ops camera_ctrl_ops = {
+    .s_ctrl = camera_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config camera_ctrl_slice_lines = {
+    .ops = &camera_ctrl_ops,
+    .id = CAMERA_CID_SLICE_LINES,
+    .name = "Slice Lines",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = 0,
+    .max = 2160,
+    .step = 1,
+    .def = 0,
+};
+
+static int camera_init_controls(struct camera_device *dev)
+{
+    struct v4l2_ctrl_handler *hdl = &dev->ctrl_handler;
+
+    v4l2_ctrl_handler_init(hdl, 1);
+    v4l2_ctrl_new_custom(hdl, &camera_ctrl_slice_lines, NULL);
+    if (hdl->error) {
+        int ret = hdl->error;
+
+        v4l2_ctrl_handler_free(hdl);
+        return ret;
+    }
+
+    return 0;
+}
+
 /*
  * Helper Functions
  */
@@ -366,7 +724,8 @@ static int camera_init_vb2_queue(struct camera_device *dev)
     struct vb2_queue *q = &dev->queue;
 
     q->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    q->io_modes = VB2_MMAP | VB2_READ;
+    /* vb2_vmalloc can import user memory and dmabufs as well */
+    q->io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF | VB2_READ;
     q->drv_priv = dev;
     q->buf_struct_size = sizeof(struct camera_buffer);
     q->ops = &camera_vb2_ops;
@@ -393,9 +752,11 @@ static int camera_create_video_device(struct camera_device *dev)
     vdev->release = video_device_release;
     vdev->lock = &dev->lock;
     vdev->queue = &dev->queue;
+    vdev->ctrl_handler = &dev->ctrl_handler;
 
     strscpy(vdev->name, "IMX6ULL Camera", sizeof(vdev->name));
-    vdev->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+    vdev->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_READWRITE |
+                        V4L2_CAP_STREAMING;
 
     video_set_drvdata(vdev, dev);
 
@@ -404,10 +765,11 @@ static int camera_create_video_device(struct camera_device *dev)
     dev->format.fmt.pix.width = 640;
     dev->format.fmt.pix.height = 480;
     dev->format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+    dev->format.fmt.pix.sizeimage = 640 * 480;
     dev->format.fmt.pix.field = V4L2_FIELD_NONE;
     dev->format.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
 
-    ret = video_register_device(vdev, VFL_TYPE_GRABBER, -1);
+    ret = video_register_device(vdev, VFL_TYPE_VIDEO, -1);
     if (ret) {
         video_device_release(vdev);
         return ret;
@@ -417,126 +779,1418 @@ static int camera_create_video_device(struct camera_device *dev)
     return 0;
 }
 
-/* Initialize USB streaming */
-static int camera_init_streaming(struct camera_device *dev)
+/*
+ * Metadata Node
+ */
+
+static int camera_meta_enum_fmt(struct file *file, void *priv,
+                                struct v4l2_fmtdesc *f)
 {
-    /* This would contain USB-specific streaming initialization */
-    /* For now, return success as a placeholder */
+    if (f->index)
+        return -EINVAL;
+
+    f->type = V4L2_BUF_TYPE_META_CAPTURE;
+    f->pixelformat = V4L2_META_FMT_UVC;
+    strscpy(f->description, "UVC Payload Header Metadata", sizeof(f->description));
     return 0;
 }
 
-/* Stop USB streaming */
-static void camera_stop_usb_streaming(struct camera_device *dev)
+/* The metadata format is fixed, G/S/TRY_FMT all report it */
+static int camera_meta_fmt(struct file *file, void *priv, struct v4l2_format *f)
 {
-    /* Stop USB transfers and clean up URBs */
-    /* Implementation depends on specific USB streaming setup */
+    memset(&f->fmt.meta, 0, sizeof(f->fmt.meta));
+    f->fmt.meta.dataformat = V4L2_META_FMT_UVC;
+    f->fmt.meta.buffersize = CAMERA_META_BUF_SIZE;
+    return 0;
 }
 
-/* Return all buffers to videobuf2 */
-static void camera_return_all_buffers(struct camera_device *dev,
-                                     enum vb2_buffer_state state)
+static int camera_meta_queue_setup(struct vb2_queue *q,
+                                   unsigned int *nbuffers,
+                                   unsigned int *nplanes,
+                                   unsigned int sizes[],
+                                   struct device *alloc_devs[])
+{
+    if (*nplanes)
+        return sizes[0] < CAMERA_META_BUF_SIZE ? -EINVAL : 0;
+
+    *nplanes = 1;
+    sizes[0] = CAMERA_META_BUF_SIZE;
+    *nbuffers = clamp_t(unsigned int, *nbuffers, MIN_BUFFERS, MAX_BUFFERS);
+    return 0;
+}
+
+static void camera_meta_buf_queue(struct vb2_buffer *vb)
+{
+    struct camera_device *dev = vb2_get_drv_priv(vb->vb2_queue);
+    struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+    struct camera_buffer *buf = container_of(vbuf, struct camera_buffer, vb);
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    list_add_tail(&buf->list, &dev->meta_buf_list);
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+}
+
+static int camera_meta_start_streaming(struct vb2_queue *q, unsigned int count)
+{
+    struct camera_device *dev = vb2_get_drv_priv(q);
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    dev->meta_streaming = true;
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+    return 0;
+}
+
+/* Return the metadata buffer of the frame in progress, buf_lock held */
+static void camera_meta_release_locked(struct camera_device *dev)
+{
+    if (dev->cur_meta) {
+        vb2_buffer_done(&dev->cur_meta->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+        dev->cur_meta = NULL;
+    }
+}
+
+static void camera_meta_stop_streaming(struct vb2_queue *q)
 {
+    struct camera_device *dev = vb2_get_drv_priv(q);
     struct camera_buffer *buf, *tmp;
     unsigned long flags;
 
     spin_lock_irqsave(&dev->buf_lock, flags);
-    list_for_each_entry_safe(buf, tmp, &dev->buf_list, list) {
+    dev->meta_streaming = false;
+    camera_meta_release_locked(dev);
+    list_for_each_entry_safe(buf, tmp, &dev->meta_buf_list, list) {
         list_del(&buf->list);
-        vb2_buffer_done(&buf->vb.vb2_buf, state);
+        vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
     }
     spin_unlock_irqrestore(&dev->buf_lock, flags);
 }
 
-/*
- * USB Operations
- */
+static struct vb2_ops camera_meta_vb2_ops = {
+    .queue_setup = camera_meta_queue_setup,
+    .buf_queue = camera_meta_buf_queue,
+    .start_streaming = camera_meta_start_streaming,
+    .stop_streaming = camera_meta_stop_streaming,
+    .wait_prepare = vb2_ops_wait_prepare,
+    .wait_finish = vb2_ops_wait_finish,
+};
 
-/* USB probe function */
-static int camera_probe(struct usb_interface *intf,
-                       const struct usb_device_id *id)
+static const struct v4l2_ioctl_ops camera_meta_ioctl_ops = {
+    .vidioc_querycap = camera_querycap,
+    .vidioc_enum_fmt_meta_cap = camera_meta_enum_fmt,
+    .vidioc_g_fmt_meta_cap = camera_meta_fmt,
+    .vidioc_s_fmt_meta_cap = camera_meta_fmt,
+    .vidioc_try_fmt_meta_cap = camera_meta_fmt,
+
+    .vidioc_reqbufs = vb2_ioctl_reqbufs,
+    .vidioc_querybuf = vb2_ioctl_querybuf,
+    .vidioc_qbuf = vb2_ioctl_qbuf,
+    .vidioc_dqbuf = vb2_ioctl_dqbuf,
+    .vidioc_streamon = vb2_ioctl_streamon,
+    .vidioc_streamoff = vb2_ioctl_streamoff,
+};
+
+/* Create the metadata video device */
+static int camera_create_meta_device(struct camera_device *dev)
 {
-    struct usb_device *udev = interface_to_usbdev(intf);
-    struct camera_device *dev;
+    struct vb2_queue *q = &dev->meta_queue;
+    struct video_device *vdev;
     int ret;
 
-    dev_info(&intf->dev, "Probing camera device\n");
+    INIT_LIST_HEAD(&dev->meta_buf_list);
 
-    /* Allocate device structure */
-    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
-    if (!dev)
+    q->type = V4L2_BUF_TYPE_META_CAPTURE;
+    q->io_modes = VB2_MMAP;
+    q->drv_priv = dev;
+    q->buf_struct_size = sizeof(struct camera_buffer);
+    q->ops = &camera_meta_vb2_ops;
+    q->mem_ops = &vb2_vmalloc_memops;
+    q->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    q->lock = &dev->lock;
+
+    ret = vb2_queue_init(q);
+    if (ret)
+        return ret;
+
+    vdev = video_device_alloc();
+    if (!vdev)
         return -ENOMEM;
 
-    /* Initialize device */
-    dev->udev = udev;
-    dev->intf = intf;
-    dev->state = CAMERA_STATE_CONNECTED;
+    vdev->v4l2_dev = &dev->v4l2_dev;
+    vdev->fops = &camera_fops;
+    vdev->ioctl_ops = &camera_meta_ioctl_ops;
+    vdev->release = video_device_release;
+    vdev->lock = &dev->lock;
+    vdev->queue = q;
 
-    mutex_init(&dev->lock);
-    spin_lock_init(&dev->buf_lock);
-    INIT_LIST_HEAD(&dev->buf_list);
+    strscpy(vdev->name, "IMX6ULL Camera Metadata", sizeof(vdev->name));
+    vdev->device_caps = V4L2_CAP_META_CAPTURE | V4L2_CAP_STREAMING;
 
-    /* Register V4L2 device */
-    ret = v4l2_device_register(&intf->dev, &dev->v4l2_dev);
-    if (ret) {
-        dev_err(&intf->dev, "Failed to register V4L2 device: %d\n", ret);
-        goto error_free;
-    }
+    video_set_drvdata(vdev, dev);
 
-    /* Initialize video buffer queue */
-    ret = camera_init_vb2_queue(dev);
+    ret = video_register_device(vdev, VFL_TYPE_VIDEO, -1);
     if (ret) {
-        dev_err(&intf->dev, "Failed to initialize VB2 queue: %d\n", ret);
-        goto error_v4l2;
+        video_device_release(vdev);
+        return ret;
     }
 
-    /* Create video device */
-    ret = camera_create_video_device(dev);
-    if (ret) {
-        dev_err(&intf->dev, "Failed to create video device: %d\n", ret);
-        goto error_v4l2;
-    }
+    dev->meta_vdev = vdev;
+    return 0;
+}
 
-    /* Set interface data */
-    usb_set_intfdata(intf, dev);
+/*
+ * UVC Descriptor Parsing
+ */
 
-    dev_info(&intf->dev, "Camera device registered as %s\n",
-             video_device_node_name(dev->vdev));
+/* GUID of the YUY2 uncompressed format */
+static const u8 camera_guid_yuy2[16] = {
+    'Y', 'U', 'Y', '2', 0x00, 0x00, 0x10, 0x00,
+    0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+};
 
-    return 0;
+/* Read bcdUVC from the VideoControl interface header */
+static void camera_parse_vc_header(struct camera_device *dev)
+{
+    const u8 *buf = dev->intf->cur_altsetting->extra;
+    int len = dev->intf->cur_altsetting->extralen;
 
-error_v4l2:
-    v4l2_device_unregister(&dev->v4l2_dev);
-error_free:
-    kfree(dev);
-    return ret;
+    dev->uvc_version = 0x0100;
+
+    for (; len > 2; len -= buf[0], buf += buf[0]) {
+        if (buf[0] < 3 || buf[0] > len)
+            break;
+        if (buf[1] == USB_DT_CS_INTERFACE && buf[2] == UVC_VC_HEADER && buf[0] >= 5) {
+            dev->uvc_version = get_unaligned_le16(buf + 3);
+            return;
+        }
+    }
 }
 
-/* USB disconnect function */
-static void camera_disconnect(struct usb_interface *intf)
+/* Collect the MJPEG and YUYV formats and their frame sizes */
+static void camera_parse_vs_formats(struct camera_device *dev)
 {
-    struct camera_device *dev = usb_get_intfdata(intf);
-    
-    dev_info(&intf->dev, "Disconnecting camera device\n");
-    
-    if (!dev)
-        return;
-    
-    dev->state = CAMERA_STATE_DISCONNECTED;
-    
-    /* Unregister video device */
-    if (dev->vdev) {
-        video_unregister_device(dev->vdev);
-        dev->vdev = NULL;
+    struct usb_host_interface *alt = &dev->streaming.intf->altsetting[0];
+    const u8 *buf = alt->extra;
+    int len = alt->extralen;
+    struct camera_uvc_format *fmt = NULL;
+    struct camera_uvc_frame *frame;
+    u32 fourcc;
+
+    dev->num_uvc_formats = 0;
+
+    for (; len > 2; len -= buf[0], buf += buf[0]) {
+        if (buf[0] < 3 || buf[0] > len)
+            break;
+        if (buf[1] != USB_DT_CS_INTERFACE)
+            continue;
+
+        switch (buf[2]) {
+        case UVC_VS_FORMAT_UNCOMPRESSED:
+        case UVC_VS_FORMAT_MJPEG:
+            fmt = NULL;
+            if (dev->num_uvc_formats >= CAMERA_MAX_UVC_FORMATS || buf[0] < 4)
+                break;
+
+            if (buf[2] == UVC_VS_FORMAT_MJPEG)
+                fourcc = V4L2_PIX_FMT_MJPEG;
+            else if (buf[0] >= 21 && !memcmp(buf + 5, camera_guid_yuy2, 16))
+                fourcc = V4L2_PIX_FMT_YUYV;
+            else
+                break;  /* Formats we cannot deliver are ignored */
+
+            fmt = &dev->uvc_formats[dev->num_uvc_formats++];
+            fmt->index = buf[3];
+            fmt->fourcc = fourcc;
+            fmt->num_frames = 0;
+            break;
+
+        case UVC_VS_FRAME_UNCOMPRESSED:
+        case UVC_VS_FRAME_MJPEG:
+            if (!fmt || fmt->num_frames >= CAMERA_MAX_UVC_FRAMES || buf[0] < 26)
+                break;
+
+            frame = &fmt->frames[fmt->num_frames++];
+            frame->index = buf[3];
+            frame->width = get_unaligned_le16(buf + 5);
+            frame->height = get_unaligned_le16(buf + 7);
+            frame->interval = get_unaligned_le32(buf + 21);
+            break;
+        }
     }
-    
+}
+
+/* Find the advertised frame closest to the requested size */
+static const struct camera_uvc_frame *camera_nearest_uvc_frame(struct camera_device *dev,
+                                                               u32 fourcc, u32 width,
+                                                               u32 height, u8 *format_index)
+{
+    const struct camera_uvc_frame *best = NULL;
+    u32 best_dist = UINT_MAX;
+    int i, j;
+
+    for (i = 0; i < dev->num_uvc_formats; i++) {
+        const struct camera_uvc_format *fmt = &dev->uvc_formats[i];
+
+        if (fmt->fourcc != fourcc)
+            continue;
+
+        for (j = 0; j < fmt->num_frames; j++) {
+            const struct camera_uvc_frame *frame = &fmt->frames[j];
+            u32 dist = abs((int)frame->width - (int)width) +
+                       abs((int)frame->height - (int)height);
+
+            if (dist < best_dist) {
+                best = frame;
+                best_dist = dist;
+                if (format_index)
+                    *format_index = fmt->index;
+            }
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Find the capture size closest to the request. Uncompressed formats can
+ * also be delivered at 1/2 or 1/4 of an advertised size. On a tie the
+ * smaller decimation wins, so native sizes are never decimated.
+ */
+static const struct camera_uvc_frame *camera_nearest_size(struct camera_device *dev,
+                                                          u32 pixelformat, u32 *width,
+                                                          u32 *height, u32 *factor)
+{
+    u32 fourcc = camera_uvc_fourcc(pixelformat);
+    const struct camera_uvc_frame *best = NULL;
+    u32 best_dist = UINT_MAX;
+    u32 best_factor = 1;
+    u32 f;
+    int i, j;
+
+    for (i = 0; i < dev->num_uvc_formats; i++) {
+        const struct camera_uvc_format *fmt = &dev->uvc_formats[i];
+
+        if (fmt->fourcc != fourcc)
+            continue;
+
+        for (j = 0; j < fmt->num_frames; j++) {
+            const struct camera_uvc_frame *frame = &fmt->frames[j];
+
+            for (f = 1; f <= camera_max_decimation(fourcc); f <<= 1) {
+                u32 dist;
+
+                if (f > 1 && !camera_can_decimate(frame, f))
+                    continue;
+
+                dist = abs((int)(frame->width / f) - (int)*width) +
+                       abs((int)(frame->height / f) - (int)*height);
+                if (dist < best_dist || (dist == best_dist && f < best_factor)) {
+                    best = frame;
+                    best_dist = dist;
+                    best_factor = f;
+                }
+            }
+        }
+    }
+
+    if (!best)
+        return NULL;
+
+    *width = best->width / best_factor;
+    *height = best->height / best_factor;
+    if (factor)
+        *factor = best_factor;
+
+    return best;
+}
+
+/* Find the VideoStreaming interface belonging to this camera */
+static struct usb_interface *camera_find_streaming_intf(struct camera_device *dev)
+{
+    struct usb_host_config *config = dev->udev->actconfig;
+    int i;
+
+    for (i = 0; i < config->desc.bNumInterfaces; i++) {
+        struct usb_interface *intf = config->interface[i];
+        struct usb_interface_descriptor *desc = &intf->altsetting[0].desc;
+
+        if (desc->bInterfaceClass == USB_CLASS_VIDEO &&
+            desc->bInterfaceSubClass == UVC_SC_VIDEOSTREAMING)
+            return intf;
+    }
+
+    return NULL;
+}
+
+/*
+ * Stream Negotiation
+ */
+
+/* VS_PROBE_CONTROL / VS_COMMIT_CONTROL field offsets */
+#define UVC_PROBE_HINT              0
+#define UVC_PROBE_FORMAT_INDEX      2
+#define UVC_PROBE_FRAME_INDEX       3
+#define UVC_PROBE_FRAME_INTERVAL    4
+#define UVC_PROBE_MAX_FRAME_SIZE    18
+#define UVC_PROBE_MAX_PAYLOAD       22
+#define UVC_PROBE_SIZE_1_0          26
+#define UVC_PROBE_SIZE_1_1          34
+#define UVC_PROBE_SIZE_1_5          48
+
+static inline u16 camera_vs_ifnum(struct camera_device *dev)
+{
+    return dev->streaming.intf->cur_altsetting->desc.bInterfaceNumber;
+}
+
+static int camera_vs_ctrl(struct camera_device *dev, u8 query, u8 selector,
+                          u8 *data, u16 size)
+{
+    bool in = query & USB_DIR_IN;
+    unsigned int pipe;
+    int ret;
+
+    pipe = in ? usb_rcvctrlpipe(dev->udev, 0) : usb_sndctrlpipe(dev->udev, 0);
+    ret = usb_control_msg(dev->udev, pipe, query,
+                          USB_TYPE_CLASS | USB_RECIP_INTERFACE | (in ? USB_DIR_IN : USB_DIR_OUT),
+                          selector << 8, camera_vs_ifnum(dev), data, size,
+                          CAMERA_CTRL_TIMEOUT);
+    if (ret != size)
+        return ret < 0 ? ret : -EIO;
+
+    return 0;
+}
+
+/* Negotiate format, frame size and payload size with the camera */
+static int camera_probe_commit(struct camera_device *dev)
+{
+    struct v4l2_pix_format *pix = &dev->format.fmt.pix;
+    struct camera_streaming *stream = &dev->streaming;
+    const struct camera_uvc_frame *frame;
+    u16 size;
+    u8 format_index = 0;
+    u8 *ctrl;
+    int ret;
+
+    frame = camera_nearest_uvc_frame(dev, stream->src_fourcc, stream->src_width,
+                                     stream->src_height, &format_index);
+    if (!frame || frame->width != stream->src_width || frame->height != stream->src_height)
+        return -EINVAL;
+
+    /* A shorter request than the spec version defines is stalled */
+    if (dev->uvc_version >= 0x0150)
+        size = UVC_PROBE_SIZE_1_5;
+    else if (dev->uvc_version >= 0x0110)
+        size = UVC_PROBE_SIZE_1_1;
+    else
+        size = UVC_PROBE_SIZE_1_0;
+
+    /* Control transfers need DMA-able memory */
+    ctrl = kzalloc(UVC_PROBE_SIZE_1_5, GFP_KERNEL);
+    if (!ctrl)
+        return -ENOMEM;
+
+    put_unaligned_le16(1, ctrl + UVC_PROBE_HINT);   /* Keep dwFrameInterval */
+    ctrl[UVC_PROBE_FORMAT_INDEX] = format_index;
+    ctrl[UVC_PROBE_FRAME_INDEX] = frame->index;
+    put_unaligned_le32(frame->interval, ctrl + UVC_PROBE_FRAME_INTERVAL);
+
+    ret = camera_vs_ctrl(dev, UVC_SET_CUR, UVC_VS_PROBE_CONTROL, ctrl, size);
+    if (!ret)
+        ret = camera_vs_ctrl(dev, UVC_GET_CUR, UVC_VS_PROBE_CONTROL, ctrl, size);
+    if (!ret)
+        ret = camera_vs_ctrl(dev, UVC_SET_CUR, UVC_VS_COMMIT_CONTROL, ctrl, size);
+    if (ret) {
+        dev_err(&dev->udev->dev, "Stream negotiation failed: %d\n", ret);
+        goto out;
+    }
+
+    stream->max_frame_size = get_unaligned_le32(ctrl + UVC_PROBE_MAX_FRAME_SIZE);
+    stream->max_payload = get_unaligned_le32(ctrl + UVC_PROBE_MAX_PAYLOAD);
+
+    /* Some cameras leave this at zero for uncompressed formats */
+    if (!stream->max_frame_size)
+        stream->max_frame_size = pix->sizeimage;
+
+out:
+    kfree(ctrl);
+    return ret;
+}
+
+/*
+ * Pick the transfer type from the descriptors. Bulk cameras expose a
+ * bulk IN endpoint on alternate setting 0. Isochronous cameras have a
+ * zero-bandwidth alternate setting 0 plus several others; use the
+ * smallest one whose bandwidth covers dwMaxPayloadTransferSize.
+ */
+static int camera_select_transfer(struct camera_device *dev)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    struct usb_interface *intf = stream->intf;
+    struct usb_host_endpoint *best_ep = NULL;
+    u32 best_psize = 0;
+    int best_alt = 0;
+    int i, j;
+
+    for (i = 0; i < intf->num_altsetting; i++) {
+        struct usb_host_interface *alt = &intf->altsetting[i];
+
+        for (j = 0; j < alt->desc.bNumEndpoints; j++) {
+            struct usb_host_endpoint *ep = &alt->endpoint[j];
+            u32 psize;
+
+            if (!usb_endpoint_dir_in(&ep->desc))
+                continue;
+
+            if (usb_endpoint_xfer_bulk(&ep->desc)) {
+                stream->mode = CAMERA_XFER_BULK;
+                stream->endpoint = ep;
+                stream->altsetting = alt->desc.bAlternateSetting;
+                return 0;
+            }
+
+            if (!usb_endpoint_xfer_isoc(&ep->desc))
+                continue;
+
+            psize = usb_endpoint_maxp(&ep->desc) * usb_endpoint_maxp_mult(&ep->desc);
+            if (!best_ep ||
+                (best_psize < stream->max_payload && psize > best_psize) ||
+                (psize >= stream->max_payload && psize < best_psize)) {
+                best_ep = ep;
+                best_psize = psize;
+                best_alt = alt->desc.bAlternateSetting;
+            }
+        }
+    }
+
+    if (!best_ep)
+        return -ENODEV;
+
+    stream->mode = CAMERA_XFER_ISOC;
+    stream->endpoint = best_ep;
+    stream->altsetting = best_alt;
+    return 0;
+}
+
+/*
+ * URB Management
+ */
+
+static void camera_urb_complete(struct urb *urb);
+
+static void camera_free_urbs(struct camera_device *dev)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    int i;
+
+    for (i = 0; i < stream->num_urbs; i++) {
+        usb_free_urb(stream->urbs[i]);
+        kfree(stream->transfer_buffer[i]);
+        stream->urbs[i] = NULL;
+        stream->transfer_buffer[i] = NULL;
+    }
+
+    stream->num_urbs = 0;
+}
+
+/*
+ * Transfer buffers come from kmalloc() rather than usb_alloc_coherent():
+ * coherent memory is uncached on i.MX6 and copying frames out of it is
+ * several times slower than out of a cached, streaming-mapped buffer.
+ *
+ * Bulk URBs are as large as a payload allows (up to 512 KB) so a frame
+ * completes in a handful of interrupts instead of one per 512-byte packet
+ * group. If memory is fragmented the size is halved until it fits, down
+ * to a page; a payload larger than one URB is reassembled in
+ * camera_decode_bulk().
+ */
+static int camera_alloc_urbs(struct camera_device *dev)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    struct usb_endpoint_descriptor *desc = &stream->endpoint->desc;
+    int num_urbs, size, npackets = 0, psize = 0;
+    struct urb *urb;
+    int i, j;
+
+    if (stream->mode == CAMERA_XFER_BULK) {
+        num_urbs = CAMERA_BULK_URBS;
+        size = stream->max_payload ? min_t(u32, stream->max_payload, CAMERA_BULK_URB_MAX)
+                                   : CAMERA_BULK_URB_MIN;
+    } else {
+        num_urbs = CAMERA_ISOC_URBS;
+        npackets = CAMERA_ISOC_PACKETS;
+        psize = usb_endpoint_maxp(desc) * usb_endpoint_maxp_mult(desc);
+        size = psize * npackets;
+    }
+
+    /* The first size is tried even if it is below a page */
+    do {
+        for (i = 0; i < num_urbs; i++) {
+            stream->transfer_buffer[i] = kmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+            stream->urbs[i] = usb_alloc_urb(npackets, GFP_KERNEL);
+            stream->num_urbs = i + 1;
+            if (!stream->transfer_buffer[i] || !stream->urbs[i])
+                break;
+        }
+
+        if (i == num_urbs)
+            break;
+
+        camera_free_urbs(dev);
+
+        /* Isochronous packet layout cannot shrink */
+        if (stream->mode != CAMERA_XFER_BULK || size <= PAGE_SIZE)
+            return -ENOMEM;
+
+        size = max_t(int, size / 2, PAGE_SIZE);
+    } while (true);
+
+    stream->urb_size = size;
+
+    for (i = 0; i < stream->num_urbs; i++) {
+        urb = stream->urbs[i];
+
+        if (stream->mode == CAMERA_XFER_BULK) {
+            usb_fill_bulk_urb(urb, dev->udev,
+                              usb_rcvbulkpipe(dev->udev, desc->bEndpointAddress),
+                              stream->transfer_buffer[i], size,
+                              camera_urb_complete, dev);
+            continue;
+        }
+
+        urb->dev = dev->udev;
+        urb->context = dev;
+        urb->pipe = usb_rcvisocpipe(dev->udev, desc->bEndpointAddress);
+        urb->transfer_flags = URB_ISO_ASAP;
+        urb->interval = desc->bInterval;
+        urb->transfer_buffer = stream->transfer_buffer[i];
+        urb->transfer_buffer_length = size;
+        urb->complete = camera_urb_complete;
+        urb->number_of_packets = npackets;
+
+        for (j = 0; j < npackets; j++) {
+            urb->iso_frame_desc[j].offset = j * psize;
+            urb->iso_frame_desc[j].length = psize;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Payload Decoding
+ */
+
+/* Take the next queued buffer, or NULL if user space is behind */
+static struct camera_buffer *camera_next_buffer(struct camera_device *dev)
+{
+    struct camera_buffer *buf = NULL;
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    if (!list_empty(&dev->buf_list)) {
+        buf = list_first_entry(&dev->buf_list, struct camera_buffer, list);
+        list_del(&buf->list);
+    }
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+
+    return buf;
+}
+
+/* Attach a metadata buffer to a new frame, if the metadata node streams */
+static void camera_meta_begin(struct camera_device *dev)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    if (!dev->cur_meta && dev->meta_streaming && !list_empty(&dev->meta_buf_list)) {
+        dev->cur_meta = list_first_entry(&dev->meta_buf_list, struct camera_buffer, list);
+        list_del(&dev->cur_meta->list);
+    }
+    dev->meta_pos = 0;
+    dev->meta_last_len = 0;
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+}
+
+/*
+ * Append a payload header as a struct uvc_meta_buf block. Like uvcvideo,
+ * only the first header of a frame and headers whose PTS/SCR changed are
+ * recorded; the rest repeat the same information. The host timestamp and
+ * SOF are those of the URB's completion, not of the deferred decode.
+ */
+static void camera_meta_header(struct camera_device *dev, const u8 *data, int hlen)
+{
+    struct uvc_meta_buf *meta;
+    unsigned long flags;
+    size_t size;
+    int len = min(hlen, CAMERA_META_HEADER_MAX);
+
+    /* Compare everything but bmHeaderInfo, whose EOF bit always changes */
+    if (dev->meta_last_len && (hlen <= 2 || (dev->meta_last_len == len &&
+        !memcmp(dev->meta_last + 2, data + 2, len - 2))))
+        return;
+
+    size = offsetof(struct uvc_meta_buf, length) + hlen;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    if (dev->cur_meta &&
+        dev->meta_pos + size <= vb2_plane_size(&dev->cur_meta->vb.vb2_buf, 0)) {
+        meta = vb2_plane_vaddr(&dev->cur_meta->vb.vb2_buf, 0) + dev->meta_pos;
+        meta->ns = dev->streaming.urb_ns;
+        meta->sof = dev->streaming.urb_sof;
+        memcpy(&meta->length, data, hlen);
+        dev->meta_pos += size;
+    }
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+
+    memcpy(dev->meta_last, data, len);
+    dev->meta_last_len = len;
+}
+
+/* Complete the metadata buffer together with its image buffer */
+static void camera_meta_done(struct camera_device *dev, u32 sequence, u64 timestamp)
+{
+    struct camera_buffer *meta;
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    meta = dev->cur_meta;
+    dev->cur_meta = NULL;
+    if (meta) {
+        vb2_set_plane_payload(&meta->vb.vb2_buf, 0, dev->meta_pos);
+        meta->vb.sequence = sequence;
+        meta->vb.vb2_buf.timestamp = timestamp;
+        vb2_buffer_done(&meta->vb.vb2_buf, VB2_BUF_STATE_DONE);
+    }
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+}
+
+/*
+ * Hand the current frame to user space. Damaged frames, and uncompressed
+ * frames with missing payloads, are recycled into the next frame instead.
+ */
+static void camera_frame_done(struct camera_device *dev)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    struct v4l2_pix_format *pix = &dev->format.fmt.pix;
+    struct camera_buffer *buf = stream->cur_buf;
+    u32 sequence = stream->sequence++;
+
+    if (!buf)
+        return;
+
+    if (stream->frame_error ||
+        (stream->src_fourcc != V4L2_PIX_FMT_MJPEG &&
+         stream->frame_pos != stream->src_bytesperline * stream->src_height)) {
+        atomic_inc(&dev->frames_dropped);
+        stream->frame_pos = 0;
+        stream->frame_error = false;
+        dev->meta_pos = 0;
+        dev->meta_last_len = 0;
+        return;
+    }
+
+    stream->cur_buf = NULL;
+
+    vb2_set_plane_payload(&buf->vb.vb2_buf, 0,
+                          stream->convert ? pix->sizeimage : stream->frame_pos);
+    buf->vb.sequence = sequence;
+    buf->vb.field = V4L2_FIELD_NONE;
+    buf->vb.vb2_buf.timestamp = ktime_get_ns();
+    dev->last_frame_time = buf->vb.vb2_buf.timestamp;
+
+    camera_meta_done(dev, sequence, buf->vb.vb2_buf.timestamp);
+    vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
+    atomic_inc(&dev->frames_received);
+}
+
+/*
+ * Signal start of frame, so user space can prepare for the buffer while
+ * the rest of the frame is still on the bus. The sequence number is the
+ * one the frame's buffer will carry.
+ */
+static void camera_frame_sync(struct camera_device *dev)
+{
+    struct v4l2_event ev = {
+        .type = V4L2_EVENT_FRAME_SYNC,
+        .u.frame_sync.frame_sequence = dev->streaming.sequence,
+    };
+
+    v4l2_event_queue(dev->vdev, &ev);
+}
+
+/*
+ * Parse a payload header and track frame boundaries. A FID toggle starts
+ * a new frame even if the previous EOF was lost. Returns the header length,
+ * or a negative value if the payload must be ignored.
+ */
+static int camera_payload_header(struct camera_device *dev, const u8 *data, int len)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    int fid;
+
+    if (len < 2 || data[0] < 2 || data[0] > len)
+        return -EINVAL;
+
+    fid = data[1] & UVC_STREAM_FID;
+
+    if (fid != stream->last_fid) {
+        if (stream->cur_buf && stream->frame_pos)
+            camera_frame_done(dev);
+
+        stream->last_fid = fid;
+        stream->in_frame = true;
+        camera_frame_sync(dev);
+
+        stream->slice_lines = READ_ONCE(dev->slice_lines);
+        stream->slice_next = stream->slice_lines;
+
+        if (!stream->cur_buf) {
+            stream->cur_buf = camera_next_buffer(dev);
+            stream->frame_pos = 0;
+            stream->frame_error = false;
+            if (stream->cur_buf)
+                camera_meta_begin(dev);
+        }
+
+        /* No buffer queued: drop the whole frame, not just its start */
+        stream->skip_frame = !stream->cur_buf;
+        if (stream->skip_frame) {
+            atomic_inc(&dev->frames_dropped);
+            stream->sequence++;
+        }
+    } else if (!stream->in_frame) {
+        /* Trailing payloads of a frame that already ended */
+        return -EAGAIN;
+    }
+
+    if (data[1] & UVC_STREAM_ERR)
+        stream->frame_error = true;
+
+    if (!stream->skip_frame)
+        camera_meta_header(dev, data, data[0]);
+
+    return data[0];
+}
+
+/* Y is every even byte of YUYV */
+static void camera_copy_luma(u8 *dst, const u8 *src, u32 offset, int len)
+{
+    int i;
+
+    for (i = offset & 1; i < len; i += 2)
+        dst[(offset + i) >> 1] = src[i];
+}
+
+/*
+ * Shrink one YUYV line by factor (2 or 4, shift = log2(factor)). Luma is
+ * averaged per output pixel and chroma per output macropixel; lines
+ * in between are dropped by the caller.
+ */
+static void camera_decimate_line(u8 *dst, const u8 *src, u32 out_width,
+                                 u32 factor, u32 shift, bool grey)
+{
+    u32 x, k, y0, y1, u, v;
+
+    if (grey) {
+        for (x = 0; x < out_width; x++, src += factor * 2) {
+            for (y0 = 0, k = 0; k < factor; k++)
+                y0 += src[2 * k];
+            dst[x] = y0 >> shift;
+        }
+        return;
+    }
+
+    /* Two output pixels come from factor source macropixels */
+    for (x = 0; x < out_width; x += 2, src += factor * 4, dst += 4) {
+        y0 = y1 = u = v = 0;
+        for (k = 0; k < factor; k++) {
+            y0 += src[2 * k];
+            y1 += src[2 * (factor + k)];
+            u += src[4 * k + 1];
+            v += src[4 * k + 3];
+        }
+        dst[0] = y0 >> shift;
+        dst[1] = u >> shift;
+        dst[2] = y1 >> shift;
+        dst[3] = v >> shift;
+    }
+}
+
+/*
+ * Convert payload data line by line into the capture buffer. Payloads are
+ * not line aligned, so each chunk is split at source line boundaries;
+ * decimation needs whole lines and collects split ones in line_buf.
+ */
+static void camera_convert_data(struct camera_device *dev, struct camera_buffer *buf,
+                                const u8 *data, int len)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    struct v4l2_pix_format *pix = &dev->format.fmt.pix;
+    u8 *vaddr = vb2_plane_vaddr(&buf->vb.vb2_buf, 0);
+    bool grey = pix->pixelformat == V4L2_PIX_FMT_GREY;
+    u32 factor = stream->decimation;
+    u32 shift = ilog2(factor);
+    u32 line, offset;
+    int n;
+
+    while (len > 0) {
+        line = stream->frame_pos / stream->src_bytesperline;
+        offset = stream->frame_pos % stream->src_bytesperline;
+        if (line >= stream->src_height) {
+            stream->frame_error = true;
+            return;
+        }
+
+        n = min_t(u32, len, stream->src_bytesperline - offset);
+
+        if (factor == 1) {
+            camera_copy_luma(vaddr + line * pix->bytesperline, data, offset, n);
+        } else if (!(line & (factor - 1))) {
+            u8 *dst = vaddr + (line >> shift) * pix->bytesperline;
+
+            if (n == stream->src_bytesperline) {
+                camera_decimate_line(dst, data, pix->width, factor, shift, grey);
+            } else {
+                memcpy(stream->line_buf + offset, data, n);
+                if (offset + n == stream->src_bytesperline)
+                    camera_decimate_line(dst, stream->line_buf, pix->width,
+                                         factor, shift, grey);
+            }
+        }
+
+        data += n;
+        len -= n;
+        stream->frame_pos += n;
+    }
+}
+
+/*
+ * Queue a slice event once slice_lines more capture lines are complete.
+ * The last slice is left to the buffer itself.
+ */
+static void camera_slice_update(struct camera_device *dev, struct camera_buffer *buf)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    u32 height = dev->format.fmt.pix.height;
+    struct camera_slice_event *slice;
+    struct v4l2_event ev = {
+        .type = CAMERA_EVENT_SLICE,
+    };
+    u32 lines;
+
+    /* Compressed frames have no lines */
+    if (!stream->slice_lines || !stream->src_bytesperline)
+        return;
+
+    /* A decimated line is written once its first source line is in */
+    lines = DIV_ROUND_UP(stream->frame_pos / stream->src_bytesperline,
+                         stream->decimation);
+    if (lines < stream->slice_next || lines >= height)
+        return;
+
+    stream->slice_next = rounddown(lines, stream->slice_lines) + stream->slice_lines;
+
+    slice = (struct camera_slice_event *)ev.u.data;
+    slice->sequence = stream->sequence;
+    slice->index = buf->vb.vb2_buf.index;
+    slice->lines = lines;
+    v4l2_event_queue(dev->vdev, &ev);
+}
+
+static void camera_payload_data(struct camera_device *dev, const u8 *data, int len)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    struct camera_buffer *buf = stream->cur_buf;
+    size_t space;
+
+    if (!buf || stream->skip_frame || len <= 0)
+        return;
+
+    if (stream->convert) {
+        camera_convert_data(dev, buf, data, len);
+    } else {
+        space = vb2_plane_size(&buf->vb.vb2_buf, 0) - stream->frame_pos;
+        if (len > space) {
+            len = space;
+            stream->frame_error = true;
+        }
+
+        memcpy(vb2_plane_vaddr(&buf->vb.vb2_buf, 0) + stream->frame_pos, data, len);
+        stream->frame_pos += len;
+    }
+
+    camera_slice_update(dev, buf);
+}
+
+static void camera_payload_end(struct camera_device *dev, u8 flags)
+{
+    struct camera_streaming *stream = &dev->streaming;
+
+    if (!(flags & UVC_STREAM_EOF) || !stream->in_frame)
+        return;
+
+    if (!stream->skip_frame)
+        camera_frame_done(dev);
+
+    stream->in_frame = false;
+}
+
+/* Every isochronous packet carries one complete payload */
+static void camera_decode_isoc(struct camera_device *dev, struct urb *urb)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    int i, hlen;
+
+    for (i = 0; i < urb->number_of_packets; i++) {
+        struct usb_iso_packet_descriptor *pkt = &urb->iso_frame_desc[i];
+        const u8 *mem = urb->transfer_buffer + pkt->offset;
+
+        if (pkt->status < 0) {
+            stream->frame_error = true;
+            continue;
+        }
+
+        hlen = camera_payload_header(dev, mem, pkt->actual_length);
+        if (hlen < 0)
+            continue;
+
+        camera_payload_data(dev, mem + hlen, pkt->actual_length - hlen);
+        camera_payload_end(dev, mem[1]);
+    }
+}
+
+/*
+ * A bulk payload starts with a header and ends with a short transfer or
+ * after dwMaxPayloadTransferSize bytes, possibly spanning several URBs.
+ */
+static void camera_decode_bulk(struct camera_device *dev, struct urb *urb)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    const u8 *mem = urb->transfer_buffer;
+    int len = urb->actual_length;
+    int hlen;
+
+    if (!stream->bulk_in_payload) {
+        stream->bulk_in_payload = true;
+        stream->bulk_payload_size = 0;
+
+        hlen = camera_payload_header(dev, mem, len);
+        stream->bulk_skip_payload = hlen < 0;
+        if (hlen >= 0) {
+            stream->bulk_header_flags = mem[1];
+            mem += hlen;
+            len -= hlen;
+        }
+    }
+
+    if (!stream->bulk_skip_payload)
+        camera_payload_data(dev, mem, len);
+
+    stream->bulk_payload_size += urb->actual_length;
+
+    if (urb->actual_length < urb->transfer_buffer_length ||
+        (stream->max_payload && stream->bulk_payload_size >= stream->max_payload)) {
+        if (!stream->bulk_skip_payload)
+            camera_payload_end(dev, stream->bulk_header_flags);
+        stream->bulk_in_payload = false;
+    }
+}
+
+/*
+ * Decode completed URBs in process context. Copying a frame out of the
+ * transfer buffers takes milliseconds on i.MX6; doing it in the completion
+ * handler would hold off every other interrupt on the board.
+ */
+static void camera_decode_work(struct work_struct *work)
+{
+    struct camera_streaming *stream = container_of(work, struct camera_streaming,
+                                                   decode_work);
+    struct camera_device *dev = container_of(stream, struct camera_device, streaming);
+    struct camera_pending_urb pending;
+    struct urb *urb;
+    int ret;
+
+    while (kfifo_get(&stream->pending, &pending)) {
+        urb = pending.urb;
+        stream->urb_ns = pending.ns;
+        stream->urb_sof = pending.sof;
+
+        /* Payloads were lost while we were behind */
+        if (atomic_xchg(&stream->overrun, 0)) {
+            stream->frame_error = true;
+            stream->bulk_in_payload = false;
+        }
+
+        if (urb->status) {
+            dev_warn_ratelimited(&dev->udev->dev, "URB error %d\n", urb->status);
+            stream->frame_error = true;
+            stream->bulk_in_payload = false;
+        } else if (stream->mode == CAMERA_XFER_BULK) {
+            camera_decode_bulk(dev, urb);
+        } else {
+            camera_decode_isoc(dev, urb);
+        }
+
+        /* -EPERM: poisoned by camera_stop_usb_streaming() */
+        ret = usb_submit_urb(urb, GFP_KERNEL);
+        if (ret && ret != -EPERM)
+            dev_err_ratelimited(&dev->udev->dev, "Failed to resubmit URB: %d\n", ret);
+    }
+}
+
+static void camera_urb_complete(struct urb *urb)
+{
+    struct camera_device *dev = urb->context;
+    struct camera_streaming *stream = &dev->streaming;
+    struct camera_pending_urb pending = { .urb = urb };
+    unsigned long flags;
+    bool queued = false;
+    int ret;
+
+    switch (urb->status) {
+    case -ENOENT:       /* usb_kill_urb() */
+    case -ECONNRESET:   /* usb_unlink_urb() */
+    case -ESHUTDOWN:    /* Device gone */
+        return;
+    }
+
+    /* The decode work runs later, the metadata wants the arrival time */
+    pending.ns = ktime_get_ns();
+    pending.sof = usb_get_current_frame_number(dev->udev);
+
+    spin_lock_irqsave(&stream->pending_lock, flags);
+    if (kfifo_len(&stream->pending) < stream->num_urbs - 1)
+        queued = kfifo_put(&stream->pending, pending);
+    spin_unlock_irqrestore(&stream->pending_lock, flags);
+
+    if (queued) {
+        queue_work(dev->workqueue, &stream->decode_work);
+        return;
+    }
+
+    /* Decoding is behind: keep the endpoint busy and drop this data */
+    atomic_set(&stream->overrun, 1);
+    stream->overruns++;
+    ret = usb_submit_urb(urb, GFP_ATOMIC);
+    if (ret && ret != -EPERM)
+        dev_err_ratelimited(&dev->udev->dev, "Failed to resubmit URB: %d\n", ret);
+}
+
+/* Initialize USB streaming */
+static int camera_init_streaming(struct camera_device *dev)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    struct v4l2_pix_format *pix = &dev->format.fmt.pix;
+    const struct camera_uvc_frame *frame;
+    u32 width = pix->width, height = pix->height;
+    int ret, i;
+
+    frame = camera_nearest_size(dev, pix->pixelformat, &width, &height,
+                                &stream->decimation);
+    if (!frame || width != pix->width || height != pix->height)
+        return -EINVAL;
+
+    stream->src_fourcc = camera_uvc_fourcc(pix->pixelformat);
+    stream->src_width = frame->width;
+    stream->src_height = frame->height;
+    stream->src_bytesperline = stream->src_fourcc == V4L2_PIX_FMT_YUYV ? frame->width * 2 : 0;
+    stream->convert = stream->src_fourcc != pix->pixelformat || stream->decimation > 1;
+
+    if (stream->decimation > 1) {
+        stream->line_buf = kmalloc(stream->src_bytesperline, GFP_KERNEL);
+        if (!stream->line_buf)
+            return -ENOMEM;
+    }
+
+    ret = camera_probe_commit(dev);
+    if (ret)
+        goto err_line_buf;
+
+    ret = camera_select_transfer(dev);
+    if (ret)
+        goto err_line_buf;
+
+    ret = camera_alloc_urbs(dev);
+    if (ret)
+        goto err_line_buf;
+
+    stream->cur_buf = NULL;
+    stream->frame_pos = 0;
+    stream->frame_error = false;
+    stream->last_fid = -1;
+    stream->in_frame = false;
+    stream->skip_frame = false;
+    stream->sequence = 0;
+    stream->bulk_in_payload = false;
+    stream->overruns = 0;
+    atomic_set(&stream->overrun, 0);
+    kfifo_reset(&stream->pending);
+
+    ret = usb_set_interface(dev->udev, camera_vs_ifnum(dev), stream->altsetting);
+    if (ret)
+        goto err_free;
+
+    for (i = 0; i < stream->num_urbs; i++) {
+        ret = usb_submit_urb(stream->urbs[i], GFP_KERNEL);
+        if (ret) {
+            dev_err(&dev->udev->dev, "Failed to submit URB %d: %d\n", i, ret);
+            camera_stop_usb_streaming(dev);
+            return ret;
+        }
+    }
+
+    dev_info(&dev->udev->dev, "Streaming %ux%u (/%u) over %s, %d URBs of %d bytes\n",
+             stream->src_width, stream->src_height, stream->decimation,
+             stream->mode == CAMERA_XFER_BULK ? "bulk" : "isochronous",
+             stream->num_urbs, stream->urb_size);
+    return 0;
+
+err_free:
+    camera_free_urbs(dev);
+err_line_buf:
+    kfree(stream->line_buf);
+    stream->line_buf = NULL;
+    return ret;
+}
+
+/* Stop USB streaming */
+static void camera_stop_usb_streaming(struct camera_device *dev)
+{
+    struct camera_streaming *stream = &dev->streaming;
+    unsigned long flags;
+    int i;
+
+    /*
+     * Poison rather than kill: the decode work may be about to resubmit a
+     * URB it just took off the pending list.
+     */
+    for (i = 0; i < stream->num_urbs; i++)
+        usb_poison_urb(stream->urbs[i]);
+    cancel_work_sync(&stream->decode_work);
+    kfifo_reset(&stream->pending);
+
+    /*
+     * Release the isochronous bandwidth. A bulk camera has no other
+     * alternate setting; like uvcvideo, clear the endpoint halt to stop it.
+     */
+    if (dev->state != CAMERA_STATE_DISCONNECTED) {
+        if (stream->mode == CAMERA_XFER_ISOC)
+            usb_set_interface(dev->udev, camera_vs_ifnum(dev), 0);
+        else
+            usb_clear_halt(dev->udev, usb_rcvbulkpipe(dev->udev,
+                           stream->endpoint->desc.bEndpointAddress));
+    }
+
+    camera_free_urbs(dev);
+    kfree(stream->line_buf);
+    stream->line_buf = NULL;
+
+    /* The frame in progress will never complete */
+    if (stream->cur_buf) {
+        vb2_buffer_done(&stream->cur_buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+        stream->cur_buf = NULL;
+    }
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    camera_meta_release_locked(dev);
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+}
+
+/* Return all buffers to videobuf2 */
+static void camera_return_all_buffers(struct camera_device *dev,
+                                     enum vb2_buffer_state state)
+{
+    struct camera_buffer *buf, *tmp;
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->buf_lock, flags);
+    list_for_each_entry_safe(buf, tmp, &dev->buf_list, list) {
+        list_del(&buf->list);
+        vb2_buffer_done(&buf->vb.vb2_buf, state);
+    }
+    spin_unlock_irqrestore(&dev->buf_lock, flags);
+}
+
+/*
+ * USB Operations
+ */
+
+/*
+ * The last file handle is closed after a disconnect, or the disconnect
+ * itself had no open handles: nothing can reach the device any more.
+ */
+static void camera_release(struct v4l2_device *v4l2_dev)
+{
+    struct camera_device *dev = container_of(v4l2_dev, struct camera_device, v4l2_dev);
+
+    v4l2_ctrl_handler_free(&dev->ctrl_handler);
+    destroy_workqueue(dev->workqueue);
+    usb_put_dev(dev->udev);
+    kfree(dev);
+}
+
+/* USB probe function */
+static int camera_probe(struct usb_interface *intf,
+                       const struct usb_device_id *id)
+{
+    struct usb_device *udev = interface_to_usbdev(intf);
+    struct camera_device *dev;
+    int ret;
+
+    /* The VideoStreaming interface is claimed from the VideoControl probe */
+    if (intf->cur_altsetting->desc.bInterfaceSubClass != UVC_SC_VIDEOCONTROL)
+        return -ENODEV;
+
+    dev_info(&intf->dev, "Probing camera device\n");
+
+    /* Allocate device structure */
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
+        return -ENOMEM;
+
+    /* Initialize device */
+    dev->udev = usb_get_dev(udev);
+    dev->intf = intf;
+    dev->state = CAMERA_STATE_CONNECTED;
+
+    mutex_init(&dev->lock);
+    spin_lock_init(&dev->buf_lock);
+    INIT_LIST_HEAD(&dev->buf_list);
+
+    INIT_KFIFO(dev->streaming.pending);
+    spin_lock_init(&dev->streaming.pending_lock);
+    INIT_WORK(&dev->streaming.decode_work, camera_decode_work);
+
+    dev->workqueue = alloc_workqueue("%s", WQ_HIGHPRI | WQ_UNBOUND, 0,
+                                     dev_name(&intf->dev));
+    if (!dev->workqueue) {
+        ret = -ENOMEM;
+        goto error_free;
+    }
+
+    dev->streaming.intf = camera_find_streaming_intf(dev);
+    if (!dev->streaming.intf) {
+        dev_err(&intf->dev, "No VideoStreaming interface\n");
+        ret = -ENODEV;
+        goto error_wq;
+    }
+
+    ret = usb_driver_claim_interface(&camera_driver, dev->streaming.intf, dev);
+    if (ret) {
+        dev_err(&intf->dev, "Failed to claim VideoStreaming interface: %d\n", ret);
+        goto error_wq;
+    }
+
+    camera_parse_vc_header(dev);
+    camera_parse_vs_formats(dev);
+
+    /* Register V4L2 device */
+    ret = v4l2_device_register(&intf->dev, &dev->v4l2_dev);
+    if (ret) {
+        dev_err(&intf->dev, "Failed to register V4L2 device: %d\n", ret);
+        goto error_release;
+    }
+
+    /* Initialize video buffer queue */
+    ret = camera_init_vb2_queue(dev);
+    if (ret) {
+        dev_err(&intf->dev, "Failed to initialize VB2 queue: %d\n", ret);
+        goto error_v4l2;
+    }
+
+    ret = camera_init_controls(dev);
+    if (ret) {
+        dev_err(&intf->dev, "Failed to initialize controls: %d\n", ret);
+        goto error_v4l2;
+    }
+
+    /* Create video device */
+    ret = camera_create_video_device(dev);
+    if (ret) {
+        dev_err(&intf->dev, "Failed to create video device: %d\n", ret);
+        goto error_ctrls;
+    }
+
+    ret = camera_create_meta_device(dev);
+    if (ret) {
+        dev_err(&intf->dev, "Failed to create metadata device: %d\n", ret);
+        goto error_vdev;
+    }
+
+    /* From here on dev is freed by camera_release() */
+    dev->v4l2_dev.release = camera_release;
+
+    /* Set interface data */
+    usb_set_intfdata(intf, dev);
+
+    dev_info(&intf->dev, "Camera device registered as %s\n",
+             video_device_node_name(dev->vdev));
+
+    return 0;
+
+error_vdev:
+    video_unregister_device(dev->vdev);
+error_ctrls:
+    v4l2_ctrl_handler_free(&dev->ctrl_handler);
+error_v4l2:
+    v4l2_device_unregister(&dev->v4l2_dev);
+error_release:
+    usb_driver_release_interface(&camera_driver, dev->streaming.intf);
+error_wq:
+    destroy_workqueue(dev->workqueue);
+error_free:
+    usb_put_dev(dev->udev);
+    kfree(dev);
+    return ret;
+}
+
+/* USB disconnect function */
+static void camera_disconnect(struct usb_interface *intf)
+{
+    struct camera_device *dev = usb_get_intfdata(intf);
+    struct camera_streaming *stream;
+    int i;
+    
+    dev_info(&intf->dev, "Disconnecting camera device\n");
+    
+    /* The VideoStreaming interface is released with VideoControl below */
+    if (!dev || intf != dev->intf)
+        return;
+    
+    stream = &dev->streaming;
+    
+    /*
+     * An open file handle may still be streaming; its stop_streaming runs
+     * when it is closed. Stop the URBs and the decode work now, under the
+     * queue lock so STREAMON/STREAMOFF cannot race with it, and keep dev
+     * itself until camera_release().
+     */
+    mutex_lock(&dev->lock);
+    dev->state = CAMERA_STATE_DISCONNECTED;
+    for (i = 0; i < stream->num_urbs; i++)
+        usb_poison_urb(stream->urbs[i]);
+    cancel_work_sync(&stream->decode_work);
+    kfifo_reset(&stream->pending);
+    mutex_unlock(&dev->lock);
+    
+    /*
+     * Unregister video devices. The pointers stay valid for ioctls still
+     * in flight, the structures are freed with their last reference.
+     */
+    video_unregister_device(dev->meta_vdev);
+    video_unregister_device(dev->vdev);
+    
     /* Unregister V4L2 device */
     v4l2_device_unregister(&dev->v4l2_dev);
     
+    usb_driver_release_interface(&camera_driver, stream->intf);
+    
     /* Clear interface data */
     usb_set_intfdata(intf, NULL);
     
-    /* Free device structure */
-    kfree(dev);
+    /* Freed now, or when the last file handle is closed */
+    v4l2_device_put(&dev->v4l2_dev);
 }
 
 /*
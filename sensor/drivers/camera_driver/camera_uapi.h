@@ -0,0 +1,44 @@
+/*
+ * Camera Driver User-Space Interface for IMX6ULL Pro
+ *
+ * Definitions shared with applications. Kept free of kernel-only
+ * headers and types so it can be installed with the driver.
+ */
+
+#ifndef _UAPI_CAMERA_DRIVER_H_
+#define _UAPI_CAMERA_DRIVER_H_
+
+#include <linux/types.h>
+
+/*
+ * Luma-only capture: the camera streams YUYV and the driver keeps the Y
+ * bytes. Same fourcc as V4L2_PIX_FMT_GREY.
+ */
+#define CAMERA_FORMAT_GREY  ((__u32)'G' | ((__u32)'R' << 8) | \
+                             ((__u32)'E' << 16) | ((__u32)'Y' << 24))
+
+/*
+ * The base for the driver's controls, reserved the way the
+ * V4L2_CID_USER_*_BASE blocks of <linux/v4l2-controls.h> are: 16 controls,
+ * in a block past those the kernel hands out to its own drivers.
+ */
+#define CAMERA_CID_USER_BASE    (0x00980900 + 0x1f00)  /* V4L2_CID_USER_BASE + 0x1f00 */
+
+/*
+ * Slice mode: with CAMERA_CID_SLICE_LINES set, a CAMERA_EVENT_SLICE event
+ * is queued each time that many more lines of the buffer being filled are
+ * complete, so user space can start on the top of the frame (through its
+ * mmap of the buffer) while the rest is still arriving. Uncompressed
+ * formats only. The final slice is signalled by the buffer completing.
+ */
+#define CAMERA_CID_SLICE_LINES  (CAMERA_CID_USER_BASE + 0)
+#define CAMERA_EVENT_SLICE      (0x08000000 + 1)       /* V4L2_EVENT_PRIVATE_START + 1 */
+
+/* Payload of CAMERA_EVENT_SLICE, in struct v4l2_event.u.data */
+struct camera_slice_event {
+    __u32 sequence;         /* Sequence number the buffer will carry */
+    __u32 index;            /* Buffer index */
+    __u32 lines;            /* Lines complete from the top of the frame */
+};
+
+#endif /* _UAPI_CAMERA_DRIVER_H_ */
@@ -14,10 +14,14 @@
 #include "face_detector.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
+#include "memory_backing.h"
 #include <memory>
 #include <vector>
 #include <string>
 #include <map>
+#include <array>
+#include <cstdint>
+#include <mutex>
 
 // Detection algorithm types
 enum class DetectionAlgorithm {
@@ -81,6 +85,27 @@ struct AdvancedDetectorConfig {
     double scale = 1.0;
     bool swap_rb = false;
     
+    // Input blob sampling; int8_input builds int8 blobs for quantized
+    // models, stored as round(value / input_quant_scale) + zero point
+    BlobSampling input_sampling = BlobSampling::BILINEAR;
+    bool int8_input = false;
+    float input_quant_scale = 1.0f;
+    int input_quant_zero_point = 0;
+    
+    // Tiling: frames over tile_min_scale times the model input are split
+    // into overlapping tiles of the input size, run in parallel, so small
+    // faces are detected at full resolution. A larger tile is used when
+    // the frame would need more than max_tiles. tile_full_frame adds a
+    // pass over the whole frame for faces larger than the overlap
+    bool enable_tiling = false;
+    float tile_overlap = 0.25f;         // Fraction of the tile size
+    float tile_min_scale = 1.5f;
+    int max_tiles = 8;
+    int tile_threads = 0;               // 0: scheduler concurrency; each extra
+                                        // thread loads its own copy of the model
+                                        // when the model is loaded
+    bool tile_full_frame = true;
+    
     // YOLO specific
     float yolo_confidence = 0.5f;
     float yolo_nms = 0.4f;
@@ -109,6 +134,13 @@ struct AdvancedDetectorConfig {
     bool enable_optimization = true;
     bool enable_fp16 = false;
     
+    // Fill blur_score for each face (Laplacian variance of the face);
+    // costs a pass over every face, so off on the detection hot path
+    bool compute_blur_score = false;
+    
+    // Backing for model weights (huge pages, mlock)
+    MemoryBackingConfig model_memory;
+    
     // Model paths
     std::string model_dir = "models/";
     std::map<DetectionAlgorithm, std::string> model_paths;
@@ -121,13 +153,21 @@ private:
     void setupDefaultModelPaths();
 };
 
+// Estimated gender
+enum class Gender : uint8_t {
+    UNKNOWN = 0,
+    MALE,
+    FEMALE
+};
+
 // Advanced face detection result with additional information
 struct AdvancedFaceDetection : public FaceDetection {
     DetectionAlgorithm algorithm_used;
     float detection_time_ms;
     
     // Additional face attributes (if supported by algorithm)
-    std::vector<cv::Point2f> landmarks;  // Facial landmarks
+    std::array<cv::Point2f, 5> landmarks{};  // Eyes, nose, mouth corners
+    uint8_t num_landmarks = 0;               // Valid entries in landmarks
     float pose_yaw = 0.0f;               // Head pose angles
     float pose_pitch = 0.0f;
     float pose_roll = 0.0f;
@@ -139,13 +179,15 @@ struct AdvancedFaceDetection : public FaceDetection {
     
     // Age and gender (if supported)
     int estimated_age = -1;
-    std::string estimated_gender = "unknown";
+    Gender estimated_gender = Gender::UNKNOWN;
     float gender_confidence = 0.0f;
     
     AdvancedFaceDetection() = default;
     AdvancedFaceDetection(const FaceDetection& base) : FaceDetection(base) {}
 };
 
+using AdvancedDetectionBuffer = DetectionBuffer<AdvancedFaceDetection>;
+
 // Main advanced face detector class
 class AdvancedFaceDetector {
 public:
@@ -167,6 +209,7 @@ public:
     // Detection methods
     std::vector<AdvancedFaceDetection> detectFaces(const cv::Mat& image);
     bool detectFaces(const cv::Mat& image, std::vector<AdvancedFaceDetection>& faces);
+    bool detectFaces(const cv::Mat& image, AdvancedDetectionBuffer& faces);
     
     // Batch processing
     std::vector<std::vector<AdvancedFaceDetection>> detectFacesBatch(
@@ -187,10 +230,11 @@ public:
     // Performance analysis
     void enableProfiling(bool enable);
     std::map<std::string, double> getProfilingResults() const;
+    std::map<std::string, uint64_t> getProfilingCounters() const;   // Event counts
     void resetProfilingResults();
     
     // Utility methods
-    cv::Mat preprocessImage(const cv::Mat& image, DetectionAlgorithm algorithm) const;
+    cv::Mat preprocessImage(const cv::Mat& image, DetectionAlgorithm algorithm) const;   // Input blob
     void drawAdvancedDetections(cv::Mat& image, 
                                const std::vector<AdvancedFaceDetection>& faces) const;
     
@@ -207,6 +251,8 @@ public:
     static std::vector<AlgorithmProfile> getBuiltinProfiles();
     static bool isAlgorithmSupported(DetectionAlgorithm algorithm);
     static std::string algorithmToString(DetectionAlgorithm algorithm);
+    static DetectionMethod algorithmToMethod(DetectionAlgorithm algorithm);
+    static const char* genderToString(Gender gender);
     static DetectionAlgorithm stringToAlgorithm(const std::string& name);
     
 private:
@@ -221,21 +267,64 @@ private:
     // Performance monitoring
     bool profiling_enabled_;
     std::map<std::string, double> profiling_results_;
+    std::map<std::string, uint64_t> profiling_counters_;
     
     // State
     bool initialized_;
     mutable std::string last_error_;
+    mutable std::mutex error_mutex_;    // Tiles report errors concurrently
+    
+    // A network and its input blob, rebuilt in place each frame. Nets are
+    // not reentrant, so each tile thread has its own
+    struct InferenceContext {
+        cv::dnn::Net net;
+        BlobBuilder blob_builder;
+        cv::Mat input_blob;
+    };
+    
+    InferenceContext main_context_;
+    
+    // Haar fallback, loaded once, and its reused result storage
+    cv::CascadeClassifier haar_cascade_;
+    std::vector<cv::Rect> face_rects_;
     
-    // Private methods
+    // Built with the model, never on the detection path: loading swaps
+    // the process-wide Mat allocator
+    std::vector<std::unique_ptr<InferenceContext>> tile_contexts_;
+    DetectionAlgorithm tile_algorithm_;
+    
+    // Files each model was loaded from, to load copies for tile threads
+    std::map<DetectionAlgorithm, std::pair<std::string, std::string>> model_files_;
+    
+    // Private methods, detectWith*() append to detections
     bool initializeAlgorithm(DetectionAlgorithm algorithm);
-    std::vector<AdvancedFaceDetection> detectWithYOLO(const cv::Mat& image);
-    std::vector<AdvancedFaceDetection> detectWithSSD(const cv::Mat& image);
-    std::vector<AdvancedFaceDetection> detectWithRetinaNet(const cv::Mat& image);
-    std::vector<AdvancedFaceDetection> detectWithMTCNN(const cv::Mat& image);
-    std::vector<AdvancedFaceDetection> detectWithLFFD(const cv::Mat& image);
+    bool readModel(DetectionAlgorithm algorithm, const std::string& model_path,
+                   const std::string& config_path, cv::dnn::Net& net);
+    BlobConfig blobConfigFor(DetectionAlgorithm algorithm, const cv::Size& image_size) const;
+    const cv::Mat& buildInputBlob(InferenceContext& context, const cv::Mat& image,
+                                  DetectionAlgorithm algorithm);
+    cv::Size modelInputSize(DetectionAlgorithm algorithm) const;
+    bool runInference(InferenceContext& context, const cv::Mat& image,
+                      std::vector<AdvancedFaceDetection>& detections);
+    bool shouldTile(const cv::Size& image_size) const;
+    int tileThreads() const;
+    void prepareTileContexts(DetectionAlgorithm algorithm);
+    void detectTiled(const cv::Mat& image, std::vector<AdvancedFaceDetection>& detections);
+    void detectWithHaar(const cv::Mat& image, std::vector<AdvancedFaceDetection>& detections);
+    void detectWithYOLO(InferenceContext& context, const cv::Mat& image,
+                        std::vector<AdvancedFaceDetection>& detections);
+    void detectWithSSD(InferenceContext& context, const cv::Mat& image,
+                       std::vector<AdvancedFaceDetection>& detections);
+    void detectWithRetinaNet(InferenceContext& context, const cv::Mat& image,
+                             std::vector<AdvancedFaceDetection>& detections);
+    void detectWithMTCNN(InferenceContext& context, const cv::Mat& image,
+                         std::vector<AdvancedFaceDetection>& detections);
+    void detectWithLFFD(InferenceContext& context, const cv::Mat& image,
+                        std::vector<AdvancedFaceDetection>& detections);
     
     void setError(const std::string& error) const;
     void updateProfilingResults(const std::string& operation, double time_ms);
+    void addProfilingCount(const std::string& counter, uint64_t count);
     
     // Non-copyable
     AdvancedFaceDetector(const AdvancedFaceDetector&) = delete;
@@ -254,7 +343,9 @@ namespace AdvancedDetectorUtils {
         DetectionAlgorithm algorithm;
         double avg_inference_time_ms;
         double avg_fps;
-        double memory_usage_mb;
+        double memory_usage_mb;     // Resident set after the run
+        double huge_page_mb;        // Backed memory on huge pages after the run
+        double locked_mb;           // Backed memory locked after the run
         int total_detections;
         double accuracy_score;
     };
@@ -262,12 +353,29 @@ namespace AdvancedDetectorUtils {
     std::vector<BenchmarkResult> benchmarkAlgorithms(
         const std::vector<cv::Mat>& test_images,
         const std::vector<DetectionAlgorithm>& algorithms);
+    std::vector<BenchmarkResult> benchmarkAlgorithms(
+        const std::vector<cv::Mat>& test_images,
+        const std::vector<DetectionAlgorithm>& algorithms,
+        const AdvancedDetectorConfig& base_config);
     
     // Algorithm comparison
     void printAlgorithmComparison(const std::vector<AlgorithmProfile>& profiles);
     AlgorithmProfile findBestAlgorithm(const std::vector<AlgorithmProfile>& profiles,
                                       bool prioritize_speed = true);
     
+    // Face quality: 0 for a sharp face, towards 1 as it gets blurrier
+    float calculateBlurScore(const cv::Mat& gray, const cv::Rect& face);
+    
+    // Tiling: tiles of tile_size (grown if more than max_tiles would be
+    // needed) covering frame_size, neighbours overlapping by overlap of
+    // the tile size, and the tiles spread evenly
+    std::vector<cv::Rect> computeTiles(const cv::Size& frame_size, const cv::Size& tile_size,
+                                       float overlap, int max_tiles);
+    
+    // Greedy NMS across tiles: highest confidence first, overlaps above
+    // iou_threshold dropped
+    void suppressOverlaps(std::vector<AdvancedFaceDetection>& detections, float iou_threshold);
+    
     // Model format conversion
     bool convertModel(const std::string& source_path, const std::string& target_path,
                      const std::string& source_format, const std::string& target_format);
@@ -283,6 +391,11 @@ namespace AdvancedDetectorConstants {
     constexpr double HIGH_ACCURACY_THRESHOLD = 0.9;
     constexpr size_t MOBILE_MEMORY_LIMIT_MB = 100;
     
+    // Blur score: Laplacian variance giving a score of 0.5, and the face
+    // width above which it is measured at half resolution
+    constexpr double BLUR_REFERENCE_VARIANCE = 100.0;
+    constexpr int BLUR_FULL_RESOLUTION_WIDTH = 160;
+    
     // Input size recommendations
     extern const std::map<DetectionAlgorithm, cv::Size> RECOMMENDED_INPUT_SIZES;
 }
@@ -0,0 +1,105 @@
+/*
+ * Blob Builder Header
+ *
+ * This header defines a single-pass builder for DNN input blobs. It
+ * samples the source image (bilinear or area), subtracts the mean, scales
+ * and writes planar NCHW float or int8 straight into the input tensor,
+ * instead of the separate resize, convert, normalize and transpose passes
+ * of cv::dnn::blobFromImage.
+ *
+ * Each source row is resampled horizontally once and blended into the
+ * blob rows that use it, so the frame is read once and no resized copy
+ * is made. The sampling tables depend only on the source and blob sizes;
+ * they are kept between frames, so a builder reused for a camera stream
+ * does no per-frame setup or allocation.
+ *
+ * As in simd_kernels.h the interface is plain pointers;
+ * FaceDetectorUtils::buildBlob() wraps it for cv::Mat.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#ifndef BLOB_BUILDER_H
+#define BLOB_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Source sampling
+enum class BlobSampling : uint8_t {
+    BILINEAR = 0,   // Same mapping as cv::resize INTER_LINEAR
+    AREA            // Box filter when shrinking (INTER_AREA), bilinear when enlarging
+};
+
+// Blob element type
+enum class BlobFormat : uint8_t {
+    FLOAT32 = 0,
+    INT8            // For quantized models, see quant_scale
+};
+
+// Blob layout and normalization, as the blobFromImage arguments
+struct BlobConfig {
+    int width = 300;
+    int height = 300;
+    float mean[3] = {0.0f, 0.0f, 0.0f};    // In blob channel order
+    float scale = 1.0f;                     // Applied after the mean
+    bool swap_rb = false;                   // Blob channel 0 is red
+    BlobSampling sampling = BlobSampling::BILINEAR;
+
+    // INT8 stores round(value / quant_scale) + quant_zero_point
+    BlobFormat format = BlobFormat::FLOAT32;
+    float quant_scale = 1.0f;
+    int quant_zero_point = 0;
+};
+
+class BlobBuilder {
+public:
+    BlobBuilder() = default;
+    explicit BlobBuilder(const BlobConfig& config);
+
+    // Sampling tables are rebuilt only if the blob size or sampling changed
+    void setConfig(const BlobConfig& config);
+    const BlobConfig& getConfig() const { return config_; }
+
+    // Elements in a blob: 3 * width * height
+    size_t blobElements() const;
+    size_t blobBytes() const;
+
+    // src is 8-bit BGR (channels 3) or gray (channels 1, copied to all
+    // three planes); dst holds blobBytes()
+    void build(const uint8_t* src, size_t src_step, int src_width, int src_height,
+               int channels, void* dst);
+
+private:
+    // Source index and weight contributing to one blob row or column
+    struct Tap {
+        int32_t index;
+        float weight;
+    };
+
+    // Taps of each output coordinate; taps of i are [offsets[i], offsets[i + 1])
+    struct Axis {
+        int source_size = 0;
+        std::vector<int32_t> offsets;
+        std::vector<Tap> taps;
+    };
+
+    BlobConfig config_;
+    Axis columns_;
+    Axis rows_;
+
+    // Horizontally resampled source rows, the two most recent are kept
+    // since consecutive blob rows share their edge rows
+    std::vector<float> resampled_[2];
+    int resampled_row_[2] = {-1, -1};
+    int resampled_next_ = 0;
+
+    std::vector<float> accumulator_;
+
+    static void buildAxis(Axis& axis, int source_size, int size, BlobSampling sampling);
+    const float* resampledRow(const uint8_t* src, size_t src_step, int channels, int y);
+};
+
+#endif // BLOB_BUILDER_H
@@ -27,6 +27,7 @@ class CameraCapture;
 class FaceDetector;
 class PerformanceMonitor;
 class ConfigManager;
+class TaskGroup;
 
 // Configuration structure
 struct FaceDetectionConfig {
@@ -42,6 +43,7 @@ struct FaceDetectionConfig {
     int min_neighbors = 3;
     int min_size = 30;
     int max_size = 300;
+    int low_light_threshold = 0;    // Mean luma below which CLAHE is used, 0 off
     
     // Display settings
     bool show_fps = true;
@@ -126,9 +128,9 @@ private:
     // Configuration
     FaceDetectionConfig config_;
     
-    // Threading
+    // Threading; frames are processed as tasks on the shared scheduler
     std::thread capture_thread_;
-    std::thread process_thread_;
+    std::unique_ptr<TaskGroup> process_tasks_;
     
     std::atomic<bool> running_{false};
     std::atomic<bool> initialized_{false};
@@ -136,7 +138,7 @@ private:
     // Frame processing queue
     std::queue<cv::Mat> frame_queue_;
     std::mutex frame_mutex_;
-    std::condition_variable frame_cv_;
+    bool processing_scheduled_ = false;     // Guarded by frame_mutex_
     
     // Result queue
     std::queue<std::pair<cv::Mat, std::vector<FaceDetectionResult>>> result_queue_;
@@ -154,7 +156,7 @@ private:
     
     // Private methods
     void captureLoop();
-    void processLoop();
+    void processNextFrame();
     
     bool initializeCamera();
     bool initializeFaceDetector();
@@ -14,24 +14,73 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/objdetect.hpp>
 #include <opencv2/dnn.hpp>
+#include "blob_builder.h"
 #include <string>
 #include <vector>
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <cstdint>
 
-// Face detection result
+// Detection method family that produced a result
+enum class DetectionMethod : uint8_t {
+    UNKNOWN = 0,
+    HAAR_CASCADE,
+    DNN,
+    YOLO,
+    SSD,
+    RETINANET,
+    MTCNN,
+    LFFD,
+    SCRFD
+};
+
+const char* detectionMethodToString(DetectionMethod method);
+
+// Face detection result, plain data so results can be copied and reused freely
 struct FaceDetection {
     cv::Rect bbox;              // Bounding box
     float confidence = 1.0f;    // Detection confidence [0.0, 1.0]
     cv::Point2f center;         // Face center point
-    std::string method;         // Detection method used
+    DetectionMethod method = DetectionMethod::UNKNOWN;  // Detection method used
     
     FaceDetection() = default;
     FaceDetection(const cv::Rect& rect, float conf = 1.0f) 
         : bbox(rect), confidence(conf), center(rect.x + rect.width/2.0f, rect.y + rect.height/2.0f) {}
 };
 
+/*
+ * Detection results reused from frame to frame. clear() keeps the storage,
+ * so once the buffer has grown to the largest face count seen, detecting
+ * into it does not allocate.
+ */
+template <typename T>
+class DetectionBuffer {
+public:
+    explicit DetectionBuffer(size_t capacity = 64) { items_.reserve(capacity); }
+    
+    void clear() { items_.clear(); }
+    size_t size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+    size_t capacity() const { return items_.capacity(); }
+    
+    T& operator[](size_t index) { return items_[index]; }
+    const T& operator[](size_t index) const { return items_[index]; }
+    typename std::vector<T>::iterator begin() { return items_.begin(); }
+    typename std::vector<T>::iterator end() { return items_.end(); }
+    typename std::vector<T>::const_iterator begin() const { return items_.begin(); }
+    typename std::vector<T>::const_iterator end() const { return items_.end(); }
+    
+    // Underlying storage, e.g. for drawDetections()
+    std::vector<T>& items() { return items_; }
+    const std::vector<T>& items() const { return items_; }
+    
+private:
+    std::vector<T> items_;
+};
+
+using FaceDetectionBuffer = DetectionBuffer<FaceDetection>;
+
 // Face detector configuration
 struct FaceDetectorConfig {
     // Detection method
@@ -48,6 +97,10 @@ struct FaceDetectorConfig {
     int min_size = 30;
     int max_size = 300;
     
+    // Frames darker than this mean luma get CLAHE instead of global
+    // histogram equalization; 0 disables
+    int low_light_threshold = 0;
+    
     // DNN parameters
     float confidence_threshold = 0.7f;
     float nms_threshold = 0.4f;
@@ -55,6 +108,7 @@ struct FaceDetectorConfig {
     cv::Scalar mean = cv::Scalar(104.0, 177.0, 123.0);
     double scale = 1.0;
     bool swap_rb = false;
+    BlobSampling input_sampling = BlobSampling::BILINEAR;
     
     // Model paths
     std::string haar_cascade_path = "haarcascade_frontalface_alt.xml";
@@ -110,6 +164,7 @@ public:
     // Detection methods
     std::vector<FaceDetection> detectFaces(const cv::Mat& image);
     bool detectFaces(const cv::Mat& image, std::vector<FaceDetection>& faces);
+    bool detectFaces(const cv::Mat& image, FaceDetectionBuffer& faces);
     
     // Batch processing
     std::vector<std::vector<FaceDetection>> detectFacesBatch(const std::vector<cv::Mat>& images);
@@ -124,6 +179,7 @@ public:
     
     // Utility methods
     cv::Mat preprocessImage(const cv::Mat& image) const;
+    void preprocessImage(const cv::Mat& image, cv::Mat& processed) const;
     void drawDetections(cv::Mat& image, const std::vector<FaceDetection>& faces) const;
     
     // Performance optimization
@@ -162,12 +218,22 @@ private:
     // Error handling
     mutable std::string last_error_;
     
-    // Private detection methods
-    std::vector<FaceDetection> detectWithHaarCascade(const cv::Mat& image);
-    std::vector<FaceDetection> detectWithDNN(const cv::Mat& image);
+    // Per-frame scratch storage, reused under detection_mutex_
+    cv::Mat gray_;
+    cv::Mat blob_;                  // Network input, rebuilt in place each frame
+    BlobBuilder blob_builder_;
+    std::vector<cv::Rect> face_rects_;
+    std::vector<cv::Rect> nms_boxes_;
+    std::vector<float> nms_scores_;
+    std::vector<int> nms_indices_;
+    std::vector<FaceDetection> nms_keep_;
+    
+    // Private detection methods, appending to faces
+    void detectWithHaarCascade(const cv::Mat& image, std::vector<FaceDetection>& faces);
+    void detectWithDNN(const cv::Mat& image, std::vector<FaceDetection>& faces);
     
     // Post-processing
-    void applyNonMaximumSuppression(std::vector<FaceDetection>& faces) const;
+    void applyNonMaximumSuppression(std::vector<FaceDetection>& faces);
     void filterDetectionsBySize(std::vector<FaceDetection>& faces) const;
     void limitMaxDetections(std::vector<FaceDetection>& faces) const;
     
@@ -200,6 +266,20 @@ namespace FaceDetectorUtils {
                                               const std::vector<FaceDetection>& detections2,
                                               double iou_threshold = 0.3);
     
+    // Image kernels, run at the SIMD level selected in simd_kernels.h
+    void convertToGray(const cv::Mat& image, cv::Mat& gray);    // From BGR
+    double equalizeGray(const cv::Mat& image, cv::Mat& gray,    // Returns mean luma
+                        int low_light_threshold = 0);
+    double laplacianVariance(const cv::Mat& gray);              // 8-bit single channel
+    void downscaleHalf(const cv::Mat& gray, cv::Mat& half);     // 2:1 area
+    
+    // DNN input blobs: blobFromImage arguments as a BlobConfig, and a
+    // single-pass build into blob (1 x 3 x height x width, reused if the
+    // shape and type match)
+    BlobConfig makeBlobConfig(const cv::Size& size, double scale, const cv::Scalar& mean,
+                              bool swap_rb, BlobSampling sampling = BlobSampling::BILINEAR);
+    void buildBlob(BlobBuilder& builder, const cv::Mat& image, cv::Mat& blob);
+    
     // Visualization utilities
     cv::Scalar getDetectionColor(size_t index);
     void drawBoundingBox(cv::Mat& image, const cv::Rect& bbox, 
@@ -0,0 +1,131 @@
+/*
+ * Frame Arena Header
+ *
+ * This header defines a per-thread bump arena for per-frame image
+ * intermediates and a cv::MatAllocator that serves Mats from it.
+ *
+ * A component opts a Mat in by setting its allocator (see makeArenaMat())
+ * and wraps its per-frame work in a FrameArenaScope. When the outermost
+ * scope ends, the arena is rewound. If a frame needed more than one chunk,
+ * the chunks are merged into a single chunk of the high-water size, so
+ * after the first few frames a detector call does not reach malloc for
+ * these intermediates.
+ *
+ * Arena Mats must be released before the frame ends and must not outlive
+ * the thread that created them. If any are still alive, the reset is
+ * skipped (and counted) rather than reusing their memory.
+ *
+ * Chunks can be backed by huge pages and locked (see memory_backing.h);
+ * set the backing with setDefaultBacking() before worker threads start.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include "memory_backing.h"
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frame arena statistics
+struct FrameArenaStats {
+    size_t capacity = 0;            // Bytes held in chunks
+    size_t used = 0;                // Bytes handed out since the last reset
+    size_t high_water = 0;          // Largest used seen
+    size_t live = 0;                // Allocations not yet released
+    size_t huge_page_bytes = 0;     // Part of capacity backed by huge pages
+    size_t locked_bytes = 0;        // Part of capacity locked in RAM
+    uint64_t allocations = 0;       // Total allocations served
+    uint64_t chunk_allocations = 0; // Chunks obtained from the heap
+    uint64_t resets = 0;
+    uint64_t deferred_resets = 0;   // Resets skipped because allocations were live
+};
+
+// Per-thread bump arena, rewound once per frame
+class FrameArena {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+    static constexpr size_t ALIGNMENT = 64;
+
+    explicit FrameArena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    ~FrameArena();
+
+    // Arena of the calling thread
+    static FrameArena& local();
+
+    // Mat allocator serving the calling thread's arena
+    static cv::MatAllocator* matAllocator();
+
+    // Backing for arenas created from now on
+    static void setDefaultBacking(const MemoryBackingConfig& config);
+    static MemoryBackingConfig getDefaultBacking();
+
+    // Backing for this arena's next chunks; idle chunks are dropped
+    void setBacking(const MemoryBackingConfig& config);
+
+    // Allocation (owning thread only), ALIGNMENT aligned
+    void* allocate(size_t size);
+
+    // Release one allocation, from any thread; memory returns on reset()
+    void release();
+
+    // Rewind the arena; returns false if allocations are still live
+    bool reset();
+
+    // Make sure the next frame fits into one chunk of at least bytes
+    void reserve(size_t bytes);
+
+    FrameArenaStats getStats() const;
+
+private:
+    friend class FrameArenaScope;
+
+    struct Chunk {
+        uint8_t* data;
+        size_t size;
+        BackedRegion region;        // Mapping, if not from the heap
+    };
+
+    std::vector<Chunk> chunks_;     // Last chunk is the one being filled
+    size_t offset_ = 0;             // Fill level of the last chunk
+    size_t chunk_size_;
+    MemoryBackingConfig backing_;
+    int scope_depth_ = 0;
+    std::atomic<size_t> live_{0};
+    FrameArenaStats stats_;
+
+    void addChunk(size_t size);
+    void freeChunks();
+
+    // Non-copyable
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+};
+
+// One frame of work on the calling thread; the outermost scope resets the arena
+class FrameArenaScope {
+public:
+    FrameArenaScope();
+    ~FrameArenaScope();
+
+private:
+    FrameArena& arena_;
+
+    // Non-copyable
+    FrameArenaScope(const FrameArenaScope&) = delete;
+    FrameArenaScope& operator=(const FrameArenaScope&) = delete;
+};
+
+// An empty Mat whose storage, once created, comes from the calling thread's arena
+inline cv::Mat makeArenaMat() {
+    cv::Mat mat;
+    mat.allocator = FrameArena::matAllocator();
+    return mat;
+}
+
+#endif // FRAME_ARENA_H
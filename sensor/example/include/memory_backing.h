@@ -0,0 +1,88 @@
+/*
+ * Memory Backing Header
+ *
+ * This header defines how large, long-lived buffers (frame arena chunks and
+ * model weights) are backed: ordinary pages, transparent huge pages or the
+ * hugetlbfs pool, optionally locked in RAM with mlock().
+ *
+ * Huge pages cut TLB misses on buffers that are walked in large strides;
+ * locking keeps model weights from being paged out under memory pressure.
+ * Both are best effort: when the hugetlbfs pool is empty the mapping falls
+ * back to transparent huge pages, then to ordinary pages, and a failed
+ * mlock() (usually RLIMIT_MEMLOCK) leaves the region unlocked. The region
+ * records what was actually obtained and the process-wide counters can be
+ * printed next to benchmark results.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#ifndef MEMORY_BACKING_H
+#define MEMORY_BACKING_H
+
+#include <opencv2/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Page backing for large buffers
+enum class MemoryBacking : uint8_t {
+    DEFAULT = 0,                // Ordinary pages
+    TRANSPARENT_HUGE_PAGES,     // madvise(MADV_HUGEPAGE)
+    HUGETLBFS                   // MAP_HUGETLB, needs vm.nr_hugepages
+};
+
+struct MemoryBackingConfig {
+    MemoryBacking backing = MemoryBacking::DEFAULT;
+    bool lock = false;          // mlock() the memory
+
+    bool isDefault() const {
+        return backing == MemoryBacking::DEFAULT && !lock;
+    }
+};
+
+// One mapping obtained with mapBackedRegion()
+struct BackedRegion {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    MemoryBacking backing = MemoryBacking::DEFAULT;    // Backing actually obtained
+    bool locked = false;
+};
+
+// Process-wide counters of live backed memory
+struct MemoryBackingStats {
+    size_t mapped_bytes = 0;
+    size_t huge_page_bytes = 0;     // THP advised or hugetlbfs
+    size_t hugetlbfs_bytes = 0;
+    size_t locked_bytes = 0;
+    uint64_t fallbacks = 0;         // Requests served with a weaker backing
+    uint64_t lock_failures = 0;
+};
+
+namespace MemoryBackingUtils {
+    // Huge page size from /proc/meminfo, 2MB if unknown
+    size_t hugePageSize();
+
+    // Map size bytes (rounded up to the huge page size unless DEFAULT);
+    // returns false only if no memory could be mapped at all
+    bool mapRegion(size_t size, const MemoryBackingConfig& config, BackedRegion& region);
+    void unmapRegion(BackedRegion& region);
+
+    MemoryBackingStats getStats();
+
+    std::string backingToString(MemoryBacking backing);
+    bool parseBacking(const std::string& name, MemoryBacking& backing);
+    std::string configToString(const MemoryBackingConfig& config);
+
+    // Pooled allocator serving large Mats from backed memory, nullptr for
+    // the default config. A Mat opts in by setting Mat::allocator before it
+    // is created; small Mats stay on the heap. The default allocator is
+    // never touched, so other threads are unaffected.
+    cv::MatAllocator* matAllocator(const MemoryBackingConfig& config);
+
+    // Moves mat's data to allocator unless other Mats share it (copying a
+    // shared buffer would only leave the old one alive next to the new)
+    bool moveToAllocator(cv::Mat& mat, cv::MatAllocator* allocator);
+}
+
+#endif // MEMORY_BACKING_H
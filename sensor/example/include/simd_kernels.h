@@ -0,0 +1,88 @@
+/*
+ * SIMD Kernels Header
+ *
+ * This header defines the project's image kernels and their runtime
+ * dispatch between scalar, SSE4.1, AVX2 and NEON implementations.
+ *
+ * Every implementation works in integer arithmetic (IoU divides in IEEE
+ * single precision), so all of them produce bit-identical output. Kernels
+ * can therefore be developed and verified on an x86 host and shipped on
+ * the ARM target; tests/simd_kernels_test.cpp checks each implementation
+ * available on the build machine against the scalar one.
+ *
+ * The best level supported by the CPU is picked on first use. The
+ * SIMD_LEVEL environment variable (scalar, sse41, avx2, neon) or
+ * setLevel() overrides it, e.g. for benchmarking.
+ *
+ * The interface is plain pointers so the kernels and their tests build
+ * without OpenCV; FaceDetectorUtils wraps them for cv::Mat.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Instruction set used by the kernels
+enum class SimdLevel : uint8_t {
+    SCALAR = 0,
+    SSE41,
+    AVX2,
+    NEON
+};
+
+// Sum and sum of squares of a Laplacian response
+struct LaplacianSums {
+    int64_t sum = 0;
+    int64_t sum_sq = 0;
+    int64_t count = 0;
+
+    double variance() const;
+};
+
+namespace SimdKernels {
+    // Level selection
+    SimdLevel getLevel();
+    bool setLevel(SimdLevel level);             // False if not supported here
+    std::vector<SimdLevel> supportedLevels();   // Scalar first
+    std::string levelToString(SimdLevel level);
+    bool parseLevel(const std::string& name, SimdLevel& level);
+
+    // Packed BGR to luma, same fixed point weights as cv::cvtColor
+    void bgrToGray(const uint8_t* bgr, uint8_t* gray, size_t pixels);
+
+    // 2:1 area downscale of a single channel image; the source must have
+    // at least 2 * dst_width columns and 2 * dst_height rows
+    void downscaleHalf(const uint8_t* src, size_t src_step,
+                       uint8_t* dst, size_t dst_step,
+                       int dst_width, int dst_height);
+
+    // 4-neighbour Laplacian of a single channel image, summed over the
+    // interior pixels (cv::Laplacian with ksize 1, without borders)
+    LaplacianSums laplacianSums(const uint8_t* src, size_t src_step,
+                                int width, int height);
+
+    // Gray conversion plus histogram equalization (cv::cvtColor followed
+    // by cv::equalizeHist) in two passes: luma and histogram together,
+    // then the LUT in place in dst. channels is 3 (BGR) or 1; a gray src
+    // is only read, so dst may be src. If low_light_threshold is above 0
+    // and the mean luma is below it, CLAHE is applied instead, with its
+    // tile histograms taken from a half resolution copy. Returns the
+    // mean luma.
+    double equalizeGray(const uint8_t* src, size_t src_step, int channels,
+                        int width, int height, uint8_t* dst, size_t dst_step,
+                        int low_light_threshold = 0);
+
+    // IoU of box against each of count boxes; boxes are x, y, width,
+    // height int32 quadruples (the layout of cv::Rect)
+    void intersectionOverUnion(const int32_t* box, const int32_t* boxes,
+                               size_t count, float* ious);
+}
+
+#endif // SIMD_KERNELS_H
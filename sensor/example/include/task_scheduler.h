@@ -0,0 +1,161 @@
+/*
+ * Task Scheduler Header
+ *
+ * This header defines the process-wide work-stealing task scheduler shared
+ * by the pipeline and by OpenCV's parallel_for_.
+ *
+ * One pool sized to the cores replaces the separate pools of OpenCV and of
+ * the pipeline, which oversubscribe a 1-2 core board. Each worker keeps one
+ * deque per priority; it pops its own work LIFO and steals FIFO from the
+ * others. Whenever a worker picks its next task it takes the highest
+ * priority available anywhere, so capture work never waits behind queued
+ * detection work (tasks are not preempted once running).
+ *
+ * Tasks inherit the priority of the thread that submits them; use a
+ * TaskPriorityScope to set it for a thread such as the capture loop.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Task priorities, highest first
+enum class TaskPriority : uint8_t {
+    CAPTURE = 0,    // Frame acquisition and conversion
+    NORMAL,         // Detection
+    BACKGROUND      // Statistics, saving
+};
+
+constexpr int TASK_PRIORITY_COUNT = 3;
+
+// Scheduler statistics
+struct TaskSchedulerStats {
+    uint64_t executed = 0;
+    uint64_t stolen = 0;            // Taken from another worker's deque
+    uint64_t parallel_for_calls = 0;
+};
+
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+
+    // num_workers 0: one per core minus the calling thread, at least one
+    explicit TaskScheduler(int num_workers = 0);
+    ~TaskScheduler();
+
+    // Scheduler shared by the process, created on first use
+    static TaskScheduler& instance();
+
+    // Queue a task; from a worker it goes to that worker's own deque
+    void submit(Task task);
+    void submit(Task task, TaskPriority priority);
+
+    // Run body over [begin, end) in chunks; the calling thread takes part
+    // and the call returns when every chunk has run
+    void parallelFor(int begin, int end, const std::function<void(int, int)>& body);
+
+    // Threads a parallelFor may use, including the caller
+    int getMaxConcurrency() const;
+    void setMaxConcurrency(int concurrency);
+
+    int getNumWorkers() const { return static_cast<int>(workers_.size()); }
+    TaskSchedulerStats getStats() const;
+
+    // Register as OpenCV's parallel_for_ backend; false if this OpenCV
+    // build has no pluggable parallel backends (before 4.5.3). Its thread
+    // numbers are the worker index + 1, and 0 for every thread outside
+    // the pool, so they are only unique within one parallel_for_
+    bool installOpenCVBackend();
+
+    // Index of the calling worker, -1 outside the pool
+    static int currentWorkerIndex();
+
+    // Priority given to tasks submitted from the calling thread
+    static TaskPriority currentPriority();
+
+private:
+    friend class TaskGroup;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> queues[TASK_PRIORITY_COUNT];
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // Submissions from threads outside the pool
+    std::mutex inject_mutex_;
+    std::deque<Task> inject_queues_[TASK_PRIORITY_COUNT];
+
+    // Tasks in all queues; changed under the lock of the queue pushed to
+    // or popped from, so a pop never sees its push uncounted
+    std::atomic<size_t> queued_{0};
+    std::atomic<int> max_concurrency_;
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> executed_{0};
+    std::atomic<uint64_t> stolen_{0};
+    std::atomic<uint64_t> parallel_for_calls_{0};
+
+    void workerLoop(int index);
+    bool takeTask(int index, Task& task, TaskPriority& priority);
+    void runTask(Task& task, TaskPriority priority);
+
+    // Non-copyable
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+};
+
+// Sets the calling thread's task priority until the scope ends
+class TaskPriorityScope {
+public:
+    explicit TaskPriorityScope(TaskPriority priority);
+    ~TaskPriorityScope();
+
+private:
+    TaskPriority previous_;
+
+    // Non-copyable
+    TaskPriorityScope(const TaskPriorityScope&) = delete;
+    TaskPriorityScope& operator=(const TaskPriorityScope&) = delete;
+};
+
+// Tasks that can be waited for together
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::instance());
+    ~TaskGroup();
+
+    void run(TaskScheduler::Task task);
+    void run(TaskScheduler::Task task, TaskPriority priority);
+
+    // Block until every task run so far has finished
+    void wait();
+
+private:
+    TaskScheduler& scheduler_;
+    size_t pending_ = 0;
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+
+    // Non-copyable
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+};
+
+#endif // TASK_SCHEDULER_H
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 # Simple build script for the basic face detection demo
-# This builds just the simple_demo.cpp file for quick testing
+# This builds simple_demo.cpp (plus the detector utilities and SIMD kernels) for quick testing
 
 set -e
 
@@ -49,7 +49,7 @@ fi
 echo ""
 
 # Build command
-BUILD_CMD="$COMPILER -std=c++14 -O2 -Wall -Wextra simple_demo.cpp $OPENCV_FLAGS -o simple_face_detection_demo"
+BUILD_CMD="$COMPILER -std=c++14 -O2 -Wall -Wextra -Iinclude simple_demo.cpp src/face_detector.cpp src/simd_kernels.cpp src/blob_builder.cpp $OPENCV_FLAGS -o simple_face_detection_demo"
 
 echo "Building simple face detection demo..."
 echo "Command: $BUILD_CMD"
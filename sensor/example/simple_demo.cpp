@@ -12,11 +12,13 @@
 #include <opencv2/objdetect.hpp>
 #include <iostream>
 #include <chrono>
+#include "face_detector.h"
 
 class SimpleFaceDetector {
 private:
     cv::CascadeClassifier face_cascade_;
     bool initialized_;
+    cv::Mat gray_;      // Reused across frames
     
 public:
     SimpleFaceDetector() : initialized_(false) {}
@@ -49,18 +51,12 @@ public:
             return {};
         }
         
-        cv::Mat gray;
-        if (image.channels() == 3) {
-            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-        } else {
-            gray = image.clone();
-        }
-        
-        cv::equalizeHist(gray, gray);
+        // Gray conversion and histogram equalization in one fused kernel
+        FaceDetectorUtils::equalizeGray(image, gray_);
         
         std::vector<cv::Rect> faces;
         face_cascade_.detectMultiScale(
-            gray,
+            gray_,
             faces,
             1.1,    // scale factor
             3,      // min neighbors
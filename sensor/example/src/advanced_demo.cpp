@@ -10,6 +10,8 @@
 
 #include "advanced_face_detector.h"
 #include "camera_capture.h"
+#include "frame_arena.h"
+#include "task_scheduler.h"
 #include "config_manager.h"
 #include "face_detection_demo.h"
 #include <opencv2/opencv.hpp>
@@ -39,6 +41,11 @@ public:
         camera_ = std::make_unique<CameraCapture>();
     }
     
+    // Settings from the command line, applied before the model is loaded
+    void setDetectorConfig(const AdvancedDetectorConfig& config) {
+        detector_.setConfig(config);
+    }
+    
     bool initialize() {
         // Load configuration
         ConfigManager config_manager;
@@ -370,14 +377,21 @@ private:
         }
         
         auto algorithms = detector_.getAvailableAlgorithms();
-        auto results = AdvancedDetectorUtils::benchmarkAlgorithms(test_frames, algorithms);
+        auto results = AdvancedDetectorUtils::benchmarkAlgorithms(test_frames, algorithms,
+                                                                  detector_.getConfig());
         
         std::cout << "\n=== Benchmark Results ===" << std::endl;
+        std::cout << "Model memory: " << MemoryBackingUtils::configToString(detector_.getConfig().model_memory)
+                  << ", frame memory: " << MemoryBackingUtils::configToString(FrameArena::getDefaultBacking())
+                  << std::endl;
         std::cout << std::left << std::setw(15) << "Algorithm" 
                   << std::setw(12) << "Avg Time(ms)" 
                   << std::setw(10) << "Avg FPS" 
-                  << std::setw(12) << "Detections" << std::endl;
-        std::cout << std::string(50, '-') << std::endl;
+                  << std::setw(12) << "Detections"
+                  << std::setw(10) << "RSS(MB)"
+                  << std::setw(10) << "Huge(MB)"
+                  << std::setw(10) << "Locked(MB)" << std::endl;
+        std::cout << std::string(80, '-') << std::endl;
         
         for (const auto& result : results) {
             std::cout << std::left << std::setw(15) 
@@ -386,7 +400,16 @@ private:
                       << result.avg_inference_time_ms
                       << std::setw(10) << std::fixed << std::setprecision(1) 
                       << result.avg_fps
-                      << std::setw(12) << result.total_detections << std::endl;
+                      << std::setw(12) << result.total_detections
+                      << std::setw(10) << result.memory_usage_mb
+                      << std::setw(10) << result.huge_page_mb
+                      << std::setw(10) << result.locked_mb << std::endl;
+        }
+        
+        auto backing_stats = MemoryBackingUtils::getStats();
+        if (backing_stats.fallbacks || backing_stats.lock_failures) {
+            std::cout << "Backing fallbacks: " << backing_stats.fallbacks
+                      << ", mlock failures: " << backing_stats.lock_failures << std::endl;
         }
         std::cout << std::endl;
     }
@@ -413,7 +436,8 @@ private:
     
     void printProfilingResults() {
         auto results = detector_.getProfilingResults();
-        if (results.empty()) {
+        auto counters = detector_.getProfilingCounters();
+        if (results.empty() && counters.empty()) {
             std::cout << "No profiling data available" << std::endl;
             return;
         }
@@ -422,6 +446,9 @@ private:
         for (const auto& pair : results) {
             std::cout << pair.first << ": " << pair.second << std::endl;
         }
+        for (const auto& pair : counters) {
+            std::cout << pair.first << ": " << pair.second << std::endl;
+        }
         std::cout << std::endl;
     }
 };
@@ -437,6 +464,14 @@ int main(int argc, char* argv[]) {
         std::cout << "Options:" << std::endl;
         std::cout << "  --help, -h    Show this help message" << std::endl;
         std::cout << "  --list        List available algorithms" << std::endl;
+        std::cout << "  --model-memory MODE   Model weight backing: default, thp, hugetlbfs" << std::endl;
+        std::cout << "  --frame-memory MODE   Frame arena backing: default, thp, hugetlbfs" << std::endl;
+        std::cout << "  --lock-memory         mlock model weights and frame arenas" << std::endl;
+        std::cout << "  --tiling              Detect on overlapping tiles of large frames" << std::endl;
+        std::cout << "  --tile-overlap F      Tile overlap as a fraction of the tile (default 0.25)" << std::endl;
+        std::cout << "  --max-tiles N         Most tiles per frame (default 8)" << std::endl;
+        std::cout << "  --tile-threads N      Threads for tiles, each with its own model copy (default: all)" << std::endl;
+        std::cout << "  --no-full-frame       Skip the whole-frame pass when tiling" << std::endl;
         return 0;
     }
     
@@ -447,7 +482,45 @@ int main(int argc, char* argv[]) {
         return 0;
     }
     
+    AdvancedDetectorConfig detector_config;
+    MemoryBackingConfig frame_memory;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if ((arg == "--model-memory" || arg == "--frame-memory") && i + 1 < argc) {
+            MemoryBackingConfig& target = arg == "--model-memory" ? detector_config.model_memory : frame_memory;
+            if (!MemoryBackingUtils::parseBacking(argv[++i], target.backing)) {
+                std::cerr << "Unknown memory backing: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg == "--lock-memory") {
+            detector_config.model_memory.lock = true;
+            frame_memory.lock = true;
+        } else if (arg == "--tiling") {
+            detector_config.enable_tiling = true;
+        } else if (arg == "--tile-overlap" && i + 1 < argc) {
+            detector_config.tile_overlap = std::stof(argv[++i]);
+        } else if (arg == "--max-tiles" && i + 1 < argc) {
+            detector_config.max_tiles = std::stoi(argv[++i]);
+        } else if (arg == "--tile-threads" && i + 1 < argc) {
+            detector_config.tile_threads = std::stoi(argv[++i]);
+        } else if (arg == "--no-full-frame") {
+            detector_config.tile_full_frame = false;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return -1;
+        }
+    }
+    
+    // Before any thread touches its arena
+    FrameArena::setDefaultBacking(frame_memory);
+    
+    // One thread pool for OpenCV and the pipeline
+    TaskScheduler::instance().installOpenCVBackend();
+    
     AdvancedFaceDetectionDemo demo;
+    demo.setDetectorConfig(detector_config);
     
     if (!demo.initialize()) {
         std::cerr << "Failed to initialize demo" << std::endl;
@@ -9,12 +9,31 @@
  */
 
 #include "advanced_face_detector.h"
+#include "frame_arena.h"
+#include "simd_kernels.h"
+#include "task_scheduler.h"
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <unistd.h>
+
+// Boxes this close to an inner tile edge are taken as cut by it
+static const int TILE_EDGE_MARGIN = 2;
+
+// The readers create the weight Mats on the heap; move each into backed
+// memory before the first forward pass takes views of them
+static void backModelWeights(cv::dnn::Net& net, cv::MatAllocator* allocator) {
+    for (const std::string& name : net.getLayerNames()) {
+        cv::Ptr<cv::dnn::Layer> layer = net.getLayer(net.getLayerId(name));
+        for (cv::Mat& blob : layer->blobs) {
+            MemoryBackingUtils::moveToAllocator(blob, allocator);
+        }
+    }
+}
 
 // Algorithm profiles initialization
 const std::vector<AlgorithmProfile> builtin_profiles = {
@@ -66,14 +85,16 @@ void AdvancedDetectorConfig::setupDefaultModelPaths() {
 AdvancedFaceDetector::AdvancedFaceDetector() 
     : current_algorithm_(DetectionAlgorithm::HAAR_CASCADE),
       profiling_enabled_(false),
-      initialized_(false) {
+      initialized_(false),
+      tile_algorithm_(DetectionAlgorithm::HAAR_CASCADE) {
 }
 
 AdvancedFaceDetector::AdvancedFaceDetector(const AdvancedDetectorConfig& config)
     : config_(config),
       current_algorithm_(config.algorithm),
       profiling_enabled_(false),
-      initialized_(false) {
+      initialized_(false),
+      tile_algorithm_(DetectionAlgorithm::HAAR_CASCADE) {
 }
 
 AdvancedFaceDetector::~AdvancedFaceDetector() {
@@ -93,6 +114,8 @@ bool AdvancedFaceDetector::initialize(DetectionAlgorithm algorithm) {
         return false;
     }
     
+    prepareTileContexts(algorithm);
+    
     initialized_ = true;
     return true;
 }
@@ -106,6 +129,8 @@ void AdvancedFaceDetector::setConfig(const AdvancedDetectorConfig& config) {
     config_ = config;
     if (config.algorithm != current_algorithm_) {
         initialize(config.algorithm);
+    } else {
+        prepareTileContexts(current_algorithm_);
     }
 }
 
@@ -124,43 +149,54 @@ DetectionAlgorithm AdvancedFaceDetector::getCurrentAlgorithm() const {
 }
 
 std::vector<AdvancedFaceDetection> AdvancedFaceDetector::detectFaces(const cv::Mat& image) {
+    std::vector<AdvancedFaceDetection> detections;
+    detectFaces(image, detections);
+    return detections;
+}
+
+bool AdvancedFaceDetector::detectFaces(const cv::Mat& image,
+                                      std::vector<AdvancedFaceDetection>& detections) {
+    detections.clear();
+    
     if (!initialized_) {
         setError("Detector not initialized");
-        return {};
+        return false;
     }
     
     if (image.empty()) {
         setError("Input image is empty");
-        return {};
+        return false;
     }
     
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    std::vector<AdvancedFaceDetection> detections;
+    // Intermediates below come from this thread's frame arena
+    FrameArenaScope frame_scope;
+    
+    // Algorithms without a loaded model fall back to the Haar cascade
+    auto model = loaded_models_.find(current_algorithm_);
+    if (model == loaded_models_.end()) {
+        detectWithHaar(image, detections);
+    } else if (shouldTile(image.size())) {
+        detectTiled(image, detections);
+    } else {
+        main_context_.net = model->second;
+        
+        if (!runInference(main_context_, image, detections)) {
+            return false;
+        }
+    }
     
-    // For now, use Haar cascade as fallback for all algorithms
-    // In a real implementation, each algorithm would have its own detection method
-    cv::CascadeClassifier cascade;
-    if (cascade.load("haarcascade_frontalface_alt.xml")) {
-        cv::Mat gray;
+    if (config_.compute_blur_score && !detections.empty()) {
+        cv::Mat gray = makeArenaMat();
         if (image.channels() == 3) {
-            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+            FaceDetectorUtils::convertToGray(image, gray);
         } else {
-            gray = image.clone();
+            image.copyTo(gray);
         }
         
-        std::vector<cv::Rect> faces;
-        cascade.detectMultiScale(gray, faces, 1.1, 3, 0, cv::Size(30, 30));
-        
-        for (const auto& face : faces) {
-            AdvancedFaceDetection detection;
-            detection.bbox = face;
-            detection.confidence = 1.0f; // Haar doesn't provide confidence
-            detection.center = cv::Point2f(face.x + face.width/2.0f, face.y + face.height/2.0f);
-            detection.method = algorithmToString(current_algorithm_);
-            detection.algorithm_used = current_algorithm_;
-            
-            detections.push_back(detection);
+        for (auto& detection : detections) {
+            detection.blur_score = AdvancedDetectorUtils::calculateBlurScore(gray, detection.bbox);
         }
     }
     
@@ -169,6 +205,7 @@ std::vector<AdvancedFaceDetection> AdvancedFaceDetector::detectFaces(const cv::M
     
     // Update detection time for all results
     for (auto& detection : detections) {
+        detection.algorithm_used = current_algorithm_;
         detection.detection_time_ms = duration.count();
     }
     
@@ -176,13 +213,11 @@ std::vector<AdvancedFaceDetection> AdvancedFaceDetector::detectFaces(const cv::M
         updateProfilingResults("detection", duration.count());
     }
     
-    return detections;
+    return !detections.empty() || !hasError();
 }
 
-bool AdvancedFaceDetector::detectFaces(const cv::Mat& image, 
-                                      std::vector<AdvancedFaceDetection>& faces) {
-    faces = detectFaces(image);
-    return !faces.empty() || !hasError();
+bool AdvancedFaceDetector::detectFaces(const cv::Mat& image, AdvancedDetectionBuffer& faces) {
+    return detectFaces(image, faces.items());
 }
 
 std::vector<std::vector<AdvancedFaceDetection>> AdvancedFaceDetector::detectFacesBatch(
@@ -228,16 +263,98 @@ bool AdvancedFaceDetector::loadModel(DetectionAlgorithm algorithm,
                                     const std::string& model_path,
                                     const std::string& config_path,
                                     const std::string& weights_path) {
-    // Simplified implementation - just mark as loaded
-    (void)algorithm;
-    (void)model_path;
-    (void)config_path;
     (void)weights_path;
     
+    cv::dnn::Net net;
+    if (!readModel(algorithm, model_path, config_path, net)) {
+        return false;
+    }
+    
+    loaded_models_[algorithm] = net;
     model_status_[algorithm] = true;
+    model_files_[algorithm] = std::make_pair(model_path, config_path);
+    
+    // Tile threads get their copies now rather than on the first frame
+    if (tile_algorithm_ == algorithm) {
+        tile_contexts_.clear();
+    }
+    prepareTileContexts(algorithm);
+    
     return true;
 }
 
+bool AdvancedFaceDetector::readModel(DetectionAlgorithm algorithm, const std::string& model_path,
+                                     const std::string& config_path, cv::dnn::Net& net) {
+    try {
+        // Load model based on file extension
+        std::string ext = model_path.substr(model_path.find_last_of('.'));
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        
+        if (ext == ".onnx") {
+            net = cv::dnn::readNetFromONNX(model_path);
+        } else if (ext == ".pb") {
+            if (!config_path.empty()) {
+                net = cv::dnn::readNetFromTensorflow(model_path, config_path);
+            } else {
+                net = cv::dnn::readNetFromTensorflow(model_path);
+            }
+        } else if (ext == ".weights") {
+            if (!config_path.empty()) {
+                net = cv::dnn::readNetFromDarknet(config_path, model_path);
+            } else {
+                setError("Config file required for .weights format");
+                return false;
+            }
+        } else if (ext == ".caffemodel") {
+            if (!config_path.empty()) {
+                net = cv::dnn::readNetFromCaffe(config_path, model_path);
+            } else {
+                setError("Config file required for .caffemodel format");
+                return false;
+            }
+        } else {
+            setError("Unsupported model format: " + ext);
+            return false;
+        }
+        
+        if (net.empty()) {
+            setError("Failed to load model: " + model_path);
+            return false;
+        }
+        
+        // Set backend and target
+        if (config_.enable_gpu) {
+            net.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
+            net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
+        } else {
+            net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+            net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        }
+        
+        // Layers take views of their weights (or repack them on the heap)
+        // on the first forward pass, so back them and run it here
+        if (!config_.model_memory.isDefault()) {
+            backModelWeights(net, MemoryBackingUtils::matAllocator(config_.model_memory));
+            try {
+                net.setInput(preprocessImage(cv::Mat::zeros(config_.input_size, CV_8UC3), algorithm));
+                std::vector<cv::Mat> outputs;
+                net.forward(outputs, net.getUnconnectedOutLayersNames());
+            } catch (const cv::Exception&) {
+                // Input shape not accepted, the first frame finalizes the net instead
+            }
+        }
+        
+        return true;
+        
+    } catch (const cv::Exception& e) {
+        setError("OpenCV error loading model: " + std::string(e.what()));
+        return false;
+    } catch (const std::exception& e) {
+        setError("Error loading model: " + std::string(e.what()));
+        return false;
+    }
+}
+
 bool AdvancedFaceDetector::isModelLoaded(DetectionAlgorithm algorithm) const {
     auto it = model_status_.find(algorithm);
     return it != model_status_.end() && it->second;
@@ -246,17 +363,27 @@ bool AdvancedFaceDetector::isModelLoaded(DetectionAlgorithm algorithm) const {
 void AdvancedFaceDetector::unloadModel(DetectionAlgorithm algorithm) {
     loaded_models_.erase(algorithm);
     model_status_[algorithm] = false;
+    model_files_.erase(algorithm);
+    
+    if (tile_algorithm_ == algorithm) {
+        tile_contexts_.clear();
+    }
+    main_context_.net = cv::dnn::Net();
 }
 
 void AdvancedFaceDetector::unloadAllModels() {
     loaded_models_.clear();
     model_status_.clear();
+    model_files_.clear();
+    tile_contexts_.clear();
+    main_context_.net = cv::dnn::Net();
 }
 
 void AdvancedFaceDetector::enableProfiling(bool enable) {
     profiling_enabled_ = enable;
     if (!enable) {
         profiling_results_.clear();
+        profiling_counters_.clear();
     }
 }
 
@@ -264,15 +391,250 @@ std::map<std::string, double> AdvancedFaceDetector::getProfilingResults() const
     return profiling_results_;
 }
 
+std::map<std::string, uint64_t> AdvancedFaceDetector::getProfilingCounters() const {
+    return profiling_counters_;
+}
+
 void AdvancedFaceDetector::resetProfilingResults() {
     profiling_results_.clear();
+    profiling_counters_.clear();
 }
 
 cv::Mat AdvancedFaceDetector::preprocessImage(const cv::Mat& image, 
                                              DetectionAlgorithm algorithm) const {
-    // Simplified preprocessing
-    (void)algorithm;
-    return image.clone();
+    BlobBuilder builder(blobConfigFor(algorithm, image.size()));
+    cv::Mat blob;
+    FaceDetectorUtils::buildBlob(builder, image, blob);
+    return blob;
+}
+
+BlobConfig AdvancedFaceDetector::blobConfigFor(DetectionAlgorithm algorithm,
+                                               const cv::Size& image_size) const {
+    BlobConfig blob;
+    
+    switch (algorithm) {
+    case DetectionAlgorithm::YOLO_V3:
+    case DetectionAlgorithm::YOLO_V4:
+    case DetectionAlgorithm::YOLO_V5:
+    case DetectionAlgorithm::YOLO_FACE:
+        blob = FaceDetectorUtils::makeBlobConfig(config_.input_size, 1.0/255.0,
+                                                 cv::Scalar(0, 0, 0), true, config_.input_sampling);
+        break;
+        
+    case DetectionAlgorithm::SSD_MOBILENET:
+    case DetectionAlgorithm::SSD_RESNET:
+        blob = FaceDetectorUtils::makeBlobConfig(config_.ssd_input_size, 1.0, config_.mean,
+                                                 config_.swap_rb, config_.input_sampling);
+        break;
+        
+    case DetectionAlgorithm::RETINANET:
+        blob = FaceDetectorUtils::makeBlobConfig(config_.retinanet_input_size, 1.0,
+                                                 cv::Scalar(103.94, 116.78, 123.68), false,
+                                                 config_.input_sampling);
+        break;
+        
+    case DetectionAlgorithm::MTCNN:
+        // Full resolution, the network builds its own pyramid
+        blob = FaceDetectorUtils::makeBlobConfig(image_size, 1.0/255.0, cv::Scalar(0, 0, 0),
+                                                 false, config_.input_sampling);
+        break;
+        
+    case DetectionAlgorithm::LFFD:
+        blob = FaceDetectorUtils::makeBlobConfig(config_.lffd_input_size, 1.0/255.0,
+                                                 cv::Scalar(0, 0, 0), true, config_.input_sampling);
+        break;
+        
+    default:
+        blob = FaceDetectorUtils::makeBlobConfig(config_.input_size, config_.scale, config_.mean,
+                                                 config_.swap_rb, config_.input_sampling);
+        break;
+    }
+    
+    if (config_.int8_input) {
+        blob.format = BlobFormat::INT8;
+        blob.quant_scale = config_.input_quant_scale;
+        blob.quant_zero_point = config_.input_quant_zero_point;
+    }
+    
+    return blob;
+}
+
+cv::Size AdvancedFaceDetector::modelInputSize(DetectionAlgorithm algorithm) const {
+    switch (algorithm) {
+    case DetectionAlgorithm::YOLO_V3:
+    case DetectionAlgorithm::YOLO_V4:
+    case DetectionAlgorithm::YOLO_V5:
+    case DetectionAlgorithm::YOLO_FACE:
+        return config_.input_size;
+        
+    case DetectionAlgorithm::SSD_MOBILENET:
+    case DetectionAlgorithm::SSD_RESNET:
+        return config_.ssd_input_size;
+        
+    case DetectionAlgorithm::RETINANET:
+        return config_.retinanet_input_size;
+        
+    case DetectionAlgorithm::LFFD:
+        return config_.lffd_input_size;
+        
+    default:
+        // MTCNN takes the image at its own size
+        return cv::Size();
+    }
+}
+
+const cv::Mat& AdvancedFaceDetector::buildInputBlob(InferenceContext& context, const cv::Mat& image,
+                                                    DetectionAlgorithm algorithm) {
+    context.blob_builder.setConfig(blobConfigFor(algorithm, image.size()));
+    FaceDetectorUtils::buildBlob(context.blob_builder, image, context.input_blob);
+    return context.input_blob;
+}
+
+bool AdvancedFaceDetector::runInference(InferenceContext& context, const cv::Mat& image,
+                                        std::vector<AdvancedFaceDetection>& detections) {
+    switch (current_algorithm_) {
+    case DetectionAlgorithm::YOLO_V3:
+    case DetectionAlgorithm::YOLO_V4:
+    case DetectionAlgorithm::YOLO_V5:
+    case DetectionAlgorithm::YOLO_FACE:
+        detectWithYOLO(context, image, detections);
+        break;
+        
+    case DetectionAlgorithm::SSD_MOBILENET:
+    case DetectionAlgorithm::SSD_RESNET:
+        detectWithSSD(context, image, detections);
+        break;
+        
+    case DetectionAlgorithm::RETINANET:
+        detectWithRetinaNet(context, image, detections);
+        break;
+        
+    case DetectionAlgorithm::MTCNN:
+        detectWithMTCNN(context, image, detections);
+        break;
+        
+    case DetectionAlgorithm::LFFD:
+        detectWithLFFD(context, image, detections);
+        break;
+        
+    default:
+        setError("Unsupported algorithm");
+        return false;
+    }
+    
+    return true;
+}
+
+bool AdvancedFaceDetector::shouldTile(const cv::Size& image_size) const {
+    cv::Size tile_size = modelInputSize(current_algorithm_);
+    
+    // Without contexts for this model the frame runs untiled
+    if (!config_.enable_tiling || tile_size.empty() ||
+        tile_contexts_.empty() || tile_algorithm_ != current_algorithm_) {
+        return false;
+    }
+    
+    return image_size.width > tile_size.width * config_.tile_min_scale ||
+           image_size.height > tile_size.height * config_.tile_min_scale;
+}
+
+int AdvancedFaceDetector::tileThreads() const {
+    int threads = config_.tile_threads > 0 ? config_.tile_threads
+                                           : TaskScheduler::instance().getMaxConcurrency();
+    
+    // No more than there can be regions
+    int regions = std::max(config_.max_tiles, 1) + (config_.tile_full_frame ? 1 : 0);
+    return std::max(1, std::min(threads, regions));
+}
+
+void AdvancedFaceDetector::prepareTileContexts(DetectionAlgorithm algorithm) {
+    auto model = loaded_models_.find(algorithm);
+    if (!config_.enable_tiling || model == loaded_models_.end() || modelInputSize(algorithm).empty()) {
+        return;
+    }
+    
+    if (tile_algorithm_ != algorithm) {
+        tile_contexts_.clear();
+        tile_algorithm_ = algorithm;
+    }
+    
+    // The first context runs the main network, the others load copies
+    if (tile_contexts_.empty()) {
+        tile_contexts_.emplace_back(new InferenceContext());
+    }
+    tile_contexts_[0]->net = model->second;
+    
+    int count = tileThreads();
+    if (static_cast<int>(tile_contexts_.size()) > count) {
+        tile_contexts_.resize(count);
+    }
+    
+    const auto& files = model_files_[algorithm];
+    while (static_cast<int>(tile_contexts_.size()) < count) {
+        std::unique_ptr<InferenceContext> context(new InferenceContext());
+        if (files.first.empty() || !readModel(algorithm, files.first, files.second, context->net)) {
+            break;      // Fewer threads then
+        }
+        tile_contexts_.push_back(std::move(context));
+    }
+}
+
+void AdvancedFaceDetector::detectTiled(const cv::Mat& image,
+                                       std::vector<AdvancedFaceDetection>& detections) {
+    std::vector<cv::Rect> regions = AdvancedDetectorUtils::computeTiles(
+        image.size(), modelInputSize(current_algorithm_), config_.tile_overlap, config_.max_tiles);
+    
+    if (config_.tile_full_frame) {
+        regions.push_back(cv::Rect(0, 0, image.cols, image.rows));
+    }
+    
+    // Contexts were loaded with the model, see prepareTileContexts()
+    TaskScheduler& scheduler = TaskScheduler::instance();
+    int contexts = std::min(static_cast<int>(tile_contexts_.size()), static_cast<int>(regions.size()));
+    
+    // Each context takes every contexts-th region, so no two threads
+    // share a network
+    std::vector<std::vector<AdvancedFaceDetection>> found(regions.size());
+    scheduler.parallelFor(0, contexts, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            for (size_t r = c; r < regions.size(); r += contexts) {
+                runInference(*tile_contexts_[c], image(regions[r]), found[r]);
+            }
+        }
+    });
+    
+    for (size_t r = 0; r < regions.size(); ++r) {
+        const cv::Rect& region = regions[r];
+        cv::Point2f offset(static_cast<float>(region.x), static_cast<float>(region.y));
+        
+        // A face cut by an inner tile edge is found whole by the full
+        // frame pass
+        bool drop_cut = config_.tile_full_frame && region.size() != image.size();
+        
+        for (auto& detection : found[r]) {
+            const cv::Rect& bbox = detection.bbox;
+            bool cut = (region.x > 0 && bbox.x <= TILE_EDGE_MARGIN) ||
+                       (region.y > 0 && bbox.y <= TILE_EDGE_MARGIN) ||
+                       (region.br().x < image.cols && bbox.br().x >= region.width - TILE_EDGE_MARGIN) ||
+                       (region.br().y < image.rows && bbox.br().y >= region.height - TILE_EDGE_MARGIN);
+            if (drop_cut && cut) {
+                continue;
+            }
+            
+            detection.bbox += region.tl();
+            detection.center += offset;
+            for (int k = 0; k < detection.num_landmarks; ++k) {
+                detection.landmarks[k] += offset;
+            }
+            detections.push_back(detection);
+        }
+    }
+    
+    // Neighbouring tiles and the full frame pass find the same faces
+    AdvancedDetectorUtils::suppressOverlaps(detections, config_.nms_threshold);
+    
+    addProfilingCount("tiled_frames", 1);
+    addProfilingCount("tiles", regions.size());
 }
 
 DetectionAlgorithm AdvancedFaceDetector::recommendAlgorithm(const cv::Size& image_size,
@@ -291,10 +653,12 @@ DetectionAlgorithm AdvancedFaceDetector::recommendAlgorithm(const cv::Size& imag
 }
 
 std::string AdvancedFaceDetector::getLastError() const {
+    std::lock_guard<std::mutex> lock(error_mutex_);
     return last_error_;
 }
 
 bool AdvancedFaceDetector::hasError() const {
+    std::lock_guard<std::mutex> lock(error_mutex_);
     return !last_error_.empty();
 }
 
@@ -329,6 +693,34 @@ std::string AdvancedFaceDetector::algorithmToString(DetectionAlgorithm algorithm
     }
 }
 
+DetectionMethod AdvancedFaceDetector::algorithmToMethod(DetectionAlgorithm algorithm) {
+    switch (algorithm) {
+    case DetectionAlgorithm::HAAR_CASCADE: return DetectionMethod::HAAR_CASCADE;
+    case DetectionAlgorithm::DNN_CAFFE:
+    case DetectionAlgorithm::DNN_TENSORFLOW:
+    case DetectionAlgorithm::DNN_ONNX: return DetectionMethod::DNN;
+    case DetectionAlgorithm::YOLO_V3:
+    case DetectionAlgorithm::YOLO_V4:
+    case DetectionAlgorithm::YOLO_V5:
+    case DetectionAlgorithm::YOLO_FACE: return DetectionMethod::YOLO;
+    case DetectionAlgorithm::SSD_MOBILENET:
+    case DetectionAlgorithm::SSD_RESNET: return DetectionMethod::SSD;
+    case DetectionAlgorithm::RETINANET: return DetectionMethod::RETINANET;
+    case DetectionAlgorithm::MTCNN: return DetectionMethod::MTCNN;
+    case DetectionAlgorithm::LFFD: return DetectionMethod::LFFD;
+    case DetectionAlgorithm::SCRFD: return DetectionMethod::SCRFD;
+    default: return DetectionMethod::UNKNOWN;
+    }
+}
+
+const char* AdvancedFaceDetector::genderToString(Gender gender) {
+    switch (gender) {
+    case Gender::MALE: return "male";
+    case Gender::FEMALE: return "female";
+    default: return "unknown";
+    }
+}
+
 DetectionAlgorithm AdvancedFaceDetector::stringToAlgorithm(const std::string& name) {
     std::string lower_name = name;
     std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(), ::tolower);
@@ -356,12 +748,366 @@ DetectionAlgorithm AdvancedFaceDetector::stringToAlgorithm(const std::string& na
 
 // Private method implementations
 bool AdvancedFaceDetector::initializeAlgorithm(DetectionAlgorithm algorithm) {
-    // For now, all algorithms are considered initialized
-    // In a real implementation, this would load specific models
-    (void)algorithm;
-    return true;
+    // The cascade is the fallback for every algorithm, load it once
+    if (haar_cascade_.empty()) {
+        haar_cascade_.load(FaceDetectorUtils::findHaarCascadeFile(
+            FaceDetectorConstants::DEFAULT_HAAR_CASCADE));
+    }
+    
+    // The Haar cascade needs no model, and is the fallback for models
+    // that are not installed
+    if (algorithm == DetectionAlgorithm::HAAR_CASCADE || isModelLoaded(algorithm)) {
+        return true;
+    }
+
+    std::string model_path = config_.model_dir + config_.model_paths[algorithm];
+    std::ifstream file(model_path);
+    if (!file.good()) {
+        return true;
+    }
+
+    // Loaded now, before frames arrive, so the weights get their backing
+    return loadModel(algorithm, model_path);
+}
+
+void AdvancedFaceDetector::detectWithHaar(const cv::Mat& image,
+                                          std::vector<AdvancedFaceDetection>& detections) {
+    if (haar_cascade_.empty()) {
+        setError("Haar cascade not loaded");
+        return;
+    }
+    
+    cv::Mat gray = makeArenaMat();
+    if (image.channels() == 3) {
+        FaceDetectorUtils::convertToGray(image, gray);
+    } else {
+        image.copyTo(gray);
+    }
+    
+    haar_cascade_.detectMultiScale(gray, face_rects_, 1.1, 3, 0, cv::Size(30, 30));
+    
+    for (const auto& face : face_rects_) {
+        AdvancedFaceDetection detection;
+        detection.bbox = face;
+        detection.confidence = 1.0f; // Haar doesn't provide confidence
+        detection.center = cv::Point2f(face.x + face.width/2.0f, face.y + face.height/2.0f);
+        detection.method = algorithmToMethod(current_algorithm_);
+        detection.algorithm_used = current_algorithm_;
+        
+        detections.push_back(detection);
+    }
+}
+
+void AdvancedFaceDetector::detectWithYOLO(InferenceContext& context, const cv::Mat& image,
+                                          std::vector<AdvancedFaceDetection>& detections) {
+    if (context.net.empty()) {
+        setError("YOLO model not loaded");
+        return;
+    }
+
+    cv::dnn::Net& net = context.net;
+
+    try {
+        // Preprocess image
+        net.setInput(buildInputBlob(context, image, current_algorithm_));
+
+        // Run forward pass
+        std::vector<cv::Mat> outputs;
+        net.forward(outputs, net.getUnconnectedOutLayersNames());
+
+        // Parse YOLO outputs
+        float conf_threshold = config_.yolo_confidence;
+        float nms_threshold = config_.yolo_nms;
+
+        std::vector<cv::Rect> boxes;
+        std::vector<float> confidences;
+        std::vector<int> class_ids;
+
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            float* data = (float*)outputs[i].data;
+            for (int j = 0; j < outputs[i].rows; ++j, data += outputs[i].cols) {
+                cv::Mat scores = outputs[i].row(j).colRange(5, outputs[i].cols);
+                cv::Point class_id_point;
+                double confidence;
+                minMaxLoc(scores, 0, &confidence, 0, &class_id_point);
+
+                if (confidence > conf_threshold) {
+                    int center_x = (int)(data[0] * image.cols);
+                    int center_y = (int)(data[1] * image.rows);
+                    int width = (int)(data[2] * image.cols);
+                    int height = (int)(data[3] * image.rows);
+                    int left = center_x - width / 2;
+                    int top = center_y - height / 2;
+
+                    boxes.push_back(cv::Rect(left, top, width, height));
+                    confidences.push_back((float)confidence);
+                    class_ids.push_back(class_id_point.x);
+                }
+            }
+        }
+
+        // Apply NMS
+        std::vector<int> indices;
+        cv::dnn::NMSBoxes(boxes, confidences, conf_threshold, nms_threshold, indices);
+
+        // Convert to AdvancedFaceDetection
+        for (size_t i = 0; i < indices.size(); ++i) {
+            int idx = indices[i];
+            AdvancedFaceDetection detection;
+            detection.bbox = boxes[idx];
+            detection.confidence = confidences[idx];
+            detection.center = cv::Point2f(detection.bbox.x + detection.bbox.width/2.0f,
+                                         detection.bbox.y + detection.bbox.height/2.0f);
+            detection.method = algorithmToMethod(current_algorithm_);
+            detection.algorithm_used = current_algorithm_;
+
+            detections.push_back(detection);
+        }
+
+    } catch (const cv::Exception& e) {
+        setError("YOLO detection error: " + std::string(e.what()));
+    }
+}
+
+void AdvancedFaceDetector::detectWithSSD(InferenceContext& context, const cv::Mat& image,
+                                         std::vector<AdvancedFaceDetection>& detections) {
+    if (context.net.empty()) {
+        setError("SSD model not loaded");
+        return;
+    }
+
+    cv::dnn::Net& net = context.net;
+
+    try {
+        // Preprocess image, set input and run inference
+        net.setInput(buildInputBlob(context, image, current_algorithm_));
+        cv::Mat detection = net.forward();
+
+        // Parse SSD outputs
+        cv::Mat detectionMat(detection.size[2], detection.size[3], CV_32F, detection.ptr<float>());
+
+        for (int i = 0; i < detectionMat.rows; i++) {
+            float confidence = detectionMat.at<float>(i, 2);
+
+            if (confidence > config_.ssd_confidence) {
+                int x1 = static_cast<int>(detectionMat.at<float>(i, 3) * image.cols);
+                int y1 = static_cast<int>(detectionMat.at<float>(i, 4) * image.rows);
+                int x2 = static_cast<int>(detectionMat.at<float>(i, 5) * image.cols);
+                int y2 = static_cast<int>(detectionMat.at<float>(i, 6) * image.rows);
+
+                cv::Rect bbox(x1, y1, x2 - x1, y2 - y1);
+
+                // Validate bounding box
+                if (bbox.x >= 0 && bbox.y >= 0 &&
+                    bbox.x + bbox.width <= image.cols &&
+                    bbox.y + bbox.height <= image.rows &&
+                    bbox.width > 0 && bbox.height > 0) {
+
+                    AdvancedFaceDetection face_detection;
+                    face_detection.bbox = bbox;
+                    face_detection.confidence = confidence;
+                    face_detection.center = cv::Point2f(bbox.x + bbox.width/2.0f,
+                                                       bbox.y + bbox.height/2.0f);
+                    face_detection.method = algorithmToMethod(current_algorithm_);
+                    face_detection.algorithm_used = current_algorithm_;
+
+                    detections.push_back(face_detection);
+                }
+            }
+        }
+
+    } catch (const cv::Exception& e) {
+        setError("SSD detection error: " + std::string(e.what()));
+    }
 }
 
+void AdvancedFaceDetector::detectWithRetinaNet(InferenceContext& context, const cv::Mat& image,
+                                               std::vector<AdvancedFaceDetection>& detections) {
+    if (context.net.empty()) {
+        setError("RetinaNet model not loaded");
+        return;
+    }
+
+    cv::dnn::Net& net = context.net;
+
+    try {
+        // Preprocess image, set input and run inference
+        net.setInput(buildInputBlob(context, image, current_algorithm_));
+        std::vector<cv::Mat> outputs;
+        net.forward(outputs, net.getUnconnectedOutLayersNames());
+
+        // Parse RetinaNet outputs (simplified)
+        for (const auto& output : outputs) {
+            if (output.dims == 2) {
+                for (int i = 0; i < output.rows; i++) {
+                    const float* data = output.ptr<float>(i);
+                    float confidence = data[4]; // Assuming confidence is at index 4
+
+                    if (confidence > config_.retinanet_confidence) {
+                        int x1 = static_cast<int>(data[0]);
+                        int y1 = static_cast<int>(data[1]);
+                        int x2 = static_cast<int>(data[2]);
+                        int y2 = static_cast<int>(data[3]);
+
+                        cv::Rect bbox(x1, y1, x2 - x1, y2 - y1);
+
+                        if (bbox.x >= 0 && bbox.y >= 0 &&
+                            bbox.x + bbox.width <= image.cols &&
+                            bbox.y + bbox.height <= image.rows &&
+                            bbox.width > 0 && bbox.height > 0) {
+
+                            AdvancedFaceDetection detection;
+                            detection.bbox = bbox;
+                            detection.confidence = confidence;
+                            detection.center = cv::Point2f(bbox.x + bbox.width/2.0f,
+                                                          bbox.y + bbox.height/2.0f);
+                            detection.method = algorithmToMethod(current_algorithm_);
+                            detection.algorithm_used = current_algorithm_;
+
+                            detections.push_back(detection);
+                        }
+                    }
+                }
+            }
+        }
+
+    } catch (const cv::Exception& e) {
+        setError("RetinaNet detection error: " + std::string(e.what()));
+    }
+}
+
+void AdvancedFaceDetector::detectWithMTCNN(InferenceContext& context, const cv::Mat& image,
+                                           std::vector<AdvancedFaceDetection>& detections) {
+    if (context.net.empty()) {
+        setError("MTCNN model not loaded");
+        return;
+    }
+
+    // MTCNN typically requires three networks (P-Net, R-Net, O-Net)
+    // This is a simplified implementation
+    cv::dnn::Net& net = context.net;
+
+    try {
+        // Preprocess image, set input and run inference
+        net.setInput(buildInputBlob(context, image, DetectionAlgorithm::MTCNN));
+        std::vector<cv::Mat> outputs;
+        net.forward(outputs, net.getUnconnectedOutLayersNames());
+
+        // Parse MTCNN outputs (simplified)
+        if (!outputs.empty()) {
+            cv::Mat detection_output = outputs[0];
+
+            for (int i = 0; i < detection_output.rows; i++) {
+                const float* data = detection_output.ptr<float>(i);
+                float confidence = data[4];
+
+                if (confidence > config_.mtcnn_thresholds[0]) {
+                    int x1 = static_cast<int>(data[0] * image.cols);
+                    int y1 = static_cast<int>(data[1] * image.rows);
+                    int x2 = static_cast<int>(data[2] * image.cols);
+                    int y2 = static_cast<int>(data[3] * image.rows);
+
+                    cv::Rect bbox(x1, y1, x2 - x1, y2 - y1);
+
+                    if (bbox.width >= config_.mtcnn_min_face_size &&
+                        bbox.height >= config_.mtcnn_min_face_size &&
+                        bbox.x >= 0 && bbox.y >= 0 &&
+                        bbox.x + bbox.width <= image.cols &&
+                        bbox.y + bbox.height <= image.rows) {
+
+                        AdvancedFaceDetection detection;
+                        detection.bbox = bbox;
+                        detection.confidence = confidence;
+                        detection.center = cv::Point2f(bbox.x + bbox.width/2.0f,
+                                                      bbox.y + bbox.height/2.0f);
+                        detection.method = algorithmToMethod(current_algorithm_);
+                        detection.algorithm_used = current_algorithm_;
+
+                        // MTCNN can provide facial landmarks
+                        if (outputs.size() > 1) {
+                            cv::Mat landmarks_output = outputs[1];
+                            if (i < landmarks_output.rows) {
+                                const float* landmark_data = landmarks_output.ptr<float>(i);
+                                for (int j = 0; j < 5; j++) {
+                                    float x = landmark_data[j * 2] * image.cols;
+                                    float y = landmark_data[j * 2 + 1] * image.rows;
+                                    detection.landmarks[j] = cv::Point2f(x, y);
+                                }
+                                detection.num_landmarks = 5;
+                            }
+                        }
+
+                        detections.push_back(detection);
+                    }
+                }
+            }
+        }
+
+    } catch (const cv::Exception& e) {
+        setError("MTCNN detection error: " + std::string(e.what()));
+    }
+}
+
+void AdvancedFaceDetector::detectWithLFFD(InferenceContext& context, const cv::Mat& image,
+                                          std::vector<AdvancedFaceDetection>& detections) {
+    if (context.net.empty()) {
+        setError("LFFD model not loaded");
+        return;
+    }
+
+    cv::dnn::Net& net = context.net;
+
+    try {
+        // Preprocess image, set input and run inference
+        net.setInput(buildInputBlob(context, image, current_algorithm_));
+        std::vector<cv::Mat> outputs;
+        net.forward(outputs, net.getUnconnectedOutLayersNames());
+
+        // Parse LFFD outputs
+        for (const auto& output : outputs) {
+            if (output.dims >= 2) {
+                for (int i = 0; i < output.rows; i++) {
+                    const float* data = output.ptr<float>(i);
+                    float confidence = data[4]; // Assuming confidence is at index 4
+
+                    if (confidence > config_.lffd_confidence) {
+                        // Scale coordinates back to original image size
+                        float scale_x = static_cast<float>(image.cols) / config_.lffd_input_size.width;
+                        float scale_y = static_cast<float>(image.rows) / config_.lffd_input_size.height;
+
+                        int x1 = static_cast<int>(data[0] * scale_x);
+                        int y1 = static_cast<int>(data[1] * scale_y);
+                        int x2 = static_cast<int>(data[2] * scale_x);
+                        int y2 = static_cast<int>(data[3] * scale_y);
+
+                        cv::Rect bbox(x1, y1, x2 - x1, y2 - y1);
+
+                        if (bbox.x >= 0 && bbox.y >= 0 &&
+                            bbox.x + bbox.width <= image.cols &&
+                            bbox.y + bbox.height <= image.rows &&
+                            bbox.width > 0 && bbox.height > 0) {
+
+                            AdvancedFaceDetection detection;
+                            detection.bbox = bbox;
+                            detection.confidence = confidence;
+                            detection.center = cv::Point2f(bbox.x + bbox.width/2.0f,
+                                                          bbox.y + bbox.height/2.0f);
+                            detection.method = algorithmToMethod(current_algorithm_);
+                            detection.algorithm_used = current_algorithm_;
+
+                            detections.push_back(detection);
+                        }
+                    }
+                }
+            }
+        }
+
+    } catch (const cv::Exception& e) {
+        setError("LFFD detection error: " + std::string(e.what()));
+    }
+}
+
+
 void AdvancedFaceDetector::drawAdvancedDetections(cv::Mat& image,
                                                   const std::vector<AdvancedFaceDetection>& faces) const {
     for (size_t i = 0; i < faces.size(); ++i) {
@@ -410,10 +1156,8 @@ void AdvancedFaceDetector::drawAdvancedDetections(cv::Mat& image,
                    cv::FONT_HERSHEY_SIMPLEX, 0.4, color, 1);
 
         // Draw landmarks if available
-        if (!face.landmarks.empty()) {
-            for (const auto& landmark : face.landmarks) {
-                cv::circle(image, landmark, 2, color, -1);
-            }
+        for (int k = 0; k < face.num_landmarks; ++k) {
+            cv::circle(image, face.landmarks[k], 2, color, -1);
         }
 
         // Draw detection time if available
@@ -427,9 +1171,11 @@ void AdvancedFaceDetector::drawAdvancedDetections(cv::Mat& image,
 }
 
 void AdvancedFaceDetector::setError(const std::string& error) const {
+    std::lock_guard<std::mutex> lock(error_mutex_);
     last_error_ = error;
 }
 
+
 void AdvancedFaceDetector::updateProfilingResults(const std::string& operation, double time_ms) {
     if (profiling_enabled_) {
         profiling_results_[operation + "_time"] = time_ms;
@@ -437,6 +1183,12 @@ void AdvancedFaceDetector::updateProfilingResults(const std::string& operation,
     }
 }
 
+void AdvancedFaceDetector::addProfilingCount(const std::string& counter, uint64_t count) {
+    if (profiling_enabled_) {
+        profiling_counters_[counter] += count;
+    }
+}
+
 // AdvancedDetectorUtils namespace implementation
 namespace AdvancedDetectorUtils {
 
@@ -500,9 +1252,51 @@ bool verifyModelFiles(DetectionAlgorithm algorithm, const std::string& model_dir
     return true;
 }
 
+float calculateBlurScore(const cv::Mat& gray, const cv::Rect& face) {
+    cv::Rect inside = face & cv::Rect(0, 0, gray.cols, gray.rows);
+    if (inside.empty()) {
+        return 0.0f;
+    }
+    
+    cv::Mat roi = gray(inside);
+    double variance;
+
+    // Large faces are measured at half resolution, which is cheaper and
+    // keeps the score comparable with small faces
+    if (roi.cols > AdvancedDetectorConstants::BLUR_FULL_RESOLUTION_WIDTH) {
+        cv::Mat half;
+        FaceDetectorUtils::downscaleHalf(roi, half);
+        variance = FaceDetectorUtils::laplacianVariance(half);
+    } else {
+        variance = FaceDetectorUtils::laplacianVariance(roi);
+    }
+
+    return static_cast<float>(AdvancedDetectorConstants::BLUR_REFERENCE_VARIANCE /
+                              (variance + AdvancedDetectorConstants::BLUR_REFERENCE_VARIANCE));
+}
+
+// Resident set size of this process in MB, 0 if unknown
+static double residentMemoryMb() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+    return static_cast<double>(resident_pages) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
 std::vector<BenchmarkResult> benchmarkAlgorithms(
     const std::vector<cv::Mat>& test_images,
     const std::vector<DetectionAlgorithm>& algorithms) {
+    return benchmarkAlgorithms(test_images, algorithms, AdvancedDetectorConfig());
+}
+
+std::vector<BenchmarkResult> benchmarkAlgorithms(
+    const std::vector<cv::Mat>& test_images,
+    const std::vector<DetectionAlgorithm>& algorithms,
+    const AdvancedDetectorConfig& base_config) {
 
     std::vector<BenchmarkResult> results;
 
@@ -511,8 +1305,11 @@ std::vector<BenchmarkResult> benchmarkAlgorithms(
         result.algorithm = algorithm;
         result.total_detections = 0;
 
+        AdvancedDetectorConfig config = base_config;
+        config.algorithm = algorithm;
+
         AdvancedFaceDetector detector;
-        if (!detector.initialize(algorithm)) {
+        if (!detector.initialize(config)) {
             continue; // Skip if initialization fails
         }
 
@@ -531,7 +1328,10 @@ std::vector<BenchmarkResult> benchmarkAlgorithms(
 
         result.avg_inference_time_ms = static_cast<double>(total_time) / test_images.size();
         result.avg_fps = 1000.0 / result.avg_inference_time_ms;
-        result.memory_usage_mb = 0; // Would need platform-specific implementation
+        MemoryBackingStats backing_stats = MemoryBackingUtils::getStats();
+        result.memory_usage_mb = residentMemoryMb();
+        result.huge_page_mb = backing_stats.huge_page_bytes / (1024.0 * 1024.0);
+        result.locked_mb = backing_stats.locked_bytes / (1024.0 * 1024.0);
         result.accuracy_score = 0; // Would need ground truth data
 
         results.push_back(result);
@@ -589,6 +1389,98 @@ AlgorithmProfile findBestAlgorithm(const std::vector<AlgorithmProfile>& profiles
     return best;
 }
 
+std::vector<cv::Rect> computeTiles(const cv::Size& frame_size, const cv::Size& tile_size,
+                                   float overlap, int max_tiles) {
+    std::vector<cv::Rect> tiles;
+
+    if (frame_size.empty() || tile_size.empty()) {
+        return tiles;
+    }
+
+    overlap = std::min(std::max(overlap, 0.0f), 0.9f);
+    max_tiles = std::max(max_tiles, 1);
+
+    // Tiles needed along one axis for neighbours to overlap by at least
+    // overlap of the tile
+    auto countAlong = [overlap](int frame, int tile) {
+        if (tile >= frame) {
+            return 1;
+        }
+        int stride = std::max(static_cast<int>(tile * (1.0f - overlap)), 1);
+        return 1 + (frame - tile + stride - 1) / stride;
+    };
+
+    // Grow the tile, keeping its shape, until the grid fits in max_tiles;
+    // a tile the size of the frame always does
+    cv::Size tile;
+    int columns;
+    int rows;
+    for (double grow = 1.0; ; grow *= 1.1) {
+        tile.width = std::min(static_cast<int>(std::lround(tile_size.width * grow)), frame_size.width);
+        tile.height = std::min(static_cast<int>(std::lround(tile_size.height * grow)), frame_size.height);
+        columns = countAlong(frame_size.width, tile.width);
+        rows = countAlong(frame_size.height, tile.height);
+
+        if (columns * rows <= max_tiles) {
+            break;
+        }
+    }
+
+    // Spread evenly, the outer tiles on the frame edges
+    for (int row = 0; row < rows; ++row) {
+        int y = rows > 1 ? row * (frame_size.height - tile.height) / (rows - 1) : 0;
+        for (int column = 0; column < columns; ++column) {
+            int x = columns > 1 ? column * (frame_size.width - tile.width) / (columns - 1) : 0;
+            tiles.push_back(cv::Rect(x, y, tile.width, tile.height));
+        }
+    }
+
+    return tiles;
+}
+
+void suppressOverlaps(std::vector<AdvancedFaceDetection>& detections, float iou_threshold) {
+    if (detections.size() < 2) {
+        return;
+    }
+
+    std::stable_sort(detections.begin(), detections.end(),
+        [](const AdvancedFaceDetection& a, const AdvancedFaceDetection& b) {
+            return a.confidence > b.confidence;
+        });
+
+    std::vector<bool> keep(detections.size(), true);
+    std::vector<int32_t> boxes;
+    std::vector<float> ious(detections.size());
+
+    boxes.reserve(detections.size() * 4);
+    for (const auto& detection : detections) {
+        const cv::Rect& bbox = detection.bbox;
+        boxes.insert(boxes.end(), {bbox.x, bbox.y, bbox.width, bbox.height});
+    }
+
+    for (size_t i = 0; i < detections.size(); ++i) {
+        if (!keep[i]) continue;
+
+        // IoU against every lower-confidence detection in one batch
+        size_t rest = detections.size() - i - 1;
+        SimdKernels::intersectionOverUnion(&boxes[4 * i], boxes.data() + 4 * (i + 1), rest, ious.data());
+
+        for (size_t j = i + 1; j < detections.size(); ++j) {
+            if (keep[j] && ious[j - i - 1] > iou_threshold) {
+                keep[j] = false;
+            }
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < detections.size(); ++i) {
+        if (keep[i]) {
+            detections[kept++] = detections[i];
+        }
+    }
+    detections.resize(kept);
+}
+
 bool convertModel(const std::string& source_path, const std::string& target_path,
                  const std::string& source_format, const std::string& target_format) {
     // Model conversion would require specific libraries like ONNX, TensorRT, etc.
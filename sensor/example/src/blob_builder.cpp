@@ -0,0 +1,223 @@
+/*
+ * Blob Builder Implementation
+ *
+ * This file implements the single-pass resize, normalize and HWC to CHW
+ * blob builder.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include "blob_builder.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Partial source pixels below this fraction are ignored by area sampling
+const double AREA_EPSILON = 1e-3;
+
+inline int8_t quantize(float value, float inv_scale, int zero_point) {
+    long q = std::lrint(value * inv_scale) + zero_point;
+    return static_cast<int8_t>(std::min(std::max(q, -128L), 127L));
+}
+
+} // namespace
+
+BlobBuilder::BlobBuilder(const BlobConfig& config) {
+    setConfig(config);
+}
+
+void BlobBuilder::setConfig(const BlobConfig& config) {
+    bool layout_changed = config.width != config_.width ||
+                          config.height != config_.height ||
+                          config.sampling != config_.sampling;
+
+    config_ = config;
+
+    if (layout_changed) {
+        // Rebuilt on the next build()
+        columns_.source_size = 0;
+        rows_.source_size = 0;
+    }
+}
+
+size_t BlobBuilder::blobElements() const {
+    return 3 * static_cast<size_t>(config_.width) * config_.height;
+}
+
+size_t BlobBuilder::blobBytes() const {
+    return blobElements() * (config_.format == BlobFormat::INT8 ? sizeof(int8_t) : sizeof(float));
+}
+
+void BlobBuilder::buildAxis(Axis& axis, int source_size, int size, BlobSampling sampling) {
+    double scale = static_cast<double>(source_size) / size;
+
+    axis.source_size = source_size;
+    axis.offsets.clear();
+    axis.taps.clear();
+
+    for (int i = 0; i < size; ++i) {
+        axis.offsets.push_back(static_cast<int32_t>(axis.taps.size()));
+
+        if (sampling == BlobSampling::AREA && scale > 1.0) {
+            // Every source pixel the output pixel covers, edges by coverage
+            double begin = i * scale;
+            double end = begin + scale;
+            int first = static_cast<int>(std::ceil(begin));
+            int last = std::min(static_cast<int>(std::floor(end)), source_size);
+
+            if (first - begin > AREA_EPSILON) {
+                axis.taps.push_back({first - 1, static_cast<float>((first - begin) / scale)});
+            }
+            for (int s = first; s < last; ++s) {
+                axis.taps.push_back({s, static_cast<float>(1.0 / scale)});
+            }
+            if (end - last > AREA_EPSILON && last < source_size) {
+                axis.taps.push_back({last, static_cast<float>(std::min(end - last, 1.0) / scale)});
+            }
+        } else {
+            // Pixel centers aligned, clamped at the borders
+            double position = (i + 0.5) * scale - 0.5;
+            int s = static_cast<int>(std::floor(position));
+            double weight = position - s;
+
+            if (s < 0) {
+                s = 0;
+                weight = 0.0;
+            }
+            if (s >= source_size - 1) {
+                s = source_size - 1;
+                weight = 0.0;
+            }
+
+            axis.taps.push_back({s, static_cast<float>(1.0 - weight)});
+            if (weight > 0.0) {
+                axis.taps.push_back({s + 1, static_cast<float>(weight)});
+            }
+        }
+    }
+
+    axis.offsets.push_back(static_cast<int32_t>(axis.taps.size()));
+}
+
+const float* BlobBuilder::resampledRow(const uint8_t* src, size_t src_step, int channels, int y) {
+    for (int slot = 0; slot < 2; ++slot) {
+        if (resampled_row_[slot] == y) {
+            return resampled_[slot].data();
+        }
+    }
+
+    int slot = resampled_next_;
+    resampled_next_ ^= 1;
+    resampled_row_[slot] = y;
+
+    const uint8_t* row = src + y * src_step;
+    float* out = resampled_[slot].data();
+    const Tap* taps = columns_.taps.data();
+    const int32_t* offsets = columns_.offsets.data();
+
+    if (channels == 3) {
+        for (int x = 0; x < config_.width; ++x) {
+            float b = 0.0f;
+            float g = 0.0f;
+            float r = 0.0f;
+
+            for (int t = offsets[x]; t < offsets[x + 1]; ++t) {
+                const uint8_t* pixel = row + 3 * taps[t].index;
+                b += taps[t].weight * pixel[0];
+                g += taps[t].weight * pixel[1];
+                r += taps[t].weight * pixel[2];
+            }
+
+            out[3 * x] = b;
+            out[3 * x + 1] = g;
+            out[3 * x + 2] = r;
+        }
+    } else {
+        for (int x = 0; x < config_.width; ++x) {
+            float v = 0.0f;
+            for (int t = offsets[x]; t < offsets[x + 1]; ++t) {
+                v += taps[t].weight * row[taps[t].index];
+            }
+            out[x] = v;
+        }
+    }
+
+    return out;
+}
+
+void BlobBuilder::build(const uint8_t* src, size_t src_step, int src_width, int src_height,
+                        int channels, void* dst) {
+    const int width = config_.width;
+    const int height = config_.height;
+    const size_t plane = static_cast<size_t>(width) * height;
+    const size_t row_values = static_cast<size_t>(width) * channels;
+
+    if (columns_.source_size != src_width) {
+        buildAxis(columns_, src_width, width, config_.sampling);
+    }
+    if (rows_.source_size != src_height) {
+        buildAxis(rows_, src_height, height, config_.sampling);
+    }
+
+    // A new frame, nothing cached is valid
+    resampled_row_[0] = resampled_row_[1] = -1;
+    for (auto& row : resampled_) {
+        row.resize(row_values);
+    }
+    accumulator_.resize(row_values);
+
+    // Blob channel c reads source channel source_channel[c] and stores
+    // value * scale + offset[c]
+    int source_channel[3];
+    float offset[3];
+    for (int c = 0; c < 3; ++c) {
+        source_channel[c] = channels == 1 ? 0 : (config_.swap_rb ? 2 - c : c);
+        offset[c] = -config_.mean[c] * config_.scale;
+    }
+    const float scale = config_.scale;
+    const float inv_quant_scale = 1.0f / config_.quant_scale;
+
+    for (int y = 0; y < height; ++y) {
+        int first = rows_.offsets[y];
+        int last = rows_.offsets[y + 1];
+        const float* values;
+
+        // Blend the source rows; a lone full-weight row is used as is
+        if (last - first == 1 && rows_.taps[first].weight == 1.0f) {
+            values = resampledRow(src, src_step, channels, rows_.taps[first].index);
+        } else {
+            float* acc = accumulator_.data();
+            std::fill(acc, acc + row_values, 0.0f);
+
+            for (int t = first; t < last; ++t) {
+                const float* row = resampledRow(src, src_step, channels, rows_.taps[t].index);
+                float weight = rows_.taps[t].weight;
+                for (size_t i = 0; i < row_values; ++i) {
+                    acc[i] += weight * row[i];
+                }
+            }
+            values = acc;
+        }
+
+        // Scatter the interleaved row into the three planes
+        for (int c = 0; c < 3; ++c) {
+            const float* in = values + source_channel[c];
+            size_t base = c * plane + static_cast<size_t>(y) * width;
+
+            if (config_.format == BlobFormat::INT8) {
+                int8_t* out = static_cast<int8_t*>(dst) + base;
+                for (int x = 0; x < width; ++x) {
+                    out[x] = quantize(in[x * channels] * scale + offset[c], inv_quant_scale,
+                                      config_.quant_zero_point);
+                }
+            } else {
+                float* out = static_cast<float*>(dst) + base;
+                for (int x = 0; x < width; ++x) {
+                    out[x] = in[x * channels] * scale + offset[c];
+                }
+            }
+        }
+    }
+}
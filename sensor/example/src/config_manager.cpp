@@ -220,6 +220,7 @@ bool ConfigManager::loadConfig(const std::string& filename, FaceDetectionConfig&
     config.min_neighbors = getInt("detection.min_neighbors", config.min_neighbors);
     config.min_size = getInt("detection.min_size", config.min_size);
     config.max_size = getInt("detection.max_size", config.max_size);
+    config.low_light_threshold = getInt("detection.low_light_threshold", config.low_light_threshold);
     
     // Load display settings
     config.show_fps = getBool("display.show_fps", config.show_fps);
@@ -258,6 +259,7 @@ bool ConfigManager::saveConfig(const std::string& filename, const FaceDetectionC
     setInt("detection.min_neighbors", config.min_neighbors);
     setInt("detection.min_size", config.min_size);
     setInt("detection.max_size", config.max_size);
+    setInt("detection.low_light_threshold", config.low_light_threshold);
     
     // Save display settings
     setBool("display.show_fps", config.show_fps);
@@ -329,6 +331,7 @@ void ConfigManager::loadDefaults() {
     setInt("detection.min_neighbors", default_config.min_neighbors);
     setInt("detection.min_size", default_config.min_size);
     setInt("detection.max_size", default_config.max_size);
+    setInt("detection.low_light_threshold", default_config.low_light_threshold);
     
     // Display defaults
     setBool("display.show_fps", default_config.show_fps);
@@ -12,6 +12,8 @@
 #include "face_detector.h"
 #include "performance_monitor.h"
 #include "config_manager.h"
+#include "task_scheduler.h"
+#include "simd_kernels.h"
 
 #include <iostream>
 #include <chrono>
@@ -96,12 +98,12 @@ void FaceDetectionDemo::cleanup() {
     // Stop processing
     stop();
     
-    // Wait for threads to finish
+    // Wait for the capture thread and queued processing to finish
     if (capture_thread_.joinable()) {
         capture_thread_.join();
     }
-    if (process_thread_.joinable()) {
-        process_thread_.join();
+    if (process_tasks_) {
+        process_tasks_->wait();
     }
     
     // Cleanup components
@@ -139,8 +141,8 @@ int FaceDetectionDemo::run() {
         
         // Start threads
         if (config_.enable_multithreading) {
+            process_tasks_ = std::make_unique<TaskGroup>();
             capture_thread_ = std::thread(&FaceDetectionDemo::captureLoop, this);
-            process_thread_ = std::thread(&FaceDetectionDemo::processLoop, this);
 
             // Main thread handles display
             while (running_) {
@@ -182,9 +184,9 @@ int FaceDetectionDemo::run() {
                 }
             }
 
-            // Wait for threads to finish
+            // Wait for capture and processing to finish
             if (capture_thread_.joinable()) capture_thread_.join();
-            if (process_thread_.joinable()) process_thread_.join();
+            process_tasks_->wait();
 
             // Clean up OpenCV windows
             cv::destroyAllWindows();
@@ -220,7 +222,6 @@ void FaceDetectionDemo::stop() {
     running_ = false;
     
     // Notify all waiting threads
-    frame_cv_.notify_all();
     result_cv_.notify_all();
     
     if (camera_) {
@@ -381,6 +382,7 @@ bool FaceDetectionDemo::initializeFaceDetector() {
     det_config.min_neighbors = config_.min_neighbors;
     det_config.min_size = config_.min_size;
     det_config.max_size = config_.max_size;
+    det_config.low_light_threshold = config_.low_light_threshold;
     
     if (!detector_->initialize(det_config)) {
         std::cerr << "Face detector initialization failed: " << detector_->getLastError() << std::endl;
@@ -425,6 +427,9 @@ void FaceDetectionDemo::captureLoop() {
         std::cout << "Capture thread started" << std::endl;
     }
 
+    // OpenCV work started from here runs ahead of detection on the shared pool
+    TaskPriorityScope capture_priority(TaskPriority::CAPTURE);
+
     int frame_count = 0;
     int failed_count = 0;
 
@@ -437,6 +442,7 @@ void FaceDetectionDemo::captureLoop() {
             }
 
             // Add frame to processing queue
+            bool schedule = false;
             {
                 std::unique_lock<std::mutex> lock(frame_mutex_);
 
@@ -448,10 +454,18 @@ void FaceDetectionDemo::captureLoop() {
 
                 if (running_) {
                     frame_queue_.push(frame.image.clone());
+
+                    // Frames are processed one task at a time, in order
+                    if (!processing_scheduled_) {
+                        processing_scheduled_ = true;
+                        schedule = true;
+                    }
                 }
             }
 
-            frame_cv_.notify_one();
+            if (schedule) {
+                process_tasks_->run([this] { processNextFrame(); }, TaskPriority::NORMAL);
+            }
         } else {
             failed_count++;
             if (failed_count % 100 == 0) { // Log every 100 failures
@@ -466,43 +480,37 @@ void FaceDetectionDemo::captureLoop() {
     }
 }
 
-void FaceDetectionDemo::processLoop() {
-    if (config_.verbose) {
-        std::cout << "Process thread started" << std::endl;
-    }
-    
-    while (running_) {
-        cv::Mat frame;
-        
-        // Get frame from queue
-        {
-            std::unique_lock<std::mutex> lock(frame_mutex_);
-            frame_cv_.wait(lock, [this] { return !frame_queue_.empty() || !running_; });
-            
-            if (!running_) break;
-            
-            if (!frame_queue_.empty()) {
-                frame = frame_queue_.front();
-                frame_queue_.pop();
-            }
-        }
-        
-        if (!frame.empty()) {
-            static int process_count = 0;
-            process_count++;
-            if (process_count % 30 == 0) {
-                std::cout << "Processing frame " << process_count << std::endl;
-            }
-            processFrame(frame);
+void FaceDetectionDemo::processNextFrame() {
+    cv::Mat frame;
+
+    {
+        std::unique_lock<std::mutex> lock(frame_mutex_);
+        if (!running_ || frame_queue_.empty()) {
+            processing_scheduled_ = false;
+            return;
         }
+
+        frame = frame_queue_.front();
+        frame_queue_.pop();
     }
-    
-    if (config_.verbose) {
-        std::cout << "Process thread stopped" << std::endl;
-    }
-}
 
+    static int process_count = 0;
+    process_count++;
+    if (process_count % 30 == 0) {
+        std::cout << "Processing frame " << process_count << std::endl;
+    }
+    processFrame(frame);
 
+    // One frame per task, so capture tasks can run in between
+    {
+        std::unique_lock<std::mutex> lock(frame_mutex_);
+        if (!running_ || frame_queue_.empty()) {
+            processing_scheduled_ = false;
+            return;
+        }
+    }
+    process_tasks_->run([this] { processNextFrame(); }, TaskPriority::NORMAL);
+}
 
 void FaceDetectionDemo::processFrame(const cv::Mat& frame) {
     auto start_time = std::chrono::high_resolution_clock::now();
@@ -779,15 +787,24 @@ void filterOverlappingDetections(std::vector<FaceDetectionResult>& detections, d
         });
 
     std::vector<bool> keep(detections.size(), true);
+    std::vector<int32_t> boxes;
+    std::vector<float> ious(detections.size());
+
+    boxes.reserve(detections.size() * 4);
+    for (const auto& detection : detections) {
+        const cv::Rect& bbox = detection.bbox;
+        boxes.insert(boxes.end(), {bbox.x, bbox.y, bbox.width, bbox.height});
+    }
 
     for (size_t i = 0; i < detections.size(); ++i) {
         if (!keep[i]) continue;
 
-        for (size_t j = i + 1; j < detections.size(); ++j) {
-            if (!keep[j]) continue;
+        // IoU against every lower-confidence detection in one batch
+        size_t rest = detections.size() - i - 1;
+        SimdKernels::intersectionOverUnion(&boxes[4 * i], boxes.data() + 4 * (i + 1), rest, ious.data());
 
-            double iou = calculateIoU(detections[i].bbox, detections[j].bbox);
-            if (iou > iou_threshold) {
+        for (size_t j = i + 1; j < detections.size(); ++j) {
+            if (keep[j] && ious[j - i - 1] > iou_threshold) {
                 keep[j] = false; // Remove the one with lower confidence
             }
         }
@@ -8,6 +8,7 @@
  */
 
 #include "face_detector.h"
+#include "simd_kernels.h"
 #include <iostream>
 #include <chrono>
 #include <algorithm>
@@ -73,7 +74,13 @@ std::vector<FaceDetection> FaceDetector::detectFaces(const cv::Mat& image) {
     return faces;
 }
 
+bool FaceDetector::detectFaces(const cv::Mat& image, FaceDetectionBuffer& faces) {
+    return detectFaces(image, faces.items());
+}
+
 bool FaceDetector::detectFaces(const cv::Mat& image, std::vector<FaceDetection>& faces) {
+    faces.clear();
+    
     if (!initialized_) {
         setError("Detector not initialized");
         return false;
@@ -90,13 +97,13 @@ bool FaceDetector::detectFaces(const cv::Mat& image, std::vector<FaceDetection>&
     
     switch (config_.method) {
     case FaceDetectorConfig::HAAR_CASCADE:
-        faces = detectWithHaarCascade(image);
+        detectWithHaarCascade(image, faces);
         break;
         
     case FaceDetectorConfig::DNN_CAFFE:
     case FaceDetectorConfig::DNN_TENSORFLOW:
     case FaceDetectorConfig::DNN_ONNX:
-        faces = detectWithDNN(image);
+        detectWithDNN(image, faces);
         break;
         
     default:
@@ -141,23 +148,18 @@ bool FaceDetector::loadDNNModel(const std::string& model_path, const std::string
 
 cv::Mat FaceDetector::preprocessImage(const cv::Mat& image) const {
     cv::Mat processed;
-    
-    // Convert to grayscale for Haar cascade
+    preprocessImage(image, processed);
+    return processed;
+}
+
+void FaceDetector::preprocessImage(const cv::Mat& image, cv::Mat& processed) const {
+    // Grayscale and histogram equalization for Haar cascade, fused
     if (config_.method == FaceDetectorConfig::HAAR_CASCADE) {
-        if (image.channels() == 3) {
-            cv::cvtColor(image, processed, cv::COLOR_BGR2GRAY);
-        } else {
-            processed = image.clone();
-        }
-        
-        // Histogram equalization for better detection
-        cv::equalizeHist(processed, processed);
+        FaceDetectorUtils::equalizeGray(image, processed, config_.low_light_threshold);
     } else {
         // For DNN methods, keep original format
-        processed = image.clone();
+        image.copyTo(processed);
     }
-    
-    return processed;
 }
 
 void FaceDetector::drawDetections(cv::Mat& image, const std::vector<FaceDetection>& faces) const {
@@ -231,20 +233,18 @@ FaceDetectorConfig FaceDetector::getDefaultConfig(FaceDetectorConfig::Method met
     return config;
 }
 
-std::vector<FaceDetection> FaceDetector::detectWithHaarCascade(const cv::Mat& image) {
-    std::vector<FaceDetection> faces;
-    
+void FaceDetector::detectWithHaarCascade(const cv::Mat& image, std::vector<FaceDetection>& faces) {
     if (!haar_cascade_ || haar_cascade_->empty()) {
         setError("Haar cascade not loaded");
-        return faces;
+        return;
     }
     
-    cv::Mat gray = preprocessImage(image);
-    std::vector<cv::Rect> face_rects;
+    // Same as preprocessImage(), into a reused buffer
+    FaceDetectorUtils::equalizeGray(image, gray_, config_.low_light_threshold);
     
     haar_cascade_->detectMultiScale(
-        gray,
-        face_rects,
+        gray_,
+        face_rects_,
         config_.scale_factor,
         config_.min_neighbors,
         0,
@@ -253,33 +253,29 @@ std::vector<FaceDetection> FaceDetector::detectWithHaarCascade(const cv::Mat& im
     );
     
     // Convert to FaceDetection format
-    for (const auto& rect : face_rects) {
+    for (const auto& rect : face_rects_) {
         FaceDetection detection;
         detection.bbox = rect;
         detection.confidence = 1.0f; // Haar cascade doesn't provide confidence
         detection.center = cv::Point2f(rect.x + rect.width/2.0f, rect.y + rect.height/2.0f);
-        detection.method = "Haar Cascade";
+        detection.method = DetectionMethod::HAAR_CASCADE;
         faces.push_back(detection);
     }
-    
-    return faces;
 }
 
-std::vector<FaceDetection> FaceDetector::detectWithDNN(const cv::Mat& image) {
-    std::vector<FaceDetection> faces;
-    
+void FaceDetector::detectWithDNN(const cv::Mat& image, std::vector<FaceDetection>& faces) {
     if (!dnn_net_) {
         setError("DNN model not loaded");
-        return faces;
+        return;
     }
     
-    // Create blob from image
-    cv::Mat blob;
-    cv::dnn::blobFromImage(image, blob, config_.scale, config_.input_size, 
-                          config_.mean, config_.swap_rb, false);
+    // Resize, normalize and transpose in one pass, into the reused blob_
+    blob_builder_.setConfig(FaceDetectorUtils::makeBlobConfig(
+        config_.input_size, config_.scale, config_.mean, config_.swap_rb, config_.input_sampling));
+    FaceDetectorUtils::buildBlob(blob_builder_, image, blob_);
     
     // Set input to the network
-    dnn_net_->setInput(blob);
+    dnn_net_->setInput(blob_);
     
     // Run forward pass
     cv::Mat detection = dnn_net_->forward();
@@ -304,41 +300,38 @@ std::vector<FaceDetection> FaceDetector::detectWithDNN(const cv::Mat& image) {
                 detection.bbox = bbox;
                 detection.confidence = confidence;
                 detection.center = cv::Point2f(bbox.x + bbox.width/2.0f, bbox.y + bbox.height/2.0f);
-                detection.method = "DNN";
+                detection.method = DetectionMethod::DNN;
                 faces.push_back(detection);
             }
         }
     }
-    
-    return faces;
 }
 
-void FaceDetector::applyNonMaximumSuppression(std::vector<FaceDetection>& faces) const {
+void FaceDetector::applyNonMaximumSuppression(std::vector<FaceDetection>& faces) {
     if (faces.size() <= 1) {
         return;
     }
     
     // Convert to OpenCV format for NMS
-    std::vector<cv::Rect> boxes;
-    std::vector<float> scores;
+    nms_boxes_.clear();
+    nms_scores_.clear();
     
     for (const auto& face : faces) {
-        boxes.push_back(face.bbox);
-        scores.push_back(face.confidence);
+        nms_boxes_.push_back(face.bbox);
+        nms_scores_.push_back(face.confidence);
     }
     
     // Apply NMS
-    std::vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, scores, config_.confidence_threshold, 
-                     config_.nms_threshold, indices);
+    cv::dnn::NMSBoxes(nms_boxes_, nms_scores_, config_.confidence_threshold, 
+                     config_.nms_threshold, nms_indices_);
     
     // Keep only selected detections
-    std::vector<FaceDetection> filtered_faces;
-    for (int idx : indices) {
-        filtered_faces.push_back(faces[idx]);
+    nms_keep_.clear();
+    for (int idx : nms_indices_) {
+        nms_keep_.push_back(faces[idx]);
     }
     
-    faces = filtered_faces;
+    faces.assign(nms_keep_.begin(), nms_keep_.end());
 }
 
 void FaceDetector::filterDetectionsBySize(std::vector<FaceDetection>& faces) const {
@@ -454,6 +447,20 @@ bool FaceDetector::validateImage(const cv::Mat& image) const {
     return !image.empty() && image.cols > 0 && image.rows > 0;
 }
 
+const char* detectionMethodToString(DetectionMethod method) {
+    switch (method) {
+    case DetectionMethod::HAAR_CASCADE: return "Haar Cascade";
+    case DetectionMethod::DNN:          return "DNN";
+    case DetectionMethod::YOLO:         return "YOLO";
+    case DetectionMethod::SSD:          return "SSD";
+    case DetectionMethod::RETINANET:    return "RetinaNet";
+    case DetectionMethod::MTCNN:        return "MTCNN";
+    case DetectionMethod::LFFD:         return "LFFD";
+    case DetectionMethod::SCRFD:        return "SCRFD";
+    default:                            return "Unknown";
+    }
+}
+
 // FaceDetectorUtils namespace implementation
 namespace FaceDetectorUtils {
 
@@ -511,16 +518,20 @@ std::vector<FaceDetection> mergeDetections(const std::vector<FaceDetection>& det
                                           const std::vector<FaceDetection>& detections2,
                                           double iou_threshold) {
     std::vector<FaceDetection> merged = detections1;
+    std::vector<int32_t> boxes;
+    std::vector<float> ious(detections1.size());
+
+    boxes.reserve(detections1.size() * 4);
+    for (const auto& det1 : detections1) {
+        boxes.insert(boxes.end(), {det1.bbox.x, det1.bbox.y, det1.bbox.width, det1.bbox.height});
+    }
 
     for (const auto& det2 : detections2) {
-        bool should_add = true;
+        const int32_t box[4] = {det2.bbox.x, det2.bbox.y, det2.bbox.width, det2.bbox.height};
+        SimdKernels::intersectionOverUnion(box, boxes.data(), detections1.size(), ious.data());
 
-        for (const auto& det1 : detections1) {
-            if (calculateIoU(det1.bbox, det2.bbox) > iou_threshold) {
-                should_add = false;
-                break;
-            }
-        }
+        bool should_add = std::none_of(ious.begin(), ious.end(),
+            [iou_threshold](float iou) { return iou > iou_threshold; });
 
         if (should_add) {
             merged.push_back(det2);
@@ -530,6 +541,91 @@ std::vector<FaceDetection> mergeDetections(const std::vector<FaceDetection>& det
     return merged;
 }
 
+void convertToGray(const cv::Mat& image, cv::Mat& gray) {
+    if (image.type() != CV_8UC3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        return;
+    }
+
+    gray.create(image.size(), CV_8UC1);
+
+    if (image.isContinuous() && gray.isContinuous()) {
+        SimdKernels::bgrToGray(image.ptr<uint8_t>(), gray.ptr<uint8_t>(), image.total());
+        return;
+    }
+
+    for (int y = 0; y < image.rows; ++y) {
+        SimdKernels::bgrToGray(image.ptr<uint8_t>(y), gray.ptr<uint8_t>(y), image.cols);
+    }
+}
+
+double equalizeGray(const cv::Mat& image, cv::Mat& gray, int low_light_threshold) {
+    CV_Assert(image.channels() == 1 || image.channels() == 3 || image.channels() == 4);
+
+    if (image.depth() != CV_8U) {
+        // Float images are in [0, 1], 16-bit ones use their full range
+        double alpha = image.depth() == CV_16U ? 255.0 / 65535.0 :
+                       image.depth() == CV_32F || image.depth() == CV_64F ? 255.0 : 1.0;
+        cv::Mat converted;
+        image.convertTo(converted, CV_8U, alpha);
+        return equalizeGray(converted, gray, low_light_threshold);
+    }
+
+    if (image.channels() == 4) {
+        cv::cvtColor(image, gray, cv::COLOR_BGRA2GRAY);
+        return equalizeGray(gray, gray, low_light_threshold);
+    }
+
+    gray.create(image.size(), CV_8UC1);
+    return SimdKernels::equalizeGray(image.ptr<uint8_t>(), image.step, image.channels(),
+                                     image.cols, image.rows, gray.ptr<uint8_t>(), gray.step,
+                                     low_light_threshold);
+}
+
+double laplacianVariance(const cv::Mat& gray) {
+    CV_Assert(gray.type() == CV_8UC1);
+    return SimdKernels::laplacianSums(gray.ptr<uint8_t>(), gray.step, gray.cols, gray.rows).variance();
+}
+
+void downscaleHalf(const cv::Mat& gray, cv::Mat& half) {
+    CV_Assert(gray.type() == CV_8UC1);
+    half.create(gray.rows / 2, gray.cols / 2, CV_8UC1);
+    SimdKernels::downscaleHalf(gray.ptr<uint8_t>(), gray.step, half.ptr<uint8_t>(), half.step,
+                               half.cols, half.rows);
+}
+
+BlobConfig makeBlobConfig(const cv::Size& size, double scale, const cv::Scalar& mean,
+                          bool swap_rb, BlobSampling sampling) {
+    BlobConfig config;
+    config.width = size.width;
+    config.height = size.height;
+    config.scale = static_cast<float>(scale);
+    config.swap_rb = swap_rb;
+    config.sampling = sampling;
+
+    for (int c = 0; c < 3; ++c) {
+        config.mean[c] = static_cast<float>(mean[c]);
+    }
+    return config;
+}
+
+void buildBlob(BlobBuilder& builder, const cv::Mat& image, cv::Mat& blob) {
+    if (image.type() == CV_8UC4) {
+        cv::Mat bgr;
+        cv::cvtColor(image, bgr, cv::COLOR_BGRA2BGR);
+        buildBlob(builder, bgr, blob);
+        return;
+    }
+    CV_Assert(image.type() == CV_8UC3 || image.type() == CV_8UC1);
+
+    const BlobConfig& config = builder.getConfig();
+    int sizes[] = {1, 3, config.height, config.width};
+    blob.create(4, sizes, config.format == BlobFormat::INT8 ? CV_8S : CV_32F);
+
+    builder.build(image.ptr<uint8_t>(), image.step, image.cols, image.rows, image.channels(),
+                  blob.ptr());
+}
+
 cv::Scalar getDetectionColor(size_t index) {
     const std::vector<cv::Scalar> colors = {
         FaceDetectorConstants::COLOR_GREEN,
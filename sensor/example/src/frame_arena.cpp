@@ -0,0 +1,244 @@
+/*
+ * Frame Arena Implementation
+ *
+ * This file implements the per-thread frame arena and its cv::MatAllocator.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include "frame_arena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace {
+
+// AccessFlag replaced the int access flags in OpenCV 4.2
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 2)
+using MatAccessFlag = cv::AccessFlag;
+#else
+using MatAccessFlag = int;
+#endif
+
+inline size_t alignUp(size_t size) {
+    return (size + FrameArena::ALIGNMENT - 1) & ~(FrameArena::ALIGNMENT - 1);
+}
+
+std::mutex default_backing_mutex;
+MemoryBackingConfig default_backing;
+
+// The UMatData header is placed in front of the pixels, in the same block
+const size_t HEADER_SIZE = alignUp(sizeof(cv::UMatData));
+
+class FrameArenaAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0,
+                           size_t* step, MatAccessFlag /*flags*/,
+                           cv::UMatUsageFlags /*usage_flags*/) const override {
+        size_t total = CV_ELEM_SIZE(type);
+
+        // Same layout as OpenCV's default allocator
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        FrameArena& arena = FrameArena::local();
+        uint8_t* block = static_cast<uint8_t*>(arena.allocate(HEADER_SIZE + (data0 ? 0 : total)));
+
+        cv::UMatData* u = new (block) cv::UMatData(this);
+        u->data = u->origdata = data0 ? static_cast<uint8_t*>(data0) : block + HEADER_SIZE;
+        u->size = total;
+        u->userdata = &arena;
+        if (data0) {
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, MatAccessFlag /*flags*/,
+                  cv::UMatUsageFlags /*usage_flags*/) const override {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        if (!u) {
+            return;
+        }
+
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+
+        FrameArena* arena = static_cast<FrameArena*>(u->userdata);
+        u->~UMatData();
+        arena->release();
+    }
+};
+
+} // namespace
+
+constexpr size_t FrameArena::DEFAULT_CHUNK_SIZE;
+constexpr size_t FrameArena::ALIGNMENT;
+
+FrameArena::FrameArena(size_t chunk_size)
+    : chunk_size_(alignUp(std::max<size_t>(chunk_size, ALIGNMENT))),
+      backing_(getDefaultBacking()) {
+}
+
+FrameArena::~FrameArena() {
+    // Live Mats still point into the chunks; leaking beats a use-after-free
+    if (live_.load() == 0) {
+        freeChunks();
+    }
+}
+
+FrameArena& FrameArena::local() {
+    thread_local FrameArena arena;
+    return arena;
+}
+
+cv::MatAllocator* FrameArena::matAllocator() {
+    static FrameArenaAllocator allocator;
+    return &allocator;
+}
+
+void FrameArena::setDefaultBacking(const MemoryBackingConfig& config) {
+    std::lock_guard<std::mutex> lock(default_backing_mutex);
+    default_backing = config;
+}
+
+MemoryBackingConfig FrameArena::getDefaultBacking() {
+    std::lock_guard<std::mutex> lock(default_backing_mutex);
+    return default_backing;
+}
+
+void FrameArena::setBacking(const MemoryBackingConfig& config) {
+    backing_ = config;
+    if (live_.load() == 0 && stats_.used == 0) {
+        freeChunks();
+    }
+}
+
+void* FrameArena::allocate(size_t size) {
+    size = alignUp(std::max<size_t>(size, 1));
+
+    if (chunks_.empty() || offset_ + size > chunks_.back().size) {
+        size_t next = chunks_.empty() ? chunk_size_ : chunks_.back().size * 2;
+        addChunk(std::max(next, size));
+    }
+
+    void* ptr = chunks_.back().data + offset_;
+    offset_ += size;
+
+    stats_.used += size;
+    stats_.high_water = std::max(stats_.high_water, stats_.used);
+    stats_.allocations++;
+    live_++;
+
+    return ptr;
+}
+
+void FrameArena::release() {
+    live_--;
+}
+
+bool FrameArena::reset() {
+    if (live_.load() != 0) {
+        stats_.deferred_resets++;
+        return false;
+    }
+
+    // The frame spilled into extra chunks: merge them for the next frame
+    if (chunks_.size() > 1) {
+        freeChunks();
+        addChunk(alignUp(stats_.high_water));
+    }
+
+    offset_ = 0;
+    stats_.used = 0;
+    stats_.resets++;
+    return true;
+}
+
+void FrameArena::reserve(size_t bytes) {
+    bytes = alignUp(bytes);
+    chunk_size_ = std::max(chunk_size_, bytes);
+
+    if (stats_.used == 0 && (chunks_.empty() || chunks_.back().size < bytes)) {
+        freeChunks();
+        addChunk(bytes);
+    }
+}
+
+FrameArenaStats FrameArena::getStats() const {
+    FrameArenaStats stats = stats_;
+    stats.live = live_.load();
+    return stats;
+}
+
+void FrameArena::addChunk(size_t size) {
+    Chunk chunk;
+
+    if (backing_.isDefault()) {
+        void* data = nullptr;
+        if (posix_memalign(&data, ALIGNMENT, size) != 0) {
+            throw std::bad_alloc();
+        }
+        chunk.data = static_cast<uint8_t*>(data);
+        chunk.size = size;
+    } else {
+        // Rounded up to whole pages, the extra is usable
+        if (!MemoryBackingUtils::mapRegion(size, backing_, chunk.region)) {
+            throw std::bad_alloc();
+        }
+        chunk.data = chunk.region.data;
+        chunk.size = chunk.region.size;
+
+        if (chunk.region.backing != MemoryBacking::DEFAULT) {
+            stats_.huge_page_bytes += chunk.size;
+        }
+        if (chunk.region.locked) {
+            stats_.locked_bytes += chunk.size;
+        }
+    }
+
+    chunks_.push_back(chunk);
+    offset_ = 0;
+    stats_.capacity += chunk.size;
+    stats_.chunk_allocations++;
+}
+
+void FrameArena::freeChunks() {
+    for (auto& chunk : chunks_) {
+        if (chunk.region.data) {
+            MemoryBackingUtils::unmapRegion(chunk.region);
+        } else {
+            free(chunk.data);
+        }
+    }
+    chunks_.clear();
+    offset_ = 0;
+    stats_.capacity = 0;
+    stats_.huge_page_bytes = 0;
+    stats_.locked_bytes = 0;
+}
+
+FrameArenaScope::FrameArenaScope() : arena_(FrameArena::local()) {
+    arena_.scope_depth_++;
+}
+
+FrameArenaScope::~FrameArenaScope() {
+    if (--arena_.scope_depth_ == 0) {
+        arena_.reset();
+    }
+}
@@ -9,6 +9,7 @@
  */
 
 #include "face_detection_demo.h"
+#include "task_scheduler.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -50,6 +51,7 @@ void printUsage(const std::string& program_name) {
     std::cout << "  -n, --neighbors NUM     Min neighbors for detection (default: 3)" << std::endl;
     std::cout << "  -m, --min-size SIZE     Minimum face size (default: 30)" << std::endl;
     std::cout << "  -M, --max-size SIZE     Maximum face size (default: 300)" << std::endl;
+    std::cout << "  --low-light LUMA        Use CLAHE below this mean luma (default: 0, off)" << std::endl;
     std::cout << "  --no-fps                Don't show FPS counter" << std::endl;
     std::cout << "  --no-info               Don't show detection info" << std::endl;
     std::cout << "  --save-video FILE       Save video to file" << std::endl;
@@ -123,6 +125,9 @@ FaceDetectionConfig parseArguments(int argc, char* argv[]) {
         else if ((arg == "-M" || arg == "--max-size") && i + 1 < argc) {
             config.max_size = std::stoi(argv[++i]);
         }
+        else if (arg == "--low-light" && i + 1 < argc) {
+            config.low_light_threshold = std::stoi(argv[++i]);
+        }
         else if (arg == "--no-fps") {
             config.show_fps = false;
         }
@@ -203,6 +208,11 @@ bool validateConfig(const FaceDetectionConfig& config) {
         return false;
     }
     
+    if (config.low_light_threshold < 0 || config.low_light_threshold > 255) {
+        std::cerr << "Error: Invalid low light threshold " << config.low_light_threshold << std::endl;
+        return false;
+    }
+    
     return true;
 }
 
@@ -218,6 +228,9 @@ void printConfigSummary(const FaceDetectionConfig& config) {
     std::cout << "  Scale Factor: " << config.scale_factor << std::endl;
     std::cout << "  Min Neighbors: " << config.min_neighbors << std::endl;
     std::cout << "  Face Size Range: " << config.min_size << "-" << config.max_size << std::endl;
+    if (config.low_light_threshold > 0) {
+        std::cout << "  Low Light CLAHE: below " << config.low_light_threshold << std::endl;
+    }
     std::cout << "  Show FPS: " << (config.show_fps ? "Yes" : "No") << std::endl;
     std::cout << "  Show Info: " << (config.show_detection_info ? "Yes" : "No") << std::endl;
     if (config.save_video) {
@@ -281,6 +294,11 @@ int main(int argc, char* argv[]) {
             std::cout << FaceDetectionUtils::getSystemInfo() << std::endl;
         }
         
+        // One thread pool for OpenCV and the pipeline
+        if (!TaskScheduler::instance().installOpenCVBackend() && config.verbose) {
+            std::cout << "OpenCV parallel backend not replaceable, OpenCV keeps its own threads" << std::endl;
+        }
+        
         // Create and initialize application
         g_app = std::make_unique<FaceDetectionDemo>(config);
         
@@ -0,0 +1,371 @@
+/*
+ * Memory Backing Implementation
+ *
+ * This file implements huge page and locked mappings and the pooled Mat
+ * allocator used while loading models.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include "memory_backing.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <new>
+
+namespace {
+
+// AccessFlag replaced the int access flags in OpenCV 4.2
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 2)
+using MatAccessFlag = cv::AccessFlag;
+#else
+using MatAccessFlag = int;
+#endif
+
+const size_t DEFAULT_HUGE_PAGE_SIZE = 2 << 20;
+
+// Smaller Mats (layer parameters, parser temporaries) stay on the heap
+const size_t MIN_POOLED_SIZE = 64 << 10;
+const size_t POOL_ALIGNMENT = 64;
+
+// Pool size, so mid-sized weights share huge pages; not grown since
+// locking faults in the whole pool
+const size_t MIN_POOL_SIZE = 4 << 20;
+
+std::atomic<size_t> mapped_bytes{0};
+std::atomic<size_t> huge_page_bytes{0};
+std::atomic<size_t> hugetlbfs_bytes{0};
+std::atomic<size_t> locked_bytes{0};
+std::atomic<uint64_t> fallbacks{0};
+std::atomic<uint64_t> lock_failures{0};
+std::once_flag lock_warning;
+
+inline size_t roundUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+uint8_t* mapAnonymous(size_t size, int extra_flags) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : static_cast<uint8_t*>(ptr);
+}
+
+// Huge page aligned mapping advised for THP; nullptr if THP is unavailable
+uint8_t* mapTransparentHugePages(size_t size, size_t huge_page) {
+#ifdef MADV_HUGEPAGE
+    // Over-map so an aligned window can be cut out, then trim both ends
+    uint8_t* raw = mapAnonymous(size + huge_page, 0);
+    if (!raw) {
+        return nullptr;
+    }
+
+    uint8_t* data = reinterpret_cast<uint8_t*>(
+        roundUp(reinterpret_cast<uintptr_t>(raw), huge_page));
+    size_t head = data - raw;
+    size_t tail = huge_page - head;
+
+    if (head) {
+        munmap(raw, head);
+    }
+    if (tail) {
+        munmap(data + size, tail);
+    }
+
+    if (madvise(data, size, MADV_HUGEPAGE) != 0) {
+        munmap(data, size);
+        return nullptr;
+    }
+    return data;
+#else
+    (void)size;
+    (void)huge_page;
+    return nullptr;
+#endif
+}
+
+// Pooled allocator over backed regions. Allocations bump through the
+// newest region; a region is returned once all its Mats are gone. Weights
+// live as long as the model, so holes are not reused.
+class BackedPoolAllocator : public cv::MatAllocator {
+public:
+    explicit BackedPoolAllocator(const MemoryBackingConfig& config) : config_(config) {
+    }
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0,
+                           size_t* step, MatAccessFlag flags,
+                           cv::UMatUsageFlags usage_flags) const override {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            total *= sizes[i];
+        }
+
+        if (data0 || total < MIN_POOLED_SIZE) {
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data0,
+                                                        step, flags, usage_flags);
+        }
+
+        // Same layout as OpenCV's default allocator
+        total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                step[i] = total;
+            }
+            total *= sizes[i];
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        size_t size = roundUp(total, POOL_ALIGNMENT);
+        if (pools_.empty() || pools_.back().offset + size > pools_.back().region.size) {
+            Pool pool;
+            if (!MemoryBackingUtils::mapRegion(std::max(size, MIN_POOL_SIZE), config_, pool.region)) {
+                CV_Error(cv::Error::StsNoMem, "Failed to map backed memory");
+            }
+            pools_.push_back(pool);
+        }
+
+        Pool& pool = pools_.back();
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = pool.region.data + pool.offset;
+        u->size = total;
+        u->userdata = &pool;
+
+        pool.offset += size;
+        pool.live++;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, MatAccessFlag /*flags*/,
+                  cv::UMatUsageFlags /*usage_flags*/) const override {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        if (!u) {
+            return;
+        }
+
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Pool* pool = static_cast<Pool*>(u->userdata);
+        size_t end = (u->origdata - pool->region.data) + roundUp(u->size, POOL_ALIGNMENT);
+
+        // Temporaries freed right after allocation give their space back
+        if (end == pool->offset) {
+            pool->offset = u->origdata - pool->region.data;
+        }
+
+        if (--pool->live == 0) {
+            pool->offset = 0;
+            if (pool != &pools_.back()) {
+                MemoryBackingUtils::unmapRegion(pool->region);
+                pools_.remove_if([pool](const Pool& p) { return &p == pool; });
+            }
+        }
+
+        delete u;
+    }
+
+private:
+    struct Pool {
+        BackedRegion region;
+        size_t offset = 0;
+        size_t live = 0;
+    };
+
+    MemoryBackingConfig config_;
+    mutable std::mutex mutex_;
+    mutable std::list<Pool> pools_;     // Stable addresses for UMatData::userdata
+};
+
+// Mats outlive any scope, so there is one immortal allocator per config
+cv::MatAllocator* backedPoolAllocator(const MemoryBackingConfig& config) {
+    static std::mutex mutex;
+    static BackedPoolAllocator* allocators[3][2] = {};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    BackedPoolAllocator*& allocator =
+        allocators[static_cast<int>(config.backing)][config.lock ? 1 : 0];
+    if (!allocator) {
+        allocator = new BackedPoolAllocator(config);
+    }
+    return allocator;
+}
+
+} // namespace
+
+namespace MemoryBackingUtils {
+
+size_t hugePageSize() {
+    static const size_t size = [] {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        size_t value = 0;
+
+        while (meminfo >> key >> value) {
+            if (key == "Hugepagesize:") {
+                return value * 1024;
+            }
+            meminfo.ignore(256, '\n');
+        }
+        return DEFAULT_HUGE_PAGE_SIZE;
+    }();
+    return size;
+}
+
+bool mapRegion(size_t size, const MemoryBackingConfig& config, BackedRegion& region) {
+    size_t huge_page = hugePageSize();
+    MemoryBacking backing = config.backing;
+    uint8_t* data = nullptr;
+
+    region = BackedRegion();
+    size = std::max<size_t>(size, 1);
+
+#ifdef MAP_HUGETLB
+    if (backing == MemoryBacking::HUGETLBFS) {
+        size = roundUp(size, huge_page);
+        data = mapAnonymous(size, MAP_HUGETLB);
+    }
+#endif
+    if (!data && backing == MemoryBacking::HUGETLBFS) {
+        // Pool empty or not configured
+        backing = MemoryBacking::TRANSPARENT_HUGE_PAGES;
+    }
+
+    if (!data && backing == MemoryBacking::TRANSPARENT_HUGE_PAGES) {
+        size = roundUp(size, huge_page);
+        data = mapTransparentHugePages(size, huge_page);
+        if (!data) {
+            backing = MemoryBacking::DEFAULT;
+        }
+    }
+
+    if (!data) {
+        size = roundUp(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        data = mapAnonymous(size, 0);
+        if (!data) {
+            return false;
+        }
+    }
+
+    // Once per request, however far it cascaded
+    if (backing != config.backing) {
+        fallbacks++;
+    }
+
+    region.data = data;
+    region.size = size;
+    region.backing = backing;
+
+    if (config.lock) {
+        if (mlock(data, size) == 0) {
+            region.locked = true;
+            locked_bytes += size;
+        } else {
+            int err = errno;
+            lock_failures++;
+            std::call_once(lock_warning, [err] {
+                std::cerr << "Warning: mlock failed (" << strerror(err)
+                          << "), check RLIMIT_MEMLOCK; memory stays pageable" << std::endl;
+            });
+        }
+    }
+
+    mapped_bytes += size;
+    if (backing != MemoryBacking::DEFAULT) {
+        huge_page_bytes += size;
+    }
+    if (backing == MemoryBacking::HUGETLBFS) {
+        hugetlbfs_bytes += size;
+    }
+
+    return true;
+}
+
+void unmapRegion(BackedRegion& region) {
+    if (!region.data) {
+        return;
+    }
+
+    mapped_bytes -= region.size;
+    if (region.backing != MemoryBacking::DEFAULT) {
+        huge_page_bytes -= region.size;
+    }
+    if (region.backing == MemoryBacking::HUGETLBFS) {
+        hugetlbfs_bytes -= region.size;
+    }
+    if (region.locked) {
+        locked_bytes -= region.size;
+    }
+
+    // munmap also drops the lock
+    munmap(region.data, region.size);
+    region = BackedRegion();
+}
+
+MemoryBackingStats getStats() {
+    MemoryBackingStats stats;
+    stats.mapped_bytes = mapped_bytes.load();
+    stats.huge_page_bytes = huge_page_bytes.load();
+    stats.hugetlbfs_bytes = hugetlbfs_bytes.load();
+    stats.locked_bytes = locked_bytes.load();
+    stats.fallbacks = fallbacks.load();
+    stats.lock_failures = lock_failures.load();
+    return stats;
+}
+
+std::string backingToString(MemoryBacking backing) {
+    switch (backing) {
+        case MemoryBacking::DEFAULT: return "default";
+        case MemoryBacking::TRANSPARENT_HUGE_PAGES: return "thp";
+        case MemoryBacking::HUGETLBFS: return "hugetlbfs";
+        default: return "unknown";
+    }
+}
+
+bool parseBacking(const std::string& name, MemoryBacking& backing) {
+    if (name == "default") {
+        backing = MemoryBacking::DEFAULT;
+    } else if (name == "thp") {
+        backing = MemoryBacking::TRANSPARENT_HUGE_PAGES;
+    } else if (name == "hugetlbfs" || name == "hugetlb") {
+        backing = MemoryBacking::HUGETLBFS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string configToString(const MemoryBackingConfig& config) {
+    return backingToString(config.backing) + (config.lock ? "+mlock" : "");
+}
+
+cv::MatAllocator* matAllocator(const MemoryBackingConfig& config) {
+    return config.isDefault() ? nullptr : backedPoolAllocator(config);
+}
+
+bool moveToAllocator(cv::Mat& mat, cv::MatAllocator* allocator) {
+    if (!allocator || mat.empty() || !mat.u || mat.u->currAllocator == allocator ||
+        mat.u->refcount != 1) {
+        return false;
+    }
+
+    cv::Mat moved;
+    moved.allocator = allocator;
+    mat.copyTo(moved);
+    mat = moved;
+    return true;
+}
+
+} // namespace MemoryBackingUtils
@@ -0,0 +1,891 @@
+/*
+ * SIMD Kernels Implementation
+ *
+ * This file implements the scalar, SSE4.1, AVX2 and NEON versions of the
+ * image kernels and selects one set at runtime.
+ *
+ * The x86 versions are compiled with target attributes, so the file builds
+ * without -msse4.1/-mavx2 and the CPU is checked before they are used. The
+ * NEON versions are compiled when the compiler targets NEON (-mfpu=neon on
+ * the i.MX6ULL build, always on AArch64).
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include "simd_kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_KERNELS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_KERNELS_NEON 1
+#include <arm_neon.h>
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+namespace {
+
+// BT.601 luma weights in Q14, as used by cv::cvtColor for 8-bit images
+const int GRAY_B = 1868;
+const int GRAY_G = 9617;
+const int GRAY_R = 4899;
+const int GRAY_SHIFT = 14;
+
+struct KernelTable {
+    void (*bgr_to_gray)(const uint8_t* bgr, uint8_t* gray, size_t pixels);
+    void (*downscale_half_row)(const uint8_t* row0, const uint8_t* row1,
+                               uint8_t* dst, int dst_width);
+    // Laplacian over columns [1, width - 1) of row, added to sums
+    void (*laplacian_row)(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+                          int width, LaplacianSums& sums);
+    void (*iou)(const int32_t* box, const int32_t* boxes, size_t count, float* ious);
+};
+
+// Scalar kernels; the SIMD versions use them for their tails
+
+inline uint8_t grayPixel(int b, int g, int r) {
+    return static_cast<uint8_t>((b * GRAY_B + g * GRAY_G + r * GRAY_R +
+                                 (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+}
+
+void bgrToGrayScalar(const uint8_t* bgr, uint8_t* gray, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i) {
+        gray[i] = grayPixel(bgr[3 * i], bgr[3 * i + 1], bgr[3 * i + 2]);
+    }
+}
+
+void downscaleHalfSpan(const uint8_t* row0, const uint8_t* row1, uint8_t* dst,
+                       int begin, int end) {
+    for (int x = begin; x < end; ++x) {
+        dst[x] = static_cast<uint8_t>((row0[2 * x] + row0[2 * x + 1] +
+                                       row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+    }
+}
+
+void downscaleHalfRowScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    downscaleHalfSpan(row0, row1, dst, 0, dst_width);
+}
+
+void laplacianSpan(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+                   int begin, int end, LaplacianSums& sums) {
+    for (int x = begin; x < end; ++x) {
+        int v = above[x] + below[x] + row[x - 1] + row[x + 1] - 4 * row[x];
+        sums.sum += v;
+        sums.sum_sq += v * v;
+    }
+}
+
+void laplacianRowScalar(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+                        int width, LaplacianSums& sums) {
+    laplacianSpan(above, row, below, 1, width - 1, sums);
+}
+
+inline float iouPair(const int32_t* a, const int32_t* b) {
+    int32_t iw = std::max(std::min(a[0] + a[2], b[0] + b[2]) - std::max(a[0], b[0]), 0);
+    int32_t ih = std::max(std::min(a[1] + a[3], b[1] + b[3]) - std::max(a[1], b[1]), 0);
+    int32_t inter = iw * ih;
+
+    if (inter <= 0) {
+        return 0.0f;
+    }
+    return static_cast<float>(inter) / static_cast<float>(a[2] * a[3] + b[2] * b[3] - inter);
+}
+
+void iouScalar(const int32_t* box, const int32_t* boxes, size_t count, float* ious) {
+    for (size_t i = 0; i < count; ++i) {
+        ious[i] = iouPair(box, boxes + 4 * i);
+    }
+}
+
+const KernelTable scalar_kernels = {
+    bgrToGrayScalar, downscaleHalfRowScalar, laplacianRowScalar, iouScalar
+};
+
+#ifdef SIMD_KERNELS_X86
+
+// 16 packed BGR pixels to planar B, G and R
+TARGET_SSE41 inline void deinterleaveBgr(const uint8_t* bgr, __m128i& b, __m128i& g, __m128i& r) {
+    const __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr));
+    const __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr + 16));
+    const __m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr + 32));
+
+    b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(s0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(s0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(s0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// Luma of 8 pixels held as 16-bit lanes; (b, g) and (r, 1) pairs go
+// through madd so the rounding constant rides along with R
+TARGET_SSE41 inline __m128i grayEight(__m128i b, __m128i g, __m128i r) {
+    const __m128i coef_bg = _mm_set1_epi32((GRAY_G << 16) | GRAY_B);
+    const __m128i coef_r1 = _mm_set1_epi32(((1 << (GRAY_SHIFT - 1)) << 16) | GRAY_R);
+    const __m128i one = _mm_set1_epi16(1);
+
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b, g), coef_bg),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(r, one), coef_r1));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b, g), coef_bg),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(r, one), coef_r1));
+
+    return _mm_packs_epi32(_mm_srli_epi32(lo, GRAY_SHIFT), _mm_srli_epi32(hi, GRAY_SHIFT));
+}
+
+TARGET_SSE41 void bgrToGraySse41(const uint8_t* bgr, uint8_t* gray, size_t pixels) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i b, g, r;
+        deinterleaveBgr(bgr + 3 * i, b, g, r);
+
+        __m128i y0 = grayEight(_mm_cvtepu8_epi16(b), _mm_cvtepu8_epi16(g), _mm_cvtepu8_epi16(r));
+        __m128i y1 = grayEight(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero),
+                               _mm_unpackhi_epi8(r, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(y0, y1));
+    }
+
+    bgrToGrayScalar(bgr + 3 * i, gray + i, pixels - i);
+}
+
+TARGET_SSE41 void downscaleHalfRowSse41(const uint8_t* row0, const uint8_t* row1,
+                                        uint8_t* dst, int dst_width) {
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi16(2);
+    int x = 0;
+
+    for (; x + 16 <= dst_width; x += 16) {
+        const uint8_t* p0 = row0 + 2 * x;
+        const uint8_t* p1 = row1 + 2 * x;
+
+        // maddubs with ones adds horizontal pairs into 16-bit lanes
+        __m128i s0 = _mm_add_epi16(
+            _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p0)), ones),
+            _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p1)), ones));
+        __m128i s1 = _mm_add_epi16(
+            _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p0 + 16)), ones),
+            _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p1 + 16)), ones));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(s0, s1));
+    }
+
+    downscaleHalfSpan(row0, row1, dst, x, dst_width);
+}
+
+// Adds the 32-bit lanes of the Laplacian accumulators into sums
+TARGET_SSE41 inline void flushLaplacian(__m128i& sum32, __m128i& sq32, LaplacianSums& sums) {
+    sums.sum += static_cast<int64_t>(_mm_extract_epi32(sum32, 0)) + _mm_extract_epi32(sum32, 1) +
+                _mm_extract_epi32(sum32, 2) + _mm_extract_epi32(sum32, 3);
+    sums.sum_sq += static_cast<int64_t>(_mm_extract_epi32(sq32, 0)) + _mm_extract_epi32(sq32, 1) +
+                   _mm_extract_epi32(sq32, 2) + _mm_extract_epi32(sq32, 3);
+    sum32 = _mm_setzero_si128();
+    sq32 = _mm_setzero_si128();
+}
+
+// Iterations between flushes, keeps the 32-bit squares far from overflow
+const int LAPLACIAN_FLUSH_INTERVAL = 256;
+
+TARGET_SSE41 inline __m128i loadWiden8(const uint8_t* p) {
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+TARGET_SSE41 void laplacianRowSse41(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+                                    int width, LaplacianSums& sums) {
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum32 = _mm_setzero_si128();
+    __m128i sq32 = _mm_setzero_si128();
+    int x = 1;
+    int iterations = 0;
+
+    for (; x + 8 <= width - 1; x += 8) {
+        __m128i v = _mm_sub_epi16(
+            _mm_add_epi16(_mm_add_epi16(loadWiden8(above + x), loadWiden8(below + x)),
+                          _mm_add_epi16(loadWiden8(row + x - 1), loadWiden8(row + x + 1))),
+            _mm_slli_epi16(loadWiden8(row + x), 2));
+
+        sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(v, ones));
+        sq32 = _mm_add_epi32(sq32, _mm_madd_epi16(v, v));
+
+        if (++iterations == LAPLACIAN_FLUSH_INTERVAL) {
+            flushLaplacian(sum32, sq32, sums);
+            iterations = 0;
+        }
+    }
+
+    flushLaplacian(sum32, sq32, sums);
+    laplacianSpan(above, row, below, x, width - 1, sums);
+}
+
+TARGET_SSE41 void iouSse41(const int32_t* box, const int32_t* boxes, size_t count, float* ious) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bx = _mm_set1_epi32(box[0]);
+    const __m128i by = _mm_set1_epi32(box[1]);
+    const __m128i bx2 = _mm_set1_epi32(box[0] + box[2]);
+    const __m128i by2 = _mm_set1_epi32(box[1] + box[3]);
+    const __m128i barea = _mm_set1_epi32(box[2] * box[3]);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const int32_t* p = boxes + 4 * i;
+        __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4));
+        __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8));
+        __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12));
+
+        // Transpose four (x, y, w, h) boxes into x, y, w and h vectors
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+        __m128i xs = _mm_unpacklo_epi64(t0, t1);
+        __m128i ys = _mm_unpackhi_epi64(t0, t1);
+        __m128i ws = _mm_unpacklo_epi64(t2, t3);
+        __m128i hs = _mm_unpackhi_epi64(t2, t3);
+
+        __m128i iw = _mm_max_epi32(_mm_sub_epi32(_mm_min_epi32(bx2, _mm_add_epi32(xs, ws)),
+                                                 _mm_max_epi32(bx, xs)), zero);
+        __m128i ih = _mm_max_epi32(_mm_sub_epi32(_mm_min_epi32(by2, _mm_add_epi32(ys, hs)),
+                                                 _mm_max_epi32(by, ys)), zero);
+        __m128i inter = _mm_mullo_epi32(iw, ih);
+        __m128i uni = _mm_sub_epi32(_mm_add_epi32(barea, _mm_mullo_epi32(ws, hs)), inter);
+
+        __m128 iou = _mm_div_ps(_mm_cvtepi32_ps(inter), _mm_cvtepi32_ps(uni));
+        iou = _mm_and_ps(iou, _mm_castsi128_ps(_mm_cmpgt_epi32(inter, zero)));
+        _mm_storeu_ps(ious + i, iou);
+    }
+
+    iouScalar(box, boxes + 4 * i, count - i, ious + i);
+}
+
+// Same as grayEight, for 16 pixels; lanes stay in order through unpack
+// and packs since both work per 128-bit half
+TARGET_AVX2 inline __m256i graySixteen(__m256i b, __m256i g, __m256i r) {
+    const __m256i coef_bg = _mm256_set1_epi32((GRAY_G << 16) | GRAY_B);
+    const __m256i coef_r1 = _mm256_set1_epi32(((1 << (GRAY_SHIFT - 1)) << 16) | GRAY_R);
+    const __m256i one = _mm256_set1_epi16(1);
+
+    __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(b, g), coef_bg),
+                                  _mm256_madd_epi16(_mm256_unpacklo_epi16(r, one), coef_r1));
+    __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(b, g), coef_bg),
+                                  _mm256_madd_epi16(_mm256_unpackhi_epi16(r, one), coef_r1));
+
+    return _mm256_packs_epi32(_mm256_srli_epi32(lo, GRAY_SHIFT), _mm256_srli_epi32(hi, GRAY_SHIFT));
+}
+
+TARGET_AVX2 void bgrToGrayAvx2(const uint8_t* bgr, uint8_t* gray, size_t pixels) {
+    size_t i = 0;
+
+    for (; i + 32 <= pixels; i += 32) {
+        __m128i b0, g0, r0, b1, g1, r1;
+        deinterleaveBgr(bgr + 3 * i, b0, g0, r0);
+        deinterleaveBgr(bgr + 3 * i + 48, b1, g1, r1);
+
+        __m256i y0 = graySixteen(_mm256_cvtepu8_epi16(b0), _mm256_cvtepu8_epi16(g0),
+                                 _mm256_cvtepu8_epi16(r0));
+        __m256i y1 = graySixteen(_mm256_cvtepu8_epi16(b1), _mm256_cvtepu8_epi16(g1),
+                                 _mm256_cvtepu8_epi16(r1));
+
+        // packus interleaves the halves, permute puts them back in order
+        __m256i y = _mm256_permute4x64_epi64(_mm256_packus_epi16(y0, y1), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + i), y);
+    }
+
+    bgrToGraySse41(bgr + 3 * i, gray + i, pixels - i);
+}
+
+TARGET_AVX2 void downscaleHalfRowAvx2(const uint8_t* row0, const uint8_t* row1,
+                                      uint8_t* dst, int dst_width) {
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    int x = 0;
+
+    for (; x + 32 <= dst_width; x += 32) {
+        const uint8_t* p0 = row0 + 2 * x;
+        const uint8_t* p1 = row1 + 2 * x;
+
+        __m256i s0 = _mm256_add_epi16(
+            _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p0)), ones),
+            _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1)), ones));
+        __m256i s1 = _mm256_add_epi16(
+            _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p0 + 32)), ones),
+            _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1 + 32)), ones));
+
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, two), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, two), 2);
+        __m256i y = _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), y);
+    }
+
+    downscaleHalfRowSse41(row0 + 2 * x, row1 + 2 * x, dst + x, dst_width - x);
+}
+
+TARGET_AVX2 inline __m256i loadWiden16(const uint8_t* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+TARGET_AVX2 void laplacianRowAvx2(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+                                  int width, LaplacianSums& sums) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum32 = _mm256_setzero_si256();
+    __m256i sq32 = _mm256_setzero_si256();
+    int x = 1;
+    int iterations = 0;
+
+    for (; x + 16 <= width - 1; x += 16) {
+        __m256i v = _mm256_sub_epi16(
+            _mm256_add_epi16(_mm256_add_epi16(loadWiden16(above + x), loadWiden16(below + x)),
+                             _mm256_add_epi16(loadWiden16(row + x - 1), loadWiden16(row + x + 1))),
+            _mm256_slli_epi16(loadWiden16(row + x), 2));
+
+        sum32 = _mm256_add_epi32(sum32, _mm256_madd_epi16(v, ones));
+        sq32 = _mm256_add_epi32(sq32, _mm256_madd_epi16(v, v));
+
+        if (++iterations == LAPLACIAN_FLUSH_INTERVAL || x + 32 > width - 1) {
+            __m128i sum_half = _mm_add_epi32(_mm256_castsi256_si128(sum32),
+                                             _mm256_extracti128_si256(sum32, 1));
+            __m128i sq_half = _mm_add_epi32(_mm256_castsi256_si128(sq32),
+                                            _mm256_extracti128_si256(sq32, 1));
+            flushLaplacian(sum_half, sq_half, sums);
+            sum32 = _mm256_setzero_si256();
+            sq32 = _mm256_setzero_si256();
+            iterations = 0;
+        }
+    }
+
+    // Remaining columns, starting at x
+    laplacianSpan(above, row, below, x, width - 1, sums);
+}
+
+const KernelTable sse41_kernels = {
+    bgrToGraySse41, downscaleHalfRowSse41, laplacianRowSse41, iouSse41
+};
+
+// IoU batches are short, AVX2 keeps the SSE4.1 kernel
+const KernelTable avx2_kernels = {
+    bgrToGrayAvx2, downscaleHalfRowAvx2, laplacianRowAvx2, iouSse41
+};
+
+#endif // SIMD_KERNELS_X86
+
+#ifdef SIMD_KERNELS_NEON
+
+void bgrToGrayNeon(const uint8_t* bgr, uint8_t* gray, size_t pixels) {
+    const uint32x4_t round = vdupq_n_u32(1 << (GRAY_SHIFT - 1));
+    size_t i = 0;
+
+    for (; i + 8 <= pixels; i += 8) {
+        uint8x8x3_t v = vld3_u8(bgr + 3 * i);
+        uint16x8_t b = vmovl_u8(v.val[0]);
+        uint16x8_t g = vmovl_u8(v.val[1]);
+        uint16x8_t r = vmovl_u8(v.val[2]);
+
+        uint32x4_t lo = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(round, vget_low_u16(b), GRAY_B),
+                                                vget_low_u16(g), GRAY_G),
+                                    vget_low_u16(r), GRAY_R);
+        uint32x4_t hi = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(round, vget_high_u16(b), GRAY_B),
+                                                vget_high_u16(g), GRAY_G),
+                                    vget_high_u16(r), GRAY_R);
+
+        uint16x8_t y = vcombine_u16(vshrn_n_u32(lo, GRAY_SHIFT), vshrn_n_u32(hi, GRAY_SHIFT));
+        vst1_u8(gray + i, vmovn_u16(y));
+    }
+
+    bgrToGrayScalar(bgr + 3 * i, gray + i, pixels - i);
+}
+
+void downscaleHalfRowNeon(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    int x = 0;
+
+    for (; x + 8 <= dst_width; x += 8) {
+        uint16x8_t s = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x)),
+                                 vpaddlq_u8(vld1q_u8(row1 + 2 * x)));
+        // Rounding narrow: (s + 2) >> 2
+        vst1_u8(dst + x, vrshrn_n_u16(s, 2));
+    }
+
+    downscaleHalfSpan(row0, row1, dst, x, dst_width);
+}
+
+inline int16x8_t loadWidenNeon(const uint8_t* p) {
+    return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+}
+
+void laplacianRowNeon(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+                      int width, LaplacianSums& sums) {
+    int32x4_t sum32 = vdupq_n_s32(0);
+    int64x2_t sq64 = vdupq_n_s64(0);
+    int x = 1;
+
+    for (; x + 8 <= width - 1; x += 8) {
+        int16x8_t v = vsubq_s16(
+            vaddq_s16(vaddq_s16(loadWidenNeon(above + x), loadWidenNeon(below + x)),
+                      vaddq_s16(loadWidenNeon(row + x - 1), loadWidenNeon(row + x + 1))),
+            vshlq_n_s16(loadWidenNeon(row + x), 2));
+
+        sum32 = vpadalq_s16(sum32, v);
+        sq64 = vpadalq_s32(sq64, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+        sq64 = vpadalq_s32(sq64, vmull_s16(vget_high_s16(v), vget_high_s16(v)));
+    }
+
+    sums.sum += static_cast<int64_t>(vgetq_lane_s32(sum32, 0)) + vgetq_lane_s32(sum32, 1) +
+                vgetq_lane_s32(sum32, 2) + vgetq_lane_s32(sum32, 3);
+    sums.sum_sq += vgetq_lane_s64(sq64, 0) + vgetq_lane_s64(sq64, 1);
+    laplacianSpan(above, row, below, x, width - 1, sums);
+}
+
+void iouNeon(const int32_t* box, const int32_t* boxes, size_t count, float* ious) {
+    const int32x4_t zero = vdupq_n_s32(0);
+    const int32x4_t bx = vdupq_n_s32(box[0]);
+    const int32x4_t by = vdupq_n_s32(box[1]);
+    const int32x4_t bx2 = vdupq_n_s32(box[0] + box[2]);
+    const int32x4_t by2 = vdupq_n_s32(box[1] + box[3]);
+    const int32x4_t barea = vdupq_n_s32(box[2] * box[3]);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        // vld4 deinterleaves four boxes into x, y, w and h
+        int32x4x4_t v = vld4q_s32(boxes + 4 * i);
+
+        int32x4_t iw = vmaxq_s32(vsubq_s32(vminq_s32(bx2, vaddq_s32(v.val[0], v.val[2])),
+                                           vmaxq_s32(bx, v.val[0])), zero);
+        int32x4_t ih = vmaxq_s32(vsubq_s32(vminq_s32(by2, vaddq_s32(v.val[1], v.val[3])),
+                                           vmaxq_s32(by, v.val[1])), zero);
+        int32x4_t inter = vmulq_s32(iw, ih);
+        int32x4_t uni = vsubq_s32(vaddq_s32(barea, vmulq_s32(v.val[2], v.val[3])), inter);
+
+        // ARMv7 NEON has no exact divide, finish in VFP like the scalar path
+        int32_t inter_lanes[4];
+        int32_t uni_lanes[4];
+        vst1q_s32(inter_lanes, inter);
+        vst1q_s32(uni_lanes, uni);
+        for (int k = 0; k < 4; ++k) {
+            ious[i + k] = inter_lanes[k] > 0
+                ? static_cast<float>(inter_lanes[k]) / static_cast<float>(uni_lanes[k])
+                : 0.0f;
+        }
+    }
+
+    iouScalar(box, boxes + 4 * i, count - i, ious + i);
+}
+
+const KernelTable neon_kernels = {
+    bgrToGrayNeon, downscaleHalfRowNeon, laplacianRowNeon, iouNeon
+};
+
+bool neonAvailable() {
+#if defined(__arm__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return true;
+#endif
+}
+
+#endif // SIMD_KERNELS_NEON
+
+bool isSupported(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SCALAR:
+            return true;
+#ifdef SIMD_KERNELS_X86
+        case SimdLevel::SSE41:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1");
+        case SimdLevel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+#ifdef SIMD_KERNELS_NEON
+        case SimdLevel::NEON:
+            return neonAvailable();
+#endif
+        default:
+            return false;
+    }
+}
+
+const KernelTable* tableFor(SimdLevel level) {
+    switch (level) {
+#ifdef SIMD_KERNELS_X86
+        case SimdLevel::SSE41: return &sse41_kernels;
+        case SimdLevel::AVX2: return &avx2_kernels;
+#endif
+#ifdef SIMD_KERNELS_NEON
+        case SimdLevel::NEON: return &neon_kernels;
+#endif
+        default: return &scalar_kernels;
+    }
+}
+
+std::atomic<const KernelTable*> active_kernels{&scalar_kernels};
+std::atomic<SimdLevel> active_level{SimdLevel::SCALAR};
+std::once_flag level_detected;
+
+void selectLevel(SimdLevel level) {
+    active_level = level;
+    active_kernels.store(tableFor(level), std::memory_order_release);
+}
+
+void detectLevel() {
+    const char* requested = std::getenv("SIMD_LEVEL");
+    SimdLevel level;
+
+    if (requested && SimdKernels::parseLevel(requested, level) && isSupported(level)) {
+        selectLevel(level);
+        return;
+    }
+
+    for (SimdLevel best : {SimdLevel::NEON, SimdLevel::AVX2, SimdLevel::SSE41}) {
+        if (isSupported(best)) {
+            selectLevel(best);
+            return;
+        }
+    }
+}
+
+const KernelTable& kernels() {
+    std::call_once(level_detected, detectLevel);
+    return *active_kernels.load(std::memory_order_acquire);
+}
+
+// Pixels converted per block of the fused equalization pass; the block is
+// still in L1 when its histogram is counted
+const size_t EQUALIZE_BLOCK = 512;
+
+// CLAHE tile grid and clip limit for low light frames
+const int CLAHE_TILES = 8;
+const double CLAHE_CLIP_LIMIT = 2.0;
+
+// Four partial histograms, so runs of equal pixels do not serialize on
+// a single counter
+void countHistogram(const uint8_t* data, size_t count, uint32_t (&partial)[4][256]) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        partial[0][data[i]]++;
+        partial[1][data[i + 1]]++;
+        partial[2][data[i + 2]]++;
+        partial[3][data[i + 3]]++;
+    }
+    for (; i < count; ++i) {
+        partial[0][data[i]]++;
+    }
+}
+
+void applyLut(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t* lut) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        dst[i] = lut[src[i]];
+        dst[i + 1] = lut[src[i + 1]];
+        dst[i + 2] = lut[src[i + 2]];
+        dst[i + 3] = lut[src[i + 3]];
+    }
+    for (; i < count; ++i) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+inline uint8_t saturateRound(float value) {
+    return static_cast<uint8_t>(std::min(std::max(std::lrint(value), 0L), 255L));
+}
+
+// Same LUT as cv::equalizeHist
+void equalizationLut(const uint32_t* hist, uint64_t total, uint8_t* lut) {
+    int i = 0;
+    while (!hist[i]) {
+        ++i;
+    }
+
+    if (hist[i] == total) {
+        std::fill(lut, lut + 256, static_cast<uint8_t>(i));
+        return;
+    }
+
+    float scale = 255.0f / static_cast<float>(total - hist[i]);
+    int sum = 0;
+
+    std::fill(lut, lut + i, 0);
+    for (lut[i++] = 0; i < 256; ++i) {
+        sum += hist[i];
+        lut[i] = saturateRound(sum * scale);
+    }
+}
+
+// Clipped-histogram LUT of each tile of src, CLAHE_TILES squared LUTs
+void claheLuts(const uint8_t* src, size_t step, int width, int height, uint8_t* luts) {
+    for (int ty = 0; ty < CLAHE_TILES; ++ty) {
+        int y0 = ty * height / CLAHE_TILES;
+        int y1 = (ty + 1) * height / CLAHE_TILES;
+
+        for (int tx = 0; tx < CLAHE_TILES; ++tx) {
+            int x0 = tx * width / CLAHE_TILES;
+            int x1 = (tx + 1) * width / CLAHE_TILES;
+            int area = (x1 - x0) * (y1 - y0);
+            uint8_t* lut = luts + (ty * CLAHE_TILES + tx) * 256;
+            uint32_t hist[256] = {};
+
+            for (int y = y0; y < y1; ++y) {
+                const uint8_t* row = src + y * step;
+                for (int x = x0; x < x1; ++x) {
+                    hist[row[x]]++;
+                }
+            }
+
+            // Clip and hand the excess out evenly, as cv::CLAHE does
+            uint32_t clip = std::max(1, static_cast<int>(CLAHE_CLIP_LIMIT * area / 256));
+            uint32_t excess = 0;
+            for (int i = 0; i < 256; ++i) {
+                if (hist[i] > clip) {
+                    excess += hist[i] - clip;
+                    hist[i] = clip;
+                }
+            }
+
+            uint32_t batch = excess / 256;
+            uint32_t residual = excess - batch * 256;
+            for (int i = 0; i < 256; ++i) {
+                hist[i] += batch;
+            }
+            if (residual) {
+                int stride = std::max(256 / static_cast<int>(residual), 1);
+                for (int i = 0; i < 256 && residual > 0; i += stride, residual--) {
+                    hist[i]++;
+                }
+            }
+
+            float scale = 255.0f / std::max(area, 1);
+            uint32_t sum = 0;
+            for (int i = 0; i < 256; ++i) {
+                sum += hist[i];
+                lut[i] = saturateRound(sum * scale);
+            }
+        }
+    }
+}
+
+// Tile and Q8 weight of the LUT pair around each of count positions
+void tileInterpolation(int count, std::vector<int32_t>& table) {
+    float tile = static_cast<float>(count) / CLAHE_TILES;
+
+    table.resize(3 * count);
+    for (int i = 0; i < count; ++i) {
+        float t = (i + 0.5f) / tile - 0.5f;
+        int first = static_cast<int>(std::floor(t));
+
+        table[3 * i] = std::max(first, 0);
+        table[3 * i + 1] = std::min(first + 1, CLAHE_TILES - 1);
+        table[3 * i + 2] = static_cast<int32_t>(std::lrint((t - first) * 256));
+    }
+}
+
+// Maps src through the tile LUTs, bilinearly blended between the four
+// nearest tiles; src may be dst
+void applyTileLuts(const uint8_t* src, size_t src_step, uint8_t* dst, size_t dst_step,
+                   int width, int height, const uint8_t* luts) {
+    // Reused per thread, so a frame does not allocate once warmed up
+    thread_local std::vector<int32_t> columns;
+    thread_local std::vector<int32_t> rows;
+
+    tileInterpolation(width, columns);
+    tileInterpolation(height, rows);
+
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* top = luts + rows[3 * y] * CLAHE_TILES * 256;
+        const uint8_t* bottom = luts + rows[3 * y + 1] * CLAHE_TILES * 256;
+        int wy = rows[3 * y + 2];
+        const uint8_t* in = src + y * src_step;
+        uint8_t* out = dst + y * dst_step;
+
+        for (int x = 0; x < width; ++x) {
+            int left = columns[3 * x] * 256 + in[x];
+            int right = columns[3 * x + 1] * 256 + in[x];
+            int wx = columns[3 * x + 2];
+
+            int upper = top[left] * (256 - wx) + top[right] * wx;
+            int lower = bottom[left] * (256 - wx) + bottom[right] * wx;
+            out[x] = static_cast<uint8_t>((upper * (256 - wy) + lower * wy + (1 << 15)) >> 16);
+        }
+    }
+}
+
+} // namespace
+
+double LaplacianSums::variance() const {
+    if (count == 0) {
+        return 0.0;
+    }
+
+    double mean = static_cast<double>(sum) / count;
+    return static_cast<double>(sum_sq) / count - mean * mean;
+}
+
+namespace SimdKernels {
+
+SimdLevel getLevel() {
+    kernels();
+    return active_level.load();
+}
+
+bool setLevel(SimdLevel level) {
+    if (!isSupported(level)) {
+        return false;
+    }
+
+    kernels();
+    selectLevel(level);
+    return true;
+}
+
+std::vector<SimdLevel> supportedLevels() {
+    std::vector<SimdLevel> levels;
+
+    for (SimdLevel level : {SimdLevel::SCALAR, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::NEON}) {
+        if (isSupported(level)) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+std::string levelToString(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SCALAR: return "scalar";
+        case SimdLevel::SSE41: return "sse41";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::NEON: return "neon";
+        default: return "unknown";
+    }
+}
+
+bool parseLevel(const std::string& name, SimdLevel& level) {
+    for (SimdLevel candidate : {SimdLevel::SCALAR, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::NEON}) {
+        if (name == levelToString(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void bgrToGray(const uint8_t* bgr, uint8_t* gray, size_t pixels) {
+    kernels().bgr_to_gray(bgr, gray, pixels);
+}
+
+void downscaleHalf(const uint8_t* src, size_t src_step,
+                   uint8_t* dst, size_t dst_step,
+                   int dst_width, int dst_height) {
+    const KernelTable& table = kernels();
+
+    for (int y = 0; y < dst_height; ++y) {
+        const uint8_t* row0 = src + 2 * y * src_step;
+        table.downscale_half_row(row0, row0 + src_step, dst + y * dst_step, dst_width);
+    }
+}
+
+LaplacianSums laplacianSums(const uint8_t* src, size_t src_step, int width, int height) {
+    const KernelTable& table = kernels();
+    LaplacianSums sums;
+
+    if (width < 3 || height < 3) {
+        return sums;
+    }
+
+    for (int y = 1; y < height - 1; ++y) {
+        const uint8_t* row = src + y * src_step;
+        table.laplacian_row(row - src_step, row, row + src_step, width, sums);
+    }
+
+    sums.count = static_cast<int64_t>(width - 2) * (height - 2);
+    return sums;
+}
+
+double equalizeGray(const uint8_t* src, size_t src_step, int channels,
+                    int width, int height, uint8_t* dst, size_t dst_step,
+                    int low_light_threshold) {
+    const KernelTable& table = kernels();
+    uint64_t total = static_cast<uint64_t>(width) * height;
+    uint32_t partial[4][256] = {};
+    uint32_t hist[256];
+    uint64_t weighted = 0;
+
+    if (total == 0) {
+        return 0.0;
+    }
+
+    // Pass 1: luma and histogram; gray input is only counted
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = src + y * src_step;
+
+        if (channels == 3) {
+            uint8_t* out = dst + y * dst_step;
+            for (size_t x = 0; x < static_cast<size_t>(width); x += EQUALIZE_BLOCK) {
+                size_t count = std::min(EQUALIZE_BLOCK, width - x);
+                table.bgr_to_gray(row + 3 * x, out + x, count);
+                countHistogram(out + x, count, partial);
+            }
+        } else {
+            countHistogram(row, width, partial);
+        }
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        hist[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+        weighted += static_cast<uint64_t>(i) * hist[i];
+    }
+
+    double mean = static_cast<double>(weighted) / total;
+    const uint8_t* luma = channels == 3 ? dst : src;
+    size_t luma_step = channels == 3 ? dst_step : src_step;
+
+    // Pass 2: global equalization, or CLAHE for a dark frame
+    if (low_light_threshold > 0 && mean < low_light_threshold &&
+        width >= 2 * CLAHE_TILES && height >= 2 * CLAHE_TILES) {
+        thread_local std::vector<uint8_t> half;
+        thread_local std::vector<uint8_t> luts;
+        int half_width = width / 2;
+        int half_height = height / 2;
+
+        half.resize(static_cast<size_t>(half_width) * half_height);
+        luts.resize(CLAHE_TILES * CLAHE_TILES * 256);
+
+        downscaleHalf(luma, luma_step, half.data(), half_width, half_width, half_height);
+        claheLuts(half.data(), half_width, half_width, half_height, luts.data());
+        applyTileLuts(luma, luma_step, dst, dst_step, width, height, luts.data());
+    } else {
+        uint8_t lut[256];
+        equalizationLut(hist, total, lut);
+        for (int y = 0; y < height; ++y) {
+            applyLut(luma + y * luma_step, dst + y * dst_step, width, lut);
+        }
+    }
+
+    return mean;
+}
+
+void intersectionOverUnion(const int32_t* box, const int32_t* boxes, size_t count, float* ious) {
+    kernels().iou(box, boxes, count, ious);
+}
+
+} // namespace SimdKernels
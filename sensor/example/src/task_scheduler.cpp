@@ -0,0 +1,368 @@
+/*
+ * Task Scheduler Implementation
+ *
+ * This file implements the work-stealing scheduler and its OpenCV
+ * parallel_for_ backend.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include "task_scheduler.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+
+#if defined(__has_include)
+#if __has_include(<opencv2/core/parallel/parallel_backend.hpp>)
+#include <opencv2/core/parallel/parallel_backend.hpp>
+#define HAVE_OPENCV_PARALLEL_BACKEND 1
+#endif
+#endif
+
+namespace {
+
+thread_local int current_worker = -1;
+thread_local const TaskScheduler* current_scheduler = nullptr;
+thread_local TaskPriority current_priority = TaskPriority::NORMAL;
+
+// Chunks per thread in a parallelFor, to even out uneven chunk costs
+const int CHUNKS_PER_THREAD = 4;
+
+// One parallelFor; shared with helper tasks that may start after it ended
+struct ParallelJob {
+    int begin;
+    int end;
+    int chunks;
+    const std::function<void(int, int)>* body;
+
+    std::atomic<int> next{0};
+    int done = 0;
+    std::mutex mutex;
+    std::condition_variable done_cv;
+
+    // Run chunks until none are left
+    void work() {
+        int chunk;
+        int finished = 0;
+
+        while ((chunk = next.fetch_add(1)) < chunks) {
+            int range = end - begin;
+            (*body)(begin + static_cast<int>(static_cast<int64_t>(range) * chunk / chunks),
+                    begin + static_cast<int>(static_cast<int64_t>(range) * (chunk + 1) / chunks));
+            finished++;
+        }
+
+        if (finished) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done += finished;
+            if (done == chunks) {
+                done_cv.notify_all();
+            }
+        }
+    }
+};
+
+#ifdef HAVE_OPENCV_PARALLEL_BACKEND
+class OpenCVParallelBackend : public cv::parallel::ParallelForAPI {
+public:
+    explicit OpenCVParallelBackend(TaskScheduler& scheduler) : scheduler_(scheduler) {
+    }
+
+    void parallel_for(int tasks, FN_parallel_for_body_cb_t body_callback,
+                      void* callback_data) override {
+        scheduler_.parallelFor(0, tasks, [=](int begin, int end) {
+            body_callback(begin, end, callback_data);
+        });
+    }
+
+    // Worker i is thread i + 1 and any thread outside the pool is 0. A
+    // region has one caller, so indices are distinct within it; regions
+    // started concurrently from outside the pool both see a thread 0
+    int getThreadNum() const override {
+        return TaskScheduler::currentWorkerIndex() + 1;
+    }
+
+    int getNumThreads() const override {
+        return scheduler_.getMaxConcurrency();
+    }
+
+    int setNumThreads(int nThreads) override {
+        int previous = getNumThreads();
+        // OpenCV: 0 disables threading, negative restores the default
+        scheduler_.setMaxConcurrency(nThreads < 0 ? scheduler_.getNumWorkers() + 1
+                                                  : std::max(nThreads, 1));
+        return previous;
+    }
+
+    const char* getName() const override {
+        return "work-stealing";
+    }
+
+private:
+    TaskScheduler& scheduler_;
+};
+#endif
+
+} // namespace
+
+TaskScheduler::TaskScheduler(int num_workers) {
+    if (num_workers <= 0) {
+        int cores = static_cast<int>(std::thread::hardware_concurrency());
+        num_workers = std::max(cores - 1, 1);
+    }
+
+    max_concurrency_ = num_workers + 1;
+
+    for (int i = 0; i < num_workers; ++i) {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    // Start only once every deque exists, workers steal from all of them
+    for (int i = 0; i < num_workers; ++i) {
+        workers_[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_cv_.notify_all();
+
+    // Workers drain the queues before they exit
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+TaskScheduler& TaskScheduler::instance() {
+    // Never destroyed: OpenCV may still call the backend during exit
+    static TaskScheduler* scheduler = new TaskScheduler();
+    return *scheduler;
+}
+
+void TaskScheduler::submit(Task task) {
+    submit(std::move(task), current_priority);
+}
+
+void TaskScheduler::submit(Task task, TaskPriority priority) {
+    int queue = static_cast<int>(priority);
+
+    if (current_scheduler == this) {
+        Worker& worker = *workers_[current_worker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queues[queue].push_back(std::move(task));
+        queued_++;
+    } else {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        inject_queues_[queue].push_back(std::move(task));
+        queued_++;
+    }
+
+    {
+        // Pairs with the predicate check in workerLoop, so no wakeup is lost
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    sleep_cv_.notify_one();
+}
+
+void TaskScheduler::parallelFor(int begin, int end, const std::function<void(int, int)>& body) {
+    int range = end - begin;
+    int concurrency = std::min(max_concurrency_.load(), getNumWorkers() + 1);
+
+    if (range <= 0) {
+        return;
+    }
+    if (range == 1 || concurrency <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    parallel_for_calls_++;
+
+    auto job = std::make_shared<ParallelJob>();
+    job->begin = begin;
+    job->end = end;
+    job->chunks = std::min(range, concurrency * CHUNKS_PER_THREAD);
+    job->body = &body;
+
+    // Helpers that start late find no chunks left and return at once
+    int helpers = std::min(concurrency, job->chunks) - 1;
+    for (int i = 0; i < helpers; ++i) {
+        submit([job] { job->work(); });
+    }
+
+    job->work();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done_cv.wait(lock, [&job] { return job->done == job->chunks; });
+}
+
+int TaskScheduler::getMaxConcurrency() const {
+    return max_concurrency_.load();
+}
+
+void TaskScheduler::setMaxConcurrency(int concurrency) {
+    max_concurrency_ = std::max(concurrency, 1);
+}
+
+TaskSchedulerStats TaskScheduler::getStats() const {
+    TaskSchedulerStats stats;
+    stats.executed = executed_.load();
+    stats.stolen = stolen_.load();
+    stats.parallel_for_calls = parallel_for_calls_.load();
+    return stats;
+}
+
+bool TaskScheduler::installOpenCVBackend() {
+#ifdef HAVE_OPENCV_PARALLEL_BACKEND
+    // Keep our own concurrency rather than OpenCV's thread count
+    cv::parallel::setParallelForBackend(std::make_shared<OpenCVParallelBackend>(*this), false);
+    return true;
+#else
+    return false;
+#endif
+}
+
+int TaskScheduler::currentWorkerIndex() {
+    return current_worker;
+}
+
+TaskPriority TaskScheduler::currentPriority() {
+    return current_priority;
+}
+
+void TaskScheduler::workerLoop(int index) {
+    current_worker = index;
+    current_scheduler = this;
+
+    while (true) {
+        Task task;
+        TaskPriority priority;
+
+        if (takeTask(index, task, priority)) {
+            runTask(task, priority);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+        if (stopping_ && queued_.load() == 0) {
+            break;
+        }
+    }
+}
+
+bool TaskScheduler::takeTask(int index, Task& task, TaskPriority& priority) {
+    int count = getNumWorkers();
+
+    for (int queue = 0; queue < TASK_PRIORITY_COUNT && !task; ++queue) {
+        // Own work first, newest first while it is still cache hot
+        {
+            Worker& worker = *workers_[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.queues[queue].empty()) {
+                task = std::move(worker.queues[queue].back());
+                worker.queues[queue].pop_back();
+                queued_--;
+            }
+        }
+
+        if (!task) {
+            std::lock_guard<std::mutex> lock(inject_mutex_);
+            if (!inject_queues_[queue].empty()) {
+                task = std::move(inject_queues_[queue].front());
+                inject_queues_[queue].pop_front();
+                queued_--;
+            }
+        }
+
+        // Steal the oldest task of the next worker that has one
+        for (int i = 1; i < count && !task; ++i) {
+            Worker& victim = *workers_[(index + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.queues[queue].empty()) {
+                task = std::move(victim.queues[queue].front());
+                victim.queues[queue].pop_front();
+                queued_--;
+                stolen_++;
+            }
+        }
+
+        priority = static_cast<TaskPriority>(queue);
+    }
+
+    return static_cast<bool>(task);
+}
+
+void TaskScheduler::runTask(Task& task, TaskPriority priority) {
+    TaskPriority previous = current_priority;
+    current_priority = priority;
+
+    task();
+
+    current_priority = previous;
+    executed_++;
+}
+
+TaskPriorityScope::TaskPriorityScope(TaskPriority priority) : previous_(current_priority) {
+    current_priority = priority;
+}
+
+TaskPriorityScope::~TaskPriorityScope() {
+    current_priority = previous_;
+}
+
+TaskGroup::TaskGroup(TaskScheduler& scheduler) : scheduler_(scheduler) {
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(TaskScheduler::Task task) {
+    run(std::move(task), TaskScheduler::currentPriority());
+}
+
+void TaskGroup::run(TaskScheduler::Task task, TaskPriority priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+    }
+
+    scheduler_.submit([this, task = std::move(task)] {
+        task();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) {
+            done_cv_.notify_all();
+        }
+    }, priority);
+}
+
+void TaskGroup::wait() {
+    // A worker runs queued tasks meanwhile, blocking it could starve the group
+    if (current_scheduler == &scheduler_) {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_ == 0) {
+                    return;
+                }
+            }
+
+            TaskScheduler::Task task;
+            TaskPriority priority;
+            if (scheduler_.takeTask(current_worker, task, priority)) {
+                scheduler_.runTask(task, priority);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
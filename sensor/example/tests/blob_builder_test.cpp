@@ -0,0 +1,217 @@
+/*
+ * Blob Builder Test
+ *
+ * Checks the blob builder against direct per-pixel computations: channel
+ * order and normalization, bilinear and area sampling, gray input and
+ * int8 quantization.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "blob_builder.h"
+#include "test_util.h"
+
+namespace {
+
+std::mt19937 rng(54321);
+
+std::vector<uint8_t> randomImage(int width, int height, int channels) {
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> image(static_cast<size_t>(width) * height * channels);
+    for (auto& value : image) {
+        value = static_cast<uint8_t>(dist(rng));
+    }
+    return image;
+}
+
+using TestUtil::check;
+
+// Largest difference between a built blob and expected
+template <typename T>
+double maxError(const std::vector<T>& blob, const std::vector<double>& expected) {
+    double error = 0.0;
+    for (size_t i = 0; i < blob.size(); ++i) {
+        error = std::max(error, std::fabs(blob[i] - expected[i]));
+    }
+    return error;
+}
+
+// Bilinear sample of channel c with cv::resize's pixel center mapping
+double bilinear(const std::vector<uint8_t>& image, int width, int height, int channels,
+                int c, double fx, double fy) {
+    auto clampedSample = [&](double f, int size, int& s, double& w) {
+        s = static_cast<int>(std::floor(f));
+        w = f - s;
+        if (s < 0) { s = 0; w = 0.0; }
+        if (s >= size - 1) { s = size - 1; w = 0.0; }
+    };
+
+    int sx, sy;
+    double wx, wy;
+    clampedSample(fx, width, sx, wx);
+    clampedSample(fy, height, sy, wy);
+
+    auto at = [&](int x, int y) {
+        return static_cast<double>(image[(static_cast<size_t>(y) * width + x) * channels + c]);
+    };
+    int sx1 = std::min(sx + 1, width - 1);
+    int sy1 = std::min(sy + 1, height - 1);
+
+    return (at(sx, sy) * (1 - wx) + at(sx1, sy) * wx) * (1 - wy) +
+           (at(sx, sy1) * (1 - wx) + at(sx1, sy1) * wx) * wy;
+}
+
+void testIdentity() {
+    int width = 37;
+    int height = 11;
+    std::vector<uint8_t> image = randomImage(width, height, 3);
+
+    BlobConfig config;
+    config.width = width;
+    config.height = height;
+    config.mean[0] = 123.0f;
+    config.mean[1] = 117.0f;
+    config.mean[2] = 104.0f;
+    config.scale = 0.5f;
+    config.swap_rb = true;
+
+    BlobBuilder builder(config);
+    std::vector<float> blob(builder.blobElements());
+    builder.build(image.data(), width * 3, width, height, 3, blob.data());
+
+    std::vector<double> expected(blob.size());
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < width * height; ++i) {
+            // swap_rb: blob channel 0 is the source's channel 2
+            expected[c * width * height + i] = (image[i * 3 + (2 - c)] - config.mean[c]) * config.scale;
+        }
+    }
+
+    check(maxError(blob, expected) == 0.0, "identity size, swapped channels");
+}
+
+void testBilinear() {
+    for (int scale_case = 0; scale_case < 3; ++scale_case) {
+        int src_width = 64, src_height = 48;
+        int width = scale_case == 0 ? 30 : (scale_case == 1 ? 100 : 41);
+        int height = scale_case == 0 ? 30 : (scale_case == 1 ? 77 : 48);
+        std::vector<uint8_t> image = randomImage(src_width, src_height, 3);
+
+        BlobConfig config;
+        config.width = width;
+        config.height = height;
+        BlobBuilder builder(config);
+        std::vector<float> blob(builder.blobElements());
+        builder.build(image.data(), src_width * 3, src_width, src_height, 3, blob.data());
+
+        std::vector<double> expected(blob.size());
+        double sx = static_cast<double>(src_width) / width;
+        double sy = static_cast<double>(src_height) / height;
+        for (int c = 0; c < 3; ++c) {
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    expected[(c * height + y) * width + x] =
+                        bilinear(image, src_width, src_height, 3, c, (x + 0.5) * sx - 0.5, (y + 0.5) * sy - 0.5);
+                }
+            }
+        }
+
+        check(maxError(blob, expected) < 1e-3,
+              "bilinear " + std::to_string(width) + "x" + std::to_string(height));
+    }
+}
+
+void testArea() {
+    // 2:1 is a 2x2 box average
+    int src_width = 40, src_height = 30;
+    std::vector<uint8_t> image = randomImage(src_width, src_height, 3);
+
+    BlobConfig config;
+    config.width = 20;
+    config.height = 15;
+    config.sampling = BlobSampling::AREA;
+    BlobBuilder builder(config);
+    std::vector<float> blob(builder.blobElements());
+
+    // Padded rows
+    size_t step = src_width * 3 + 5;
+    std::vector<uint8_t> padded(step * src_height);
+    for (int y = 0; y < src_height; ++y) {
+        std::copy(image.begin() + y * src_width * 3, image.begin() + (y + 1) * src_width * 3,
+                  padded.begin() + y * step);
+    }
+    builder.build(padded.data(), step, src_width, src_height, 3, blob.data());
+
+    std::vector<double> expected(blob.size());
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < 15; ++y) {
+            for (int x = 0; x < 20; ++x) {
+                double sum = 0.0;
+                for (int dy = 0; dy < 2; ++dy) {
+                    for (int dx = 0; dx < 2; ++dx) {
+                        sum += image[((2 * y + dy) * src_width + 2 * x + dx) * 3 + c];
+                    }
+                }
+                expected[(c * 15 + y) * 20 + x] = sum / 4;
+            }
+        }
+    }
+    check(maxError(blob, expected) < 1e-3, "area 2:1");
+
+    // A flat image stays flat at a fractional ratio
+    std::vector<uint8_t> flat(97 * 61 * 3, 200);
+    config.width = 30;
+    config.height = 17;
+    builder.setConfig(config);
+    blob.resize(builder.blobElements());
+    builder.build(flat.data(), 97 * 3, 97, 61, 3, blob.data());
+    check(maxError(blob, std::vector<double>(blob.size(), 200.0)) < 1e-2, "area fractional");
+}
+
+void testGrayAndInt8() {
+    int width = 16, height = 8;
+    std::vector<uint8_t> gray = randomImage(width, height, 1);
+
+    BlobConfig config;
+    config.width = width;
+    config.height = height;
+    config.mean[0] = config.mean[1] = config.mean[2] = 128.0f;
+    config.scale = 1.0f / 128.0f;
+    config.format = BlobFormat::INT8;
+    config.quant_scale = 1.0f / 127.0f;
+    config.quant_zero_point = 0;
+
+    BlobBuilder builder(config);
+    std::vector<int8_t> blob(builder.blobElements());
+    check(builder.blobBytes() == blob.size(), "int8 blob size");
+    builder.build(gray.data(), width, width, height, 1, blob.data());
+
+    std::vector<double> expected(blob.size());
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < width * height; ++i) {
+            double q = std::round((gray[i] - 128.0) / 128.0 * 127.0);
+            expected[c * width * height + i] = std::min(std::max(q, -128.0), 127.0);
+        }
+    }
+    check(maxError(blob, expected) <= 1.0, "gray input, int8");
+}
+
+} // namespace
+
+int main() {
+    std::cout << "=== Blob Builder Test ===" << std::endl;
+
+    testIdentity();
+    testBilinear();
+    testArea();
+    testGrayAndInt8();
+
+    return TestUtil::finish("All blob checks passed");
+}
@@ -0,0 +1,149 @@
+/*
+ * Detection Tiling Test
+ *
+ * Checks the tile grid used for high-resolution frames (overlap, clamping
+ * at the frame edge, the max_tiles limit) and the cross-tile NMS that
+ * merges faces found twice along a tile seam.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "advanced_face_detector.h"
+#include "test_util.h"
+
+namespace {
+
+using TestUtil::check;
+
+// Every pixel of the frame lies in some tile, and no tile leaves it
+bool coversFrame(const std::vector<cv::Rect>& tiles, const cv::Size& frame) {
+    cv::Mat covered = cv::Mat::zeros(frame, CV_8UC1);
+    cv::Rect bounds(0, 0, frame.width, frame.height);
+
+    for (const auto& tile : tiles) {
+        if ((tile & bounds) != tile) {
+            return false;
+        }
+        covered(tile).setTo(1);
+    }
+    return cv::countNonZero(covered) == frame.area();
+}
+
+AdvancedFaceDetection face(int x, int y, int size, float confidence) {
+    AdvancedFaceDetection detection(FaceDetection(cv::Rect(x, y, size, size), confidence));
+    return detection;
+}
+
+void testOverlap() {
+    cv::Size frame(1920, 1080);
+    cv::Size tile(416, 416);
+    float overlap = 0.25f;
+
+    std::vector<cv::Rect> tiles = AdvancedDetectorUtils::computeTiles(frame, tile, overlap, 64);
+
+    check(!tiles.empty(), "overlap: tiles produced");
+    check(coversFrame(tiles, frame), "overlap: frame covered");
+
+    // No growth was needed, so tiles keep the model input size
+    bool native = true;
+    for (const auto& t : tiles) {
+        native = native && t.size() == tile;
+    }
+    check(native, "overlap: native tile size");
+
+    // Horizontal neighbours overlap by at least the requested fraction
+    int min_overlap = static_cast<int>(tile.width * overlap);
+    bool overlapping = true;
+    for (size_t i = 1; i < tiles.size(); ++i) {
+        if (tiles[i].y == tiles[i - 1].y) {
+            overlapping = overlapping && tiles[i - 1].br().x - tiles[i].x >= min_overlap;
+        }
+    }
+    check(overlapping, "overlap: neighbours overlap");
+}
+
+void testEdgeClamping() {
+    // Not a multiple of the stride: the last tile sits on the frame edge
+    cv::Size frame(1000, 700);
+    cv::Size tile(300, 300);
+
+    std::vector<cv::Rect> tiles = AdvancedDetectorUtils::computeTiles(frame, tile, 0.25f, 64);
+
+    check(coversFrame(tiles, frame), "edge: frame covered");
+    check(tiles.front().tl() == cv::Point(0, 0), "edge: first tile at origin");
+    check(tiles.back().br() == cv::Point(frame.width, frame.height), "edge: last tile on the far edges");
+
+    // A tile larger than the frame is clamped to it
+    tiles = AdvancedDetectorUtils::computeTiles(cv::Size(200, 150), tile, 0.25f, 8);
+    check(tiles.size() == 1 && tiles[0] == cv::Rect(0, 0, 200, 150), "edge: tile clamped to a small frame");
+
+    // Degenerate input
+    check(AdvancedDetectorUtils::computeTiles(cv::Size(), tile, 0.25f, 8).empty(), "edge: empty frame");
+    check(AdvancedDetectorUtils::computeTiles(frame, cv::Size(), 0.25f, 8).empty(), "edge: empty tile");
+}
+
+void testMaxTiles() {
+    cv::Size frame(3840, 2160);
+    cv::Size tile(416, 416);
+
+    for (int max_tiles : {1, 2, 4, 8}) {
+        std::vector<cv::Rect> tiles = AdvancedDetectorUtils::computeTiles(frame, tile, 0.25f, max_tiles);
+        std::string name = "max_tiles " + std::to_string(max_tiles);
+
+        check(!tiles.empty() && static_cast<int>(tiles.size()) <= max_tiles, name + ": limit");
+        check(coversFrame(tiles, frame), name + ": frame covered");
+
+        // The limit is met by growing the tile, keeping its shape until clamped
+        check(tiles[0].width >= tile.width && tiles[0].height >= tile.height, name + ": tile grown");
+    }
+
+    std::vector<cv::Rect> single = AdvancedDetectorUtils::computeTiles(frame, tile, 0.25f, 1);
+    check(single.size() == 1 && single[0] == cv::Rect(0, 0, frame.width, frame.height),
+          "max_tiles 1: whole frame");
+}
+
+void testSeamSuppression() {
+    // One face found by two neighbouring tiles, offset by rounding, and
+    // a separate face next to it
+    std::vector<AdvancedFaceDetection> detections = {
+        face(300, 100, 80, 0.80f),
+        face(302, 101, 80, 0.95f),
+        face(500, 100, 80, 0.90f),
+    };
+
+    AdvancedDetectorUtils::suppressOverlaps(detections, 0.4f);
+
+    check(detections.size() == 2, "seam: duplicate dropped");
+    check(detections[0].confidence == 0.95f, "seam: highest confidence kept");
+    check(detections[1].bbox.x == 500, "seam: separate face kept");
+
+    // A box cut by the seam overlapping the full-frame box below the threshold stays
+    detections = {
+        face(100, 100, 100, 0.9f),
+        face(170, 100, 100, 0.8f),
+    };
+    AdvancedDetectorUtils::suppressOverlaps(detections, 0.4f);
+    check(detections.size() == 2, "seam: low overlap kept");
+
+    // Nothing to merge
+    detections = {face(10, 10, 20, 0.5f)};
+    AdvancedDetectorUtils::suppressOverlaps(detections, 0.4f);
+    check(detections.size() == 1, "seam: single detection");
+}
+
+} // namespace
+
+int main() {
+    std::cout << "=== Detection Tiling Test ===" << std::endl;
+
+    testOverlap();
+    testEdgeClamping();
+    testMaxTiles();
+    testSeamSuppression();
+
+    return TestUtil::finish("All tiling checks passed");
+}
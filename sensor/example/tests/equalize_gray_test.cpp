@@ -0,0 +1,107 @@
+/*
+ * Equalize Gray Test
+ *
+ * Checks FaceDetectorUtils::equalizeGray against cv::cvtColor followed
+ * by cv::equalizeHist at each SIMD level, for BGR, BGRA and gray input,
+ * continuous and ROI images, and 16-bit or float input scaled to 8 bits. The output must be bit-identical and the
+ * returned mean must be the mean of the OpenCV gray image.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <opencv2/imgproc.hpp>
+#include "face_detector.h"
+#include "simd_kernels.h"
+#include "test_util.h"
+
+namespace {
+
+void check(bool ok, const std::string& test, SimdLevel level) {
+    TestUtil::check(ok, test + " differs at " + SimdKernels::levelToString(level));
+}
+
+cv::Mat randomImage(int width, int height, int type) {
+    cv::Mat image(height, width, type);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+    return image;
+}
+
+// cv::cvtColor + cv::equalizeHist, the reference for equalizeGray
+double referenceEqualize(const cv::Mat& image, cv::Mat& equalized) {
+    cv::Mat gray;
+    if (image.channels() == 4) {
+        cv::cvtColor(image, gray, cv::COLOR_BGRA2GRAY);
+    } else if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = image;
+    }
+
+    cv::equalizeHist(gray, equalized);
+    return cv::mean(gray)[0];
+}
+
+// reference is the 8-bit image the reference path sees, image by default
+void compare(const cv::Mat& image, const std::string& name, SimdLevel level,
+             const cv::Mat& reference = cv::Mat()) {
+    cv::Mat expected, actual;
+    double expected_mean = referenceEqualize(reference.empty() ? image : reference, expected);
+    double actual_mean = FaceDetectorUtils::equalizeGray(image, actual);
+
+    check(actual.type() == CV_8UC1 && actual.size() == image.size(), name + " shape", level);
+    check(cv::norm(expected, actual, cv::NORM_INF) == 0, name, level);
+    check(std::abs(expected_mean - actual_mean) < 1e-6, name + " mean", level);
+}
+
+void testEqualizeGray(SimdLevel level) {
+    // Widths around the fused pass's block size and the vector widths
+    for (int width : {1, 17, 511, 513, 640}) {
+        std::string size = std::to_string(width) + "x24";
+
+        compare(randomImage(width, 24, CV_8UC3), "bgr " + size, level);
+        compare(randomImage(width, 24, CV_8UC4), "bgra " + size, level);
+        compare(randomImage(width, 24, CV_8UC1), "gray " + size, level);
+    }
+
+    // Non-continuous rows
+    cv::Mat frame = randomImage(640, 480, CV_8UC3);
+    compare(frame(cv::Rect(13, 7, 301, 203)), "bgr roi", level);
+
+    cv::Mat gray_frame = randomImage(640, 480, CV_8UC1);
+    compare(gray_frame(cv::Rect(13, 7, 301, 203)), "gray roi", level);
+
+    // A narrow histogram is stretched, a flat image keeps its value
+    cv::Mat dim = randomImage(320, 240, CV_8UC3) / 8 + cv::Scalar::all(40);
+    compare(dim, "bgr narrow range", level);
+    compare(cv::Mat(64, 64, CV_8UC3, cv::Scalar(77, 77, 77)), "bgr flat", level);
+
+    // Other depths are scaled to 8 bits first
+    cv::Mat bgr = randomImage(64, 24, CV_8UC3);
+    cv::Mat wide, unit;
+    bgr.convertTo(wide, CV_16U, 257.0);
+    bgr.convertTo(unit, CV_32F, 1.0 / 255.0);
+    compare(wide, "bgr 16-bit", level, bgr);
+    compare(unit, "bgr float", level, bgr);
+
+    cv::Mat gray = randomImage(64, 24, CV_8UC1);
+    gray.convertTo(unit, CV_32F, 1.0 / 255.0);
+    compare(unit, "gray float", level, gray);
+}
+
+} // namespace
+
+int main() {
+    std::cout << "=== Equalize Gray Test ===" << std::endl;
+
+    for (SimdLevel level : SimdKernels::supportedLevels()) {
+        std::cout << "Testing " << SimdKernels::levelToString(level) << "..." << std::endl;
+        SimdKernels::setLevel(level);
+        testEqualizeGray(level);
+    }
+
+    return TestUtil::finish("All levels match OpenCV");
+}
@@ -0,0 +1,114 @@
+/*
+ * Frame Arena Test
+ *
+ * Runs frames in a steady-state loop, first through arena intermediates
+ * directly and then through the advanced detector, and checks that after
+ * warm-up the arena's high-water mark and chunk count stay fixed, every
+ * reset goes through and nothing falls back to a weaker backing.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+#include "advanced_face_detector.h"
+#include "frame_arena.h"
+#include "test_util.h"
+
+namespace {
+
+const int WARMUP_FRAMES = 3;
+const int STEADY_FRAMES = 100;
+
+using TestUtil::check;
+
+// Runs frame() WARMUP_FRAMES times, then STEADY_FRAMES times and checks
+// the arena did not grow in the second run
+template <typename Frame>
+void checkSteadyState(const std::string& name, Frame frame) {
+    FrameArena& arena = FrameArena::local();
+
+    for (int i = 0; i < WARMUP_FRAMES; ++i) {
+        frame();
+    }
+
+    FrameArenaStats before = arena.getStats();
+    uint64_t fallbacks = MemoryBackingUtils::getStats().fallbacks;
+
+    for (int i = 0; i < STEADY_FRAMES; ++i) {
+        frame();
+    }
+
+    FrameArenaStats after = arena.getStats();
+
+    check(after.high_water == before.high_water, name + ": high-water mark fixed");
+    check(after.capacity == before.capacity, name + ": capacity fixed");
+    check(after.chunk_allocations == before.chunk_allocations, name + ": no chunk allocations");
+    check(after.resets - before.resets == static_cast<uint64_t>(STEADY_FRAMES), name + ": every frame reset");
+    check(after.deferred_resets == 0, name + ": no deferred resets");
+    check(after.live == 0, name + ": nothing live between frames");
+    check(MemoryBackingUtils::getStats().fallbacks == fallbacks, name + ": no backing fallbacks");
+}
+
+cv::Mat testFrame() {
+    // Larger than one default chunk, so the first frame spills and merges
+    cv::Mat frame(720, 1280, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    return frame;
+}
+
+void testIntermediates() {
+    cv::Mat frame = testFrame();
+
+    checkSteadyState("intermediates", [&frame] {
+        FrameArenaScope scope;
+
+        cv::Mat gray = makeArenaMat();
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+
+        cv::Mat half = makeArenaMat();
+        cv::resize(gray, half, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+
+        cv::Mat blurred = makeArenaMat();
+        cv::GaussianBlur(half, blurred, cv::Size(5, 5), 0);
+    });
+
+    check(FrameArena::local().getStats().high_water > FrameArena::DEFAULT_CHUNK_SIZE,
+          "intermediates: frame spilled past the first chunk");
+}
+
+void testDetector() {
+    AdvancedFaceDetector detector;
+    if (!detector.initialize(DetectionAlgorithm::HAAR_CASCADE)) {
+        check(false, "detector: initialize");
+        return;
+    }
+
+    cv::Mat frame = testFrame();
+    AdvancedDetectionBuffer faces;
+
+    detector.detectFaces(frame, faces);
+    if (detector.hasError()) {
+        std::cout << "- detector: skipped (" << detector.getLastError() << ")" << std::endl;
+        return;
+    }
+
+    checkSteadyState("detector", [&] {
+        detector.detectFaces(frame, faces);
+    });
+    check(!detector.hasError(), "detector: no errors");
+}
+
+} // namespace
+
+int main() {
+    std::cout << "=== Frame Arena Test ===" << std::endl;
+
+    testIntermediates();
+    testDetector();
+
+    return TestUtil::finish("All frame arena checks passed");
+}
@@ -0,0 +1,155 @@
+/*
+ * Memory Backing Test
+ *
+ * Checks the fallback order of backed mappings (hugetlbfs, then
+ * transparent huge pages, then ordinary pages, each counted once), the
+ * pooled Mat allocator Mats opt into, and moving Mats into it.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "memory_backing.h"
+#include "test_util.h"
+
+namespace {
+
+using TestUtil::check;
+
+// Pooled Mats are at least 64KB; this is well above that
+const int POOLED_SIDE = 512;
+
+void testFallbackOrder() {
+    const MemoryBacking order[] = {
+        MemoryBacking::DEFAULT,
+        MemoryBacking::TRANSPARENT_HUGE_PAGES,
+        MemoryBacking::HUGETLBFS
+    };
+
+    for (MemoryBacking requested : order) {
+        std::string name = MemoryBackingUtils::backingToString(requested);
+        MemoryBackingConfig config;
+        config.backing = requested;
+
+        MemoryBackingStats before = MemoryBackingUtils::getStats();
+        BackedRegion region;
+        bool mapped = MemoryBackingUtils::mapRegion(100 << 10, config, region);
+        MemoryBackingStats after = MemoryBackingUtils::getStats();
+
+        check(mapped && region.data, name + ": mapped");
+        check(region.size >= (100u << 10), name + ": size");
+
+        // Never stronger than asked for, and a cascade counts once
+        check(region.backing <= requested, name + ": backing not stronger than requested");
+        uint64_t expected = region.backing == requested ? 0 : 1;
+        check(after.fallbacks - before.fallbacks == expected, name + ": fallback counted once");
+
+        if (region.backing != MemoryBacking::DEFAULT) {
+            check(region.size % MemoryBackingUtils::hugePageSize() == 0, name + ": huge page rounding");
+            check(after.huge_page_bytes - before.huge_page_bytes == region.size, name + ": huge page bytes");
+        }
+        check(after.mapped_bytes - before.mapped_bytes == region.size, name + ": mapped bytes");
+
+        // The memory is usable
+        memset(region.data, 0xA5, region.size);
+        check(region.data[region.size - 1] == 0xA5, name + ": writable");
+
+        MemoryBackingUtils::unmapRegion(region);
+        check(!region.data, name + ": unmapped");
+        check(MemoryBackingUtils::getStats().mapped_bytes == before.mapped_bytes, name + ": mapped bytes returned");
+    }
+}
+
+void testPooling() {
+    MemoryBackingConfig config;
+    config.backing = MemoryBacking::TRANSPARENT_HUGE_PAGES;
+
+    check(MemoryBackingUtils::matAllocator(MemoryBackingConfig()) == nullptr, "no pool for default config");
+
+    cv::MatAllocator* heap = cv::Mat::getDefaultAllocator();
+    cv::MatAllocator* pool = MemoryBackingUtils::matAllocator(config);
+    check(pool != nullptr, "pool for thp config");
+
+    MemoryBackingStats before = MemoryBackingUtils::getStats();
+    cv::Mat a, b, small, temp, reused;
+    for (cv::Mat* mat : {&a, &b, &small, &temp, &reused}) {
+        mat->allocator = pool;
+    }
+
+    a.create(POOLED_SIDE, POOLED_SIDE, CV_8UC1);
+    b.create(POOLED_SIDE, POOLED_SIDE, CV_8UC1);
+    small.create(16, 16, CV_8UC1);
+
+    // A temporary freed right away gives its space back
+    temp.create(POOLED_SIDE, POOLED_SIDE, CV_8UC1);
+    uint8_t* temp_data = temp.data;
+    temp.release();
+    reused.create(POOLED_SIDE, POOLED_SIDE, CV_8UC1);
+    check(reused.data == temp_data, "freed tail reused");
+    reused.release();
+
+    // Mats that did not opt in are untouched
+    cv::Mat plain(POOLED_SIDE, POOLED_SIDE, CV_8UC1);
+    check(cv::Mat::getDefaultAllocator() == heap, "default allocator untouched");
+    check(plain.u && plain.u->currAllocator != pool, "plain Mat off the pool");
+
+    MemoryBackingStats after = MemoryBackingUtils::getStats();
+    size_t region_size = after.mapped_bytes - before.mapped_bytes;
+
+    // Both weights share one region, placed back to back
+    size_t pool_size = std::max<size_t>(4 << 20, MemoryBackingUtils::hugePageSize());
+    check(region_size >= (4u << 20) && region_size <= pool_size, "one pool region for both Mats");
+    check(b.data == a.data + POOLED_SIDE * POOLED_SIDE, "Mats packed in the pool");
+    check(reinterpret_cast<uintptr_t>(a.data) % 64 == 0, "pool alignment");
+
+    // Small Mats stay on the heap
+    check(small.u && small.u->currAllocator == cv::Mat::getStdAllocator(), "small Mat on the heap");
+
+    a.setTo(1);
+    b.setTo(2);
+    check(a.at<uint8_t>(POOLED_SIDE - 1, POOLED_SIDE - 1) == 1 &&
+          b.at<uint8_t>(0, 0) == 2, "pooled Mats usable");
+
+    a.release();
+    b.release();
+    check(MemoryBackingUtils::getStats().fallbacks - before.fallbacks <= 1, "pool falls back at most once");
+}
+
+void testMoveToAllocator() {
+    MemoryBackingConfig config;
+    config.backing = MemoryBacking::TRANSPARENT_HUGE_PAGES;
+    cv::MatAllocator* pool = MemoryBackingUtils::matAllocator(config);
+
+    // An unshared heap Mat moves with its contents
+    cv::Mat weights(POOLED_SIDE, POOLED_SIDE, CV_32FC1, cv::Scalar(3.0f));
+    uint8_t* heap_data = weights.data;
+    check(MemoryBackingUtils::moveToAllocator(weights, pool), "move: unshared Mat moved");
+    check(weights.data != heap_data && weights.u->currAllocator == pool, "move: data in the pool");
+    check(weights.at<float>(POOLED_SIDE - 1, POOLED_SIDE - 1) == 3.0f, "move: contents kept");
+    check(!MemoryBackingUtils::moveToAllocator(weights, pool), "move: already in the pool");
+
+    // A Mat another view shares stays where it is
+    cv::Mat shared(POOLED_SIDE, POOLED_SIDE, CV_32FC1);
+    cv::Mat view = shared.reshape(1, 1);
+    check(!MemoryBackingUtils::moveToAllocator(shared, pool), "move: shared Mat kept");
+    check(shared.data == view.data, "move: view still aliases");
+
+    check(!MemoryBackingUtils::moveToAllocator(shared, nullptr), "move: no pool");
+}
+
+} // namespace
+
+int main() {
+    std::cout << "=== Memory Backing Test ===" << std::endl;
+
+    testFallbackOrder();
+    testPooling();
+    testMoveToAllocator();
+
+    return TestUtil::finish("All memory backing checks passed");
+}
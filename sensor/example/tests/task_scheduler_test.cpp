@@ -0,0 +1,226 @@
+/*
+ * Task Scheduler Test
+ *
+ * Checks nested parallelFor from workers and from outside the pool,
+ * TaskGroup::wait on tasks that keep rescheduling themselves (waited for
+ * from outside the pool and from a worker), and that a scheduler being
+ * destroyed still runs every queued task. A hang is reported as a failure
+ * after a timeout instead of blocking the test run.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "task_scheduler.h"
+#include "test_util.h"
+
+namespace {
+
+const int WORKERS = 3;
+const std::chrono::seconds TIMEOUT(30);
+
+using TestUtil::check;
+
+// A deadlock would hang ctest; give up on the whole run instead
+void runWithTimeout(const std::string& name, const std::function<void()>& test) {
+    std::packaged_task<void()> task(test);
+    std::future<void> done = task.get_future();
+    std::thread thread(std::move(task));
+
+    if (done.wait_for(TIMEOUT) != std::future_status::ready) {
+        std::cout << "✗ " << name << ": timed out" << std::endl;
+        std::_Exit(1);
+    }
+
+    thread.join();
+    done.get();
+}
+
+// outer x inner nested loop; every index must run exactly once
+bool nestedLoop(TaskScheduler& scheduler, int outer, int inner) {
+    std::unique_ptr<std::atomic<int>[]> hits(new std::atomic<int>[outer * inner]);
+    for (int i = 0; i < outer * inner; ++i) {
+        hits[i] = 0;
+    }
+
+    scheduler.parallelFor(0, outer, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            scheduler.parallelFor(0, inner, [&](int inner_begin, int inner_end) {
+                for (int j = inner_begin; j < inner_end; ++j) {
+                    hits[i * inner + j]++;
+                }
+            });
+        }
+    });
+
+    for (int i = 0; i < outer * inner; ++i) {
+        if (hits[i] != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testNestedFromExternal() {
+    TaskScheduler scheduler(WORKERS);
+
+    check(TaskScheduler::currentWorkerIndex() == -1, "external: not a worker");
+    check(nestedLoop(scheduler, 16, 100), "external: nested parallelFor");
+
+    // Two threads outside the pool nest at the same time
+    bool other_ok = false;
+    std::thread other([&] { other_ok = nestedLoop(scheduler, 16, 100); });
+    bool ok = nestedLoop(scheduler, 16, 100);
+    other.join();
+    check(ok && other_ok, "external: concurrent nested parallelFor");
+
+    check(scheduler.getStats().parallel_for_calls > 0, "external: loops went parallel");
+}
+
+void testNestedFromWorker() {
+    TaskScheduler scheduler(WORKERS);
+
+    // More tasks than workers, so every worker nests while the others are
+    // busy nesting too
+    const int TASKS = WORKERS * 4;
+    std::atomic<int> passed{0};
+    std::atomic<int> on_worker{0};
+
+    TaskGroup group(scheduler);
+    for (int t = 0; t < TASKS; ++t) {
+        group.run([&] {
+            if (TaskScheduler::currentWorkerIndex() >= 0) {
+                on_worker++;
+            }
+            if (nestedLoop(scheduler, 8, 50)) {
+                passed++;
+            }
+        });
+    }
+    group.wait();
+
+    check(on_worker == TASKS, "worker: tasks ran on workers");
+    check(passed == TASKS, "worker: nested parallelFor");
+}
+
+// A chain of tasks, each queuing the next from inside the group
+void runChain(TaskGroup& group, std::atomic<int>& count, int remaining) {
+    count++;
+    if (remaining > 0) {
+        group.run([&group, &count, remaining] { runChain(group, count, remaining - 1); });
+    }
+}
+
+// A binary tree of tasks, each queuing two children
+void runTree(TaskGroup& group, std::atomic<int>& count, int depth) {
+    count++;
+    if (depth > 0) {
+        for (int i = 0; i < 2; ++i) {
+            group.run([&group, &count, depth] { runTree(group, count, depth - 1); });
+        }
+    }
+}
+
+void testRescheduling() {
+    TaskScheduler scheduler(WORKERS);
+
+    // Waited for from outside the pool; pending must not reach zero
+    // between a task and the one it queued
+    {
+        std::atomic<int> count{0};
+        TaskGroup group(scheduler);
+        group.run([&] { runChain(group, count, 999); });
+        group.wait();
+        check(count == 1000, "reschedule: chain waited from outside");
+
+        count = 0;
+        group.run([&] { runTree(group, count, 10); });
+        group.wait();
+        check(count == 2047, "reschedule: tree waited from outside");
+    }
+
+    // Waited for from a worker, which runs queued tasks while it waits
+    {
+        std::atomic<int> chain{0};
+        std::atomic<int> tree{0};
+        bool waited_on_worker = false;
+
+        TaskGroup outer(scheduler);
+        outer.run([&] {
+            waited_on_worker = TaskScheduler::currentWorkerIndex() >= 0;
+
+            TaskGroup inner(scheduler);
+            inner.run([&] { runChain(inner, chain, 999); });
+            inner.run([&] { runTree(inner, tree, 10); });
+            inner.wait();
+
+            // Both totals are final as soon as wait returns
+            waited_on_worker = waited_on_worker && chain == 1000 && tree == 2047;
+        });
+        outer.wait();
+
+        check(waited_on_worker, "reschedule: waited from a worker");
+    }
+}
+
+void testShutdownWithQueuedTasks() {
+    const int QUEUED = 100;
+    std::atomic<int> started{0};
+    std::atomic<bool> release{false};
+    std::atomic<int> ran{0};
+    std::atomic<int> followups{0};
+
+    {
+        TaskScheduler scheduler(WORKERS);
+
+        // Hold every worker so the rest stays queued
+        for (int i = 0; i < WORKERS; ++i) {
+            scheduler.submit([&] {
+                started++;
+                while (!release) {
+                    std::this_thread::yield();
+                }
+            });
+        }
+        while (started < WORKERS) {
+            std::this_thread::yield();
+        }
+
+        // Each queued task queues one more while the scheduler shuts down
+        for (int i = 0; i < QUEUED; ++i) {
+            scheduler.submit([&] {
+                ran++;
+                scheduler.submit([&] { followups++; });
+            }, i % 2 ? TaskPriority::NORMAL : TaskPriority::BACKGROUND);
+        }
+
+        check(ran == 0, "shutdown: tasks still queued");
+        release = true;
+    }
+
+    check(ran == QUEUED, "shutdown: queued tasks ran");
+    check(followups == QUEUED, "shutdown: tasks queued during shutdown ran");
+}
+
+} // namespace
+
+int main() {
+    std::cout << "=== Task Scheduler Test ===" << std::endl;
+
+    runWithTimeout("nested parallelFor from outside the pool", testNestedFromExternal);
+    runWithTimeout("nested parallelFor from a worker", testNestedFromWorker);
+    runWithTimeout("rescheduling tasks", testRescheduling);
+    runWithTimeout("shutdown with queued tasks", testShutdownWithQueuedTasks);
+
+    return TestUtil::finish("All task scheduler checks passed");
+}
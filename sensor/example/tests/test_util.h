@@ -0,0 +1,43 @@
+/*
+ * Test Utilities
+ *
+ * The check counter and summary line shared by the test programs. Each
+ * test is its own executable, so one counter per process is enough.
+ *
+ * Author: Face Detection Demo Team
+ * License: MIT
+ */
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <iostream>
+#include <string>
+
+namespace TestUtil {
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    // Records a failed check and names it
+    inline void check(bool ok, const std::string& test) {
+        if (!ok) {
+            std::cout << "✗ " << test << std::endl;
+            failures()++;
+        }
+    }
+
+    // Prints the summary, returns the exit code for main()
+    inline int finish(const std::string& passed) {
+        if (failures()) {
+            std::cout << "✗ " << failures() << " check(s) failed" << std::endl;
+            return 1;
+        }
+
+        std::cout << "✓ " << passed << std::endl;
+        return 0;
+    }
+}
+
+#endif // TEST_UTIL_H
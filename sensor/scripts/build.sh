@@ -85,9 +85,12 @@ EXAMPLES:
     # Clean release build with packaging
     $0 --clean --build-type Release --package
 
-    # Build kernel driver only
+    # Build kernel driver for IMX6ULL
     $0 --target imx6ull --kernel-dir /path/to/kernel/build
 
+    # Build kernel driver for the running kernel
+    $0 --kernel-dir /lib/modules/\$(uname -r)/build
+
 EOF
 }
 
@@ -315,11 +318,17 @@ build_driver() {
     cd "$PROJECT_ROOT/drivers/camera_driver"
     
     local make_args=(
-        "KERNEL_DIR=$KERNEL_DIR"
-        "ARCH=arm"
-        "CROSS_COMPILE=$CROSS_COMPILE"
+        "-C" "$KERNEL_DIR"
+        "M=$PWD"
     )
     
+    # The host kernel's own ARCH is used unless cross-compiling
+    if [[ "$TARGET_PLATFORM" == "imx6ull" ]]; then
+        make_args+=("ARCH=arm" "CROSS_COMPILE=$CROSS_COMPILE")
+    fi
+    
+    make_args+=("modules")
+    
     log_info "Driver make command: make ${make_args[*]}"
     make "${make_args[@]}"
     
@@ -1,160 +1,382 @@
 /*
  * Camera Driver Test Program for IMX6ULL Pro
- * 
- * Tests basic camera functionality including:
- * - Device detection and initialization
- * - Format setting and validation
- * - Frame capture and processing
- * - Performance measurement
- * 
+ *
+ * Checks the device and benchmarks the V4L2 capture paths:
+ * - Device detection and format setting
+ * - I/O methods: read(), mmap, userptr and dmabuf (from a DMA heap)
+ * - Buffer counts and wait methods: poll, select and epoll
+ * - Sustained fps, dropped frames, CPU usage, dequeue latency
+ *   distribution and, with uvc_feeder -s, end-to-end latency
+ *
  * Author: Test Team
  * License: MIT
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <getopt.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <linux/videodev2.h>
+#include <linux/dma-heap.h>
 
 #define TEST_DEVICE "/dev/video0"
+#define TEST_HEAP "/dev/dma_heap/system"
 #define TEST_WIDTH 640
 #define TEST_HEIGHT 480
 #define TEST_FPS 30
 #define TEST_BUFFER_COUNT 4
-#define TEST_FRAME_COUNT 100
+#define TEST_FRAME_COUNT 300
+#define TEST_MAX_BUFFER_COUNTS 8
+#define TEST_WAIT_TIMEOUT_MS 2000
+
+enum io_method {
+    IO_READ = 0,
+    IO_MMAP,
+    IO_USERPTR,
+    IO_DMABUF,
+    IO_NUM
+};
+
+enum wait_method {
+    WAIT_POLL = 0,
+    WAIT_SELECT,
+    WAIT_EPOLL,
+    WAIT_NUM
+};
+
+static const char *io_names[IO_NUM] = { "read", "mmap", "userptr", "dmabuf" };
+static const char *wait_names[WAIT_NUM] = { "poll", "select", "epoll" };
+static const enum v4l2_memory io_memory[IO_NUM] = {
+    0, V4L2_MEMORY_MMAP, V4L2_MEMORY_USERPTR, V4L2_MEMORY_DMABUF
+};
 
 struct buffer {
     void *start;
     size_t length;
+    int dmabuf_fd;
+};
+
+// Latency samples in milliseconds
+struct latency {
+    double *samples;
+    unsigned int count;
+};
+
+struct bench_result {
+    unsigned int frames;
+    unsigned int frames_dropped;    // Sequence gaps reported by the driver
+    unsigned int timeouts;
+    double elapsed;
+    double fps;
+    double cpu_percent;
+    struct latency dequeue;         // Buffer timestamp to DQBUF
+    struct latency end_to_end;      // Feeder stamp to DQBUF
 };
 
 struct test_context {
+    const char *device;
     int fd;
+    int heap_fd;
     struct buffer *buffers;
     unsigned int n_buffers;
     struct v4l2_format format;
     struct v4l2_capability cap;
-    
-    // Statistics
-    unsigned int frames_captured;
-    unsigned int frames_dropped;
-    struct timeval start_time;
-    struct timeval end_time;
+
+    // Configuration
+    __u32 pixelformat;
+    unsigned int width;
+    unsigned int height;
+    unsigned int frame_count;
+    unsigned int target_fps;
+    unsigned int io_mask;
+    unsigned int wait_mask;
+    unsigned int buffer_counts[TEST_MAX_BUFFER_COUNTS];
+    unsigned int n_buffer_counts;
+    int stamped;            // Frames carry a CLOCK_MONOTONIC stamp (uvc_feeder -s)
 };
 
 // Function prototypes
 static int test_device_capabilities(struct test_context *ctx);
 static int test_format_setting(struct test_context *ctx);
-static int test_buffer_allocation(struct test_context *ctx);
-static int test_streaming(struct test_context *ctx);
-static int test_performance(struct test_context *ctx);
-static void cleanup_buffers(struct test_context *ctx);
+static int bench_setup_buffers(struct test_context *ctx, enum io_method io, unsigned int count);
+static void bench_release_buffers(struct test_context *ctx, enum io_method io);
+static int bench_run(struct test_context *ctx, enum io_method io, unsigned int count,
+                     enum wait_method wait, struct bench_result *res);
+static void print_bench_header(void);
+static void print_bench_result(enum io_method io, unsigned int count,
+                               enum wait_method wait, struct bench_result *res);
 static double get_time_diff(struct timeval *start, struct timeval *end);
 static void print_test_result(const char *test_name, int result);
 
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] [device]\n", prog);
+    printf("  -f FOURCC   Pixel format (default: MJPG)\n");
+    printf("  -W WIDTH    Frame width (default: %d)\n", TEST_WIDTH);
+    printf("  -H HEIGHT   Frame height (default: %d)\n", TEST_HEIGHT);
+    printf("  -n FRAMES   Frames per run (default: %d)\n", TEST_FRAME_COUNT);
+    printf("  -r FPS      Expected frame rate (default: %d)\n", TEST_FPS);
+    printf("  -m LIST     I/O methods: read,mmap,userptr,dmabuf or all (default: all)\n");
+    printf("  -b LIST     Buffer counts, e.g. 2,4,8 (default: %d)\n", TEST_BUFFER_COUNT);
+    printf("  -w LIST     Wait methods: poll,select,epoll or all (default: select)\n");
+    printf("  -s          Frames carry a CLOCK_MONOTONIC stamp (uvc_feeder -s)\n");
+}
+
+// Parse a comma separated list of names into a bit mask
+static int parse_names(const char *arg, const char **names, int n, unsigned int *mask)
+{
+    char *copy = strdup(arg);
+    char *tok, *save = NULL;
+    int i;
+
+    *mask = 0;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (!strcmp(tok, "all")) {
+            *mask = (1u << n) - 1;
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (!strcmp(tok, names[i]))
+                break;
+        }
+        if (i == n) {
+            fprintf(stderr, "Unknown method %s\n", tok);
+            free(copy);
+            return -1;
+        }
+        *mask |= 1u << i;
+    }
+
+    free(copy);
+    return *mask ? 0 : -1;
+}
+
+static int parse_counts(const char *arg, struct test_context *ctx)
+{
+    char *copy = strdup(arg);
+    char *tok, *save = NULL;
+
+    ctx->n_buffer_counts = 0;
+    for (tok = strtok_r(copy, ",", &save); tok && ctx->n_buffer_counts < TEST_MAX_BUFFER_COUNTS;
+         tok = strtok_r(NULL, ",", &save)) {
+        int count = atoi(tok);
+
+        if (count < 1) {
+            free(copy);
+            return -1;
+        }
+        ctx->buffer_counts[ctx->n_buffer_counts++] = count;
+    }
+
+    free(copy);
+    return ctx->n_buffer_counts ? 0 : -1;
+}
+
 int main(int argc, char *argv[])
 {
     struct test_context ctx;
-    const char *device = TEST_DEVICE;
+    const char *fourcc = "MJPG";
+    unsigned int io, wait, i;
     int result = 0;
-    
+    int opt;
+
     printf("=== IMX6ULL Camera Driver Test ===\n");
-    
-    // Parse command line arguments
-    if (argc > 1) {
-        device = argv[1];
-    }
-    
-    printf("Testing device: %s\n\n", device);
-    
+
     // Initialize context
     memset(&ctx, 0, sizeof(ctx));
+    ctx.device = TEST_DEVICE;
     ctx.fd = -1;
-    
+    ctx.heap_fd = -1;
+    ctx.width = TEST_WIDTH;
+    ctx.height = TEST_HEIGHT;
+    ctx.frame_count = TEST_FRAME_COUNT;
+    ctx.target_fps = TEST_FPS;
+    ctx.io_mask = (1u << IO_NUM) - 1;
+    ctx.wait_mask = 1u << WAIT_SELECT;
+    ctx.buffer_counts[0] = TEST_BUFFER_COUNT;
+    ctx.n_buffer_counts = 1;
+
+    // Parse command line arguments
+    while ((opt = getopt(argc, argv, "f:W:H:n:r:m:b:w:sh")) != -1) {
+        switch (opt) {
+        case 'f':
+            fourcc = optarg;
+            break;
+        case 'W':
+            ctx.width = atoi(optarg);
+            break;
+        case 'H':
+            ctx.height = atoi(optarg);
+            break;
+        case 'n':
+            ctx.frame_count = atoi(optarg) > 1 ? atoi(optarg) : TEST_FRAME_COUNT;
+            break;
+        case 'r':
+            ctx.target_fps = atoi(optarg);
+            break;
+        case 'm':
+            if (parse_names(optarg, io_names, IO_NUM, &ctx.io_mask)) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'b':
+            if (parse_counts(optarg, &ctx)) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'w':
+            if (parse_names(optarg, wait_names, WAIT_NUM, &ctx.wait_mask)) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 's':
+            ctx.stamped = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+
+    if (optind < argc) {
+        ctx.device = argv[optind];
+    }
+
+    if (strlen(fourcc) != 4) {
+        fprintf(stderr, "Invalid format %s\n", fourcc);
+        return -1;
+    }
+    ctx.pixelformat = v4l2_fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]);
+
+    printf("Testing device: %s\n\n", ctx.device);
+
     // Open device
-    ctx.fd = open(device, O_RDWR | O_NONBLOCK, 0);
+    ctx.fd = open(ctx.device, O_RDWR | O_NONBLOCK, 0);
     if (ctx.fd == -1) {
-        fprintf(stderr, "Cannot open device %s: %s\n", device, strerror(errno));
+        fprintf(stderr, "Cannot open device %s: %s\n", ctx.device, strerror(errno));
         return -1;
     }
-    
+
     printf("Device opened successfully\n");
-    
+
     // Run tests
     printf("\n--- Running Tests ---\n");
-    
+
     result = test_device_capabilities(&ctx);
     print_test_result("Device Capabilities", result);
     if (result != 0) goto cleanup;
-    
+
     result = test_format_setting(&ctx);
     print_test_result("Format Setting", result);
     if (result != 0) goto cleanup;
-    
-    result = test_buffer_allocation(&ctx);
-    print_test_result("Buffer Allocation", result);
-    if (result != 0) goto cleanup;
-    
-    result = test_streaming(&ctx);
-    print_test_result("Streaming", result);
-    if (result != 0) goto cleanup;
-    
-    result = test_performance(&ctx);
-    print_test_result("Performance", result);
-    
+
+    // Benchmark every requested combination
+    printf("\n--- Running Benchmark (%u frames per run) ---\n", ctx.frame_count);
+    print_bench_header();
+
+    for (io = 0; io < IO_NUM; io++) {
+        if (!(ctx.io_mask & (1u << io)))
+            continue;
+
+        // read() manages its own buffers, the count does not apply
+        for (i = 0; i < (io == IO_READ ? 1 : ctx.n_buffer_counts) &&
+                    (ctx.io_mask & (1u << io)); i++) {
+            for (wait = 0; wait < WAIT_NUM; wait++) {
+                struct bench_result res;
+                int ret;
+
+                if (!(ctx.wait_mask & (1u << wait)))
+                    continue;
+
+                memset(&res, 0, sizeof(res));
+                ret = bench_run(&ctx, io, ctx.buffer_counts[i], wait, &res);
+                if (ret > 0) {
+                    printf("%-8s not supported, skipped\n", io_names[io]);
+                    ctx.io_mask &= ~(1u << io);
+                    break;
+                } else if (ret < 0 || res.fps < ctx.target_fps * 0.8) {
+                    result = -1;
+                }
+
+                if (ret == 0)
+                    print_bench_result(io, io == IO_READ ? 0 : ctx.buffer_counts[i], wait, &res);
+
+                free(res.dequeue.samples);
+                free(res.end_to_end.samples);
+            }
+        }
+    }
+
+    if (result != 0) {
+        printf("\n  WARNING: some runs failed or stayed below 80%% of %u fps\n", ctx.target_fps);
+    }
+    print_test_result("Benchmark", result);
+
 cleanup:
-    cleanup_buffers(&ctx);
+    if (ctx.heap_fd >= 0) {
+        close(ctx.heap_fd);
+    }
     if (ctx.fd >= 0) {
         close(ctx.fd);
     }
-    
+
     printf("\n=== Test Summary ===\n");
     if (result == 0) {
         printf("All tests PASSED\n");
     } else {
         printf("Some tests FAILED\n");
     }
-    
+
     return result;
 }
 
 static int test_device_capabilities(struct test_context *ctx)
 {
     printf("Testing device capabilities...\n");
-    
+
     if (ioctl(ctx->fd, VIDIOC_QUERYCAP, &ctx->cap) == -1) {
         fprintf(stderr, "VIDIOC_QUERYCAP failed: %s\n", strerror(errno));
         return -1;
     }
-    
+
     printf("  Driver: %s\n", ctx->cap.driver);
     printf("  Card: %s\n", ctx->cap.card);
     printf("  Bus info: %s\n", ctx->cap.bus_info);
-    printf("  Version: %u.%u.%u\n", 
+    printf("  Version: %u.%u.%u\n",
            (ctx->cap.version >> 16) & 0xFF,
            (ctx->cap.version >> 8) & 0xFF,
            ctx->cap.version & 0xFF);
-    
+
     // Check required capabilities
     if (!(ctx->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
         fprintf(stderr, "Device does not support video capture\n");
         return -1;
     }
-    
+
     if (!(ctx->cap.capabilities & V4L2_CAP_STREAMING)) {
         fprintf(stderr, "Device does not support streaming\n");
         return -1;
     }
-    
-    printf("  Capabilities: Video Capture, Streaming\n");
+
+    printf("  Capabilities: Video Capture, Streaming%s\n",
+           ctx->cap.capabilities & V4L2_CAP_READWRITE ? ", Read/Write" : "");
     return 0;
 }
 
@@ -162,313 +384,553 @@ static int test_format_setting(struct test_context *ctx)
 {
     struct v4l2_fmtdesc fmt_desc;
     struct v4l2_frmsizeenum frmsize;
-    int index = 0;
-    
+
     printf("Testing format setting...\n");
-    
+
     // Enumerate supported formats
     printf("  Supported formats:\n");
     memset(&fmt_desc, 0, sizeof(fmt_desc));
     fmt_desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    
+
     while (ioctl(ctx->fd, VIDIOC_ENUM_FMT, &fmt_desc) == 0) {
         printf("    %d: %s (%.4s)\n", fmt_desc.index, fmt_desc.description,
                (char*)&fmt_desc.pixelformat);
-        
+
         // Enumerate frame sizes for this format
         memset(&frmsize, 0, sizeof(frmsize));
         frmsize.pixel_format = fmt_desc.pixelformat;
         frmsize.index = 0;
-        
+
         while (ioctl(ctx->fd, VIDIOC_ENUM_FRAMESIZES, &frmsize) == 0) {
             if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
                 printf("      %dx%d\n", frmsize.discrete.width, frmsize.discrete.height);
             }
             frmsize.index++;
         }
-        
+
         fmt_desc.index++;
     }
-    
+
     // Set format
     memset(&ctx->format, 0, sizeof(ctx->format));
     ctx->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    ctx->format.fmt.pix.width = TEST_WIDTH;
-    ctx->format.fmt.pix.height = TEST_HEIGHT;
-    ctx->format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+    ctx->format.fmt.pix.width = ctx->width;
+    ctx->format.fmt.pix.height = ctx->height;
+    ctx->format.fmt.pix.pixelformat = ctx->pixelformat;
     ctx->format.fmt.pix.field = V4L2_FIELD_NONE;
-    
+
     if (ioctl(ctx->fd, VIDIOC_S_FMT, &ctx->format) == -1) {
         fprintf(stderr, "VIDIOC_S_FMT failed: %s\n", strerror(errno));
         return -1;
     }
-    
+
     printf("  Set format: %dx%d, %.4s\n",
            ctx->format.fmt.pix.width,
            ctx->format.fmt.pix.height,
            (char*)&ctx->format.fmt.pix.pixelformat);
-    
+
     // Verify format
     if (ioctl(ctx->fd, VIDIOC_G_FMT, &ctx->format) == -1) {
         fprintf(stderr, "VIDIOC_G_FMT failed: %s\n", strerror(errno));
         return -1;
     }
-    
+
     printf("  Actual format: %dx%d, %.4s, size: %u bytes\n",
            ctx->format.fmt.pix.width,
            ctx->format.fmt.pix.height,
            (char*)&ctx->format.fmt.pix.pixelformat,
            ctx->format.fmt.pix.sizeimage);
-    
+
+    if (ctx->format.fmt.pix.pixelformat != ctx->pixelformat) {
+        fprintf(stderr, "Format %.4s not supported\n", (char*)&ctx->pixelformat);
+        return -1;
+    }
+
     return 0;
 }
 
-static int test_buffer_allocation(struct test_context *ctx)
+// Allocate one dmabuf from the system DMA heap
+static int alloc_dmabuf(struct test_context *ctx, size_t size)
+{
+    struct dma_heap_allocation_data data;
+
+    memset(&data, 0, sizeof(data));
+    data.len = size;
+    data.fd_flags = O_RDWR | O_CLOEXEC;
+
+    if (ioctl(ctx->heap_fd, DMA_HEAP_IOCTL_ALLOC, &data) == -1) {
+        fprintf(stderr, "DMA_HEAP_IOCTL_ALLOC failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return data.fd;
+}
+
+static int queue_buffer(struct test_context *ctx, enum io_method io, unsigned int index)
+{
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = io_memory[io];
+    buf.index = index;
+
+    if (io == IO_USERPTR) {
+        buf.m.userptr = (unsigned long)ctx->buffers[index].start;
+        buf.length = ctx->buffers[index].length;
+    } else if (io == IO_DMABUF) {
+        buf.m.fd = ctx->buffers[index].dmabuf_fd;
+        buf.length = ctx->buffers[index].length;
+    }
+
+    return ioctl(ctx->fd, VIDIOC_QBUF, &buf);
+}
+
+/*
+ * Request and queue count buffers for a streaming I/O method. Returns 1 if
+ * the driver does not support the memory type.
+ */
+static int bench_setup_buffers(struct test_context *ctx, enum io_method io, unsigned int count)
 {
     struct v4l2_requestbuffers req;
     struct v4l2_buffer buf;
+    size_t size = ctx->format.fmt.pix.sizeimage;
+    size_t page = sysconf(_SC_PAGESIZE);
     unsigned int i;
-    
-    printf("Testing buffer allocation...\n");
-    
-    // Request buffers
+
+    // Without a DMA heap there is nothing to import
+    if (io == IO_DMABUF && ctx->heap_fd < 0) {
+        ctx->heap_fd = open(TEST_HEAP, O_RDONLY | O_CLOEXEC);
+        if (ctx->heap_fd < 0)
+            return 1;
+    }
+
     memset(&req, 0, sizeof(req));
-    req.count = TEST_BUFFER_COUNT;
+    req.count = count;
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    
+    req.memory = io_memory[io];
+
     if (ioctl(ctx->fd, VIDIOC_REQBUFS, &req) == -1) {
+        if (errno == EINVAL)
+            return 1;
         fprintf(stderr, "VIDIOC_REQBUFS failed: %s\n", strerror(errno));
         return -1;
     }
-    
-    if (req.count < 2) {
+
+    if (req.count < 1) {
         fprintf(stderr, "Insufficient buffer memory\n");
         return -1;
     }
-    
-    printf("  Requested %d buffers, got %d\n", TEST_BUFFER_COUNT, req.count);
+
     ctx->n_buffers = req.count;
-    
-    // Allocate buffer array
     ctx->buffers = calloc(req.count, sizeof(*ctx->buffers));
     if (!ctx->buffers) {
         fprintf(stderr, "Out of memory\n");
         return -1;
     }
-    
-    // Map buffers
+
     for (i = 0; i < ctx->n_buffers; ++i) {
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-        
-        if (ioctl(ctx->fd, VIDIOC_QUERYBUF, &buf) == -1) {
-            fprintf(stderr, "VIDIOC_QUERYBUF failed: %s\n", strerror(errno));
+        struct buffer *b = &ctx->buffers[i];
+
+        b->start = MAP_FAILED;
+        b->dmabuf_fd = -1;
+
+        switch (io) {
+        case IO_MMAP:
+            memset(&buf, 0, sizeof(buf));
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index = i;
+
+            if (ioctl(ctx->fd, VIDIOC_QUERYBUF, &buf) == -1) {
+                fprintf(stderr, "VIDIOC_QUERYBUF failed: %s\n", strerror(errno));
+                return -1;
+            }
+
+            b->length = buf.length;
+            b->start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, ctx->fd, buf.m.offset);
+            break;
+
+        case IO_USERPTR:
+            b->length = (size + page - 1) & ~(page - 1);
+            if (posix_memalign(&b->start, page, b->length))
+                b->start = MAP_FAILED;
+            break;
+
+        case IO_DMABUF:
+            b->length = (size + page - 1) & ~(page - 1);
+            b->dmabuf_fd = alloc_dmabuf(ctx, b->length);
+            if (b->dmabuf_fd < 0)
+                return -1;
+            b->start = mmap(NULL, b->length, PROT_READ, MAP_SHARED, b->dmabuf_fd, 0);
+            break;
+
+        default:
             return -1;
         }
-        
-        ctx->buffers[i].length = buf.length;
-        ctx->buffers[i].start = mmap(NULL, buf.length,
-                                    PROT_READ | PROT_WRITE,
-                                    MAP_SHARED,
-                                    ctx->fd, buf.m.offset);
-        
-        if (MAP_FAILED == ctx->buffers[i].start) {
-            fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+
+        if (b->start == MAP_FAILED) {
+            fprintf(stderr, "Buffer %u allocation failed: %s\n", i, strerror(errno));
+            return -1;
+        }
+
+        if (queue_buffer(ctx, io, i) == -1) {
+            fprintf(stderr, "VIDIOC_QBUF failed: %s\n", strerror(errno));
             return -1;
         }
-        
-        printf("  Buffer %d: %zu bytes mapped\n", i, ctx->buffers[i].length);
     }
-    
+
     return 0;
 }
 
-static int test_streaming(struct test_context *ctx)
+static void bench_release_buffers(struct test_context *ctx, enum io_method io)
 {
-    struct v4l2_buffer buf;
-    enum v4l2_buf_type type;
+    struct v4l2_requestbuffers req;
     unsigned int i;
-    int frames_to_capture = 10;
-    
-    printf("Testing streaming...\n");
-    
-    // Queue all buffers
-    for (i = 0; i < ctx->n_buffers; ++i) {
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-        
-        if (ioctl(ctx->fd, VIDIOC_QBUF, &buf) == -1) {
-            fprintf(stderr, "VIDIOC_QBUF failed: %s\n", strerror(errno));
-            return -1;
+
+    // Free the driver side first, it may still reference user memory
+    memset(&req, 0, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = io_memory[io];
+    ioctl(ctx->fd, VIDIOC_REQBUFS, &req);
+
+    if (ctx->buffers) {
+        for (i = 0; i < ctx->n_buffers; ++i) {
+            struct buffer *b = &ctx->buffers[i];
+
+            if (b->start == MAP_FAILED)
+                continue;
+
+            if (io == IO_USERPTR)
+                free(b->start);
+            else
+                munmap(b->start, b->length);
+
+            if (b->dmabuf_fd >= 0)
+                close(b->dmabuf_fd);
         }
+        free(ctx->buffers);
+        ctx->buffers = NULL;
     }
-    
-    // Start streaming
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (ioctl(ctx->fd, VIDIOC_STREAMON, &type) == -1) {
-        fprintf(stderr, "VIDIOC_STREAMON failed: %s\n", strerror(errno));
-        return -1;
+
+    ctx->n_buffers = 0;
+}
+
+/*
+ * Wait until a frame can be dequeued (or read). Returns >0 when ready,
+ * 0 on timeout and -1 on error.
+ */
+static int wait_frame(struct test_context *ctx, enum wait_method wait, int epoll_fd)
+{
+    int r;
+
+    switch (wait) {
+    case WAIT_POLL: {
+        struct pollfd pfd = { .fd = ctx->fd, .events = POLLIN };
+
+        r = poll(&pfd, 1, TEST_WAIT_TIMEOUT_MS);
+        break;
     }
-    
-    printf("  Streaming started, capturing %d frames...\n", frames_to_capture);
-    
-    // Capture frames
-    for (i = 0; i < frames_to_capture; ++i) {
+    case WAIT_SELECT: {
         fd_set fds;
         struct timeval tv;
-        int r;
-        
+
         FD_ZERO(&fds);
         FD_SET(ctx->fd, &fds);
-        
-        tv.tv_sec = 2;
-        tv.tv_usec = 0;
-        
+        tv.tv_sec = TEST_WAIT_TIMEOUT_MS / 1000;
+        tv.tv_usec = (TEST_WAIT_TIMEOUT_MS % 1000) * 1000;
+
         r = select(ctx->fd + 1, &fds, NULL, NULL, &tv);
-        
-        if (-1 == r) {
-            if (EINTR == errno) continue;
-            fprintf(stderr, "select failed: %s\n", strerror(errno));
-            return -1;
-        }
-        
-        if (0 == r) {
-            fprintf(stderr, "select timeout\n");
-            return -1;
-        }
-        
-        // Dequeue buffer
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        
-        if (ioctl(ctx->fd, VIDIOC_DQBUF, &buf) == -1) {
-            fprintf(stderr, "VIDIOC_DQBUF failed: %s\n", strerror(errno));
-            return -1;
-        }
-        
-        printf("  Frame %d: %u bytes, sequence %u\n", 
-               i + 1, buf.bytesused, buf.sequence);
-        
-        // Queue buffer back
-        if (ioctl(ctx->fd, VIDIOC_QBUF, &buf) == -1) {
-            fprintf(stderr, "VIDIOC_QBUF failed: %s\n", strerror(errno));
-            return -1;
-        }
+        break;
     }
-    
-    // Stop streaming
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (ioctl(ctx->fd, VIDIOC_STREAMOFF, &type) == -1) {
-        fprintf(stderr, "VIDIOC_STREAMOFF failed: %s\n", strerror(errno));
+    case WAIT_EPOLL: {
+        struct epoll_event ev;
+
+        r = epoll_wait(epoll_fd, &ev, 1, TEST_WAIT_TIMEOUT_MS);
+        break;
+    }
+    default:
+        return -1;
+    }
+
+    if (r == -1 && errno == EINTR)
+        return wait_frame(ctx, wait, epoll_fd);
+
+    return r;
+}
+
+static int reopen_device(struct test_context *ctx)
+{
+    close(ctx->fd);
+
+    ctx->fd = open(ctx->device, O_RDWR | O_NONBLOCK, 0);
+    if (ctx->fd == -1) {
+        fprintf(stderr, "Cannot reopen device %s: %s\n", ctx->device, strerror(errno));
         return -1;
     }
-    
-    printf("  Streaming stopped\n");
+
     return 0;
 }
 
-static int test_performance(struct test_context *ctx)
+static uint64_t now_ns(void)
 {
-    struct v4l2_buffer buf;
-    enum v4l2_buf_type type;
-    unsigned int i;
-    double elapsed_time, fps;
-    
-    printf("Testing performance...\n");
-    
-    // Start streaming
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (ioctl(ctx->fd, VIDIOC_STREAMON, &type) == -1) {
-        fprintf(stderr, "VIDIOC_STREAMON failed: %s\n", strerror(errno));
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void add_sample(struct latency *lat, double ms)
+{
+    lat->samples[lat->count++] = ms;
+}
+
+// Latency from the stamp uvc_feeder writes into the first 8 bytes
+static void add_stamp_sample(struct bench_result *res, const void *data, size_t len, uint64_t now)
+{
+    uint64_t stamp;
+
+    if (len < sizeof(stamp))
+        return;
+
+    memcpy(&stamp, data, sizeof(stamp));
+    if (stamp && stamp < now)
+        add_sample(&res->end_to_end, (now - stamp) / 1e6);
+}
+
+/*
+ * Capture frame_count frames with one configuration. The clock starts at
+ * the first frame, so stream start-up does not count against the fps.
+ * Returns 1 if the I/O method is not supported.
+ */
+static int bench_run(struct test_context *ctx, enum io_method io, unsigned int count,
+                     enum wait_method wait, struct bench_result *res)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    size_t size = ctx->format.fmt.pix.sizeimage;
+    struct timeval start_time, end_time;
+    void *read_buf = NULL;
+    double cpu_start = 0;
+    int epoll_fd = -1;
+    int streaming = 0;
+    int last_sequence = -1;
+    int ret = -1;
+
+    res->dequeue.samples = calloc(ctx->frame_count, sizeof(double));
+    res->end_to_end.samples = calloc(ctx->frame_count, sizeof(double));
+    if (!res->dequeue.samples || !res->end_to_end.samples)
         return -1;
+
+    if (io == IO_READ) {
+        __u32 caps = ctx->cap.capabilities & V4L2_CAP_DEVICE_CAPS ?
+                     ctx->cap.device_caps : ctx->cap.capabilities;
+
+        if (!(caps & V4L2_CAP_READWRITE))
+            return 1;
+        read_buf = malloc(size);
+        if (!read_buf)
+            return -1;
+    } else {
+        ret = bench_setup_buffers(ctx, io, count);
+        if (ret)
+            goto out;
+        ret = -1;
+
+        if (ioctl(ctx->fd, VIDIOC_STREAMON, &type) == -1) {
+            fprintf(stderr, "VIDIOC_STREAMON failed: %s\n", strerror(errno));
+            goto out;
+        }
+        streaming = 1;
     }
-    
-    gettimeofday(&ctx->start_time, NULL);
-    
-    // Capture frames for performance measurement
-    for (i = 0; i < TEST_FRAME_COUNT; ++i) {
-        fd_set fds;
-        struct timeval tv;
+
+    if (wait == WAIT_EPOLL) {
+        struct epoll_event ev = { .events = EPOLLIN };
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        ev.data.fd = ctx->fd;
+        if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ctx->fd, &ev) == -1) {
+            fprintf(stderr, "epoll setup failed: %s\n", strerror(errno));
+            goto out;
+        }
+    }
+
+    // read() only starts streaming on the first call
+    if (io == IO_READ && read(ctx->fd, read_buf, size) == -1 && errno != EAGAIN) {
+        fprintf(stderr, "read failed: %s\n", strerror(errno));
+        goto out;
+    }
+
+    while (res->frames < ctx->frame_count) {
+        struct v4l2_buffer buf;
+        uint64_t now;
         int r;
-        
-        FD_ZERO(&fds);
-        FD_SET(ctx->fd, &fds);
-        
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        
-        r = select(ctx->fd + 1, &fds, NULL, NULL, &tv);
-        
-        if (r <= 0) {
-            ctx->frames_dropped++;
-            continue;
+
+        r = wait_frame(ctx, wait, epoll_fd);
+        if (r == -1) {
+            fprintf(stderr, "%s failed: %s\n", wait_names[wait], strerror(errno));
+            goto out;
         }
-        
-        // Dequeue buffer
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        
-        if (ioctl(ctx->fd, VIDIOC_DQBUF, &buf) == -1) {
-            ctx->frames_dropped++;
+        if (r == 0) {
+            if (++res->timeouts >= 3) {
+                fprintf(stderr, "%s timeout\n", wait_names[wait]);
+                goto out;
+            }
             continue;
         }
-        
-        ctx->frames_captured++;
-        
-        // Queue buffer back
-        ioctl(ctx->fd, VIDIOC_QBUF, &buf);
-    }
-    
-    gettimeofday(&ctx->end_time, NULL);
-    
-    // Stop streaming
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    ioctl(ctx->fd, VIDIOC_STREAMOFF, &type);
-    
-    // Calculate performance metrics
-    elapsed_time = get_time_diff(&ctx->start_time, &ctx->end_time);
-    fps = ctx->frames_captured / elapsed_time;
-    
-    printf("  Performance Results:\n");
-    printf("    Frames captured: %u\n", ctx->frames_captured);
-    printf("    Frames dropped: %u\n", ctx->frames_dropped);
-    printf("    Elapsed time: %.2f seconds\n", elapsed_time);
-    printf("    Average FPS: %.2f\n", fps);
-    printf("    Target FPS: %d\n", TEST_FPS);
-    
-    if (fps < TEST_FPS * 0.8) {
-        printf("    WARNING: FPS below 80%% of target\n");
-        return -1;
+
+        if (io == IO_READ) {
+            ssize_t n = read(ctx->fd, read_buf, size);
+
+            if (n == -1) {
+                if (errno == EAGAIN)
+                    continue;
+                fprintf(stderr, "read failed: %s\n", strerror(errno));
+                goto out;
+            }
+
+            now = now_ns();
+            if (ctx->stamped)
+                add_stamp_sample(res, read_buf, n, now);
+        } else {
+            memset(&buf, 0, sizeof(buf));
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = io_memory[io];
+
+            if (ioctl(ctx->fd, VIDIOC_DQBUF, &buf) == -1) {
+                if (errno == EAGAIN)
+                    continue;
+                fprintf(stderr, "VIDIOC_DQBUF failed: %s\n", strerror(errno));
+                goto out;
+            }
+
+            now = now_ns();
+            if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+                uint64_t ts = (uint64_t)buf.timestamp.tv_sec * 1000000000ull +
+                              buf.timestamp.tv_usec * 1000ull;
+
+                if (ts && ts <= now)
+                    add_sample(&res->dequeue, (now - ts) / 1e6);
+            }
+
+            if (last_sequence >= 0 && (int)buf.sequence > last_sequence + 1)
+                res->frames_dropped += buf.sequence - last_sequence - 1;
+            last_sequence = buf.sequence;
+
+            if (ctx->stamped)
+                add_stamp_sample(res, ctx->buffers[buf.index].start, buf.bytesused, now);
+
+            if (queue_buffer(ctx, io, buf.index) == -1) {
+                fprintf(stderr, "VIDIOC_QBUF failed: %s\n", strerror(errno));
+                goto out;
+            }
+        }
+
+        if (res->frames++ == 0) {
+            gettimeofday(&start_time, NULL);
+            cpu_start = cpu_seconds();
+        }
     }
-    
-    return 0;
+
+    gettimeofday(&end_time, NULL);
+    res->elapsed = get_time_diff(&start_time, &end_time);
+    if (res->elapsed > 0) {
+        res->fps = (res->frames - 1) / res->elapsed;
+        res->cpu_percent = (cpu_seconds() - cpu_start) / res->elapsed * 100.0;
+    }
+    ret = 0;
+
+out:
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    if (streaming)
+        ioctl(ctx->fd, VIDIOC_STREAMOFF, &type);
+    if (io == IO_READ) {
+        free(read_buf);
+        // Only closing the file stops the streaming read() started
+        if (reopen_device(ctx))
+            ret = -1;
+    } else {
+        bench_release_buffers(ctx, io);
+    }
+
+    return ret;
 }
 
-static void cleanup_buffers(struct test_context *ctx)
+static int compare_double(const void *a, const void *b)
 {
-    unsigned int i;
-    
-    if (ctx->buffers) {
-        for (i = 0; i < ctx->n_buffers; ++i) {
-            if (ctx->buffers[i].start != MAP_FAILED) {
-                munmap(ctx->buffers[i].start, ctx->buffers[i].length);
-            }
-        }
-        free(ctx->buffers);
-        ctx->buffers = NULL;
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const struct latency *lat, double p)
+{
+    unsigned int rank;
+
+    if (!lat->count)
+        return 0;
+
+    rank = (unsigned int)(p / 100.0 * lat->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > lat->count)
+        rank = lat->count;
+    return lat->samples[rank - 1];
+}
+
+static void format_latency(char *out, size_t len, struct latency *lat)
+{
+    if (!lat->count) {
+        snprintf(out, len, "%s", "-");
+        return;
     }
+
+    qsort(lat->samples, lat->count, sizeof(double), compare_double);
+    snprintf(out, len, "%.2f/%.2f/%.2f/%.2f",
+             percentile(lat, 50), percentile(lat, 90),
+             percentile(lat, 99), lat->samples[lat->count - 1]);
+}
+
+static void print_bench_header(void)
+{
+    printf("%-8s %4s %-7s %6s %5s %7s %6s  %-27s %s\n",
+           "io", "bufs", "wait", "frames", "drop", "fps", "cpu%",
+           "dequeue ms p50/p90/p99/max", "end-to-end ms p50/p90/p99/max");
+}
+
+static void print_bench_result(enum io_method io, unsigned int count,
+                               enum wait_method wait, struct bench_result *res)
+{
+    char dequeue[64], end_to_end[64];
+    char bufs[16];
+
+    format_latency(dequeue, sizeof(dequeue), &res->dequeue);
+    format_latency(end_to_end, sizeof(end_to_end), &res->end_to_end);
+
+    if (count)
+        snprintf(bufs, sizeof(bufs), "%u", count);
+    else
+        snprintf(bufs, sizeof(bufs), "-");
+
+    printf("%-8s %4s %-7s %6u %5u %7.2f %6.1f  %-27s %s\n",
+           io_names[io], bufs, wait_names[wait], res->frames, res->frames_dropped,
+           res->fps, res->cpu_percent, dequeue, end_to_end);
 }
 
 static double get_time_diff(struct timeval *start, struct timeval *end)
 {
-    return (end->tv_sec - start->tv_sec) + 
+    return (end->tv_sec - start->tv_sec) +
            (end->tv_usec - start->tv_usec) / 1000000.0;
 }
 
@@ -0,0 +1,236 @@
+#!/bin/bash
+
+# Camera driver test bench on an emulated UVC camera
+#
+# Runs camera_driver.c against uvc_feeder (a raw-gadget UVC camera on
+# dummy_hcd) and reports throughput and end-to-end latency per capture
+# format. Needs root and a kernel with CONFIG_USB_DUMMY_HCD=m and
+# CONFIG_USB_RAW_GADGET=m (5.7 or later); a VM is fine.
+#
+# Author: Test Team
+# License: MIT
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+TESTS_DIR="$(dirname "$SCRIPT_DIR")"
+PROJECT_ROOT="$(dirname "$TESTS_DIR")"
+
+# Default configuration
+MODULE="$PROJECT_ROOT/build/drivers/camera_driver.ko"
+FPS=30
+PAYLOAD=""
+INPUT=""
+FORMATS="YUYV GREY"
+TEST_ARGS=""
+CC="${CC:-cc}"
+WORK_DIR=""
+FEEDER_PID=""
+
+# Color output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+log_info() {
+    echo -e "${BLUE}[INFO]${NC} $1"
+}
+
+log_warn() {
+    echo -e "${YELLOW}[WARN]${NC} $1"
+}
+
+log_error() {
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+log_success() {
+    echo -e "${GREEN}[SUCCESS]${NC} $1"
+}
+
+show_help() {
+    cat << EOF
+Usage: $0 [OPTIONS]
+
+Test bench for the IMX6ULL camera driver on an emulated UVC camera
+
+OPTIONS:
+    -h, --help              Show this help message
+    -m, --module FILE       Driver module [default: $MODULE]
+    -f, --fps FPS           Emulated camera frame rate [default: $FPS]
+    -p, --payload BYTES     dwMaxPayloadTransferSize [default: one payload per frame]
+    -i, --input FILE        Replay raw YUYV frames instead of a test pattern
+    -F, --formats LIST      Capture formats to measure [default: "$FORMATS"]
+    -a, --test-args ARGS    Extra camera_test options, e.g. "-m all -b 2,4,8 -w all"
+
+Latency is measured end to end (feeder stamp to DQBUF) for YUYV only;
+other formats rewrite the stamped bytes.
+
+EXAMPLES:
+    # Default run after scripts/build.sh --kernel-dir /lib/modules/\$(uname -r)/build
+    sudo $0
+
+    # Exercise payloads spanning several URBs
+    sudo $0 --payload 1048576
+
+    # Compare every I/O method, buffer count and wait method
+    sudo $0 --formats YUYV --test-args "-m all -b 2,3,4,8 -w all"
+EOF
+}
+
+parse_args() {
+    while [[ $# -gt 0 ]]; do
+        case $1 in
+            -h|--help)
+                show_help
+                exit 0
+                ;;
+            -m|--module)
+                MODULE="$2"
+                shift 2
+                ;;
+            -f|--fps)
+                FPS="$2"
+                shift 2
+                ;;
+            -p|--payload)
+                PAYLOAD="$2"
+                shift 2
+                ;;
+            -i|--input)
+                INPUT="$2"
+                shift 2
+                ;;
+            -F|--formats)
+                FORMATS="$2"
+                shift 2
+                ;;
+            -a|--test-args)
+                TEST_ARGS="$2"
+                shift 2
+                ;;
+            *)
+                log_error "Unknown option: $1"
+                show_help
+                exit 1
+                ;;
+        esac
+    done
+}
+
+cleanup() {
+    if [[ -n "$FEEDER_PID" ]]; then
+        kill "$FEEDER_PID" 2>/dev/null || true
+        wait "$FEEDER_PID" 2>/dev/null || true
+    fi
+    if [[ -n "$WORK_DIR" ]]; then
+        rm -rf "$WORK_DIR"
+    fi
+}
+
+# Load dummy_hcd, raw_gadget and the driver under test
+setup_modules() {
+    if [[ $EUID -ne 0 ]]; then
+        log_error "Must run as root"
+        exit 1
+    fi
+
+    modprobe dummy_hcd
+    modprobe raw_gadget
+
+    # uvcvideo matches the same interfaces and would claim the camera first
+    if lsmod | grep -q '^uvcvideo'; then
+        log_warn "Unloading uvcvideo"
+        modprobe -r uvcvideo
+    fi
+
+    if ! lsmod | grep -q '^camera_driver'; then
+        if [[ ! -f "$MODULE" ]]; then
+            log_error "Driver module not found: $MODULE"
+            exit 1
+        fi
+        insmod "$MODULE"
+    fi
+}
+
+build_tools() {
+    WORK_DIR="$(mktemp -d)"
+    log_info "Building test tools in $WORK_DIR"
+    "$CC" -O2 -Wall -pthread -o "$WORK_DIR/uvc_feeder" "$SCRIPT_DIR/uvc_feeder.c"
+    "$CC" -O2 -Wall -o "$WORK_DIR/camera_test" "$TESTS_DIR/camera_test.c"
+}
+
+start_feeder() {
+    local args=(-s -f "$FPS")
+
+    [[ -n "$PAYLOAD" ]] && args+=(-p "$PAYLOAD")
+    [[ -n "$INPUT" ]] && args+=(-i "$INPUT")
+
+    "$WORK_DIR/uvc_feeder" "${args[@]}" &
+    FEEDER_PID=$!
+}
+
+# Wait for the driver to register its capture node
+find_video_node() {
+    local i node
+
+    for i in $(seq 1 50); do
+        for node in /sys/class/video4linux/video*; do
+            if [[ -f "$node/name" && "$(cat "$node/name")" == "IMX6ULL Camera" ]]; then
+                echo "/dev/$(basename "$node")"
+                return 0
+            fi
+        done
+        sleep 0.2
+    done
+
+    return 1
+}
+
+run_bench() {
+    local device="$1"
+    local format result=0
+
+    for format in $FORMATS; do
+        local args=(-f "$format" -r "$FPS")
+
+        [[ "$format" == "YUYV" ]] && args+=(-s)
+        # Word splitting is intended here
+        args+=($TEST_ARGS)
+
+        log_info "Measuring $format on $device"
+        if ! "$WORK_DIR/camera_test" "${args[@]}" "$device"; then
+            log_warn "$format run reported failures"
+            result=1
+        fi
+    done
+
+    return $result
+}
+
+main() {
+    local device
+
+    parse_args "$@"
+    trap cleanup EXIT
+
+    setup_modules
+    build_tools
+    start_feeder
+
+    if ! device="$(find_video_node)"; then
+        log_error "Camera driver did not bind to the emulated camera"
+        exit 1
+    fi
+
+    if run_bench "$device"; then
+        log_success "Test bench completed"
+    else
+        log_error "Test bench completed with failures"
+        exit 1
+    fi
+}
+
+main "$@"
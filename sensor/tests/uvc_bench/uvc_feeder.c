@@ -0,0 +1,745 @@
+/*
+ * Emulated UVC Camera for the IMX6ULL Camera Driver Test Bench
+ *
+ * Presents a bulk-streaming UVC 1.1 camera through raw-gadget on top of
+ * dummy_hcd, so camera_driver.c can be exercised on any Linux host:
+ * - VideoControl/VideoStreaming descriptors with YUYV 640x480 and 1280x720
+ * - VS_PROBE/VS_COMMIT negotiation
+ * - Payloads with FID/EOF/PTS/SCR headers, paced to the requested frame rate
+ * - Frames replayed from a raw YUYV recording or a generated test pattern
+ *
+ * The in-kernel UVC gadget function streams isochronously, which dummy_hcd
+ * does not emulate, hence the user space device.
+ *
+ * Requires a kernel with CONFIG_USB_DUMMY_HCD and CONFIG_USB_RAW_GADGET.
+ *
+ * Author: Test Team
+ * License: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <linux/usb/ch9.h>
+#include <linux/usb/video.h>
+#include <linux/usb/raw_gadget.h>
+
+#define FEEDER_UDC_DRIVER   "dummy_udc"
+#define FEEDER_UDC_DEVICE   "dummy_udc.0"
+#define FEEDER_EP0_MAX      4096
+#define FEEDER_IO_MAX       4096        // raw-gadget limits one transfer to a page
+#define FEEDER_HEADER_LEN   12          // bHeaderLength, bmHeaderInfo, PTS, SCR
+#define FEEDER_BULK_PACKET  512
+#define FEEDER_CLOCK_HZ     48000000    // dwClockFrequency
+#define FEEDER_PROBE_LEN    34          // UVC 1.1 probe/commit control
+
+struct feeder_frame {
+    uint16_t width;
+    uint16_t height;
+};
+
+static const struct feeder_frame frames[] = {
+    { 640, 480 },
+    { 1280, 720 },
+};
+#define NUM_FRAMES (sizeof(frames) / sizeof(frames[0]))
+
+struct io_buf {
+    struct usb_raw_ep_io io;
+    uint8_t data[FEEDER_IO_MAX];
+};
+
+struct feeder {
+    int fd;
+    int ep_handle;
+    uint8_t ep_addr;
+
+    // Options
+    const char *input;
+    unsigned int fps;
+    uint32_t max_payload;
+    bool stamp;
+
+    // Negotiated state, guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t probe[FEEDER_PROBE_LEN];
+    unsigned int frame_index;       // 1-based, 0 = not committed
+    unsigned int generation;        // Bumped on every commit
+
+    // Statistics
+    unsigned long frames_sent;
+    unsigned long bytes_sent;
+};
+
+static volatile sig_atomic_t stop;
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t frame_size(unsigned int index)
+{
+    return frames[index - 1].width * frames[index - 1].height * 2;
+}
+
+/*
+ * Descriptors
+ */
+
+static const struct usb_device_descriptor device_desc = {
+    .bLength = USB_DT_DEVICE_SIZE,
+    .bDescriptorType = USB_DT_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = USB_CLASS_MISC,
+    .bDeviceSubClass = 0x02,            // Common class
+    .bDeviceProtocol = 0x01,            // Interface association
+    .bMaxPacketSize0 = 64,
+    .idVendor = 0x1d6b,                 // Linux Foundation
+    .idProduct = 0x0102,
+    .bcdDevice = 0x0100,
+    .iManufacturer = 1,
+    .iProduct = 2,
+    .iSerialNumber = 0,
+    .bNumConfigurations = 1,
+};
+
+static const char *strings[] = { NULL, "imx6pull", "UVC Bench Camera" };
+
+// Build the configuration descriptor; returns its length
+static int build_config(uint8_t *buf, uint8_t ep_addr)
+{
+    uint8_t *p = buf;
+    uint8_t *vc_header, *vs_header;
+    unsigned int i;
+
+    // Configuration
+    p[0] = USB_DT_CONFIG_SIZE; p[1] = USB_DT_CONFIG;
+    p[4] = 2;                           // bNumInterfaces
+    p[5] = 1;                           // bConfigurationValue
+    p[6] = 0;
+    p[7] = USB_CONFIG_ATT_ONE | USB_CONFIG_ATT_SELFPOWER;
+    p[8] = 50;
+    p += USB_DT_CONFIG_SIZE;
+
+    // Interface association
+    p[0] = 8; p[1] = USB_DT_INTERFACE_ASSOCIATION;
+    p[2] = 0; p[3] = 2;
+    p[4] = USB_CLASS_VIDEO; p[5] = UVC_SC_VIDEO_INTERFACE_COLLECTION;
+    p[6] = UVC_PC_PROTOCOL_UNDEFINED; p[7] = 2;
+    p += 8;
+
+    // VideoControl interface, no interrupt endpoint
+    p[0] = USB_DT_INTERFACE_SIZE; p[1] = USB_DT_INTERFACE;
+    p[2] = 0; p[3] = 0; p[4] = 0;
+    p[5] = USB_CLASS_VIDEO; p[6] = UVC_SC_VIDEOCONTROL; p[7] = 0; p[8] = 2;
+    p += USB_DT_INTERFACE_SIZE;
+
+    vc_header = p;
+    p[0] = 13; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VC_HEADER;
+    put_le16(p + 3, 0x0110);
+    put_le32(p + 7, FEEDER_CLOCK_HZ);
+    p[11] = 1; p[12] = 1;               // One streaming interface: 1
+    p += 13;
+
+    // Camera input terminal
+    memset(p, 0, 18);
+    p[0] = 18; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VC_INPUT_TERMINAL;
+    p[3] = 1; put_le16(p + 4, UVC_ITT_CAMERA);
+    p[14] = 3;                          // bControlSize, no controls
+    p += 18;
+
+    // Streaming output terminal
+    p[0] = 9; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VC_OUTPUT_TERMINAL;
+    p[3] = 2; put_le16(p + 4, UVC_TT_STREAMING);
+    p[6] = 0; p[7] = 1; p[8] = 0;
+    p += 9;
+    put_le16(vc_header + 5, p - vc_header);
+
+    // VideoStreaming interface with a bulk endpoint on alternate setting 0
+    p[0] = USB_DT_INTERFACE_SIZE; p[1] = USB_DT_INTERFACE;
+    p[2] = 1; p[3] = 0; p[4] = 1;
+    p[5] = USB_CLASS_VIDEO; p[6] = UVC_SC_VIDEOSTREAMING; p[7] = 0; p[8] = 0;
+    p += USB_DT_INTERFACE_SIZE;
+
+    vs_header = p;
+    p[0] = 14; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VS_INPUT_HEADER;
+    p[3] = 1;                           // bNumFormats
+    p[5] = ep_addr;
+    p[6] = 0; p[7] = 2;                 // bmInfo, bTerminalLink
+    p[8] = 0; p[9] = 0; p[10] = 0;
+    p[11] = 1; p[12] = 0; p[13] = 0;
+    p += 14;
+
+    // Uncompressed YUY2 format
+    memset(p, 0, 27);
+    p[0] = 27; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VS_FORMAT_UNCOMPRESSED;
+    p[3] = 1; p[4] = NUM_FRAMES;
+    memcpy(p + 5, "YUY2\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 16);
+    p[21] = 16; p[22] = 1;
+    p += 27;
+
+    for (i = 0; i < NUM_FRAMES; i++) {
+        uint32_t size = frames[i].width * frames[i].height * 2;
+        uint32_t interval = 10000000 / 30;
+
+        memset(p, 0, 30);
+        p[0] = 30; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VS_FRAME_UNCOMPRESSED;
+        p[3] = i + 1;
+        put_le16(p + 5, frames[i].width);
+        put_le16(p + 7, frames[i].height);
+        put_le32(p + 9, size * 8 * 30);
+        put_le32(p + 13, size * 8 * 30);
+        put_le32(p + 17, size);
+        put_le32(p + 21, interval);
+        p[25] = 1;
+        put_le32(p + 26, interval);
+        p += 30;
+    }
+
+    // Color matching: BT.709, BT.709, SMPTE 170M
+    p[0] = 6; p[1] = USB_DT_CS_INTERFACE; p[2] = UVC_VS_COLORFORMAT;
+    p[3] = 1; p[4] = 1; p[5] = 4;
+    p += 6;
+    put_le16(vs_header + 4, p - vs_header);
+
+    // Bulk IN endpoint
+    p[0] = USB_DT_ENDPOINT_SIZE; p[1] = USB_DT_ENDPOINT;
+    p[2] = ep_addr; p[3] = USB_ENDPOINT_XFER_BULK;
+    put_le16(p + 4, FEEDER_BULK_PACKET); p[6] = 0;
+    p += USB_DT_ENDPOINT_SIZE;
+
+    put_le16(buf + 2, p - buf);
+    return p - buf;
+}
+
+static int build_string(uint8_t *buf, unsigned int index)
+{
+    const char *s;
+    int i, len;
+
+    if (index == 0) {
+        buf[0] = 4; buf[1] = USB_DT_STRING;
+        put_le16(buf + 2, 0x0409);
+        return 4;
+    }
+
+    if (index >= sizeof(strings) / sizeof(strings[0]))
+        return -1;
+
+    s = strings[index];
+    len = strlen(s);
+    buf[0] = 2 + len * 2; buf[1] = USB_DT_STRING;
+    for (i = 0; i < len; i++)
+        put_le16(buf + 2 + i * 2, (uint8_t)s[i]);
+    return buf[0];
+}
+
+/*
+ * Probe/Commit
+ */
+
+// Clamp a probe request to what we support and fill in the computed fields
+static void fix_probe(struct feeder *f, uint8_t *probe)
+{
+    unsigned int index = probe[3];
+    uint32_t size;
+
+    if (index < 1 || index > NUM_FRAMES)
+        index = 1;
+    size = frame_size(index);
+
+    probe[2] = 1;                       // bFormatIndex
+    probe[3] = index;                   // bFrameIndex
+    put_le32(probe + 4, 10000000 / f->fps);
+    put_le32(probe + 18, size);
+    put_le32(probe + 22, f->max_payload ? f->max_payload : size + FEEDER_HEADER_LEN);
+    put_le32(probe + 26, FEEDER_CLOCK_HZ);
+    probe[30] = 0x03;                   // bmFramingInfo: FID and EOF used
+    probe[31] = 1; probe[32] = 1; probe[33] = 1;
+}
+
+/*
+ * Control Endpoint
+ */
+
+static int ep0_write(int fd, const void *data, int len)
+{
+    struct io_buf b;
+
+    b.io.ep = 0;
+    b.io.flags = 0;
+    b.io.length = len;
+    memcpy(b.data, data, len);
+    return ioctl(fd, USB_RAW_IOCTL_EP0_WRITE, &b);
+}
+
+static int ep0_read(int fd, void *data, int len)
+{
+    struct io_buf b;
+    int ret;
+
+    b.io.ep = 0;
+    b.io.flags = 0;
+    b.io.length = len;
+    ret = ioctl(fd, USB_RAW_IOCTL_EP0_READ, &b);
+    if (ret > 0 && data)
+        memcpy(data, b.data, ret);
+    return ret;
+}
+
+static void ep0_stall(int fd)
+{
+    ioctl(fd, USB_RAW_IOCTL_EP0_STALL, 0);
+}
+
+static int enable_endpoint(struct feeder *f)
+{
+    struct usb_endpoint_descriptor ep = {
+        .bLength = USB_DT_ENDPOINT_SIZE,
+        .bDescriptorType = USB_DT_ENDPOINT,
+        .bEndpointAddress = f->ep_addr,
+        .bmAttributes = USB_ENDPOINT_XFER_BULK,
+        .wMaxPacketSize = FEEDER_BULK_PACKET,
+    };
+
+    f->ep_handle = ioctl(f->fd, USB_RAW_IOCTL_EP_ENABLE, &ep);
+    if (f->ep_handle < 0) {
+        fprintf(stderr, "EP_ENABLE failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ioctl(f->fd, USB_RAW_IOCTL_VBUS_DRAW, 100);
+    ioctl(f->fd, USB_RAW_IOCTL_CONFIGURE, 0);
+    return 0;
+}
+
+// Pick the first bulk IN endpoint the UDC offers
+static int pick_endpoint(struct feeder *f)
+{
+    struct usb_raw_eps_info info;
+    int i, n;
+
+    memset(&info, 0, sizeof(info));
+    n = ioctl(f->fd, USB_RAW_IOCTL_EPS_INFO, &info);
+    for (i = 0; i < n; i++) {
+        if (!info.eps[i].caps.type_bulk || !info.eps[i].caps.dir_in)
+            continue;
+        f->ep_addr = USB_DIR_IN |
+                     (info.eps[i].addr == USB_RAW_EP_ADDR_ANY ? 1 : info.eps[i].addr);
+        return 0;
+    }
+
+    fprintf(stderr, "UDC has no bulk IN endpoint\n");
+    return -1;
+}
+
+static void handle_standard(struct feeder *f, struct usb_ctrlrequest *ctrl)
+{
+    uint8_t buf[FEEDER_EP0_MAX];
+    int len = -1;
+
+    switch (ctrl->bRequest) {
+    case USB_REQ_GET_DESCRIPTOR:
+        switch (ctrl->wValue >> 8) {
+        case USB_DT_DEVICE:
+            memcpy(buf, &device_desc, sizeof(device_desc));
+            len = sizeof(device_desc);
+            break;
+        case USB_DT_CONFIG:
+            len = build_config(buf, f->ep_addr);
+            break;
+        case USB_DT_STRING:
+            len = build_string(buf, ctrl->wValue & 0xff);
+            break;
+        }
+        if (len < 0)
+            break;
+        ep0_write(f->fd, buf, len < ctrl->wLength ? len : ctrl->wLength);
+        return;
+
+    case USB_REQ_SET_CONFIGURATION:
+        if (f->ep_handle < 0 && enable_endpoint(f))
+            break;
+        ep0_read(f->fd, NULL, 0);
+        return;
+
+    case USB_REQ_SET_INTERFACE:
+        ep0_read(f->fd, NULL, 0);
+        return;
+
+    case USB_REQ_GET_STATUS:
+        memset(buf, 0, 2);
+        ep0_write(f->fd, buf, 2);
+        return;
+    }
+
+    ep0_stall(f->fd);
+}
+
+static void handle_class(struct feeder *f, struct usb_ctrlrequest *ctrl)
+{
+    unsigned int selector = ctrl->wValue >> 8;
+    unsigned int intf = ctrl->wIndex & 0xff;
+    uint8_t buf[FEEDER_PROBE_LEN];
+    int len;
+
+    // Only the streaming interface has controls
+    if (intf != 1 || (selector != UVC_VS_PROBE_CONTROL && selector != UVC_VS_COMMIT_CONTROL)) {
+        ep0_stall(f->fd);
+        return;
+    }
+
+    switch (ctrl->bRequest) {
+    case UVC_SET_CUR:
+        memset(buf, 0, sizeof(buf));
+        len = ep0_read(f->fd, buf, ctrl->wLength < sizeof(buf) ? ctrl->wLength : sizeof(buf));
+        if (len < 0)
+            return;
+
+        pthread_mutex_lock(&f->lock);
+        fix_probe(f, buf);
+        memcpy(f->probe, buf, sizeof(buf));
+        if (selector == UVC_VS_COMMIT_CONTROL) {
+            f->frame_index = buf[3];
+            f->generation++;
+            pthread_cond_signal(&f->cond);
+            printf("Committed %ux%u, payload %u bytes\n",
+                   frames[buf[3] - 1].width, frames[buf[3] - 1].height,
+                   buf[22] | buf[23] << 8 | buf[24] << 16 | (uint32_t)buf[25] << 24);
+        }
+        pthread_mutex_unlock(&f->lock);
+        return;
+
+    case UVC_GET_CUR:
+    case UVC_GET_MIN:
+    case UVC_GET_MAX:
+    case UVC_GET_DEF:
+        pthread_mutex_lock(&f->lock);
+        memcpy(buf, f->probe, sizeof(buf));
+        pthread_mutex_unlock(&f->lock);
+        if (ctrl->bRequest == UVC_GET_MAX)
+            buf[3] = NUM_FRAMES;
+        else if (ctrl->bRequest != UVC_GET_CUR)
+            buf[3] = 1;
+        fix_probe(f, buf);
+        ep0_write(f->fd, buf, ctrl->wLength < sizeof(buf) ? ctrl->wLength : sizeof(buf));
+        return;
+
+    case UVC_GET_LEN:
+        put_le16(buf, FEEDER_PROBE_LEN);
+        ep0_write(f->fd, buf, 2);
+        return;
+
+    case UVC_GET_INFO:
+        buf[0] = 0x03;                  // GET and SET supported
+        ep0_write(f->fd, buf, 1);
+        return;
+    }
+
+    ep0_stall(f->fd);
+}
+
+/*
+ * Streaming
+ */
+
+static int ep_write(struct feeder *f, const uint8_t *data, int len, bool zlp)
+{
+    struct io_buf b;
+
+    b.io.ep = f->ep_handle;
+    b.io.flags = zlp ? USB_RAW_IO_FLAGS_ZERO : 0;
+    b.io.length = len;
+    memcpy(b.data, data, len);
+    return ioctl(f->fd, USB_RAW_IOCTL_EP_WRITE, &b);
+}
+
+// Fill the next frame from the recording, or draw moving bars
+static void next_frame(FILE *in, uint8_t *frame,
+                       unsigned int index, unsigned long count)
+{
+    unsigned int width = frames[index - 1].width;
+    unsigned int height = frames[index - 1].height;
+    uint32_t size = frame_size(index);
+    unsigned int x, y;
+
+    if (in) {
+        if (fread(frame, 1, size, in) == size)
+            return;
+        rewind(in);
+        if (fread(frame, 1, size, in) == size)
+            return;
+    }
+
+    for (y = 0; y < height; y++) {
+        uint8_t *line = frame + y * width * 2;
+
+        for (x = 0; x < width; x++) {
+            line[x * 2] = ((x + count * 4) / 32 % 2) ? 0xeb : 0x10;
+            line[x * 2 + 1] = 0x80;
+        }
+    }
+}
+
+/*
+ * Send one frame as a sequence of payloads. Each payload is written in
+ * page-sized pieces; a payload shorter than dwMaxPayloadTransferSize
+ * that ends on a packet boundary is terminated with a ZLP.
+ */
+static int send_frame(struct feeder *f, const uint8_t *frame, uint32_t size,
+                      uint32_t max_payload, int fid)
+{
+    uint32_t data_per_payload = max_payload - FEEDER_HEADER_LEN;
+    uint32_t offset = 0;
+    uint8_t chunk[FEEDER_IO_MAX];
+
+    while (offset < size) {
+        uint32_t data_len = size - offset < data_per_payload ? size - offset : data_per_payload;
+        uint32_t payload_len = data_len + FEEDER_HEADER_LEN;
+        uint32_t sent = 0;
+        uint64_t ts = now_ns();
+        uint32_t stc = ts * (FEEDER_CLOCK_HZ / 1000000) / 1000;
+
+        chunk[0] = FEEDER_HEADER_LEN;
+        chunk[1] = UVC_STREAM_EOH | UVC_STREAM_PTS | UVC_STREAM_SCR | fid;
+        if (offset + data_len == size)
+            chunk[1] |= UVC_STREAM_EOF;
+        put_le32(chunk + 2, stc);
+        put_le32(chunk + 6, stc);
+        put_le16(chunk + 10, (ts / 1000000) & 0x7ff);
+
+        while (sent < payload_len) {
+            uint32_t hdr = sent ? 0 : FEEDER_HEADER_LEN;
+            uint32_t n = payload_len - sent < FEEDER_IO_MAX ? payload_len - sent : FEEDER_IO_MAX;
+            bool last = sent + n == payload_len;
+
+            memcpy(chunk + hdr, frame + offset, n - hdr);
+            offset += n - hdr;
+
+            if (ep_write(f, chunk, n, last && payload_len < max_payload &&
+                         !(payload_len % FEEDER_BULK_PACKET)) < 0)
+                return -1;
+            sent += n;
+        }
+
+        f->bytes_sent += payload_len;
+    }
+
+    return 0;
+}
+
+static void *stream_thread(void *arg)
+{
+    struct feeder *f = arg;
+    FILE *in = NULL;
+    uint8_t *frame = NULL;
+    unsigned int index = 0, generation = 0;
+    uint32_t max_payload = 0;
+    struct timespec next;
+    int fid = 0;
+
+    if (f->input) {
+        in = fopen(f->input, "rb");
+        if (!in)
+            fprintf(stderr, "Cannot open %s, using test pattern\n", f->input);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stop) {
+        pthread_mutex_lock(&f->lock);
+        while (!f->frame_index && !stop)
+            pthread_cond_wait(&f->cond, &f->lock);
+        if (generation != f->generation) {
+            generation = f->generation;
+            index = f->frame_index;
+            max_payload = f->probe[22] | f->probe[23] << 8 | f->probe[24] << 16 |
+                          (uint32_t)f->probe[25] << 24;
+            free(frame);
+            frame = malloc(frame_size(index));
+        }
+        pthread_mutex_unlock(&f->lock);
+
+        if (stop || !frame)
+            break;
+
+        // Pace to the frame rate; the host only drains the endpoint
+        next.tv_nsec += 1000000000 / f->fps;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        next_frame(in, frame, index, f->frames_sent);
+
+        // End-to-end latency probe for camera_test --stamped
+        if (f->stamp) {
+            uint64_t ts = now_ns();
+            memcpy(frame, &ts, sizeof(ts));
+        }
+
+        if (send_frame(f, frame, frame_size(index), max_payload, fid) < 0) {
+            if (errno != ESHUTDOWN && errno != EINTR)
+                fprintf(stderr, "EP_WRITE failed: %s\n", strerror(errno));
+            break;
+        }
+
+        fid ^= UVC_STREAM_FID;
+        f->frames_sent++;
+    }
+
+    free(frame);
+    if (in)
+        fclose(in);
+    stop = 1;
+    return NULL;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -i FILE   Replay raw YUYV frames from FILE (default: test pattern)\n");
+    printf("  -f FPS    Frame rate (default: 30)\n");
+    printf("  -p BYTES  dwMaxPayloadTransferSize (default: one payload per frame)\n");
+    printf("  -s        Stamp CLOCK_MONOTONIC ns into the first 8 bytes of each frame\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct feeder f;
+    struct usb_raw_init init;
+    pthread_t thread;
+    bool thread_started = false;
+    int opt;
+
+    memset(&f, 0, sizeof(f));
+    f.fps = 30;
+    f.ep_handle = -1;
+    pthread_mutex_init(&f.lock, NULL);
+    pthread_cond_init(&f.cond, NULL);
+
+    while ((opt = getopt(argc, argv, "i:f:p:sh")) != -1) {
+        switch (opt) {
+        case 'i': f.input = optarg; break;
+        case 'f': f.fps = atoi(optarg) > 0 ? atoi(optarg) : 30; break;
+        case 'p': f.max_payload = strtoul(optarg, NULL, 0); break;
+        case 's': f.stamp = true; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (f.max_payload && f.max_payload <= FEEDER_HEADER_LEN) {
+        fprintf(stderr, "Payload size must exceed the %d byte header\n", FEEDER_HEADER_LEN);
+        return 1;
+    }
+
+    f.probe[3] = 1;
+    fix_probe(&f, f.probe);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    f.fd = open("/dev/raw-gadget", O_RDWR);
+    if (f.fd < 0) {
+        fprintf(stderr, "Cannot open /dev/raw-gadget: %s\n", strerror(errno));
+        return 1;
+    }
+
+    memset(&init, 0, sizeof(init));
+    strcpy((char *)init.driver_name, FEEDER_UDC_DRIVER);
+    strcpy((char *)init.device_name, FEEDER_UDC_DEVICE);
+    init.speed = USB_SPEED_HIGH;
+
+    if (ioctl(f.fd, USB_RAW_IOCTL_INIT, &init) < 0 ||
+        ioctl(f.fd, USB_RAW_IOCTL_RUN, 0) < 0) {
+        fprintf(stderr, "Cannot start raw gadget on %s: %s\n",
+                FEEDER_UDC_DEVICE, strerror(errno));
+        close(f.fd);
+        return 1;
+    }
+
+    printf("Emulated camera running, %u fps\n", f.fps);
+
+    while (!stop) {
+        struct {
+            struct usb_raw_event event;
+            struct usb_ctrlrequest ctrl;
+        } ev;
+
+        ev.event.type = 0;
+        ev.event.length = sizeof(ev.ctrl);
+        if (ioctl(f.fd, USB_RAW_IOCTL_EVENT_FETCH, &ev) < 0) {
+            if (errno != EINTR)
+                fprintf(stderr, "EVENT_FETCH failed: %s\n", strerror(errno));
+            break;
+        }
+
+        switch (ev.event.type) {
+        case USB_RAW_EVENT_CONNECT:
+            if (pick_endpoint(&f))
+                stop = 1;
+            else if (!thread_started)
+                thread_started = !pthread_create(&thread, NULL, stream_thread, &f);
+            break;
+        case USB_RAW_EVENT_CONTROL:
+            if ((ev.ctrl.bRequestType & USB_TYPE_MASK) == USB_TYPE_STANDARD)
+                handle_standard(&f, &ev.ctrl);
+            else if ((ev.ctrl.bRequestType & USB_TYPE_MASK) == USB_TYPE_CLASS)
+                handle_class(&f, &ev.ctrl);
+            else
+                ep0_stall(f.fd);
+            break;
+        default:
+            break;
+        }
+    }
+
+    stop = 1;
+    if (thread_started) {
+        pthread_mutex_lock(&f.lock);
+        pthread_cond_signal(&f.cond);
+        pthread_mutex_unlock(&f.lock);
+        pthread_cancel(thread);     // May be blocked in EP_WRITE
+        pthread_join(thread, NULL);
+    }
+    close(f.fd);
+
+    printf("Sent %lu frames, %lu bytes\n", f.frames_sent, f.bytes_sent);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * 蓝牙驱动核心实现
+ *
+ * 基于IMX6ULL Pro开发板的蓝牙驱动通用层。HCI传输由芯片驱动(hci_uart等)
+ * 注册，本层按bluetooth_platform_data->hci_index绑定对应的hci_dev，
+ * 负责设备生命周期和GATT服务端。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+
+#include "bluetooth_driver.h"
+
+/*
+ * 扫描控制
+ */
+
+/* 按需求和暂停状态启停控制器扫描，调用者持有lock */
+static int bluetooth_scan_update_locked(struct bluetooth_device *bdev)
+{
+    bool run = bdev->scan_requested && !bdev->scan_paused;
+    int ret = 0;
+
+    if (run == bdev->scan_running)
+        return 0;
+
+    if (run && bdev->ops->scan_start)
+        ret = bdev->ops->scan_start(bdev);
+    else if (!run && bdev->ops->scan_stop)
+        ret = bdev->ops->scan_stop(bdev);
+
+    if (!ret)
+        bdev->scan_running = run;
+
+    return ret;
+}
+
+int bluetooth_scan_start(struct bluetooth_device *bdev)
+{
+    int ret;
+
+    mutex_lock(&bdev->lock);
+    bdev->scan_requested = true;
+    bdev->status.state = BT_STATE_SCANNING;
+    ret = bluetooth_scan_update_locked(bdev);
+    mutex_unlock(&bdev->lock);
+
+    return ret;
+}
+EXPORT_SYMBOL_GPL(bluetooth_scan_start);
+
+int bluetooth_scan_stop(struct bluetooth_device *bdev)
+{
+    int ret;
+
+    mutex_lock(&bdev->lock);
+    bdev->scan_requested = false;
+    if (bdev->status.state == BT_STATE_SCANNING)
+        bdev->status.state = BT_STATE_READY;
+    ret = bluetooth_scan_update_locked(bdev);
+    mutex_unlock(&bdev->lock);
+
+    return ret;
+}
+EXPORT_SYMBOL_GPL(bluetooth_scan_stop);
+
+void bluetooth_scan_pause(struct bluetooth_device *bdev, bool pause)
+{
+    mutex_lock(&bdev->lock);
+    bdev->scan_paused = pause;
+    bluetooth_scan_update_locked(bdev);
+    mutex_unlock(&bdev->lock);
+}
+EXPORT_SYMBOL_GPL(bluetooth_scan_pause);
+
+/*
+ * 平台驱动
+ */
+
+int bluetooth_driver_probe(struct platform_device *pdev)
+{
+    struct bluetooth_platform_data *pdata = dev_get_platdata(&pdev->dev);
+    struct bluetooth_device *bdev;
+    int ret;
+
+    if (!pdata || !pdata->ops) {
+        dev_err(&pdev->dev, "missing platform data or chip ops\n");
+        return -ENODEV;
+    }
+
+    bdev = devm_kzalloc(&pdev->dev, sizeof(*bdev), GFP_KERNEL);
+    if (!bdev)
+        return -ENOMEM;
+
+    /* HCI传输驱动可能还没注册 */
+    bdev->hdev = hci_dev_get(pdata->hci_index);
+    if (!bdev->hdev)
+        return -EPROBE_DEFER;
+
+    bdev->dev = &pdev->dev;
+    bdev->ops = pdata->ops;
+    bdev->status.state = BT_STATE_INIT;
+    bdev->status.att_mtu = BT_ATT_DEFAULT_MTU;
+
+    mutex_init(&bdev->lock);
+    mutex_init(&bdev->gatt_lock);
+    INIT_LIST_HEAD(&bdev->gatt_services);
+
+    bdev->workqueue = alloc_workqueue("bt_%s", WQ_UNBOUND | WQ_FREEZABLE, 0,
+                                      dev_name(&pdev->dev));
+    if (!bdev->workqueue) {
+        ret = -ENOMEM;
+        goto err_hdev;
+    }
+
+    platform_set_drvdata(pdev, bdev);
+
+    bdev->debug_dir = debugfs_create_dir(dev_name(&pdev->dev), NULL);
+    bluetooth_scan_init(bdev);
+
+    if (bdev->ops->init) {
+        ret = bdev->ops->init(bdev);
+        if (ret)
+            goto err_wq;
+    }
+
+    ret = bluetooth_gatt_init(bdev);
+    if (ret)
+        goto err_deinit;
+
+    bdev->status.state = BT_STATE_READY;
+    dev_info(&pdev->dev, "Bluetooth device ready on %s\n", bdev->hdev->name);
+    return 0;
+
+err_deinit:
+    if (bdev->ops->deinit)
+        bdev->ops->deinit(bdev);
+err_wq:
+    bluetooth_scan_cleanup(bdev);
+    debugfs_remove_recursive(bdev->debug_dir);
+    destroy_workqueue(bdev->workqueue);
+err_hdev:
+    hci_dev_put(bdev->hdev);
+    return ret;
+}
+
+int bluetooth_driver_remove(struct platform_device *pdev)
+{
+    struct bluetooth_device *bdev = platform_get_drvdata(pdev);
+
+    bluetooth_gatt_cleanup(bdev);
+    bluetooth_scan_stop(bdev);
+
+    if (bdev->ops->deinit)
+        bdev->ops->deinit(bdev);
+
+    bluetooth_scan_cleanup(bdev);
+    debugfs_remove_recursive(bdev->debug_dir);
+    destroy_workqueue(bdev->workqueue);
+    hci_dev_put(bdev->hdev);
+
+    return 0;
+}
+
+static struct platform_driver bluetooth_platform_driver = {
+    .probe = bluetooth_driver_probe,
+    .remove = bluetooth_driver_remove,
+    .driver = {
+        .name = BT_DRIVER_NAME,
+    },
+};
+module_platform_driver(bluetooth_platform_driver);
+
+MODULE_AUTHOR("Linux Cool Team");
+MODULE_DESCRIPTION("IMX6ULL Bluetooth driver core");
+MODULE_LICENSE("GPL v2");
@@ -11,9 +11,36 @@
 
 #include <linux/device.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/workqueue.h>
-#include <linux/bluetooth/bluetooth.h>
-#include <linux/bluetooth/hci_core.h>
+#include <linux/platform_device.h>
+#include <linux/average.h>
+#include <net/bluetooth/bluetooth.h>
+#include <net/bluetooth/hci_core.h>
+
+#define BT_DRIVER_NAME              "imx6ull_bt"
+
+/* ATT/GATT参数 */
+#define BT_ATT_DEFAULT_MTU          23
+#define BT_ATT_MAX_MTU              517     /* ATT规范允许的最大值 */
+#define BT_LE_MAX_TX_OCTETS         251     /* 数据长度扩展上限 */
+#define BT_LE_MAX_TX_TIME           2120    /* us，1M PHY下251字节 */
+
+/* 事件缓冲参数 */
+#define BT_GATT_EVENT_RING_SIZE     512     /* 必须是2的幂 */
+#define BT_GATT_EVENT_MAX_LEN       32
+#define BT_GATT_NOTIFY_DELAY_MS     20      /* 实时事件合批等待时间 */
+#define BT_GATT_APP_STATUS_LEN      64
+
+/* 扫描过滤参数 */
+#define BT_SCAN_MAX_DEVICES         64      /* 去重表容量 */
+#define BT_SCAN_MAX_ADDR_FILTERS    8
+#define BT_SCAN_MAX_UUID_FILTERS    4
+#define BT_SCAN_REFRESH_MS          1000    /* 无变化时的最长上报间隔 */
+#define BT_SCAN_RSSI_DELTA          6       /* dB，平均RSSI变化超过该值立即上报 */
+#define BT_SCAN_EXPIRE_MS           10000   /* 超过该时间未出现的设备可被淘汰 */
+
+struct bluetooth_device;
 
 /* 蓝牙设备类型 */
 enum bluetooth_device_type {
@@ -35,6 +62,70 @@ enum bluetooth_connection_state {
     BT_STATE_MAX
 };
 
+/* 蓝牙状态 */
+struct bluetooth_status {
+    enum bluetooth_connection_state state;
+    int rssi;
+    u16 conn_handle;        /* 当前LE连接句柄 */
+    u16 att_mtu;            /* 协商后的ATT MTU */
+    u16 tx_octets;          /* 数据长度扩展后的链路层载荷 */
+};
+
+/* GATT特征属性(Core Spec Vol 3, Part G, 3.3.1.1) */
+#define GATT_CHR_PROP_READ          0x02
+#define GATT_CHR_PROP_WRITE_NR      0x04
+#define GATT_CHR_PROP_WRITE         0x08
+#define GATT_CHR_PROP_NOTIFY        0x10
+
+struct gatt_characteristic;
+
+/* read返回写入buf的字节数，offset用于Read Blob */
+typedef ssize_t (*gatt_read_t)(struct bluetooth_device *bdev,
+                               struct gatt_characteristic *chr,
+                               u16 offset, u8 *buf, size_t len);
+typedef int (*gatt_write_t)(struct bluetooth_device *bdev,
+                            struct gatt_characteristic *chr,
+                            const u8 *data, size_t len);
+
+/* GATT特征，句柄由gatt_service_add()分配 */
+struct gatt_characteristic {
+    u8 uuid[16];            /* 128位UUID，小端 */
+    u8 properties;
+    gatt_read_t read;
+    gatt_write_t write;
+
+    u16 decl_handle;
+    u16 value_handle;
+    u16 cccd_handle;        /* 仅NOTIFY特征有 */
+    bool notify_enabled;
+};
+
+/* GATT主服务 */
+struct gatt_service {
+    struct list_head list;
+    u8 uuid[16];
+    struct gatt_characteristic *chrs;
+    unsigned int num_chrs;
+
+    u16 start_handle;
+    u16 end_handle;
+};
+
+/* GATT事件记录，按序号连续存放在环形缓冲中 */
+struct bt_gatt_event {
+    u32 seq;
+    u32 timestamp;          /* boottime秒 */
+    u8 len;
+    u8 data[BT_GATT_EVENT_MAX_LEN];
+};
+
+/*
+ * RSSI加BT_SCAN_RSSI_OFFSET后做指数平均，权重1/4。EWMA只接受无符号值，
+ * 偏移后-127..126映射到1..254，读出时再减去偏移。
+ */
+DECLARE_EWMA(bt_rssi, 4, 4)
+#define BT_SCAN_RSSI_OFFSET         128
+
 /* 蓝牙设备信息 */
 struct bluetooth_device_info {
     bdaddr_t addr;
@@ -47,6 +138,27 @@ struct bluetooth_device_info {
     uint8_t data[31];
 };
 
+/* 扫描去重表条目 */
+struct bt_scan_entry {
+    struct bluetooth_device_info info;  /* 最近一次上报给协议栈的内容 */
+    u8 addr_type;
+    bool valid;
+    bool matched;           /* 曾通过UUID过滤，其扫描响应也放行 */
+    struct ewma_bt_rssi rssi_avg;
+    u32 data_hash;
+    unsigned long last_seen;    /* jiffies */
+    unsigned long last_report;  /* jiffies */
+};
+
+/* 扫描过滤条件，各类条件之间为"或"，全部为空时不过滤只去重 */
+struct bt_scan_filter {
+    bdaddr_t addrs[BT_SCAN_MAX_ADDR_FILTERS];
+    unsigned int num_addrs;
+    u8 uuids[BT_SCAN_MAX_UUID_FILTERS][16];     /* 128位UUID，小端 */
+    unsigned int num_uuids;
+    s8 min_rssi;            /* 0表示不限制 */
+};
+
 /* 蓝牙连接信息 */
 struct bluetooth_connection_info {
     bdaddr_t addr;
@@ -84,11 +196,87 @@ struct bluetooth_device {
     void *private_data;
     struct hci_dev *hdev;
     struct list_head gatt_services;
-    struct mutex gatt_lock;
+    struct mutex gatt_lock;         /* 保护服务表和ATT会话 */
+    u16 gatt_next_handle;
+
+    /* ATT服务端 */
+    struct socket *att_listen;
+    struct socket *att_sock;        /* 当前连接，同一时间只服务一个中心设备，受gatt_lock保护 */
+    bool att_stopping;              /* 清理已开始，受gatt_lock保护 */
+    struct task_struct *att_thread;
+    u8 *att_rx_buf;
+    u8 *att_tx_buf;
+
+    /* 事件缓冲与通知 */
+    spinlock_t event_lock;
+    struct bt_gatt_event *events;
+    u32 event_head_seq;             /* 下一条事件的序号 */
+    u32 event_notify_seq;           /* 下一条待通知的序号 */
+    struct delayed_work notify_work;
+    struct gatt_service *status_svc;
+    u8 app_status[BT_GATT_APP_STATUS_LEN];
+    u8 app_status_len;
+
+    /* 广播过滤与去重 */
+    spinlock_t scan_lock;
+    struct bt_scan_filter scan_filter;
+    struct bt_scan_entry scan_table[BT_SCAN_MAX_DEVICES];
+    u64 scan_reports_in;
+    u64 scan_reports_out;
+    struct dentry *debug_dir;
+
+    /* 标准传输驱动下接收广播报告的原始HCI socket */
+    struct socket *scan_sock;
+    struct task_struct *scan_thread;
+    u8 *scan_rx_buf;
+    bool scan_rx_hooked;            /* 传输驱动调用了bluetooth_recv_frame() */
+
+    /* 扫描请求与共存暂停，受lock保护 */
+    bool scan_requested;
+    bool scan_paused;
+    bool scan_running;
+};
+
+/* 蓝牙平台数据 */
+struct bluetooth_platform_data {
+    int hci_index;                  /* 对应的hciX */
+    struct bluetooth_driver_ops *ops;
 };
 
 /* 函数声明 */
 int bluetooth_driver_probe(struct platform_device *pdev);
 int bluetooth_driver_remove(struct platform_device *pdev);
 
+/* 扫描控制函数声明
+ *
+ * bluetooth_scan_start/stop记录上层的扫描需求，bluetooth_scan_pause由
+ * WiFi/蓝牙共存调度调用，只在有扫描需求时实际启停控制器扫描。
+ */
+int bluetooth_scan_start(struct bluetooth_device *bdev);
+int bluetooth_scan_stop(struct bluetooth_device *bdev);
+void bluetooth_scan_pause(struct bluetooth_device *bdev, bool pause);
+
+/* 扫描过滤函数声明
+ *
+ * 自带传输的芯片驱动应调用bluetooth_recv_frame()代替hci_recv_frame()，
+ * LE广播报告在进入协议栈前被过滤和去重。使用hci_uart/btusb时报告经原始
+ * HCI socket进入去重表，协议栈不受过滤影响。
+ */
+void bluetooth_scan_init(struct bluetooth_device *bdev);
+void bluetooth_scan_cleanup(struct bluetooth_device *bdev);
+int bluetooth_recv_frame(struct bluetooth_device *bdev, struct sk_buff *skb);
+int bluetooth_scan_filter_set(struct bluetooth_device *bdev, const struct bt_scan_filter *filter);
+int bluetooth_scan_get_devices(struct bluetooth_device *bdev,
+                               struct bluetooth_device_info *info, int max);
+
+/* GATT函数声明 */
+int gatt_service_add(struct bluetooth_device *bdev, struct gatt_service *service);
+void gatt_service_remove(struct bluetooth_device *bdev, struct gatt_service *service);
+int bluetooth_gatt_init(struct bluetooth_device *bdev);
+void bluetooth_gatt_cleanup(struct bluetooth_device *bdev);
+int bluetooth_gatt_event_push(struct bluetooth_device *bdev, const void *data, size_t len);
+int bluetooth_gatt_set_app_status(struct bluetooth_device *bdev, const void *data, size_t len);
+void bluetooth_gatt_data_len_changed(struct bluetooth_device *bdev,
+                                     const struct hci_ev_le_data_len_change *ev);
+
 #endif /* __BLUETOOTH_DRIVER_H */
@@ -0,0 +1,946 @@
+/*
+ * 蓝牙GATT服务端
+ *
+ * 在LE ATT固定信道(CID 4)上实现一个精简的GATT服务端，并注册设备状态
+ * 服务，供手机App读取设备状态和拉取最近的事件记录：
+ *
+ *   STATUS  (read)   设备状态，见struct bt_gatt_status_payload
+ *   EVENTS  (notify) 事件记录，多条记录打包进一个通知
+ *   CONTROL (write)  拉取控制，见BT_GATT_CTRL_*
+ *
+ * 连接建立后请求LE数据长度扩展，并接受最大517字节的ATT MTU，一个通知
+ * 可装下十几条事件，几百条事件在一秒内即可拉完。
+ *
+ * 事件记录格式(小端)：seq(4) timestamp(4) len(1) data(len)
+ *
+ * 注意：ATT信道同一时间只能有一个监听者，系统中运行bluetoothd时本服务
+ * 无法绑定，会在日志中给出提示。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/net.h>
+#include <linux/timekeeping.h>
+#include <asm/unaligned.h>
+#include <net/sock.h>
+#include <net/bluetooth/l2cap.h>
+
+#include "bluetooth_driver.h"
+
+/* ATT操作码 */
+#define ATT_OP_ERROR_RSP            0x01
+#define ATT_OP_MTU_REQ              0x02
+#define ATT_OP_MTU_RSP              0x03
+#define ATT_OP_FIND_INFO_REQ        0x04
+#define ATT_OP_FIND_INFO_RSP        0x05
+#define ATT_OP_READ_BY_TYPE_REQ     0x08
+#define ATT_OP_READ_BY_TYPE_RSP     0x09
+#define ATT_OP_READ_REQ             0x0a
+#define ATT_OP_READ_RSP             0x0b
+#define ATT_OP_READ_BLOB_REQ        0x0c
+#define ATT_OP_READ_BLOB_RSP        0x0d
+#define ATT_OP_READ_BY_GROUP_REQ    0x10
+#define ATT_OP_READ_BY_GROUP_RSP    0x11
+#define ATT_OP_WRITE_REQ            0x12
+#define ATT_OP_WRITE_RSP            0x13
+#define ATT_OP_HANDLE_NOTIFY        0x1b
+#define ATT_OP_WRITE_CMD            0x52
+#define ATT_OP_CMD_FLAG             0x40
+
+/* ATT错误码 */
+#define ATT_ECODE_INVALID_HANDLE    0x01
+#define ATT_ECODE_READ_NOT_PERM     0x02
+#define ATT_ECODE_WRITE_NOT_PERM    0x03
+#define ATT_ECODE_INVALID_PDU       0x04
+#define ATT_ECODE_REQ_NOT_SUPP      0x06
+#define ATT_ECODE_INVALID_OFFSET    0x07
+#define ATT_ECODE_ATTR_NOT_FOUND    0x0a
+#define ATT_ECODE_INVAL_ATTR_LEN    0x0d
+#define ATT_ECODE_UNSUPP_GRP_TYPE   0x10
+
+/* GATT声明类型 */
+#define GATT_UUID_PRIMARY_SVC       0x2800
+#define GATT_UUID_CHARACTERISTIC    0x2803
+#define GATT_UUID_CCCD              0x2902
+
+/* 设备状态服务UUID：b5e4xxxx-6c3a-4f8e-9b1d-2f0c6d5a7e10 */
+#define BT_GATT_UUID(id) { 0x10, 0x7e, 0x5a, 0x6d, 0x0c, 0x2f, 0x1d, 0x9b, \
+                           0x8e, 0x4f, 0x3a, 0x6c, (id) & 0xff, (id) >> 8, 0xe4, 0xb5 }
+
+#define BT_GATT_SVC_STATUS          0x0001
+#define BT_GATT_CHR_STATUS          0x0002
+#define BT_GATT_CHR_EVENTS          0x0003
+#define BT_GATT_CHR_CONTROL         0x0004
+
+/* CONTROL特征命令：cmd(1) [seq(4)] */
+#define BT_GATT_CTRL_PULL           0x01    /* 从seq开始重发缓冲中的事件 */
+#define BT_GATT_CTRL_LIVE           0x02    /* 只通知此后的新事件 */
+
+#define BT_GATT_EVENT_HDR_LEN       9
+
+enum bt_attr_kind {
+    BT_ATTR_SVC_DECL,
+    BT_ATTR_CHR_DECL,
+    BT_ATTR_CHR_VALUE,
+    BT_ATTR_CCCD,
+};
+
+struct bt_attr {
+    enum bt_attr_kind kind;
+    struct gatt_service *svc;
+    struct gatt_characteristic *chr;
+};
+
+/* 设备状态，后面紧跟app_len字节的应用状态(bluetooth_gatt_set_app_status) */
+struct bt_gatt_status_payload {
+    __le32 uptime;
+    __le32 event_head;      /* 下一条事件的序号 */
+    __le32 event_oldest;    /* 缓冲中最早的事件序号 */
+    __le16 att_mtu;
+    __le16 tx_octets;
+    u8 state;
+    u8 app_len;
+} __packed;
+
+enum {
+    BT_GATT_IDX_STATUS,
+    BT_GATT_IDX_EVENTS,
+    BT_GATT_IDX_CONTROL,
+    BT_GATT_NUM_CHRS
+};
+
+/*
+ * 属性表
+ */
+
+static bool bt_gatt_find_attr(struct bluetooth_device *bdev, u16 handle,
+                              struct bt_attr *attr)
+{
+    struct gatt_service *svc;
+    unsigned int i;
+
+    list_for_each_entry(svc, &bdev->gatt_services, list) {
+        if (handle < svc->start_handle || handle > svc->end_handle)
+            continue;
+
+        attr->svc = svc;
+        attr->chr = NULL;
+        if (handle == svc->start_handle) {
+            attr->kind = BT_ATTR_SVC_DECL;
+            return true;
+        }
+
+        for (i = 0; i < svc->num_chrs; i++) {
+            struct gatt_characteristic *chr = &svc->chrs[i];
+
+            attr->chr = chr;
+            if (handle == chr->decl_handle) {
+                attr->kind = BT_ATTR_CHR_DECL;
+                return true;
+            }
+            if (handle == chr->value_handle) {
+                attr->kind = BT_ATTR_CHR_VALUE;
+                return true;
+            }
+            if (chr->cccd_handle && handle == chr->cccd_handle) {
+                attr->kind = BT_ATTR_CCCD;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+int gatt_service_add(struct bluetooth_device *bdev, struct gatt_service *service)
+{
+    unsigned int i;
+    u16 handle;
+    int ret = 0;
+
+    mutex_lock(&bdev->gatt_lock);
+
+    handle = bdev->gatt_next_handle ?: 1;
+    service->start_handle = handle++;
+    for (i = 0; i < service->num_chrs; i++) {
+        struct gatt_characteristic *chr = &service->chrs[i];
+
+        chr->decl_handle = handle++;
+        chr->value_handle = handle++;
+        chr->cccd_handle = (chr->properties & GATT_CHR_PROP_NOTIFY) ? handle++ : 0;
+        chr->notify_enabled = false;
+    }
+    service->end_handle = handle - 1;
+
+    /* 芯片自带GATT服务端时由芯片驱动接管，句柄分配保持一致 */
+    if (bdev->ops->gatt_service_add)
+        ret = bdev->ops->gatt_service_add(bdev, service);
+
+    if (!ret) {
+        list_add_tail(&service->list, &bdev->gatt_services);
+        bdev->gatt_next_handle = handle;
+    }
+
+    mutex_unlock(&bdev->gatt_lock);
+
+    return ret;
+}
+EXPORT_SYMBOL_GPL(gatt_service_add);
+
+void gatt_service_remove(struct bluetooth_device *bdev, struct gatt_service *service)
+{
+    mutex_lock(&bdev->gatt_lock);
+    list_del(&service->list);
+    mutex_unlock(&bdev->gatt_lock);
+}
+EXPORT_SYMBOL_GPL(gatt_service_remove);
+
+/*
+ * ATT协议处理，调用者持有gatt_lock
+ */
+
+static int bt_att_error(u8 *rsp, u8 opcode, u16 handle, u8 ecode)
+{
+    rsp[0] = ATT_OP_ERROR_RSP;
+    rsp[1] = opcode;
+    put_unaligned_le16(handle, rsp + 2);
+    rsp[4] = ecode;
+    return 5;
+}
+
+static void bt_att_put_uuid16(u8 *p, u16 uuid)
+{
+    put_unaligned_le16(uuid, p);
+}
+
+/* 读取属性值，返回长度或负的ATT错误码 */
+static int bt_att_read_attr(struct bluetooth_device *bdev, struct bt_attr *attr,
+                            u16 offset, u8 *buf, size_t len)
+{
+    u8 value[3 + 16];
+    size_t vlen;
+    ssize_t ret;
+
+    switch (attr->kind) {
+    case BT_ATTR_SVC_DECL:
+        memcpy(value, attr->svc->uuid, 16);
+        vlen = 16;
+        break;
+    case BT_ATTR_CHR_DECL:
+        value[0] = attr->chr->properties;
+        put_unaligned_le16(attr->chr->value_handle, value + 1);
+        memcpy(value + 3, attr->chr->uuid, 16);
+        vlen = 19;
+        break;
+    case BT_ATTR_CCCD:
+        put_unaligned_le16(attr->chr->notify_enabled ? 0x0001 : 0, value);
+        vlen = 2;
+        break;
+    case BT_ATTR_CHR_VALUE:
+        if (!attr->chr->read || !(attr->chr->properties & GATT_CHR_PROP_READ))
+            return -ATT_ECODE_READ_NOT_PERM;
+        ret = attr->chr->read(bdev, attr->chr, offset, buf, len);
+        if (ret < 0)
+            return -ATT_ECODE_INVALID_OFFSET;
+        return ret;
+    default:
+        return -ATT_ECODE_INVALID_HANDLE;
+    }
+
+    if (offset > vlen)
+        return -ATT_ECODE_INVALID_OFFSET;
+
+    vlen = min(vlen - offset, len);
+    memcpy(buf, value + offset, vlen);
+    return vlen;
+}
+
+static int bt_att_mtu_req(struct bluetooth_device *bdev, const u8 *req, size_t len, u8 *rsp)
+{
+    u16 client_mtu;
+
+    if (len != 3)
+        return bt_att_error(rsp, req[0], 0, ATT_ECODE_INVALID_PDU);
+
+    client_mtu = get_unaligned_le16(req + 1);
+    bdev->status.att_mtu = clamp_t(u16, client_mtu, BT_ATT_DEFAULT_MTU, BT_ATT_MAX_MTU);
+
+    rsp[0] = ATT_OP_MTU_RSP;
+    put_unaligned_le16(BT_ATT_MAX_MTU, rsp + 1);
+    return 3;
+}
+
+static int bt_att_find_info_req(struct bluetooth_device *bdev, const u8 *req,
+                                size_t len, u8 *rsp)
+{
+    u16 start, end, handle, mtu = bdev->status.att_mtu;
+    struct bt_attr attr;
+    int format = 0, off = 2, entry;
+
+    if (len != 5)
+        return bt_att_error(rsp, req[0], 0, ATT_ECODE_INVALID_PDU);
+
+    start = get_unaligned_le16(req + 1);
+    end = get_unaligned_le16(req + 3);
+    if (!start || start > end)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_INVALID_HANDLE);
+
+    end = min_t(u16, end, bdev->gatt_next_handle ? bdev->gatt_next_handle - 1 : 0);
+
+    /* 格式1为16位UUID，格式2为128位UUID，一个响应内不能混用 */
+    for (handle = start; handle && handle <= end; handle++) {
+        int this_format;
+
+        if (!bt_gatt_find_attr(bdev, handle, &attr))
+            continue;
+
+        this_format = attr.kind == BT_ATTR_CHR_VALUE ? 2 : 1;
+        if (format && this_format != format)
+            break;
+        format = this_format;
+
+        entry = format == 1 ? 4 : 18;
+        if (off + entry > mtu)
+            break;
+
+        put_unaligned_le16(handle, rsp + off);
+        switch (attr.kind) {
+        case BT_ATTR_SVC_DECL:
+            bt_att_put_uuid16(rsp + off + 2, GATT_UUID_PRIMARY_SVC);
+            break;
+        case BT_ATTR_CHR_DECL:
+            bt_att_put_uuid16(rsp + off + 2, GATT_UUID_CHARACTERISTIC);
+            break;
+        case BT_ATTR_CCCD:
+            bt_att_put_uuid16(rsp + off + 2, GATT_UUID_CCCD);
+            break;
+        case BT_ATTR_CHR_VALUE:
+            memcpy(rsp + off + 2, attr.chr->uuid, 16);
+            break;
+        }
+        off += entry;
+    }
+
+    if (!format)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_ATTR_NOT_FOUND);
+
+    rsp[0] = ATT_OP_FIND_INFO_RSP;
+    rsp[1] = format;
+    return off;
+}
+
+/* 仅支持特征发现(0x2803) */
+static int bt_att_read_by_type_req(struct bluetooth_device *bdev, const u8 *req,
+                                   size_t len, u8 *rsp)
+{
+    u16 start, end, mtu = bdev->status.att_mtu;
+    struct gatt_service *svc;
+    unsigned int i;
+    int off = 2;
+    const int entry = 2 + 19;
+
+    if (len != 7 && len != 21)
+        return bt_att_error(rsp, req[0], 0, ATT_ECODE_INVALID_PDU);
+
+    start = get_unaligned_le16(req + 1);
+    end = get_unaligned_le16(req + 3);
+    if (!start || start > end)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_INVALID_HANDLE);
+
+    if (len != 7 || get_unaligned_le16(req + 5) != GATT_UUID_CHARACTERISTIC)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_ATTR_NOT_FOUND);
+
+    list_for_each_entry(svc, &bdev->gatt_services, list) {
+        for (i = 0; i < svc->num_chrs; i++) {
+            struct gatt_characteristic *chr = &svc->chrs[i];
+
+            if (chr->decl_handle < start || chr->decl_handle > end)
+                continue;
+            if (off + entry > mtu)
+                goto out;
+
+            put_unaligned_le16(chr->decl_handle, rsp + off);
+            rsp[off + 2] = chr->properties;
+            put_unaligned_le16(chr->value_handle, rsp + off + 3);
+            memcpy(rsp + off + 5, chr->uuid, 16);
+            off += entry;
+        }
+    }
+
+out:
+    if (off == 2)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_ATTR_NOT_FOUND);
+
+    rsp[0] = ATT_OP_READ_BY_TYPE_RSP;
+    rsp[1] = entry;
+    return off;
+}
+
+/* 仅支持主服务发现(0x2800) */
+static int bt_att_read_by_group_req(struct bluetooth_device *bdev, const u8 *req,
+                                    size_t len, u8 *rsp)
+{
+    u16 start, end, mtu = bdev->status.att_mtu;
+    struct gatt_service *svc;
+    int off = 2;
+    const int entry = 4 + 16;
+
+    if (len != 7 && len != 21)
+        return bt_att_error(rsp, req[0], 0, ATT_ECODE_INVALID_PDU);
+
+    start = get_unaligned_le16(req + 1);
+    end = get_unaligned_le16(req + 3);
+    if (!start || start > end)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_INVALID_HANDLE);
+
+    if (len != 7 || get_unaligned_le16(req + 5) != GATT_UUID_PRIMARY_SVC)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_UNSUPP_GRP_TYPE);
+
+    list_for_each_entry(svc, &bdev->gatt_services, list) {
+        if (svc->start_handle < start || svc->start_handle > end)
+            continue;
+        if (off + entry > mtu)
+            break;
+
+        put_unaligned_le16(svc->start_handle, rsp + off);
+        put_unaligned_le16(svc->end_handle, rsp + off + 2);
+        memcpy(rsp + off + 4, svc->uuid, 16);
+        off += entry;
+    }
+
+    if (off == 2)
+        return bt_att_error(rsp, req[0], start, ATT_ECODE_ATTR_NOT_FOUND);
+
+    rsp[0] = ATT_OP_READ_BY_GROUP_RSP;
+    rsp[1] = entry;
+    return off;
+}
+
+static int bt_att_read_req(struct bluetooth_device *bdev, const u8 *req,
+                           size_t len, u8 *rsp)
+{
+    bool blob = req[0] == ATT_OP_READ_BLOB_REQ;
+    u16 handle, offset = 0;
+    struct bt_attr attr;
+    int ret;
+
+    if (len != (blob ? 5 : 3))
+        return bt_att_error(rsp, req[0], 0, ATT_ECODE_INVALID_PDU);
+
+    handle = get_unaligned_le16(req + 1);
+    if (blob)
+        offset = get_unaligned_le16(req + 3);
+
+    if (!bt_gatt_find_attr(bdev, handle, &attr))
+        return bt_att_error(rsp, req[0], handle, ATT_ECODE_INVALID_HANDLE);
+
+    ret = bt_att_read_attr(bdev, &attr, offset, rsp + 1, bdev->status.att_mtu - 1);
+    if (ret < 0)
+        return bt_att_error(rsp, req[0], handle, -ret);
+
+    rsp[0] = blob ? ATT_OP_READ_BLOB_RSP : ATT_OP_READ_RSP;
+    return ret + 1;
+}
+
+static int bt_att_write_req(struct bluetooth_device *bdev, const u8 *req,
+                            size_t len, u8 *rsp)
+{
+    bool cmd = req[0] == ATT_OP_WRITE_CMD;
+    const u8 *value = req + 3;
+    size_t vlen = len - 3;
+    struct bt_attr attr;
+    u16 handle;
+    u8 ecode = 0;
+
+    if (len < 3)
+        return cmd ? 0 : bt_att_error(rsp, req[0], 0, ATT_ECODE_INVALID_PDU);
+
+    handle = get_unaligned_le16(req + 1);
+    if (!bt_gatt_find_attr(bdev, handle, &attr)) {
+        ecode = ATT_ECODE_INVALID_HANDLE;
+    } else if (attr.kind == BT_ATTR_CCCD) {
+        if (vlen != 2) {
+            ecode = ATT_ECODE_INVAL_ATTR_LEN;
+        } else {
+            attr.chr->notify_enabled = get_unaligned_le16(value) & 0x0001;
+            if (attr.chr->notify_enabled)
+                mod_delayed_work(bdev->workqueue, &bdev->notify_work, 0);
+        }
+    } else if (attr.kind != BT_ATTR_CHR_VALUE || !attr.chr->write ||
+               !(attr.chr->properties & (GATT_CHR_PROP_WRITE | GATT_CHR_PROP_WRITE_NR))) {
+        ecode = ATT_ECODE_WRITE_NOT_PERM;
+    } else if (attr.chr->write(bdev, attr.chr, value, vlen)) {
+        ecode = ATT_ECODE_INVAL_ATTR_LEN;
+    }
+
+    if (cmd)
+        return 0;
+    if (ecode)
+        return bt_att_error(rsp, req[0], handle, ecode);
+
+    rsp[0] = ATT_OP_WRITE_RSP;
+    return 1;
+}
+
+/* 返回响应长度，0表示无需响应 */
+static int bt_att_handle_pdu(struct bluetooth_device *bdev, const u8 *req,
+                             size_t len, u8 *rsp)
+{
+    switch (req[0]) {
+    case ATT_OP_MTU_REQ:
+        return bt_att_mtu_req(bdev, req, len, rsp);
+    case ATT_OP_FIND_INFO_REQ:
+        return bt_att_find_info_req(bdev, req, len, rsp);
+    case ATT_OP_READ_BY_TYPE_REQ:
+        return bt_att_read_by_type_req(bdev, req, len, rsp);
+    case ATT_OP_READ_BY_GROUP_REQ:
+        return bt_att_read_by_group_req(bdev, req, len, rsp);
+    case ATT_OP_READ_REQ:
+    case ATT_OP_READ_BLOB_REQ:
+        return bt_att_read_req(bdev, req, len, rsp);
+    case ATT_OP_WRITE_REQ:
+    case ATT_OP_WRITE_CMD:
+        return bt_att_write_req(bdev, req, len, rsp);
+    default:
+        if (req[0] & ATT_OP_CMD_FLAG)
+            return 0;
+        return bt_att_error(rsp, req[0], 0, ATT_ECODE_REQ_NOT_SUPP);
+    }
+}
+
+static int bt_att_send(struct socket *sock, const u8 *buf, size_t len)
+{
+    struct msghdr msg = { .msg_flags = MSG_NOSIGNAL };
+    struct kvec iov = { .iov_base = (void *)buf, .iov_len = len };
+    int ret;
+
+    ret = kernel_sendmsg(sock, &msg, &iov, 1, len);
+    return ret < 0 ? ret : 0;
+}
+
+/*
+ * 事件缓冲与批量通知
+ */
+
+static u32 bt_gatt_event_oldest(struct bluetooth_device *bdev)
+{
+    u32 head = bdev->event_head_seq;
+
+    return head > BT_GATT_EVENT_RING_SIZE ? head - BT_GATT_EVENT_RING_SIZE : 0;
+}
+
+int bluetooth_gatt_event_push(struct bluetooth_device *bdev, const void *data, size_t len)
+{
+    struct bt_gatt_event *ev;
+    unsigned long flags;
+
+    if (len > BT_GATT_EVENT_MAX_LEN)
+        return -EMSGSIZE;
+
+    spin_lock_irqsave(&bdev->event_lock, flags);
+    ev = &bdev->events[bdev->event_head_seq & (BT_GATT_EVENT_RING_SIZE - 1)];
+    ev->seq = bdev->event_head_seq++;
+    ev->timestamp = (u32)ktime_get_boottime_seconds();
+    ev->len = len;
+    memcpy(ev->data, data, len);
+    spin_unlock_irqrestore(&bdev->event_lock, flags);
+
+    /* 已在等待中的通知不会被推迟，BT_GATT_NOTIFY_DELAY_MS内的事件合并发送 */
+    queue_delayed_work(bdev->workqueue, &bdev->notify_work,
+                       msecs_to_jiffies(BT_GATT_NOTIFY_DELAY_MS));
+    return 0;
+}
+EXPORT_SYMBOL_GPL(bluetooth_gatt_event_push);
+
+int bluetooth_gatt_set_app_status(struct bluetooth_device *bdev, const void *data, size_t len)
+{
+    if (len > BT_GATT_APP_STATUS_LEN)
+        return -EMSGSIZE;
+
+    mutex_lock(&bdev->gatt_lock);
+    memcpy(bdev->app_status, data, len);
+    bdev->app_status_len = len;
+    mutex_unlock(&bdev->gatt_lock);
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(bluetooth_gatt_set_app_status);
+
+/* 把尽可能多的事件记录装进一个通知，返回PDU长度，没有待发事件时返回0 */
+static size_t bt_gatt_build_notify(struct bluetooth_device *bdev,
+                                   struct gatt_characteristic *chr, u8 *pdu)
+{
+    size_t off = 3, mtu = bdev->status.att_mtu;
+    struct bt_gatt_event *ev;
+
+    pdu[0] = ATT_OP_HANDLE_NOTIFY;
+    put_unaligned_le16(chr->value_handle, pdu + 1);
+
+    spin_lock_irq(&bdev->event_lock);
+
+    /* 手机太久没拉取时，被覆盖的事件直接跳过 */
+    if (bdev->event_notify_seq < bt_gatt_event_oldest(bdev))
+        bdev->event_notify_seq = bt_gatt_event_oldest(bdev);
+
+    while (bdev->event_notify_seq != bdev->event_head_seq) {
+        ev = &bdev->events[bdev->event_notify_seq & (BT_GATT_EVENT_RING_SIZE - 1)];
+        if (off + BT_GATT_EVENT_HDR_LEN + ev->len > mtu)
+            break;
+
+        put_unaligned_le32(ev->seq, pdu + off);
+        put_unaligned_le32(ev->timestamp, pdu + off + 4);
+        pdu[off + 8] = ev->len;
+        memcpy(pdu + off + BT_GATT_EVENT_HDR_LEN, ev->data, ev->len);
+        off += BT_GATT_EVENT_HDR_LEN + ev->len;
+        bdev->event_notify_seq++;
+    }
+
+    spin_unlock_irq(&bdev->event_lock);
+
+    return off > 3 ? off : 0;
+}
+
+static void bt_gatt_notify_work(struct work_struct *work)
+{
+    struct bluetooth_device *bdev = container_of(to_delayed_work(work),
+                                                 struct bluetooth_device, notify_work);
+    struct gatt_characteristic *chr;
+    bool more = false;
+    size_t len;
+
+    mutex_lock(&bdev->gatt_lock);
+
+    chr = &bdev->status_svc->chrs[BT_GATT_IDX_EVENTS];
+    if (!bdev->att_sock || !chr->notify_enabled)
+        goto out;
+
+    /* 每次只发一个通知后释放锁，拉取大量事件时不阻塞ATT请求处理 */
+    len = bt_gatt_build_notify(bdev, chr, bdev->att_tx_buf);
+    if (!len)
+        goto out;
+
+    if (bt_att_send(bdev->att_sock, bdev->att_tx_buf, len)) {
+        dev_dbg(bdev->dev, "event notification failed\n");
+        goto out;
+    }
+
+    spin_lock_irq(&bdev->event_lock);
+    more = bdev->event_notify_seq != bdev->event_head_seq;
+    spin_unlock_irq(&bdev->event_lock);
+
+out:
+    mutex_unlock(&bdev->gatt_lock);
+
+    if (more)
+        mod_delayed_work(bdev->workqueue, &bdev->notify_work, 0);
+}
+
+/*
+ * 设备状态服务
+ */
+
+static ssize_t bt_gatt_status_read(struct bluetooth_device *bdev,
+                                   struct gatt_characteristic *chr,
+                                   u16 offset, u8 *buf, size_t len)
+{
+    u8 value[sizeof(struct bt_gatt_status_payload) + BT_GATT_APP_STATUS_LEN];
+    struct bt_gatt_status_payload *st = (void *)value;
+    size_t vlen;
+
+    spin_lock_irq(&bdev->event_lock);
+    st->event_head = cpu_to_le32(bdev->event_head_seq);
+    st->event_oldest = cpu_to_le32(bt_gatt_event_oldest(bdev));
+    spin_unlock_irq(&bdev->event_lock);
+
+    st->uptime = cpu_to_le32((u32)ktime_get_boottime_seconds());
+    st->att_mtu = cpu_to_le16(bdev->status.att_mtu);
+    st->tx_octets = cpu_to_le16(bdev->status.tx_octets);
+    st->state = bdev->status.state;
+    st->app_len = bdev->app_status_len;
+    memcpy(value + sizeof(*st), bdev->app_status, bdev->app_status_len);
+
+    vlen = sizeof(*st) + bdev->app_status_len;
+    if (offset > vlen)
+        return -EINVAL;
+
+    vlen = min(vlen - offset, len);
+    memcpy(buf, value + offset, vlen);
+    return vlen;
+}
+
+static int bt_gatt_control_write(struct bluetooth_device *bdev,
+                                 struct gatt_characteristic *chr,
+                                 const u8 *data, size_t len)
+{
+    u32 seq;
+
+    if (!len)
+        return -EINVAL;
+
+    switch (data[0]) {
+    case BT_GATT_CTRL_PULL:
+        if (len != 5)
+            return -EINVAL;
+        seq = get_unaligned_le32(data + 1);
+        spin_lock_irq(&bdev->event_lock);
+        bdev->event_notify_seq = clamp(seq, bt_gatt_event_oldest(bdev),
+                                       bdev->event_head_seq);
+        spin_unlock_irq(&bdev->event_lock);
+        break;
+    case BT_GATT_CTRL_LIVE:
+        spin_lock_irq(&bdev->event_lock);
+        bdev->event_notify_seq = bdev->event_head_seq;
+        spin_unlock_irq(&bdev->event_lock);
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    mod_delayed_work(bdev->workqueue, &bdev->notify_work, 0);
+    return 0;
+}
+
+static const struct gatt_characteristic bt_gatt_status_chrs[BT_GATT_NUM_CHRS] = {
+    [BT_GATT_IDX_STATUS] = {
+        .uuid = BT_GATT_UUID(BT_GATT_CHR_STATUS),
+        .properties = GATT_CHR_PROP_READ,
+        .read = bt_gatt_status_read,
+    },
+    [BT_GATT_IDX_EVENTS] = {
+        .uuid = BT_GATT_UUID(BT_GATT_CHR_EVENTS),
+        .properties = GATT_CHR_PROP_NOTIFY,
+    },
+    [BT_GATT_IDX_CONTROL] = {
+        .uuid = BT_GATT_UUID(BT_GATT_CHR_CONTROL),
+        .properties = GATT_CHR_PROP_WRITE | GATT_CHR_PROP_WRITE_NR,
+        .write = bt_gatt_control_write,
+    },
+};
+
+/*
+ * ATT连接
+ */
+
+/*
+ * 请求最大链路层载荷，一个251字节的PDU不再被拆成多个27字节的空口包。
+ * 命令发出不代表对端接受，tx_octets等LE Data Length Change事件再更新。
+ */
+static void bt_gatt_set_data_len(struct bluetooth_device *bdev, u16 handle)
+{
+    struct hci_cp_le_set_data_len cp;
+
+    if (!(bdev->hdev->le_features[0] & HCI_LE_DATA_LEN_EXT))
+        return;
+
+    cp.handle = cpu_to_le16(handle);
+    cp.tx_len = cpu_to_le16(BT_LE_MAX_TX_OCTETS);
+    cp.tx_time = cpu_to_le16(BT_LE_MAX_TX_TIME);
+
+    hci_send_cmd(bdev->hdev, HCI_OP_LE_SET_DATA_LEN, sizeof(cp), &cp);
+}
+
+/* LE Data Length Change事件，由原始HCI socket接收线程调用 */
+void bluetooth_gatt_data_len_changed(struct bluetooth_device *bdev,
+                                     const struct hci_ev_le_data_len_change *ev)
+{
+    mutex_lock(&bdev->gatt_lock);
+    if (bdev->att_sock && bdev->status.conn_handle == le16_to_cpu(ev->handle))
+        bdev->status.tx_octets = le16_to_cpu(ev->tx_len);
+    mutex_unlock(&bdev->gatt_lock);
+}
+
+static void bt_att_session(struct bluetooth_device *bdev, struct socket *sock)
+{
+    struct l2cap_chan *chan = l2cap_pi(sock->sk)->chan;
+    struct msghdr msg = {};
+    struct kvec iov;
+    unsigned int i;
+    int len, rsp_len;
+    u16 handle;
+
+    handle = chan->conn->hcon->handle;
+
+    /*
+     * 在接收循环之前发布socket，此后清理流程一定能shutdown它；清理已经
+     * 开始时自己shutdown，下面的recvmsg立即返回。
+     */
+    mutex_lock(&bdev->gatt_lock);
+    bdev->att_sock = sock;
+    if (bdev->att_stopping)
+        kernel_sock_shutdown(sock, SHUT_RDWR);
+    bdev->status.state = BT_STATE_CONNECTED;
+    bdev->status.conn_handle = handle;
+    bdev->status.att_mtu = BT_ATT_DEFAULT_MTU;
+    bdev->status.tx_octets = 27;
+    bt_gatt_set_data_len(bdev, handle);
+    mutex_unlock(&bdev->gatt_lock);
+
+    dev_info(bdev->dev, "GATT client %pMR connected\n", &chan->dst);
+
+    while (!kthread_should_stop()) {
+        iov.iov_base = bdev->att_rx_buf;
+        iov.iov_len = BT_ATT_MAX_MTU;
+        len = kernel_recvmsg(sock, &msg, &iov, 1, BT_ATT_MAX_MTU, 0);
+        if (len <= 0)
+            break;
+
+        mutex_lock(&bdev->gatt_lock);
+        rsp_len = bt_att_handle_pdu(bdev, bdev->att_rx_buf, len, bdev->att_tx_buf);
+        if (rsp_len > 0)
+            bt_att_send(sock, bdev->att_tx_buf, rsp_len);
+        mutex_unlock(&bdev->gatt_lock);
+    }
+
+    mutex_lock(&bdev->gatt_lock);
+    bdev->att_sock = NULL;
+    bdev->status.state = BT_STATE_READY;
+    bdev->status.att_mtu = BT_ATT_DEFAULT_MTU;
+    for (i = 0; i < bdev->status_svc->num_chrs; i++)
+        bdev->status_svc->chrs[i].notify_enabled = false;
+    mutex_unlock(&bdev->gatt_lock);
+
+    dev_info(bdev->dev, "GATT client disconnected\n");
+    sock_release(sock);
+}
+
+static int bt_att_thread(void *data)
+{
+    struct bluetooth_device *bdev = data;
+    struct socket *sock;
+    int ret;
+
+    while (!kthread_should_stop()) {
+        ret = kernel_accept(bdev->att_listen, &sock, 0);
+        if (ret) {
+            /* 监听socket被shutdown后accept立即返回，等待kthread_stop() */
+            msleep(100);
+            continue;
+        }
+        bt_att_session(bdev, sock);
+    }
+
+    return 0;
+}
+
+static int bt_att_listen(struct bluetooth_device *bdev)
+{
+    struct sockaddr_l2 addr;
+    struct socket *sock;
+    int ret;
+
+    ret = sock_create_kern(&init_net, PF_BLUETOOTH, SOCK_SEQPACKET,
+                           BTPROTO_L2CAP, &sock);
+    if (ret)
+        return ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.l2_family = AF_BLUETOOTH;
+    bacpy(&addr.l2_bdaddr, &bdev->hdev->bdaddr);
+    addr.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+    addr.l2_cid = cpu_to_le16(L2CAP_CID_ATT);
+
+    ret = kernel_bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret) {
+        if (ret == -EADDRINUSE)
+            dev_warn(bdev->dev, "ATT channel in use, is bluetoothd running?\n");
+        goto err;
+    }
+
+    ret = kernel_listen(sock, 1);
+    if (ret)
+        goto err;
+
+    bdev->att_listen = sock;
+    return 0;
+
+err:
+    sock_release(sock);
+    return ret;
+}
+
+int bluetooth_gatt_init(struct bluetooth_device *bdev)
+{
+    struct gatt_service *svc;
+    static const u8 svc_uuid[16] = BT_GATT_UUID(BT_GATT_SVC_STATUS);
+    int ret;
+
+    spin_lock_init(&bdev->event_lock);
+    INIT_DELAYED_WORK(&bdev->notify_work, bt_gatt_notify_work);
+
+    bdev->events = devm_kcalloc(bdev->dev, BT_GATT_EVENT_RING_SIZE,
+                                sizeof(*bdev->events), GFP_KERNEL);
+    bdev->att_rx_buf = devm_kmalloc(bdev->dev, BT_ATT_MAX_MTU, GFP_KERNEL);
+    bdev->att_tx_buf = devm_kmalloc(bdev->dev, BT_ATT_MAX_MTU, GFP_KERNEL);
+    svc = devm_kzalloc(bdev->dev, sizeof(*svc), GFP_KERNEL);
+    if (!bdev->events || !bdev->att_rx_buf || !bdev->att_tx_buf || !svc)
+        return -ENOMEM;
+
+    svc->chrs = devm_kmemdup(bdev->dev, bt_gatt_status_chrs,
+                             sizeof(bt_gatt_status_chrs), GFP_KERNEL);
+    if (!svc->chrs)
+        return -ENOMEM;
+    svc->num_chrs = BT_GATT_NUM_CHRS;
+    memcpy(svc->uuid, svc_uuid, sizeof(svc->uuid));
+    bdev->status_svc = svc;
+
+    ret = gatt_service_add(bdev, svc);
+    if (ret)
+        return ret;
+
+    /* 芯片接管GATT时不需要主机侧ATT服务端 */
+    if (bdev->ops->gatt_service_add)
+        return 0;
+
+    ret = bt_att_listen(bdev);
+    if (ret)
+        goto err_svc;
+
+    bdev->att_thread = kthread_run(bt_att_thread, bdev, "bt_att/%s", bdev->hdev->name);
+    if (IS_ERR(bdev->att_thread)) {
+        ret = PTR_ERR(bdev->att_thread);
+        bdev->att_thread = NULL;
+        goto err_sock;
+    }
+
+    return 0;
+
+err_sock:
+    sock_release(bdev->att_listen);
+    bdev->att_listen = NULL;
+err_svc:
+    gatt_service_remove(bdev, svc);
+    return ret;
+}
+
+void bluetooth_gatt_cleanup(struct bluetooth_device *bdev)
+{
+    if (bdev->att_thread) {
+        kernel_sock_shutdown(bdev->att_listen, SHUT_RDWR);
+        mutex_lock(&bdev->gatt_lock);
+        bdev->att_stopping = true;
+        if (bdev->att_sock)
+            kernel_sock_shutdown(bdev->att_sock, SHUT_RDWR);
+        mutex_unlock(&bdev->gatt_lock);
+
+        kthread_stop(bdev->att_thread);
+        bdev->att_thread = NULL;
+    }
+
+    if (bdev->att_listen) {
+        sock_release(bdev->att_listen);
+        bdev->att_listen = NULL;
+    }
+
+    cancel_delayed_work_sync(&bdev->notify_work);
+    gatt_service_remove(bdev, bdev->status_svc);
+}
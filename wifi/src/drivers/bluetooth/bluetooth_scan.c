@@ -0,0 +1,528 @@
+/*
+ * 蓝牙LE广播过滤与去重
+ *
+ * 门禁场景下持续扫描，周围每个BLE设备每秒都会产生多条广播报告。本模块在
+ * HCI事件进入协议栈之前处理LE Advertising Report：
+ *
+ *   - 按地址/服务UUID/RSSI门限过滤，不相关的设备直接丢弃
+ *   - 对同一设备做RSSI指数平均，只有首次出现、广播内容变化、平均RSSI
+ *     变化超过BT_SCAN_RSSI_DELTA或超过refresh间隔时才上报
+ *   - 上报的RSSI替换为平均值，用户态看到的是平滑后的信号强度
+ *
+ * 扩展广播报告(LE Extended Advertising Report)原样放行。
+ *
+ * 报告有两个入口：
+ *
+ *   - 芯片传输驱动调用bluetooth_recv_frame()代替hci_recv_frame()，过滤
+ *     结果就是协议栈看到的报告
+ *   - 传输驱动是hci_uart/btusb等标准驱动时，报告不经过本驱动。此时在
+ *     绑定的hciX上开一个原始HCI socket只收LE Meta事件，同样过滤去重，
+ *     维护去重表供bluetooth_scan_get_devices()和debugfs使用，协议栈
+ *     仍收到全部报告
+ *
+ * 一旦bluetooth_recv_frame()被调用过，原始socket收到的(已过滤的)报告
+ * 不再处理，避免同一报告计入两次。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <asm/unaligned.h>
+#include <net/sock.h>
+#include <net/bluetooth/hci_sock.h>
+
+#include "bluetooth_driver.h"
+
+static unsigned int scan_refresh_ms = BT_SCAN_REFRESH_MS;
+module_param(scan_refresh_ms, uint, 0644);
+MODULE_PARM_DESC(scan_refresh_ms, "Maximum interval between reports of an unchanged device (ms)");
+
+static unsigned int scan_rssi_delta = BT_SCAN_RSSI_DELTA;
+module_param(scan_rssi_delta, uint, 0644);
+MODULE_PARM_DESC(scan_rssi_delta, "Averaged RSSI change that triggers an immediate report (dB)");
+
+/* AD类型 */
+#define AD_UUID16_SOME              0x02
+#define AD_UUID16_ALL               0x03
+#define AD_UUID128_SOME             0x06
+#define AD_UUID128_ALL              0x07
+#define AD_SERVICE_DATA16           0x16
+#define AD_SERVICE_DATA128          0x21
+
+#define ADV_REPORT_SCAN_RSP         0x04
+
+/* 原始HCI socket收到的事件：包类型 + 事件头 + 最长参数 */
+#define BT_SCAN_RX_BUF_SIZE         (1 + HCI_EVENT_HDR_SIZE + HCI_MAX_EVENT_SIZE)
+#define BT_SCAN_RX_TIMEOUT          (HZ / 2)    /* 检查kthread_should_stop()的间隔 */
+
+/* 蓝牙基础UUID 00000000-0000-1000-8000-00805F9B34FB，小端 */
+static const u8 bt_base_uuid[16] = {
+    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static void bt_uuid16_to_128(u16 uuid16, u8 *uuid)
+{
+    memcpy(uuid, bt_base_uuid, 16);
+    uuid[12] = uuid16 & 0xff;
+    uuid[13] = uuid16 >> 8;
+}
+
+static bool bt_scan_uuid_wanted(const struct bt_scan_filter *f, const u8 *uuid)
+{
+    unsigned int i;
+
+    for (i = 0; i < f->num_uuids; i++)
+        if (!memcmp(f->uuids[i], uuid, 16))
+            return true;
+
+    return false;
+}
+
+/* 在广播数据中查找过滤表里的服务UUID */
+static bool bt_scan_match_uuid(const struct bt_scan_filter *f, const u8 *data, u8 len)
+{
+    u8 uuid[16];
+    int i, off = 0;
+
+    while (off + 1 < len) {
+        u8 field_len = data[off];
+        u8 type = data[off + 1];
+        const u8 *p = data + off + 2;
+        int plen = field_len - 1;
+
+        if (!field_len || off + 1 + field_len > len)
+            break;
+
+        switch (type) {
+        case AD_UUID16_SOME:
+        case AD_UUID16_ALL:
+            for (i = 0; i + 2 <= plen; i += 2) {
+                bt_uuid16_to_128(get_unaligned_le16(p + i), uuid);
+                if (bt_scan_uuid_wanted(f, uuid))
+                    return true;
+            }
+            break;
+        case AD_SERVICE_DATA16:
+            if (plen >= 2) {
+                bt_uuid16_to_128(get_unaligned_le16(p), uuid);
+                if (bt_scan_uuid_wanted(f, uuid))
+                    return true;
+            }
+            break;
+        case AD_UUID128_SOME:
+        case AD_UUID128_ALL:
+            for (i = 0; i + 16 <= plen; i += 16)
+                if (bt_scan_uuid_wanted(f, p + i))
+                    return true;
+            break;
+        case AD_SERVICE_DATA128:
+            if (plen >= 16 && bt_scan_uuid_wanted(f, p))
+                return true;
+            break;
+        }
+
+        off += 1 + field_len;
+    }
+
+    return false;
+}
+
+static struct bt_scan_entry *bt_scan_find(struct bluetooth_device *bdev,
+                                          const bdaddr_t *addr, u8 addr_type)
+{
+    struct bt_scan_entry *e;
+    unsigned int i;
+
+    for (i = 0; i < BT_SCAN_MAX_DEVICES; i++) {
+        e = &bdev->scan_table[i];
+        if (e->valid && e->addr_type == addr_type && !bacmp(&e->info.addr, addr))
+            return e;
+    }
+
+    return NULL;
+}
+
+static struct bt_scan_entry *bt_scan_alloc(struct bluetooth_device *bdev,
+                                           const bdaddr_t *addr, u8 addr_type)
+{
+    struct bt_scan_entry *e, *victim = NULL;
+    unsigned int i;
+
+    for (i = 0; i < BT_SCAN_MAX_DEVICES; i++) {
+        e = &bdev->scan_table[i];
+        if (!e->valid) {
+            if (!victim || victim->valid)
+                victim = e;
+        } else if (!victim || (victim->valid &&
+                               time_before(e->last_seen, victim->last_seen))) {
+            victim = e;
+        }
+    }
+
+    /* 表满时只淘汰已经过期的设备，否则不跟踪该设备，报告直接放行 */
+    if (victim->valid &&
+        time_before(jiffies, victim->last_seen + msecs_to_jiffies(BT_SCAN_EXPIRE_MS)))
+        return NULL;
+
+    memset(victim, 0, sizeof(*victim));
+    bacpy(&victim->info.addr, addr);
+    victim->addr_type = addr_type;
+    ewma_bt_rssi_init(&victim->rssi_avg);
+    return victim;
+}
+
+static bool bt_scan_addr_wanted(const struct bt_scan_filter *f, const bdaddr_t *addr)
+{
+    unsigned int i;
+
+    for (i = 0; i < f->num_addrs; i++)
+        if (!bacmp(&f->addrs[i], addr))
+            return true;
+
+    return false;
+}
+
+/* 处理一条广播报告，返回true表示上报给协议栈，*rssi被替换为平均值 */
+static bool bt_scan_process_report(struct bluetooth_device *bdev,
+                                   struct hci_ev_le_advertising_info *adv, s8 *rssi)
+{
+    const struct bt_scan_filter *f = &bdev->scan_filter;
+    bool filtered = f->num_addrs || f->num_uuids;
+    bool uuid_match = false;
+    struct bt_scan_entry *e;
+    bool report, changed;
+    u32 hash;
+    int avg;
+
+    /* 127表示控制器没有RSSI，既不能参与平均也无法按门限判断 */
+    if (*rssi == HCI_RSSI_INVALID)
+        return false;
+
+    if (f->min_rssi && *rssi < f->min_rssi)
+        return false;
+
+    e = bt_scan_find(bdev, &adv->bdaddr, adv->bdaddr_type);
+
+    /* 先过滤再分配表项，无关设备不占用去重表 */
+    if (filtered && !bt_scan_addr_wanted(f, &adv->bdaddr)) {
+        uuid_match = bt_scan_match_uuid(f, adv->data, adv->length);
+        /* 扫描响应一般不带UUID，跟随同一设备的广播结果 */
+        if (!uuid_match &&
+            (adv->type != ADV_REPORT_SCAN_RSP || !e || !e->matched))
+            return false;
+    }
+
+    if (!e)
+        e = bt_scan_alloc(bdev, &adv->bdaddr, adv->bdaddr_type);
+    if (!e)
+        return true;
+    if (uuid_match)
+        e->matched = true;
+
+    /* 扫描响应与广播内容不同，只用广播内容判断变化，否则两者会互相触发上报 */
+    hash = jhash(adv->data, adv->length, adv->type);
+    ewma_bt_rssi_add(&e->rssi_avg, *rssi + BT_SCAN_RSSI_OFFSET);
+    avg = (int)ewma_bt_rssi_read(&e->rssi_avg) - BT_SCAN_RSSI_OFFSET;
+    e->last_seen = jiffies;
+
+    changed = !e->valid || (adv->type != ADV_REPORT_SCAN_RSP && hash != e->data_hash);
+    report = changed ||
+             abs(avg - (s8)e->info.rssi) >= scan_rssi_delta ||
+             time_after_eq(jiffies, e->last_report + msecs_to_jiffies(scan_refresh_ms));
+
+    if (!report)
+        return false;
+
+    e->valid = true;
+    if (adv->type != ADV_REPORT_SCAN_RSP) {
+        e->data_hash = hash;
+        e->info.data_len = min_t(u8, adv->length, sizeof(e->info.data));
+        memcpy(e->info.data, adv->data, e->info.data_len);
+    }
+    e->info.rssi = (u8)(s8)avg;
+    e->last_report = jiffies;
+
+    *rssi = avg;
+    return true;
+}
+
+/* HCI事件是否为指定的LE Meta子事件，且参数至少有min_len字节 */
+static bool bt_scan_is_le_event(const u8 *data, unsigned int len, u8 subevent,
+                                unsigned int min_len)
+{
+    const struct hci_event_hdr *hdr = (const void *)data;
+
+    return len >= HCI_EVENT_HDR_SIZE + 1 + min_len && hdr->evt == HCI_EV_LE_META &&
+           data[HCI_EVENT_HDR_SIZE] == subevent;
+}
+
+static bool bt_scan_is_adv_report(const u8 *data, unsigned int len)
+{
+    return bt_scan_is_le_event(data, len, HCI_EV_LE_ADVERTISING_REPORT, 1);
+}
+
+/*
+ * 过滤LE Advertising Report事件，通过的报告原地前移压缩，*len更新为
+ * 压缩后的长度。返回false表示事件中已无报告，应丢弃。
+ */
+static bool bt_scan_filter_event(struct bluetooth_device *bdev, u8 *data, unsigned int *len)
+{
+    struct hci_event_hdr *hdr = (void *)data;
+    u8 *num_reports = data + HCI_EVENT_HDR_SIZE + 1;
+    u8 *rd, *wr, *end = data + *len;
+    unsigned int i, kept = 0, in;
+    unsigned long flags;
+
+    in = *num_reports;
+    rd = wr = num_reports + 1;
+
+    spin_lock_irqsave(&bdev->scan_lock, flags);
+
+    for (i = 0; i < in; i++) {
+        struct hci_ev_le_advertising_info *adv = (void *)rd;
+        size_t size;
+        s8 rssi;
+
+        if (rd + sizeof(*adv) > end || rd + sizeof(*adv) + adv->length + 1 > end)
+            break;
+
+        size = sizeof(*adv) + adv->length + 1;
+        rssi = (s8)rd[size - 1];
+
+        if (bt_scan_process_report(bdev, adv, &rssi)) {
+            rd[size - 1] = (u8)rssi;
+            if (wr != rd)
+                memmove(wr, rd, size);
+            wr += size;
+            kept++;
+        }
+        rd += size;
+    }
+
+    bdev->scan_reports_in += in;
+    bdev->scan_reports_out += kept;
+
+    spin_unlock_irqrestore(&bdev->scan_lock, flags);
+
+    if (!kept)
+        return false;
+
+    *num_reports = kept;
+    *len = wr - data;
+    hdr->plen = *len - HCI_EVENT_HDR_SIZE;
+    return true;
+}
+
+int bluetooth_recv_frame(struct bluetooth_device *bdev, struct sk_buff *skb)
+{
+    unsigned int len = skb->len;
+
+    WRITE_ONCE(bdev->scan_rx_hooked, true);
+
+    if (hci_skb_pkt_type(skb) != HCI_EVENT_PKT || !bt_scan_is_adv_report(skb->data, len))
+        return hci_recv_frame(bdev->hdev, skb);
+
+    if (!bt_scan_filter_event(bdev, skb->data, &len)) {
+        kfree_skb(skb);
+        return 0;
+    }
+
+    skb_trim(skb, len);
+    return hci_recv_frame(bdev->hdev, skb);
+}
+EXPORT_SYMBOL_GPL(bluetooth_recv_frame);
+
+/* 更换过滤条件后清空去重表，新条件下所有设备重新上报一次 */
+int bluetooth_scan_filter_set(struct bluetooth_device *bdev, const struct bt_scan_filter *filter)
+{
+    unsigned long flags;
+
+    if (filter->num_addrs > BT_SCAN_MAX_ADDR_FILTERS ||
+        filter->num_uuids > BT_SCAN_MAX_UUID_FILTERS)
+        return -EINVAL;
+
+    spin_lock_irqsave(&bdev->scan_lock, flags);
+    bdev->scan_filter = *filter;
+    memset(bdev->scan_table, 0, sizeof(bdev->scan_table));
+    spin_unlock_irqrestore(&bdev->scan_lock, flags);
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(bluetooth_scan_filter_set);
+
+/* 当前跟踪中的设备快照，返回条目数 */
+int bluetooth_scan_get_devices(struct bluetooth_device *bdev,
+                               struct bluetooth_device_info *info, int max)
+{
+    unsigned long flags;
+    int i, n = 0;
+
+    spin_lock_irqsave(&bdev->scan_lock, flags);
+    for (i = 0; i < BT_SCAN_MAX_DEVICES && n < max; i++) {
+        if (bdev->scan_table[i].valid)
+            info[n++] = bdev->scan_table[i].info;
+    }
+    spin_unlock_irqrestore(&bdev->scan_lock, flags);
+
+    return n;
+}
+EXPORT_SYMBOL_GPL(bluetooth_scan_get_devices);
+
+static int bt_scan_debug_show(struct seq_file *seq, void *v)
+{
+    struct bluetooth_device *bdev = seq->private;
+    struct bt_scan_entry *e;
+    unsigned long flags;
+    u64 in, out;
+    int i;
+
+    seq_puts(seq, "# addr type rssi_avg age_ms matched\n");
+
+    spin_lock_irqsave(&bdev->scan_lock, flags);
+    in = bdev->scan_reports_in;
+    out = bdev->scan_reports_out;
+    for (i = 0; i < BT_SCAN_MAX_DEVICES; i++) {
+        e = &bdev->scan_table[i];
+        if (!e->valid)
+            continue;
+        seq_printf(seq, "%pMR %u %d %u %d\n", &e->info.addr, e->addr_type,
+                   (s8)e->info.rssi, jiffies_to_msecs(jiffies - e->last_seen),
+                   e->matched);
+    }
+    spin_unlock_irqrestore(&bdev->scan_lock, flags);
+
+    seq_printf(seq, "reports: %llu in, %llu forwarded\n", in, out);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bt_scan_debug);
+
+/*
+ * 从原始HCI socket接收LE Meta事件：广播报告(标准传输驱动下)，以及GATT
+ * 会话需要的LE Data Length Change
+ */
+static int bt_scan_rx_thread(void *data)
+{
+    struct bluetooth_device *bdev = data;
+    u8 *buf = bdev->scan_rx_buf;
+    struct msghdr msg = {};
+    struct kvec iov;
+    unsigned int len;
+    int ret;
+
+    while (!kthread_should_stop()) {
+        iov.iov_base = buf;
+        iov.iov_len = BT_SCAN_RX_BUF_SIZE;
+        ret = kernel_recvmsg(bdev->scan_sock, &msg, &iov, 1, BT_SCAN_RX_BUF_SIZE, 0);
+        if (ret == -EAGAIN)
+            continue;
+        if (ret < 0) {
+            /* hciX已注销，等待kthread_stop() */
+            msleep(100);
+            continue;
+        }
+
+        if (ret < 1 || buf[0] != HCI_EVENT_PKT)
+            continue;
+
+        len = ret - 1;
+        if (bt_scan_is_le_event(buf + 1, len, HCI_EV_LE_DATA_LEN_CHANGE,
+                                sizeof(struct hci_ev_le_data_len_change))) {
+            bluetooth_gatt_data_len_changed(bdev, (void *)(buf + 1 + HCI_EVENT_HDR_SIZE + 1));
+            continue;
+        }
+
+        /* 传输驱动已经在调用bluetooth_recv_frame()，这里是过滤后的副本 */
+        if (READ_ONCE(bdev->scan_rx_hooked) || !bt_scan_is_adv_report(buf + 1, len))
+            continue;
+
+        bt_scan_filter_event(bdev, buf + 1, &len);
+    }
+
+    return 0;
+}
+
+static int bt_scan_rx_open(struct bluetooth_device *bdev)
+{
+    struct sockaddr_hci addr = {};
+    struct hci_ufilter flt = {};
+    struct socket *sock;
+    int ret;
+
+    bdev->scan_rx_buf = devm_kmalloc(bdev->dev, BT_SCAN_RX_BUF_SIZE, GFP_KERNEL);
+    if (!bdev->scan_rx_buf)
+        return -ENOMEM;
+
+    ret = sock_create_kern(&init_net, PF_BLUETOOTH, SOCK_RAW, BTPROTO_HCI, &sock);
+    if (ret)
+        return ret;
+
+    addr.hci_family = AF_BLUETOOTH;
+    addr.hci_dev = bdev->hdev->id;
+    addr.hci_channel = HCI_CHANNEL_RAW;
+    ret = kernel_bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret)
+        goto err;
+
+    /* 只收LE Meta事件 */
+    flt.type_mask = BIT(HCI_EVENT_PKT);
+    flt.event_mask[HCI_EV_LE_META / 32] = BIT(HCI_EV_LE_META % 32);
+    ret = sock->ops->setsockopt(sock, SOL_HCI, HCI_FILTER, KERNEL_SOCKPTR(&flt), sizeof(flt));
+    if (ret)
+        goto err;
+
+    sock->sk->sk_rcvtimeo = BT_SCAN_RX_TIMEOUT;
+    bdev->scan_sock = sock;
+
+    bdev->scan_thread = kthread_run(bt_scan_rx_thread, bdev, "bt_scan/%s", bdev->hdev->name);
+    if (IS_ERR(bdev->scan_thread)) {
+        ret = PTR_ERR(bdev->scan_thread);
+        bdev->scan_thread = NULL;
+        bdev->scan_sock = NULL;
+        goto err;
+    }
+
+    return 0;
+
+err:
+    sock_release(sock);
+    return ret;
+}
+
+void bluetooth_scan_init(struct bluetooth_device *bdev)
+{
+    int ret;
+
+    spin_lock_init(&bdev->scan_lock);
+    debugfs_create_file("scan", 0444, bdev->debug_dir, bdev, &bt_scan_debug_fops);
+
+    /* 没有原始socket时只有调用bluetooth_recv_frame()的传输驱动能过滤 */
+    ret = bt_scan_rx_open(bdev);
+    if (ret)
+        dev_warn(bdev->dev, "no raw HCI socket for advertising reports: %d\n", ret);
+}
+
+void bluetooth_scan_cleanup(struct bluetooth_device *bdev)
+{
+    if (bdev->scan_thread) {
+        kthread_stop(bdev->scan_thread);
+        bdev->scan_thread = NULL;
+    }
+
+    if (bdev->scan_sock) {
+        sock_release(bdev->scan_sock);
+        bdev->scan_sock = NULL;
+    }
+}
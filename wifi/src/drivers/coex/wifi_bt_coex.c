@@ -0,0 +1,287 @@
+/*
+ * WiFi/蓝牙共存调度
+ *
+ * 每个周期开始时评估双方需求：
+ *
+ *   - 只有一方有需求：本周期不做限制(IDLE)
+ *   - 双方都有需求，且WiFi待发流量中最高优先级高于蓝牙扫描：整个周期
+ *     留给WiFi，蓝牙最多被连续跳过COEX_MAX_BT_SKIPS个周期
+ *   - 其余情况：周期前bt_share%为蓝牙时隙，暂停优先级低于蓝牙的WiFi
+ *     子队列；剩余时间为WiFi时隙，暂停控制器扫描
+ *
+ * 蓝牙时隙内有高于蓝牙优先级的WiFi帧入队时立即结束蓝牙时隙。
+ *
+ * 芯片内部若有硬件PTA仲裁，可以不加载本模块。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "wifi_bt_coex.h"
+
+static unsigned int coex_period_ms = COEX_PERIOD_MS;
+module_param(coex_period_ms, uint, 0444);
+MODULE_PARM_DESC(coex_period_ms, "Arbitration period (ms)");
+
+static unsigned int coex_bt_share = COEX_BT_SHARE;
+module_param(coex_bt_share, uint, 0444);
+MODULE_PARM_DESC(coex_bt_share, "Share of a contended period given to BLE scanning (%)");
+
+/* 默认：结果事件 > 蓝牙扫描 > 普通流量 > 快照上传 */
+static unsigned int coex_prio[COEX_CLASS_MAX] = {
+    [COEX_WIFI_EVENT]   = 3,
+    [COEX_WIFI_DEFAULT] = 1,
+    [COEX_WIFI_BULK]    = 0,
+    [COEX_BT_SCAN]      = 2,
+};
+module_param_array(coex_prio, uint, NULL, 0444);
+MODULE_PARM_DESC(coex_prio, "Priorities of wifi_event,wifi_default,wifi_bulk,bt_scan (higher wins)");
+
+static const char * const coex_slot_names[] = {
+    [COEX_SLOT_IDLE] = "idle",
+    [COEX_SLOT_WIFI] = "wifi",
+    [COEX_SLOT_BT]   = "bt",
+};
+
+/* WIFI_TXQ_*与COEX_WIFI_*一一对应 */
+static inline enum coex_class coex_txq_class(enum wifi_tx_queue queue)
+{
+    return (enum coex_class)queue;
+}
+
+static void coex_set_slot(struct wifi_bt_coex *coex, enum coex_slot slot)
+{
+    spin_lock_bh(&coex->lock);
+    coex->slot = slot;
+    spin_unlock_bh(&coex->lock);
+}
+
+/* 按优先级暂停或恢复WiFi子队列，bt_slot为false时全部恢复 */
+static void coex_update_txqs(struct wifi_bt_coex *coex, bool bt_slot)
+{
+    u32 bt_prio = coex->prio[COEX_BT_SCAN];
+    int q;
+
+    for (q = 0; q < WIFI_TXQ_NUM; q++) {
+        bool block = bt_slot && coex->prio[coex_txq_class(q)] < bt_prio;
+
+        if (block != test_bit(q, &coex->wdev->txq_blocked))
+            wifi_txq_set_blocked(coex->wdev, q, block);
+    }
+}
+
+static void coex_enter_slot(struct wifi_bt_coex *coex, enum coex_slot slot)
+{
+    coex_set_slot(coex, slot);
+    coex_update_txqs(coex, slot == COEX_SLOT_BT);
+    bluetooth_scan_pause(coex->bdev, slot == COEX_SLOT_WIFI);
+}
+
+/*
+ * WiFi是否有需求，*top返回待发流量中的最高优先级。
+ * 上个周期有发送但当前队列已空，按普通流量计。
+ */
+static bool coex_wifi_demand(struct wifi_bt_coex *coex, u32 *top)
+{
+    struct wifi_device *wdev = coex->wdev;
+    struct wifi_stats_totals t;
+    bool busy = false;
+    int q;
+
+    *top = 0;
+    for (q = 0; q < WIFI_TXQ_NUM; q++) {
+        if (atomic_read(&wdev->tx_pending[q]) <= 0)
+            continue;
+        busy = true;
+        *top = max(*top, coex->prio[coex_txq_class(q)]);
+    }
+
+    wifi_stats_get_totals(wdev, &t);
+    if (!busy && t.tx_packets != coex->last_tx_packets) {
+        busy = true;
+        *top = coex->prio[COEX_WIFI_DEFAULT];
+    }
+    coex->last_tx_packets = t.tx_packets;
+
+    return busy;
+}
+
+static void coex_slot_work(struct work_struct *work)
+{
+    struct wifi_bt_coex *coex = container_of(to_delayed_work(work),
+                                             struct wifi_bt_coex, slot_work);
+    u32 period = max(coex->period_ms, 10U);
+    u32 bt_ms = period * min(coex->bt_share, 100U) / 100;
+    bool wifi_busy, bt_busy;
+    u32 top;
+
+    /* 蓝牙时隙结束(或被抢占)，本周期剩余时间给WiFi */
+    if (coex->slot == COEX_SLOT_BT) {
+        coex_enter_slot(coex, COEX_SLOT_WIFI);
+        queue_delayed_work(coex->workqueue, &coex->slot_work,
+                           msecs_to_jiffies(period - bt_ms));
+        return;
+    }
+
+    wifi_busy = coex_wifi_demand(coex, &top);
+    bt_busy = READ_ONCE(coex->bdev->scan_requested);
+
+    spin_lock_bh(&coex->lock);
+    coex->stats.periods++;
+    spin_unlock_bh(&coex->lock);
+
+    if (!wifi_busy || !bt_busy) {
+        coex->bt_skips = 0;
+        coex_enter_slot(coex, COEX_SLOT_IDLE);
+        queue_delayed_work(coex->workqueue, &coex->slot_work,
+                           msecs_to_jiffies(period));
+        return;
+    }
+
+    if (top > coex->prio[COEX_BT_SCAN] && coex->bt_skips < COEX_MAX_BT_SKIPS) {
+        coex->bt_skips++;
+        spin_lock_bh(&coex->lock);
+        coex->stats.bt_slots_skipped++;
+        spin_unlock_bh(&coex->lock);
+        coex_enter_slot(coex, COEX_SLOT_WIFI);
+        queue_delayed_work(coex->workqueue, &coex->slot_work,
+                           msecs_to_jiffies(period));
+        return;
+    }
+
+    coex->bt_skips = 0;
+    spin_lock_bh(&coex->lock);
+    coex->stats.bt_slots++;
+    spin_unlock_bh(&coex->lock);
+    coex_enter_slot(coex, COEX_SLOT_BT);
+    queue_delayed_work(coex->workqueue, &coex->slot_work, msecs_to_jiffies(bt_ms));
+}
+
+/* 在WiFi发送路径上调用(软中断上下文) */
+static void coex_tx_kick(struct wifi_device *wdev, enum wifi_tx_queue queue)
+{
+    struct wifi_bt_coex *coex = wdev->coex;
+    bool preempt;
+
+    if (coex->prio[coex_txq_class(queue)] <= coex->prio[COEX_BT_SCAN])
+        return;
+
+    spin_lock(&coex->lock);
+    preempt = coex->slot == COEX_SLOT_BT;
+    if (preempt)
+        coex->stats.bt_slots_preempted++;
+    spin_unlock(&coex->lock);
+
+    if (preempt)
+        mod_delayed_work(coex->workqueue, &coex->slot_work, 0);
+}
+
+static int coex_stats_show(struct seq_file *seq, void *v)
+{
+    struct wifi_bt_coex *coex = seq->private;
+    struct wifi_bt_coex_stats st;
+    enum coex_slot slot;
+
+    spin_lock_bh(&coex->lock);
+    st = coex->stats;
+    slot = coex->slot;
+    spin_unlock_bh(&coex->lock);
+
+    seq_printf(seq, "slot:               %s\n", coex_slot_names[slot]);
+    seq_printf(seq, "periods:            %llu\n", st.periods);
+    seq_printf(seq, "bt_slots:           %llu\n", st.bt_slots);
+    seq_printf(seq, "bt_slots_skipped:   %llu\n", st.bt_slots_skipped);
+    seq_printf(seq, "bt_slots_preempted: %llu\n", st.bt_slots_preempted);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(coex_stats);
+
+static void coex_debug_init(struct wifi_bt_coex *coex)
+{
+    struct dentry *dir;
+
+    dir = debugfs_create_dir("wifi_bt_coex", NULL);
+    coex->debug_dir = dir;
+
+    debugfs_create_file("stats", 0444, dir, coex, &coex_stats_fops);
+    debugfs_create_u32("period_ms", 0644, dir, &coex->period_ms);
+    debugfs_create_u32("bt_share", 0644, dir, &coex->bt_share);
+    debugfs_create_u32("prio_wifi_event", 0644, dir, &coex->prio[COEX_WIFI_EVENT]);
+    debugfs_create_u32("prio_wifi_default", 0644, dir, &coex->prio[COEX_WIFI_DEFAULT]);
+    debugfs_create_u32("prio_wifi_bulk", 0644, dir, &coex->prio[COEX_WIFI_BULK]);
+    debugfs_create_u32("prio_bt_scan", 0644, dir, &coex->prio[COEX_BT_SCAN]);
+}
+
+/* 由同时持有两个设备的板级或芯片代码调用，一对设备只能创建一个实例 */
+struct wifi_bt_coex *wifi_bt_coex_create(struct wifi_device *wdev,
+                                         struct bluetooth_device *bdev)
+{
+    struct wifi_bt_coex *coex;
+
+    if (wdev->coex)
+        return ERR_PTR(-EBUSY);
+
+    coex = kzalloc(sizeof(*coex), GFP_KERNEL);
+    if (!coex)
+        return ERR_PTR(-ENOMEM);
+
+    coex->wdev = wdev;
+    coex->bdev = bdev;
+    coex->period_ms = coex_period_ms;
+    coex->bt_share = coex_bt_share;
+    memcpy(coex->prio, coex_prio, sizeof(coex->prio));
+    spin_lock_init(&coex->lock);
+    INIT_DELAYED_WORK(&coex->slot_work, coex_slot_work);
+
+    /* 时隙切换对时延敏感，不能排在扫描、统计等工作之后 */
+    coex->workqueue = alloc_ordered_workqueue("wifi_bt_coex", WQ_HIGHPRI | WQ_FREEZABLE);
+    if (!coex->workqueue) {
+        kfree(coex);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    coex_debug_init(coex);
+
+    wdev->coex = coex;
+    smp_wmb();
+    WRITE_ONCE(wdev->coex_tx_kick, coex_tx_kick);
+
+    queue_delayed_work(coex->workqueue, &coex->slot_work, 0);
+
+    dev_info(wdev->dev, "WiFi/BT coexistence enabled, period %u ms, BT share %u%%\n",
+             coex->period_ms, coex->bt_share);
+    return coex;
+}
+EXPORT_SYMBOL_GPL(wifi_bt_coex_create);
+
+void wifi_bt_coex_destroy(struct wifi_bt_coex *coex)
+{
+    struct wifi_device *wdev = coex->wdev;
+
+    WRITE_ONCE(wdev->coex_tx_kick, NULL);
+    /* 等待正在执行的发送路径退出 */
+    synchronize_net();
+
+    cancel_delayed_work_sync(&coex->slot_work);
+    coex_enter_slot(coex, COEX_SLOT_IDLE);
+    destroy_workqueue(coex->workqueue);
+
+    debugfs_remove_recursive(coex->debug_dir);
+    wdev->coex = NULL;
+    kfree(coex);
+}
+EXPORT_SYMBOL_GPL(wifi_bt_coex_destroy);
+
+MODULE_AUTHOR("Linux Cool Team");
+MODULE_DESCRIPTION("IMX6ULL WiFi/Bluetooth coexistence arbiter");
+MODULE_LICENSE("GPL v2");
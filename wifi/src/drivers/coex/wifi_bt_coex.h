@@ -0,0 +1,70 @@
+/*
+ * WiFi/蓝牙共存调度头文件
+ *
+ * 模组上WiFi和蓝牙共用一套2.4GHz射频，同时工作时互相打断重传。本模块
+ * 把时间切成固定周期，在有竞争时按优先级为蓝牙扫描分配一个时隙：
+ * 蓝牙时隙内暂停低优先级WiFi子队列，WiFi时隙内暂停控制器扫描。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ */
+
+#ifndef __WIFI_BT_COEX_H
+#define __WIFI_BT_COEX_H
+
+#include <linux/workqueue.h>
+#include <linux/spinlock.h>
+
+#include "../wifi/wifi_driver.h"
+#include "../bluetooth/bluetooth_driver.h"
+
+#define COEX_PERIOD_MS              100     /* 调度周期 */
+#define COEX_BT_SHARE               30      /* 竞争时蓝牙时隙占比(%) */
+#define COEX_MAX_BT_SKIPS           4       /* 蓝牙时隙最多被连续跳过的周期数 */
+
+/* 共存优先级，数值越大越优先 */
+enum coex_class {
+    COEX_WIFI_EVENT = 0,
+    COEX_WIFI_DEFAULT,
+    COEX_WIFI_BULK,
+    COEX_BT_SCAN,
+    COEX_CLASS_MAX
+};
+
+enum coex_slot {
+    COEX_SLOT_IDLE = 0,     /* 无竞争，双方自由使用射频 */
+    COEX_SLOT_WIFI,
+    COEX_SLOT_BT,
+};
+
+struct wifi_bt_coex_stats {
+    u64 periods;
+    u64 bt_slots;
+    u64 bt_slots_skipped;   /* 高优先级WiFi流量占用了本周期 */
+    u64 bt_slots_preempted; /* 蓝牙时隙被高优先级WiFi帧提前结束 */
+};
+
+struct wifi_bt_coex {
+    struct wifi_device *wdev;
+    struct bluetooth_device *bdev;
+
+    struct workqueue_struct *workqueue;
+    struct delayed_work slot_work;
+    spinlock_t lock;                /* 保护slot和stats */
+
+    enum coex_slot slot;
+    unsigned int bt_skips;
+    u64 last_tx_packets;
+
+    u32 period_ms;
+    u32 bt_share;
+    u32 prio[COEX_CLASS_MAX];
+
+    struct wifi_bt_coex_stats stats;
+    struct dentry *debug_dir;
+};
+
+struct wifi_bt_coex *wifi_bt_coex_create(struct wifi_device *wdev,
+                                         struct bluetooth_device *bdev);
+void wifi_bt_coex_destroy(struct wifi_bt_coex *coex);
+
+#endif /* __WIFI_BT_COEX_H */
@@ -0,0 +1,245 @@
+/*
+ * WiFi驱动debugfs接口
+ *
+ * 在/sys/kernel/debug/<设备名>/下导出链路状态、实时吞吐、每秒采样历史
+ * 和扫描缓存，供现场排查"检测结果上传慢"到底是无线链路问题还是
+ * 处理流水线问题。所有文件只读(debug_enabled除外)，读取时不阻塞收发路径。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include "wifi_driver.h"
+
+static const char * const wifi_state_names[WIFI_STATE_MAX] = {
+    [WIFI_STATE_INIT]          = "init",
+    [WIFI_STATE_READY]         = "ready",
+    [WIFI_STATE_SCANNING]      = "scanning",
+    [WIFI_STATE_CONNECTING]    = "connecting",
+    [WIFI_STATE_CONNECTED]     = "connected",
+    [WIFI_STATE_DISCONNECTING] = "disconnecting",
+    [WIFI_STATE_ERROR]         = "error",
+};
+
+static const char *wifi_state_name(enum wifi_connection_state state)
+{
+    if (state >= WIFI_STATE_MAX || !wifi_state_names[state])
+        return "unknown";
+    return wifi_state_names[state];
+}
+
+static const char *wifi_ps_mode_name(enum wifi_power_mode mode)
+{
+    switch (mode) {
+    case WIFI_PS_ACTIVE:
+        return "active";
+    case WIFI_PS_SAVE:
+        return "save";
+    case WIFI_PS_DEEP_SAVE:
+        return "deep";
+    default:
+        return "unknown";
+    }
+}
+
+/* 取最近一次采样，没有采样时返回false */
+static bool wifi_debug_last_sample(struct wifi_device *wdev,
+                                   struct wifi_stats_sample *sample)
+{
+    unsigned int idx;
+    bool valid;
+
+    spin_lock_bh(&wdev->stats_lock);
+    valid = wdev->stats_count > 0;
+    if (valid) {
+        idx = (wdev->stats_head + WIFI_STATS_HISTORY_LEN - 1) % WIFI_STATS_HISTORY_LEN;
+        *sample = wdev->stats_history[idx];
+    }
+    spin_unlock_bh(&wdev->stats_lock);
+
+    return valid;
+}
+
+/* 芯片未上报的字段为0，显示为n/a而不是0 */
+static void wifi_debug_show_value(struct seq_file *seq, const char *name, int value,
+                                  const char *unit)
+{
+    if (value)
+        seq_printf(seq, "%-15s %d%s\n", name, value, unit);
+    else
+        seq_printf(seq, "%-15s n/a\n", name);
+}
+
+void wifi_debug_show_status(struct wifi_device *wdev, struct seq_file *seq)
+{
+    struct wifi_status st;
+
+    /* 链路字段由采样工作在wdev->lock下整体刷新，取一致的快照 */
+    mutex_lock(&wdev->lock);
+    st = wdev->status;
+    mutex_unlock(&wdev->lock);
+
+    seq_printf(seq, "state:          %s\n", wifi_state_name(st.state));
+    seq_printf(seq, "ssid:           %.*s\n", IEEE80211_MAX_SSID_LEN, st.ssid);
+    wifi_debug_show_value(seq, "channel:", st.channel, "");
+    wifi_debug_show_value(seq, "signal:", st.signal_strength, " dBm");
+    wifi_debug_show_value(seq, "noise:", st.noise_level, " dBm");
+    wifi_debug_show_value(seq, "tx_rate:", st.tx_rate, "");
+    wifi_debug_show_value(seq, "rx_rate:", st.rx_rate, "");
+    seq_printf(seq, "tx_pending:     event %d default %d bulk %d\n",
+               atomic_read(&wdev->tx_pending[WIFI_TXQ_EVENT]),
+               atomic_read(&wdev->tx_pending[WIFI_TXQ_DEFAULT]),
+               atomic_read(&wdev->tx_pending[WIFI_TXQ_BULK]));
+    seq_printf(seq, "last_reconnect: %u ms\n", wdev->last_reconnect_ms);
+    seq_printf(seq, "power_save:     %s (listen interval %u, %u transitions)\n",
+               wifi_ps_mode_name(READ_ONCE(wdev->ps_mode)),
+               wdev->ps_listen_interval, wdev->ps_transitions);
+}
+EXPORT_SYMBOL_GPL(wifi_debug_show_status);
+
+static int wifi_debug_status_show(struct seq_file *seq, void *v)
+{
+    wifi_debug_show_status(seq->private, seq);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wifi_debug_status);
+
+/* 最近一秒的速率，watch -n1 cat throughput 即可观察 */
+static int wifi_debug_throughput_show(struct seq_file *seq, void *v)
+{
+    struct wifi_device *wdev = seq->private;
+    struct wifi_stats_sample s;
+
+    if (!wifi_debug_last_sample(wdev, &s)) {
+        seq_puts(seq, "no samples yet\n");
+        return 0;
+    }
+
+    seq_printf(seq, "tx:      %llu B/s  %u pkt/s\n", s.tx_bytes_ps, s.tx_pps);
+    seq_printf(seq, "rx:      %llu B/s  %u pkt/s\n", s.rx_bytes_ps, s.rx_pps);
+    seq_printf(seq, "retry:   %u.%u%%\n", s.retry_permille / 10, s.retry_permille % 10);
+    seq_printf(seq, "fail:    %u.%u%%\n", s.fail_permille / 10, s.fail_permille % 10);
+    wifi_debug_show_value(seq, "signal:", s.signal, " dBm");
+    wifi_debug_show_value(seq, "noise:", s.noise, " dBm");
+    seq_printf(seq, "txqueue: event %u default %u bulk %u\n",
+               s.tx_queue_depth[WIFI_TXQ_EVENT], s.tx_queue_depth[WIFI_TXQ_DEFAULT],
+               s.tx_queue_depth[WIFI_TXQ_BULK]);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wifi_debug_throughput);
+
+/* 采样历史，按时间从旧到新，一行一个样本，便于直接导入表格 */
+static int wifi_debug_history_show(struct seq_file *seq, void *v)
+{
+    struct wifi_device *wdev = seq->private;
+    struct wifi_stats_sample *hist;
+    unsigned int count, head, i;
+
+    hist = kmalloc_array(WIFI_STATS_HISTORY_LEN, sizeof(*hist), GFP_KERNEL);
+    if (!hist)
+        return -ENOMEM;
+
+    /* 先拷贝再格式化，避免持锁时间随输出长度增长 */
+    spin_lock_bh(&wdev->stats_lock);
+    memcpy(hist, wdev->stats_history, sizeof(wdev->stats_history));
+    count = wdev->stats_count;
+    head = wdev->stats_head;
+    spin_unlock_bh(&wdev->stats_lock);
+
+    /* signal/noise为0表示芯片未上报 */
+    seq_puts(seq, "# time tx_Bps rx_Bps tx_pps rx_pps retry_pm fail_pm signal noise txq_event txq_default txq_bulk\n");
+    for (i = 0; i < count; i++) {
+        struct wifi_stats_sample *s;
+
+        s = &hist[(head + WIFI_STATS_HISTORY_LEN - count + i) % WIFI_STATS_HISTORY_LEN];
+        seq_printf(seq, "%lld %llu %llu %u %u %u %u %d %d %u %u %u\n",
+                   (long long)s->timestamp, s->tx_bytes_ps, s->rx_bytes_ps,
+                   s->tx_pps, s->rx_pps, s->retry_permille, s->fail_permille,
+                   s->signal, s->noise, s->tx_queue_depth[WIFI_TXQ_EVENT],
+                   s->tx_queue_depth[WIFI_TXQ_DEFAULT],
+                   s->tx_queue_depth[WIFI_TXQ_BULK]);
+    }
+
+    kfree(hist);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wifi_debug_history);
+
+/* 自加载以来的累计计数 */
+static int wifi_debug_counters_show(struct seq_file *seq, void *v)
+{
+    struct wifi_device *wdev = seq->private;
+    struct wifi_stats_totals t;
+
+    wifi_stats_get_totals(wdev, &t);
+
+    seq_printf(seq, "tx_packets: %llu\n", t.tx_packets);
+    seq_printf(seq, "tx_bytes:   %llu\n", t.tx_bytes);
+    seq_printf(seq, "tx_retries: %llu\n", t.tx_retries);
+    seq_printf(seq, "tx_failed:  %llu\n", t.tx_failed);
+    seq_printf(seq, "rx_packets: %llu\n", t.rx_packets);
+    seq_printf(seq, "rx_bytes:   %llu\n", t.rx_bytes);
+    seq_printf(seq, "rx_dropped: %llu\n", t.rx_dropped);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wifi_debug_counters);
+
+/* 扫描缓存快照 */
+static int wifi_debug_networks_show(struct seq_file *seq, void *v)
+{
+    struct wifi_device *wdev = seq->private;
+    struct wifi_network *net;
+    time64_t now = ktime_get_boottime_seconds();
+
+    seq_puts(seq, "# bssid ch signal age ssid\n");
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(net, &wdev->network_list, list) {
+        seq_printf(seq, "%pM %3d %4d %4lld %.*s%s\n",
+                   net->bssid, net->channel, net->signal_strength,
+                   (long long)(now - net->last_seen),
+                   IEEE80211_MAX_SSID_LEN, net->ssid,
+                   net->connected ? " [connected]" : "");
+    }
+    rcu_read_unlock();
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(wifi_debug_networks);
+
+void wifi_debug_init(struct wifi_device *wdev)
+{
+    struct dentry *dir;
+
+    /* debugfs失败不影响驱动功能，不检查返回值 */
+    dir = debugfs_create_dir(dev_name(wdev->dev), NULL);
+    wdev->debug_dir = dir;
+
+    debugfs_create_file("status", 0444, dir, wdev, &wifi_debug_status_fops);
+    debugfs_create_file("throughput", 0444, dir, wdev, &wifi_debug_throughput_fops);
+    debugfs_create_file("history", 0444, dir, wdev, &wifi_debug_history_fops);
+    debugfs_create_file("counters", 0444, dir, wdev, &wifi_debug_counters_fops);
+    debugfs_create_file("networks", 0444, dir, wdev, &wifi_debug_networks_fops);
+    debugfs_create_bool("debug_enabled", 0644, dir, &wdev->debug_enabled);
+    debugfs_create_u32("ps_max_wake_latency_ms", 0644, dir, &wdev->ps_max_latency_ms);
+    debugfs_create_u32("ps_deep_wake_latency_ms", 0644, dir, &wdev->ps_deep_latency_ms);
+    debugfs_create_u32("ps_idle_ms", 0644, dir, &wdev->ps_idle_ms);
+}
+EXPORT_SYMBOL_GPL(wifi_debug_init);
+
+void wifi_debug_cleanup(struct wifi_device *wdev)
+{
+    debugfs_remove_recursive(wdev->debug_dir);
+    wdev->debug_dir = NULL;
+}
+EXPORT_SYMBOL_GPL(wifi_debug_cleanup);
@@ -0,0 +1,1095 @@
+/*
+ * WiFi驱动核心实现
+ *
+ * 基于IMX6ULL Pro开发板的WiFi驱动通用层，负责设备生命周期、后台扫描
+ * 和扫描结果缓存。芯片相关操作通过wifi_platform_data->ops注入。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/jiffies.h>
+#include <linux/etherdevice.h>
+#include <linux/timekeeping.h>
+#include <linux/math64.h>
+#include <net/iw_handler.h>
+
+#include "wifi_driver.h"
+
+static unsigned int scan_interval_ms = WIFI_SCAN_INTERVAL_MS;
+module_param(scan_interval_ms, uint, 0644);
+MODULE_PARM_DESC(scan_interval_ms, "Background scan interval when disconnected (ms)");
+
+static unsigned int scan_max_age = WIFI_SCAN_MAX_AGE_S;
+module_param(scan_max_age, uint, 0644);
+MODULE_PARM_DESC(scan_max_age, "Scan cache entry lifetime (s, 0 = never expire)");
+
+/*
+ * 扫描缓存管理
+ *
+ * network_list以BSSID为键，同一SSID可以对应多个AP。写者(扫描上报、老化)
+ * 在network_lock下用RCU原语修改链表，读者(连接、状态查询)只需
+ * rcu_read_lock()，不会与扫描互相阻塞。
+ */
+
+static struct wifi_network *wifi_find_bss_locked(struct wifi_device *wdev,
+                                                 const u8 *bssid)
+{
+    struct wifi_network *net;
+
+    list_for_each_entry(net, &wdev->network_list, list) {
+        if (ether_addr_equal(net->bssid, bssid))
+            return net;
+    }
+
+    return NULL;
+}
+
+/* 缓存已满时淘汰最久未出现的条目，调用者持有network_lock */
+static void wifi_evict_oldest_locked(struct wifi_device *wdev)
+{
+    struct wifi_network *net, *oldest = NULL;
+
+    list_for_each_entry(net, &wdev->network_list, list) {
+        if (net->connected)
+            continue;
+        if (!oldest || net->last_seen < oldest->last_seen)
+            oldest = net;
+    }
+
+    if (oldest) {
+        list_del_rcu(&oldest->list);
+        wdev->network_count--;
+        kfree_rcu(oldest, rcu);
+    }
+}
+
+int wifi_add_network_to_list(struct wifi_device *wdev, struct wifi_network *network)
+{
+    struct wifi_network *net, *old;
+
+    net = kmemdup(network, sizeof(*net), GFP_ATOMIC);
+    if (!net)
+        return -ENOMEM;
+
+    spin_lock_bh(&wdev->network_lock);
+
+    old = wifi_find_bss_locked(wdev, network->bssid);
+    if (old) {
+        /* 保留连接标记，读者看到的始终是完整的新旧节点之一 */
+        net->connected = old->connected;
+        list_replace_rcu(&old->list, &net->list);
+        kfree_rcu(old, rcu);
+    } else {
+        if (wdev->network_count >= WIFI_MAX_NETWORKS)
+            wifi_evict_oldest_locked(wdev);
+        list_add_tail_rcu(&net->list, &wdev->network_list);
+        wdev->network_count++;
+    }
+
+    spin_unlock_bh(&wdev->network_lock);
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(wifi_add_network_to_list);
+
+int wifi_remove_network_from_list(struct wifi_device *wdev, const char *ssid)
+{
+    struct wifi_network *net, *tmp;
+    int removed = 0;
+
+    spin_lock_bh(&wdev->network_lock);
+    list_for_each_entry_safe(net, tmp, &wdev->network_list, list) {
+        if (strncmp(net->ssid, ssid, IEEE80211_MAX_SSID_LEN))
+            continue;
+        list_del_rcu(&net->list);
+        wdev->network_count--;
+        kfree_rcu(net, rcu);
+        removed++;
+    }
+    spin_unlock_bh(&wdev->network_lock);
+
+    return removed ? 0 : -ENOENT;
+}
+EXPORT_SYMBOL_GPL(wifi_remove_network_from_list);
+
+static struct wifi_network *__wifi_find_network(struct wifi_device *wdev,
+                                                const char *ssid,
+                                                const u8 *exclude_bssid)
+{
+    struct wifi_network *net, *best = NULL;
+    time64_t now = ktime_get_boottime_seconds();
+    unsigned int max_age = READ_ONCE(wdev->scan_max_age);
+
+    list_for_each_entry_rcu(net, &wdev->network_list, list) {
+        if (strncmp(net->ssid, ssid, IEEE80211_MAX_SSID_LEN))
+            continue;
+        if (max_age && now - net->last_seen > max_age)
+            continue;
+        if (exclude_bssid && ether_addr_equal(net->bssid, exclude_bssid))
+            continue;
+        if (!best || net->signal_strength > best->signal_strength)
+            best = net;
+    }
+
+    return best;
+}
+
+/*
+ * 查找SSID对应的信号最强且未过期的AP
+ *
+ * 无锁查找，调用者必须持有rcu_read_lock()，返回的指针只在读临界区内有效。
+ */
+struct wifi_network *wifi_find_network(struct wifi_device *wdev, const char *ssid)
+{
+    RCU_LOCKDEP_WARN(!rcu_read_lock_held(),
+                     "wifi_find_network() needs rcu_read_lock() protection");
+
+    return __wifi_find_network(wdev, ssid, NULL);
+}
+EXPORT_SYMBOL_GPL(wifi_find_network);
+
+/* 删除超过max_age秒未出现的条目，当前连接的AP不参与老化 */
+void wifi_expire_networks(struct wifi_device *wdev, unsigned int max_age)
+{
+    struct wifi_network *net, *tmp;
+    time64_t now = ktime_get_boottime_seconds();
+
+    if (!max_age)
+        return;
+
+    spin_lock_bh(&wdev->network_lock);
+    list_for_each_entry_safe(net, tmp, &wdev->network_list, list) {
+        if (net->connected || now - net->last_seen <= max_age)
+            continue;
+        list_del_rcu(&net->list);
+        wdev->network_count--;
+        kfree_rcu(net, rcu);
+    }
+    spin_unlock_bh(&wdev->network_lock);
+}
+EXPORT_SYMBOL_GPL(wifi_expire_networks);
+
+static void wifi_flush_networks(struct wifi_device *wdev)
+{
+    struct wifi_network *net, *tmp;
+
+    spin_lock_bh(&wdev->network_lock);
+    list_for_each_entry_safe(net, tmp, &wdev->network_list, list) {
+        list_del_rcu(&net->list);
+        kfree_rcu(net, rcu);
+    }
+    wdev->network_count = 0;
+    spin_unlock_bh(&wdev->network_lock);
+}
+
+/*
+ * 扫描
+ *
+ * 扫描在workqueue中后台进行：scan_work触发芯片扫描，芯片驱动通过
+ * wifi_scan_report_result()逐条上报结果并直接更新缓存，最后调用
+ * wifi_scan_done()。连接路径只读缓存，从不等待扫描完成。
+ */
+
+/* 芯片驱动上报单条扫描结果，可在原子上下文调用 */
+void wifi_scan_report_result(struct wifi_device *wdev,
+                             const struct wifi_scan_result *result)
+{
+    struct wifi_network net;
+
+    memset(&net, 0, sizeof(net));
+    memcpy(net.ssid, result->ssid, sizeof(net.ssid));
+    memcpy(net.bssid, result->bssid, ETH_ALEN);
+    net.security = result->security;
+    net.cipher = result->cipher;
+    net.signal_strength = result->signal_strength;
+    net.channel = result->channel;
+    net.frequency = result->frequency;
+    net.hidden = result->hidden;
+    net.last_seen = ktime_get_boottime_seconds();
+
+    if (wifi_add_network_to_list(wdev, &net))
+        dev_warn_ratelimited(wdev->dev, "failed to cache scan result\n");
+}
+EXPORT_SYMBOL_GPL(wifi_scan_report_result);
+
+/* 芯片驱动在一轮扫描结束(或被中止)后调用 */
+void wifi_scan_done(struct wifi_device *wdev)
+{
+    complete_all(&wdev->scan_completion);
+}
+EXPORT_SYMBOL_GPL(wifi_scan_done);
+
+int wifi_scan_request(struct wifi_device *wdev, unsigned long delay_ms)
+{
+    if (!wdev->ops->scan_start)
+        return -EOPNOTSUPP;
+    if (READ_ONCE(wdev->removing))
+        return -ENODEV;
+
+    mod_delayed_work(wdev->workqueue, &wdev->scan_work,
+                     msecs_to_jiffies(delay_ms));
+    return 0;
+}
+EXPORT_SYMBOL_GPL(wifi_scan_request);
+
+static void wifi_scan_work(struct work_struct *work)
+{
+    struct wifi_device *wdev = container_of(to_delayed_work(work),
+                                            struct wifi_device, scan_work);
+    enum wifi_connection_state prev_state;
+    unsigned int interval;
+    int ret;
+
+    mutex_lock(&wdev->lock);
+
+    prev_state = wdev->status.state;
+    /* 连接/断开过程中不切信道，下个周期再扫 */
+    if (prev_state == WIFI_STATE_CONNECTING ||
+        prev_state == WIFI_STATE_DISCONNECTING ||
+        prev_state == WIFI_STATE_SCANNING) {
+        mutex_unlock(&wdev->lock);
+        goto reschedule;
+    }
+
+    reinit_completion(&wdev->scan_completion);
+    if (prev_state != WIFI_STATE_CONNECTED)
+        wdev->status.state = WIFI_STATE_SCANNING;
+
+    ret = wdev->ops->scan_start(wdev);
+    mutex_unlock(&wdev->lock);
+
+    if (ret) {
+        dev_warn(wdev->dev, "scan start failed: %d\n", ret);
+        goto restore;
+    }
+
+    if (!wait_for_completion_timeout(&wdev->scan_completion,
+                                     msecs_to_jiffies(WIFI_SCAN_TIMEOUT_MS))) {
+        dev_warn(wdev->dev, "scan timed out\n");
+        if (wdev->ops->scan_stop)
+            wdev->ops->scan_stop(wdev);
+    }
+
+    wifi_expire_networks(wdev, READ_ONCE(wdev->scan_max_age));
+    wifi_send_scan_complete_event(wdev);
+
+restore:
+    mutex_lock(&wdev->lock);
+    if (wdev->status.state == WIFI_STATE_SCANNING)
+        wdev->status.state = prev_state;
+    mutex_unlock(&wdev->lock);
+
+reschedule:
+    interval = wdev->status.state == WIFI_STATE_CONNECTED ?
+               WIFI_SCAN_INTERVAL_CONN_MS : READ_ONCE(wdev->scan_interval_ms);
+    if (interval && !READ_ONCE(wdev->removing))
+        queue_delayed_work(wdev->workqueue, &wdev->scan_work,
+                           msecs_to_jiffies(interval));
+}
+
+/*
+ * 连接
+ */
+
+int wifi_validate_connect_params(struct wifi_connect_params *params)
+{
+    size_t pwd_len;
+
+    if (!params || !params->ssid[0])
+        return -EINVAL;
+
+    if (params->security >= WIFI_SECURITY_MAX || params->cipher >= WIFI_CIPHER_MAX)
+        return -EINVAL;
+
+    pwd_len = strnlen(params->password, sizeof(params->password));
+    switch (params->security) {
+    case WIFI_SECURITY_OPEN:
+        break;
+    case WIFI_SECURITY_WEP:
+        if (pwd_len != 5 && pwd_len != 13)
+            return -EINVAL;
+        break;
+    case WIFI_SECURITY_WPA_PSK:
+    case WIFI_SECURITY_WPA2_PSK:
+    case WIFI_SECURITY_WPA3_PSK:
+        if (pwd_len < 8 || pwd_len > 63)
+            return -EINVAL;
+        break;
+    default:
+        if (!params->identity[0])
+            return -EINVAL;
+        break;
+    }
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(wifi_validate_connect_params);
+
+/* 调用者持有wdev->lock */
+static int wifi_connect_locked(struct wifi_device *wdev, struct wifi_connect_params *params)
+{
+    int ret;
+
+    if (wdev->status.state == WIFI_STATE_SCANNING && wdev->ops->scan_stop)
+        wdev->ops->scan_stop(wdev);
+
+    reinit_completion(&wdev->connect_completion);
+    wdev->status.state = WIFI_STATE_CONNECTING;
+
+    ret = wdev->ops->connect(wdev, params);
+    if (ret)
+        wdev->status.state = WIFI_STATE_READY;
+
+    return ret;
+}
+
+/*
+ * 发起连接
+ *
+ * 信道取自扫描缓存，不触发新的扫描；缓存未命中时交给芯片自行全信道搜索。
+ * 连接结果由芯片驱动通过wifi_send_connection_event()异步上报。参数会被
+ * 保存下来，链路意外断开时用于快速重连。
+ */
+int wifi_connect(struct wifi_device *wdev, struct wifi_connect_params *params)
+{
+    struct wifi_network *net;
+    int ret;
+
+    ret = wifi_validate_connect_params(params);
+    if (ret)
+        return ret;
+
+    if (!params->channel) {
+        rcu_read_lock();
+        net = wifi_find_network(wdev, params->ssid);
+        if (net)
+            params->channel = net->channel;
+        rcu_read_unlock();
+    }
+
+    mutex_lock(&wdev->lock);
+    ret = wifi_connect_locked(wdev, params);
+    if (!ret) {
+        wdev->last_params = *params;
+        wdev->last_params_valid = true;
+        wdev->reconnect_attempts = 0;
+    }
+    mutex_unlock(&wdev->lock);
+
+    return ret;
+}
+EXPORT_SYMBOL_GPL(wifi_connect);
+
+/*
+ * 用户主动断开：清除重连参数，不触发自动重连
+ *
+ * 清除last_params_valid和撤销排队中的重连在同一临界区内完成；已在运行的
+ * 重连工作每次发起连接前都在wdev->lock下重新检查该标志，因此不会把用户
+ * 的断开撤销。芯片驱动的断开路径会调用wifi_send_disconnection_event()，
+ * 其中要拿wdev->lock，所以ops->disconnect在锁外调用。
+ */
+int wifi_disconnect(struct wifi_device *wdev)
+{
+    enum wifi_connection_state prev_state;
+    int ret;
+
+    if (!wdev->ops->disconnect)
+        return -EOPNOTSUPP;
+
+    mutex_lock(&wdev->lock);
+    wdev->last_params_valid = false;
+    wdev->reconnect_attempts = 0;
+    cancel_delayed_work(&wdev->reconnect_work);
+    prev_state = wdev->status.state;
+    wdev->status.state = WIFI_STATE_DISCONNECTING;
+    reinit_completion(&wdev->disconnect_completion);
+    mutex_unlock(&wdev->lock);
+
+    /* 等正在进行的快速重连尝试结束，它同样要拿wdev->lock，不能持锁等待 */
+    cancel_delayed_work_sync(&wdev->reconnect_work);
+
+    ret = wdev->ops->disconnect(wdev);
+
+    mutex_lock(&wdev->lock);
+    wdev->reconnecting = false;
+    if (ret && wdev->status.state == WIFI_STATE_DISCONNECTING)
+        wdev->status.state = prev_state;
+    mutex_unlock(&wdev->lock);
+
+    return ret;
+}
+EXPORT_SYMBOL_GPL(wifi_disconnect);
+
+/*
+ * PMKSA缓存
+ */
+
+/* 登记一次完整握手得到的PMKSA，调用者处于进程上下文 */
+int wifi_pmksa_add(struct wifi_device *wdev, const u8 *bssid, const u8 *pmkid,
+                   const u8 *pmk, size_t pmk_len)
+{
+    struct wifi_pmksa *entry = NULL;
+    int i;
+
+    if (!bssid || !pmkid || pmk_len > WIFI_PMK_MAX_LEN)
+        return -EINVAL;
+
+    mutex_lock(&wdev->lock);
+
+    /* 优先覆盖同一BSS，其次空闲槽位，最后是最早过期的条目 */
+    for (i = 0; i < WIFI_PMKSA_CACHE_SIZE; i++) {
+        struct wifi_pmksa *cur = &wdev->pmksa_cache[i];
+
+        if (cur->valid && ether_addr_equal(cur->bssid, bssid)) {
+            entry = cur;
+            break;
+        }
+        if (!entry || (entry->valid && (!cur->valid || cur->expire < entry->expire)))
+            entry = cur;
+    }
+
+    memzero_explicit(entry, sizeof(*entry));
+    memcpy(entry->ssid, wdev->last_params.ssid, sizeof(entry->ssid));
+    memcpy(entry->bssid, bssid, ETH_ALEN);
+    memcpy(entry->pmkid, pmkid, WIFI_PMKID_LEN);
+    if (pmk && pmk_len) {
+        memcpy(entry->pmk, pmk, pmk_len);
+        entry->pmk_len = pmk_len;
+    }
+    entry->expire = ktime_get_boottime_seconds() + WIFI_PMKSA_LIFETIME_S;
+    entry->valid = true;
+
+    mutex_unlock(&wdev->lock);
+
+    return 0;
+}
+EXPORT_SYMBOL_GPL(wifi_pmksa_add);
+
+void wifi_pmksa_flush(struct wifi_device *wdev)
+{
+    mutex_lock(&wdev->lock);
+    memzero_explicit(wdev->pmksa_cache, sizeof(wdev->pmksa_cache));
+    mutex_unlock(&wdev->lock);
+}
+EXPORT_SYMBOL_GPL(wifi_pmksa_flush);
+
+/*
+ * 为params->bssid查找可用的PMKSA，调用者持有wdev->lock
+ *
+ * 同一BSS的条目可直接用PMKID做PMKSA缓存；WPA/WPA2-PSK的PMK只取决于
+ * SSID和口令，漫游到同SSID的另一个AP时仍可复用，由芯片重新计算PMKID。
+ */
+static void wifi_pmksa_lookup_locked(struct wifi_device *wdev,
+                                     struct wifi_connect_params *params)
+{
+    time64_t now = ktime_get_boottime_seconds();
+    struct wifi_pmksa *entry, *ssid_match = NULL;
+    int i;
+
+    params->pmkid_valid = false;
+    memset(&params->pmksa, 0, sizeof(params->pmksa));
+
+    for (i = 0; i < WIFI_PMKSA_CACHE_SIZE; i++) {
+        entry = &wdev->pmksa_cache[i];
+
+        if (!entry->valid || entry->expire < now)
+            continue;
+        if (strncmp(entry->ssid, params->ssid, IEEE80211_MAX_SSID_LEN))
+            continue;
+        if (ether_addr_equal(entry->bssid, params->bssid)) {
+            params->pmksa = *entry;
+            params->pmkid_valid = true;
+            return;
+        }
+        if (entry->pmk_len)
+            ssid_match = entry;
+    }
+
+    if (ssid_match && (params->security == WIFI_SECURITY_WPA_PSK ||
+                       params->security == WIFI_SECURITY_WPA2_PSK)) {
+        params->pmksa = *ssid_match;
+        memcpy(params->pmksa.bssid, params->bssid, ETH_ALEN);
+    }
+}
+
+/*
+ * 快速重连
+ *
+ * 链路意外断开后不做全信道扫描，按以下顺序尝试：
+ *   1. 原AP、原信道，带PMKSA
+ *   2. 扫描缓存中同SSID信号最强的另一个AP(两AP之间漫游)
+ *   3. 回退到普通连接，由芯片自行搜索，同时刷新扫描缓存
+ */
+static int wifi_fast_connect_attempt(struct wifi_device *wdev,
+                                     struct wifi_connect_params *params,
+                                     const u8 *bssid, int channel)
+{
+    int ret;
+
+    memcpy(params->bssid, bssid, ETH_ALEN);
+    params->bssid_set = true;
+    params->channel = channel;
+
+    mutex_lock(&wdev->lock);
+    if (!wdev->last_params_valid) {
+        mutex_unlock(&wdev->lock);
+        return -ECANCELED;
+    }
+    wifi_pmksa_lookup_locked(wdev, params);
+    ret = wifi_connect_locked(wdev, params);
+    mutex_unlock(&wdev->lock);
+
+    if (ret)
+        return ret;
+
+    if (!wait_for_completion_timeout(&wdev->connect_completion,
+                                     msecs_to_jiffies(WIFI_RECONNECT_TIMEOUT_MS))) {
+        /* 断开事件要拿wdev->lock，锁外调用 */
+        if (wdev->ops->disconnect)
+            wdev->ops->disconnect(wdev);
+        mutex_lock(&wdev->lock);
+        if (wdev->status.state == WIFI_STATE_CONNECTING)
+            wdev->status.state = WIFI_STATE_READY;
+        mutex_unlock(&wdev->lock);
+        return -ETIMEDOUT;
+    }
+
+    return READ_ONCE(wdev->status.state) == WIFI_STATE_CONNECTED ? 0 : -ECONNREFUSED;
+}
+
+/*
+ * 安排下一轮重连，调用者持有wdev->lock
+ *
+ * 掉线后第一轮立即进行，之后按WIFI_RECONNECT_BACKOFF_MS起逐次翻倍退避，
+ * 连续WIFI_RECONNECT_MAX_ATTEMPTS轮失败后放弃，AP失效时不会反复扫描和
+ * 连接。重连成功或用户重新连接/断开时计数清零。
+ */
+static bool wifi_reconnect_schedule_locked(struct wifi_device *wdev)
+{
+    unsigned int attempts = wdev->reconnect_attempts;
+    unsigned long delay_ms = 0;
+
+    if (!wdev->last_params_valid || wdev->reconnecting)
+        return false;
+
+    if (attempts >= WIFI_RECONNECT_MAX_ATTEMPTS) {
+        if (attempts == WIFI_RECONNECT_MAX_ATTEMPTS) {
+            dev_warn(wdev->dev, "giving up reconnect after %u attempts\n", attempts);
+            wdev->reconnect_attempts++;
+        }
+        return false;
+    }
+
+    if (attempts)
+        delay_ms = min_t(unsigned long, WIFI_RECONNECT_BACKOFF_MS << (attempts - 1),
+                         WIFI_RECONNECT_BACKOFF_MAX_MS);
+    else
+        wdev->link_lost_time = ktime_get();
+
+    wdev->reconnect_attempts++;
+    wdev->reconnecting = true;
+    queue_delayed_work(wdev->workqueue, &wdev->reconnect_work,
+                       msecs_to_jiffies(delay_ms));
+    return true;
+}
+
+static void wifi_reconnect_work(struct work_struct *work)
+{
+    struct wifi_device *wdev = container_of(to_delayed_work(work),
+                                            struct wifi_device, reconnect_work);
+    struct wifi_connect_params *params;
+    struct wifi_network *net;
+    u8 last_bssid[ETH_ALEN], roam_bssid[ETH_ALEN];
+    int last_channel, roam_channel = 0;
+    int ret;
+
+    params = kmalloc(sizeof(*params), GFP_KERNEL);
+    if (!params)
+        goto out;
+
+    mutex_lock(&wdev->lock);
+    if (!wdev->last_params_valid) {
+        mutex_unlock(&wdev->lock);
+        goto out_free;
+    }
+    *params = wdev->last_params;
+    memcpy(last_bssid, wdev->conn_info.bssid, ETH_ALEN);
+    last_channel = wdev->conn_info.channel;
+    mutex_unlock(&wdev->lock);
+
+    if (is_valid_ether_addr(last_bssid) && last_channel &&
+        !wifi_fast_connect_attempt(wdev, params, last_bssid, last_channel))
+        goto connected;
+
+    rcu_read_lock();
+    net = __wifi_find_network(wdev, params->ssid, last_bssid);
+    if (net) {
+        memcpy(roam_bssid, net->bssid, ETH_ALEN);
+        roam_channel = net->channel;
+    }
+    rcu_read_unlock();
+
+    if (roam_channel &&
+        !wifi_fast_connect_attempt(wdev, params, roam_bssid, roam_channel))
+        goto connected;
+
+    dev_info(wdev->dev, "fast reconnect failed, falling back to full connect\n");
+    params->bssid_set = false;
+    params->pmkid_valid = false;
+    params->channel = 0;
+    memzero_explicit(&params->pmksa, sizeof(params->pmksa));
+    wifi_scan_request(wdev, 0);
+
+    /*
+     * 普通连接失败时由断开事件按退避间隔进入下一轮。检查标志和发起连接
+     * 在同一临界区内，用户断开之后不会再连上。
+     */
+    mutex_lock(&wdev->lock);
+    wdev->reconnecting = false;
+    ret = wdev->last_params_valid ? wifi_connect_locked(wdev, params) : -ECANCELED;
+    if (ret && ret != -ECANCELED)
+        wifi_reconnect_schedule_locked(wdev);
+    mutex_unlock(&wdev->lock);
+
+    memzero_explicit(params, sizeof(*params));
+    kfree(params);
+    return;
+
+connected:
+    wdev->last_reconnect_ms = ktime_ms_delta(ktime_get(), wdev->link_lost_time);
+    dev_info(wdev->dev, "reconnected to %pM in %u ms\n",
+             params->bssid, wdev->last_reconnect_ms);
+out_free:
+    memzero_explicit(params, sizeof(*params));
+    kfree(params);
+out:
+    mutex_lock(&wdev->lock);
+    wdev->reconnecting = false;
+    mutex_unlock(&wdev->lock);
+}
+
+/* 标记当前连接的BSS，使其不被老化淘汰 */
+static void wifi_mark_connected_bss(struct wifi_device *wdev, const u8 *bssid)
+{
+    struct wifi_network *net;
+
+    spin_lock_bh(&wdev->network_lock);
+    list_for_each_entry(net, &wdev->network_list, list)
+        WRITE_ONCE(net->connected, bssid && ether_addr_equal(net->bssid, bssid));
+    spin_unlock_bh(&wdev->network_lock);
+}
+
+/*
+ * 链路统计
+ *
+ * 收发路径只写每CPU计数(见wifi_stats_tx_done()/wifi_stats_rx())，
+ * status_work每秒汇总一次，计算速率并写入环形历史，debugfs读取历史时
+ * 只与采样工作竞争stats_lock。
+ */
+
+void wifi_stats_get_totals(struct wifi_device *wdev, struct wifi_stats_totals *totals)
+{
+    int cpu;
+
+    memset(totals, 0, sizeof(*totals));
+
+    for_each_possible_cpu(cpu) {
+        const struct wifi_pcpu_stats *s = per_cpu_ptr(wdev->pcpu_stats, cpu);
+        struct wifi_stats_totals snap;
+        unsigned int start;
+
+        do {
+            start = u64_stats_fetch_begin(&s->syncp);
+            snap.tx_packets = s->tx_packets;
+            snap.tx_bytes = s->tx_bytes;
+            snap.tx_retries = s->tx_retries;
+            snap.tx_failed = s->tx_failed;
+            snap.rx_packets = s->rx_packets;
+            snap.rx_bytes = s->rx_bytes;
+            snap.rx_dropped = s->rx_dropped;
+        } while (u64_stats_fetch_retry(&s->syncp, start));
+
+        totals->tx_packets += snap.tx_packets;
+        totals->tx_bytes += snap.tx_bytes;
+        totals->tx_retries += snap.tx_retries;
+        totals->tx_failed += snap.tx_failed;
+        totals->rx_packets += snap.rx_packets;
+        totals->rx_bytes += snap.rx_bytes;
+        totals->rx_dropped += snap.rx_dropped;
+    }
+}
+EXPORT_SYMBOL_GPL(wifi_stats_get_totals);
+
+static u16 wifi_permille(u64 part, u64 total)
+{
+    return total ? div64_u64(part * 1000, total) : 0;
+}
+
+/*
+ * 刷新status中的链路字段
+ *
+ * 优先用ops->get_status取芯片上报的信号、噪声、速率和发射功率，芯片
+ * 驱动未实现时退回ops->get_signal_strength()。芯片查询可能走SDIO/SPI
+ * 总线，在锁外进行。SSID和信道芯片没给时取连接记录和连接参数。state由核心层
+ * 维护，不从芯片覆盖；未连接时清掉链路字段，避免debugfs显示旧AP的值。
+ */
+static void wifi_update_link_status(struct wifi_device *wdev)
+{
+    struct wifi_status st;
+    bool have_status = false, have_signal = false;
+
+    memset(&st, 0, sizeof(st));
+    if (READ_ONCE(wdev->status.state) == WIFI_STATE_CONNECTED) {
+        if (wdev->ops->get_status)
+            have_status = !wdev->ops->get_status(wdev, &st);
+        if (!have_status && wdev->ops->get_signal_strength)
+            have_signal = !wdev->ops->get_signal_strength(wdev, &st.signal_strength);
+    }
+
+    mutex_lock(&wdev->lock);
+    if (wdev->status.state == WIFI_STATE_CONNECTED) {
+        if (have_status || have_signal)
+            WRITE_ONCE(wdev->status.signal_strength, st.signal_strength);
+        if (have_status) {
+            WRITE_ONCE(wdev->status.noise_level, st.noise_level);
+            wdev->status.tx_rate = st.tx_rate;
+            wdev->status.rx_rate = st.rx_rate;
+            wdev->status.tx_power = st.tx_power;
+            wdev->status.link_quality = st.link_quality;
+        }
+        if (have_status && st.ssid[0])
+            memcpy(wdev->status.ssid, st.ssid, sizeof(wdev->status.ssid));
+        else if (wdev->conn_info.ssid[0])
+            memcpy(wdev->status.ssid, wdev->conn_info.ssid, sizeof(wdev->status.ssid));
+        else
+            memcpy(wdev->status.ssid, wdev->last_params.ssid, sizeof(wdev->status.ssid));
+        wdev->status.channel = have_status && st.channel ? st.channel : wdev->conn_info.channel;
+        wdev->status.security = wdev->conn_info.security;
+    } else {
+        memset(wdev->status.ssid, 0, sizeof(wdev->status.ssid));
+        wdev->status.channel = 0;
+        wdev->status.tx_rate = 0;
+        wdev->status.rx_rate = 0;
+        wdev->status.link_quality = 0;
+    }
+    mutex_unlock(&wdev->lock);
+}
+
+static void wifi_status_work(struct work_struct *work)
+{
+    struct wifi_device *wdev = container_of(to_delayed_work(work),
+                                            struct wifi_device, status_work);
+    struct wifi_stats_totals now, *prev = &wdev->stats_prev;
+    struct wifi_stats_sample sample;
+    unsigned long elapsed_ms;
+    u64 tx_attempts;
+    int q;
+
+    wifi_stats_get_totals(wdev, &now);
+    elapsed_ms = jiffies_to_msecs(jiffies - wdev->stats_prev_jiffies) ?: 1;
+
+    wifi_update_link_status(wdev);
+
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp = ktime_get_boottime_seconds();
+    sample.tx_bytes_ps = div_u64((now.tx_bytes - prev->tx_bytes) * 1000, elapsed_ms);
+    sample.rx_bytes_ps = div_u64((now.rx_bytes - prev->rx_bytes) * 1000, elapsed_ms);
+    sample.tx_pps = div_u64((now.tx_packets - prev->tx_packets) * 1000, elapsed_ms);
+    sample.rx_pps = div_u64((now.rx_packets - prev->rx_packets) * 1000, elapsed_ms);
+
+    tx_attempts = (now.tx_packets - prev->tx_packets) +
+                  (now.tx_failed - prev->tx_failed) +
+                  (now.tx_retries - prev->tx_retries);
+    sample.retry_permille = wifi_permille(now.tx_retries - prev->tx_retries, tx_attempts);
+    sample.fail_permille = wifi_permille(now.tx_failed - prev->tx_failed, tx_attempts);
+    sample.signal = READ_ONCE(wdev->status.signal_strength);
+    sample.noise = READ_ONCE(wdev->status.noise_level);
+    for (q = 0; q < WIFI_TXQ_NUM; q++)
+        sample.tx_queue_depth[q] = max(atomic_read(&wdev->tx_pending[q]), 0);
+
+    spin_lock_bh(&wdev->stats_lock);
+    wdev->stats_history[wdev->stats_head] = sample;
+    wdev->stats_head = (wdev->stats_head + 1) % WIFI_STATS_HISTORY_LEN;
+    if (wdev->stats_count < WIFI_STATS_HISTORY_LEN)
+        wdev->stats_count++;
+    spin_unlock_bh(&wdev->stats_lock);
+
+    *prev = now;
+    wdev->stats_prev_jiffies = jiffies;
+
+    if (!READ_ONCE(wdev->removing))
+        queue_delayed_work(wdev->workqueue, &wdev->status_work,
+                           msecs_to_jiffies(WIFI_STATS_INTERVAL_MS));
+}
+
+/*
+ * 事件上报
+ */
+
+void wifi_send_scan_complete_event(struct wifi_device *wdev)
+{
+    union iwreq_data wrqu;
+
+    if (!wdev->ndev)
+        return;
+
+    memset(&wrqu, 0, sizeof(wrqu));
+    wireless_send_event(wdev->ndev, SIOCGIWSCAN, &wrqu, NULL);
+}
+EXPORT_SYMBOL_GPL(wifi_send_scan_complete_event);
+
+/* 芯片驱动上报连接结果，CONNECTED之前应已填好conn_info(bssid、信道) */
+void wifi_send_connection_event(struct wifi_device *wdev, enum wifi_connection_state state)
+{
+    union iwreq_data wrqu;
+
+    mutex_lock(&wdev->lock);
+    wdev->status.state = state;
+    if (state == WIFI_STATE_CONNECTED) {
+        wdev->reconnect_attempts = 0;
+        wdev->conn_info.connected = true;
+        wdev->conn_info.connect_time = ktime_get_boottime_seconds();
+        wifi_mark_connected_bss(wdev, wdev->conn_info.bssid);
+    }
+    mutex_unlock(&wdev->lock);
+
+    complete_all(&wdev->connect_completion);
+
+    if (state == WIFI_STATE_CONNECTED && wdev->ndev) {
+        netif_carrier_on(wdev->ndev);
+        memset(&wrqu, 0, sizeof(wrqu));
+        wrqu.ap_addr.sa_family = ARPHRD_ETHER;
+        memcpy(wrqu.ap_addr.sa_data, wdev->conn_info.bssid, ETH_ALEN);
+        wireless_send_event(wdev->ndev, SIOCGIWAP, &wrqu, NULL);
+    }
+}
+EXPORT_SYMBOL_GPL(wifi_send_connection_event);
+
+void wifi_send_disconnection_event(struct wifi_device *wdev)
+{
+    union iwreq_data wrqu;
+    bool reconnect, in_progress;
+
+    mutex_lock(&wdev->lock);
+    wdev->status.state = WIFI_STATE_READY;
+    wdev->conn_info.connected = false;
+    wifi_mark_connected_bss(wdev, NULL);
+    in_progress = wdev->reconnecting;
+    reconnect = wifi_reconnect_schedule_locked(wdev);
+    mutex_unlock(&wdev->lock);
+
+    complete_all(&wdev->disconnect_completion);
+    /* 快速重连尝试期间的断开即为该次尝试失败，唤醒等待者 */
+    complete_all(&wdev->connect_completion);
+
+    if (wdev->ndev) {
+        netif_carrier_off(wdev->ndev);
+        memset(&wrqu, 0, sizeof(wrqu));
+        wrqu.ap_addr.sa_family = ARPHRD_ETHER;
+        wireless_send_event(wdev->ndev, SIOCGIWAP, &wrqu, NULL);
+    }
+
+    if (!reconnect && !in_progress)
+        wifi_scan_request(wdev, 0);
+}
+EXPORT_SYMBOL_GPL(wifi_send_disconnection_event);
+
+/*
+ * 平台驱动
+ */
+
+int wifi_driver_probe(struct platform_device *pdev)
+{
+    struct wifi_platform_data *pdata = dev_get_platdata(&pdev->dev);
+    struct wifi_device *wdev;
+    int cpu, q, ret;
+
+    if (!pdata || !pdata->ops) {
+        dev_err(&pdev->dev, "missing platform data or chip ops\n");
+        return -ENODEV;
+    }
+
+    wdev = devm_kzalloc(&pdev->dev, sizeof(*wdev), GFP_KERNEL);
+    if (!wdev)
+        return -ENOMEM;
+
+    wdev->dev = &pdev->dev;
+    wdev->pdev = pdev;
+    wdev->ops = pdata->ops;
+    wdev->status.state = WIFI_STATE_INIT;
+    wdev->scan_interval_ms = scan_interval_ms;
+    wdev->scan_max_age = scan_max_age;
+
+    mutex_init(&wdev->lock);
+    spin_lock_init(&wdev->stats_lock);
+    spin_lock_init(&wdev->network_lock);
+    INIT_LIST_HEAD(&wdev->network_list);
+    init_completion(&wdev->scan_completion);
+    init_completion(&wdev->connect_completion);
+    init_completion(&wdev->disconnect_completion);
+    INIT_DELAYED_WORK(&wdev->scan_work, wifi_scan_work);
+    INIT_DELAYED_WORK(&wdev->reconnect_work, wifi_reconnect_work);
+    INIT_DELAYED_WORK(&wdev->status_work, wifi_status_work);
+    wifi_ps_init(wdev);
+    for (q = 0; q < WIFI_TXQ_NUM; q++)
+        atomic_set(&wdev->tx_pending[q], 0);
+
+    wdev->pcpu_stats = devm_alloc_percpu(&pdev->dev, struct wifi_pcpu_stats);
+    if (!wdev->pcpu_stats)
+        return -ENOMEM;
+    for_each_possible_cpu(cpu)
+        u64_stats_init(&per_cpu_ptr(wdev->pcpu_stats, cpu)->syncp);
+
+    /* 非有序队列：扫描工作等待完成时不阻塞其他工作 */
+    wdev->workqueue = alloc_workqueue("wifi_%s", WQ_UNBOUND | WQ_MEM_RECLAIM |
+                                      WQ_FREEZABLE, 0, dev_name(&pdev->dev));
+    if (!wdev->workqueue)
+        return -ENOMEM;
+
+    platform_set_drvdata(pdev, wdev);
+
+    ret = wifi_netdev_create(wdev);
+    if (ret)
+        goto err_wq;
+
+    if (wdev->ops->probe) {
+        ret = wdev->ops->probe(wdev);
+        if (ret)
+            goto err_netdev;
+    }
+
+    if (wdev->ops->init) {
+        ret = wdev->ops->init(wdev);
+        if (ret)
+            goto err_remove;
+    }
+
+    ret = wifi_netdev_register(wdev);
+    if (ret)
+        goto err_deinit;
+
+    wdev->status.state = WIFI_STATE_READY;
+    wdev->stats_prev_jiffies = jiffies;
+    queue_delayed_work(wdev->workqueue, &wdev->status_work,
+                       msecs_to_jiffies(WIFI_STATS_INTERVAL_MS));
+    wifi_ps_start(wdev);
+    wifi_debug_init(wdev);
+    wifi_scan_request(wdev, 0);
+
+    dev_info(&pdev->dev, "WiFi device ready\n");
+    return 0;
+
+err_deinit:
+    WRITE_ONCE(wdev->removing, true);
+    if (wdev->ops->deinit)
+        wdev->ops->deinit(wdev);
+    /* deinit上报的断开事件可能已排队扫描 */
+    cancel_delayed_work_sync(&wdev->scan_work);
+err_remove:
+    if (wdev->ops->remove)
+        wdev->ops->remove(wdev);
+err_netdev:
+    wifi_netdev_free(wdev);
+err_wq:
+    destroy_workqueue(wdev->workqueue);
+    return ret;
+}
+
+int wifi_driver_remove(struct platform_device *pdev)
+{
+    struct wifi_device *wdev = platform_get_drvdata(pdev);
+
+    /*
+     * 先置removing再停工作：之后的事件处理(包括deinit时芯片上报的断开)
+     * 不再排队新工作，工作自身也不再重新排队
+     */
+    mutex_lock(&wdev->lock);
+    wdev->last_params_valid = false;
+    WRITE_ONCE(wdev->removing, true);
+    mutex_unlock(&wdev->lock);
+
+    wifi_debug_cleanup(wdev);
+
+    cancel_delayed_work_sync(&wdev->reconnect_work);
+    cancel_delayed_work_sync(&wdev->scan_work);
+    cancel_delayed_work_sync(&wdev->status_work);
+
+    wifi_netdev_unregister(wdev);
+    wifi_ps_stop(wdev);
+
+    if (wdev->ops->deinit)
+        wdev->ops->deinit(wdev);
+    if (wdev->ops->remove)
+        wdev->ops->remove(wdev);
+
+    /* 置removing之前已进入排队路径的事件 */
+    cancel_delayed_work_sync(&wdev->reconnect_work);
+    cancel_delayed_work_sync(&wdev->scan_work);
+    cancel_delayed_work_sync(&wdev->status_work);
+    cancel_delayed_work_sync(&wdev->ps_work);
+
+    wifi_netdev_free(wdev);
+
+    destroy_workqueue(wdev->workqueue);
+    wifi_flush_networks(wdev);
+    wifi_pmksa_flush(wdev);
+    memzero_explicit(&wdev->last_params, sizeof(wdev->last_params));
+
+    return 0;
+}
+
+int wifi_driver_suspend(struct platform_device *pdev, pm_message_t state)
+{
+    struct wifi_device *wdev = platform_get_drvdata(pdev);
+
+    cancel_delayed_work_sync(&wdev->scan_work);
+    cancel_delayed_work_sync(&wdev->status_work);
+    wifi_ps_stop(wdev);
+
+    return wdev->ops->suspend ? wdev->ops->suspend(wdev) : 0;
+}
+
+int wifi_driver_resume(struct platform_device *pdev)
+{
+    struct wifi_device *wdev = platform_get_drvdata(pdev);
+    int ret;
+
+    if (wdev->ops->resume) {
+        ret = wdev->ops->resume(wdev);
+        if (ret)
+            return ret;
+    }
+
+    wdev->stats_prev_jiffies = jiffies;
+    queue_delayed_work(wdev->workqueue, &wdev->status_work,
+                       msecs_to_jiffies(WIFI_STATS_INTERVAL_MS));
+    wifi_ps_start(wdev);
+
+    /* 休眠期间缓存可能已过期，恢复后立即刷新 */
+    wifi_scan_request(wdev, 0);
+    return 0;
+}
+
+static struct platform_driver wifi_platform_driver = {
+    .probe = wifi_driver_probe,
+    .remove = wifi_driver_remove,
+    .suspend = wifi_driver_suspend,
+    .resume = wifi_driver_resume,
+    .driver = {
+        .name = WIFI_DRIVER_NAME,
+    },
+};
+module_platform_driver(wifi_platform_driver);
+
+MODULE_AUTHOR("Linux Cool Team");
+MODULE_DESCRIPTION("IMX6ULL Pro WiFi driver core");
+MODULE_LICENSE("GPL v2");
@@ -16,10 +16,54 @@
 
 #include <linux/device.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/completion.h>
 #include <linux/workqueue.h>
+#include <linux/rculist.h>
+#include <linux/platform_device.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/netdevice.h>
+#include <linux/ieee80211.h>
 #include <linux/wireless.h>
 
+#define WIFI_DRIVER_NAME            "imx6ull_wifi"
+
+/* 扫描参数 */
+#define WIFI_SCAN_TIMEOUT_MS        5000    /* 单次扫描超时 */
+#define WIFI_SCAN_INTERVAL_MS       10000   /* 未连接时后台扫描周期 */
+#define WIFI_SCAN_INTERVAL_CONN_MS  60000   /* 已连接时后台扫描周期 */
+#define WIFI_SCAN_MAX_AGE_S         120     /* 扫描结果老化时间 */
+#define WIFI_MAX_NETWORKS           64      /* 扫描缓存上限 */
+
+/* 快速重连参数 */
+#define WIFI_PMKSA_CACHE_SIZE       4
+#define WIFI_PMKSA_LIFETIME_S       43200   /* 与wpa_supplicant默认PMK寿命一致 */
+#define WIFI_PMKID_LEN              16
+#define WIFI_PMK_MAX_LEN            48
+#define WIFI_RECONNECT_TIMEOUT_MS   800     /* 单次快速重连尝试超时 */
+#define WIFI_RECONNECT_BACKOFF_MS   500     /* 重连失败后的首次重试间隔，之后逐次翻倍 */
+#define WIFI_RECONNECT_BACKOFF_MAX_MS 30000
+#define WIFI_RECONNECT_MAX_ATTEMPTS 8       /* 连续失败后停止自动重连，只保留后台扫描 */
+
+/* 链路统计参数 */
+#define WIFI_STATS_INTERVAL_MS      1000    /* 采样周期 */
+#define WIFI_STATS_HISTORY_LEN      60      /* 保留最近60个采样 */
+
+/* 各发送队列交给芯片的在途帧上限 */
+#define WIFI_TXQ_EVENT_LIMIT        16
+#define WIFI_TXQ_DEFAULT_LIMIT      32
+#define WIFI_TXQ_BULK_LIMIT         4       /* 约6KB，保证芯片FIFO里不会积压秒级的上传数据 */
+
+/* 省电策略参数 */
+#define WIFI_PS_CHECK_MS            500     /* 空闲检测周期 */
+#define WIFI_PS_IDLE_MS             3000    /* 连续空闲多久进入深度省电 */
+#define WIFI_PS_MAX_WAKE_LATENCY_MS 100     /* 省电(SAVE)下的最大下行唤醒延迟 */
+#define WIFI_PS_DEEP_WAKE_LATENCY_MS 250    /* 深度省电的延迟预算，低于300ms的DTIM延迟 */
+#define WIFI_DEFAULT_BEACON_TU      100
+
+struct wifi_device;
+
 /* WiFi安全类型定义 */
 enum wifi_security {
     WIFI_SECURITY_OPEN = 0,
@@ -43,6 +87,33 @@ enum wifi_cipher {
     WIFI_CIPHER_MAX
 };
 
+/* 发送队列
+ *
+ * 检测结果事件包小而对时延敏感，快照上传是大块数据。两者走不同的netdev
+ * 子队列并分别限制在途帧数，事件包不必排在已经交给芯片的图像数据之后。
+ * 应用通过SO_PRIORITY或IP_TOS(内核会换算成sk_priority)选择队列。
+ */
+enum wifi_tx_queue {
+    WIFI_TXQ_EVENT = 0,     /* TC_PRIO_INTERACTIVE/TC_PRIO_CONTROL */
+    WIFI_TXQ_DEFAULT,       /* TC_PRIO_BESTEFFORT及其它 */
+    WIFI_TXQ_BULK,          /* TC_PRIO_BULK/TC_PRIO_FILLER */
+    WIFI_TXQ_NUM
+};
+
+/* 省电模式
+ *
+ * SAVE和DEEP_SAVE各有一个下行唤醒延迟预算，按beacon间隔换算成listen
+ * interval：SAVE用ps_max_latency_ms(默认每个beacon醒一次)，连续空闲后
+ * 的DEEP_SAVE用更大的ps_deep_latency_ms。芯片驱动应按该间隔醒来而不是
+ * 按AP的DTIM周期，否则DTIM较大的AP上下行延迟会超出预算。
+ */
+enum wifi_power_mode {
+    WIFI_PS_ACTIVE = 0,
+    WIFI_PS_SAVE,
+    WIFI_PS_DEEP_SAVE,
+    WIFI_PS_MAX
+};
+
 /* WiFi连接状态定义 */
 enum wifi_connection_state {
     WIFI_STATE_INIT = 0,
@@ -64,9 +135,16 @@ enum wifi_mode {
     WIFI_MODE_MAX
 };
 
-/* WiFi网络信息结构 */
+/* WiFi网络信息结构
+ *
+ * 扫描缓存节点，挂在wifi_device->network_list上。写者持network_lock，
+ * 读者只需rcu_read_lock()，因此连接路径查找网络时不会被扫描阻塞。
+ */
 struct wifi_network {
+    struct list_head list;
+    struct rcu_head rcu;
     char ssid[IEEE80211_MAX_SSID_LEN];
+    u8 bssid[ETH_ALEN];
     enum wifi_security security;
     enum wifi_cipher cipher;
     int signal_strength;
@@ -74,7 +152,22 @@ struct wifi_network {
     int frequency;
     bool hidden;
     bool connected;
-    time_t last_seen;
+    time_t last_seen;   /* 最后一次在扫描中出现的时间(boottime秒) */
+};
+
+/* PMKSA缓存条目
+ *
+ * 芯片驱动完成一次完整握手后通过wifi_pmksa_add()登记。重连时带上PMKID
+ * 可跳过802.1X/SAE认证；对PSK网络，缓存的PMK还省去了一次PBKDF2计算。
+ */
+struct wifi_pmksa {
+    char ssid[IEEE80211_MAX_SSID_LEN];
+    u8 bssid[ETH_ALEN];
+    u8 pmkid[WIFI_PMKID_LEN];
+    u8 pmk[WIFI_PMK_MAX_LEN];
+    size_t pmk_len;
+    time64_t expire;
+    bool valid;
 };
 
 /* WiFi连接参数结构 */
@@ -89,6 +182,12 @@ struct wifi_connect_params {
     char ca_cert[256];  // CA证书路径
     char client_cert[256]; // 客户端证书路径
     char private_key[256]; // 私钥路径
+
+    /* 快速重连：指定BSS并携带PMKSA，芯片驱动应跳过扫描直接关联 */
+    u8 bssid[ETH_ALEN];
+    bool bssid_set;
+    struct wifi_pmksa pmksa;
+    bool pmkid_valid;   // pmksa.pmkid属于bssid，可直接用于PMKSA缓存
 };
 
 /* WiFi状态结构 */
@@ -116,11 +215,52 @@ struct wifi_connection_info {
     int signal_strength;
     int tx_rate;
     int rx_rate;
+    int beacon_interval;    /* TU，芯片驱动在上报CONNECTED前填写，0表示未知 */
     bool connected;
     time_t connect_time;
     time_t last_seen;
 };
 
+/* 每CPU收发计数
+ *
+ * 收发热路径只更新本CPU的副本，不加锁；采样时再跨CPU汇总。
+ */
+struct wifi_pcpu_stats {
+    u64 tx_packets;
+    u64 tx_bytes;
+    u64 tx_retries;
+    u64 tx_failed;
+    u64 rx_packets;
+    u64 rx_bytes;
+    u64 rx_dropped;
+    struct u64_stats_sync syncp;
+};
+
+/* 汇总后的累计计数 */
+struct wifi_stats_totals {
+    u64 tx_packets;
+    u64 tx_bytes;
+    u64 tx_retries;
+    u64 tx_failed;
+    u64 rx_packets;
+    u64 rx_bytes;
+    u64 rx_dropped;
+};
+
+/* 每秒一次的链路采样，用于区分网络慢和处理流水线慢 */
+struct wifi_stats_sample {
+    time64_t timestamp;
+    u64 tx_bytes_ps;
+    u64 rx_bytes_ps;
+    u32 tx_pps;
+    u32 rx_pps;
+    u16 retry_permille;     /* 重传占发送尝试的千分比 */
+    u16 fail_permille;      /* 发送失败千分比 */
+    int signal;             /* dBm */
+    int noise;              /* dBm */
+    u32 tx_queue_depth[WIFI_TXQ_NUM];   /* 各队列已交给芯片未完成的帧数 */
+};
+
 /* WiFi扫描结果结构 */
 struct wifi_scan_result {
     char ssid[IEEE80211_MAX_SSID_LEN];
@@ -154,6 +294,11 @@ struct wifi_driver_ops {
     int (*scan_stop)(struct wifi_device *dev);
     int (*connect)(struct wifi_device *dev, struct wifi_connect_params *params);
     int (*disconnect)(struct wifi_device *dev);
+
+    /* 数据发送：成功后skb归芯片驱动所有，完成时调用wifi_tx_complete()。
+     * 总线空闲时芯片驱动应先发送WIFI_TXQ_EVENT队列的帧。
+     */
+    int (*xmit)(struct wifi_device *dev, struct sk_buff *skb, enum wifi_tx_queue queue);
     
     /* 状态查询 */
     int (*get_status)(struct wifi_device *dev, struct wifi_status *status);
@@ -164,6 +309,9 @@ struct wifi_driver_ops {
     int (*set_mode)(struct wifi_device *dev, enum wifi_mode mode);
     int (*set_power)(struct wifi_device *dev, int power);
     int (*set_channel)(struct wifi_device *dev, int channel);
+    /* listen_interval以beacon为单位，对WIFI_PS_SAVE和WIFI_PS_DEEP_SAVE有意义 */
+    int (*set_power_save)(struct wifi_device *dev, enum wifi_power_mode mode,
+                          unsigned int listen_interval);
     
     /* 统计信息 */
     int (*get_statistics)(struct wifi_device *dev, struct wireless_stats *stats);
@@ -180,6 +328,7 @@ struct wifi_device {
     struct workqueue_struct *workqueue;
     struct delayed_work scan_work;
     struct delayed_work status_work;
+    bool removing;                  /* 卸载中，事件处理不再排队工作 */
     
     /* 硬件相关 */
     void *private_data;
@@ -191,17 +340,53 @@ struct wifi_device {
     struct wireless_dev *wdev;
     
     /* 扫描相关 */
-    struct list_head network_list;
+    struct list_head network_list;  /* RCU保护的扫描缓存 */
+    spinlock_t network_lock;        /* 扫描缓存写者锁 */
     int network_count;
     struct completion scan_completion;
+    unsigned int scan_interval_ms;
+    unsigned int scan_max_age;      /* 秒，0表示不老化 */
     
     /* 连接相关 */
     struct completion connect_completion;
     struct completion disconnect_completion;
+
+    /* 快速重连 */
+    struct wifi_connect_params last_params;
+    bool last_params_valid;         /* 用户主动断开后清除 */
+    bool reconnecting;
+    unsigned int reconnect_attempts; /* 本次掉线后已进行的重连轮数 */
+    struct delayed_work reconnect_work;
+    struct wifi_pmksa pmksa_cache[WIFI_PMKSA_CACHE_SIZE];
+    ktime_t link_lost_time;
+    u32 last_reconnect_ms;
+
+    /* 省电策略 */
+    enum wifi_power_mode ps_mode;
+    unsigned int ps_listen_interval;
+    u32 ps_max_latency_ms;          /* SAVE的延迟预算，可通过debugfs调整 */
+    u32 ps_deep_latency_ms;         /* DEEP_SAVE的延迟预算，可通过debugfs调整 */
+    u32 ps_idle_ms;
+    struct delayed_work ps_work;
+    unsigned long ps_last_active;   /* jiffies */
+    u64 ps_last_packets;
+    u32 ps_transitions;
     
     /* 统计信息 */
     struct wireless_stats stats;
-    spinlock_t stats_lock;
+    spinlock_t stats_lock;          /* 保护stats和采样历史，不在收发路径上 */
+    struct wifi_pcpu_stats __percpu *pcpu_stats;
+    struct wifi_stats_totals stats_prev;
+    unsigned long stats_prev_jiffies;
+    struct wifi_stats_sample stats_history[WIFI_STATS_HISTORY_LEN];
+    unsigned int stats_head;        /* 下一个写入位置 */
+    unsigned int stats_count;
+    atomic_t tx_pending[WIFI_TXQ_NUM];
+    unsigned long txq_blocked;      /* 被共存调度暂停的子队列位图 */
+
+    /* WiFi/蓝牙共存，由wifi_bt_coex注册 */
+    void *coex;
+    void (*coex_tx_kick)(struct wifi_device *wdev, enum wifi_tx_queue queue);
     
     /* 调试信息 */
     bool debug_enabled;
@@ -220,6 +405,7 @@ struct wifi_platform_data {
     int power_delay_ms;
     int reset_delay_ms;
     int init_delay_ms;
+    struct wifi_driver_ops *ops;    /* 芯片相关实现 */
 };
 
 /* 函数声明 */
@@ -234,12 +420,94 @@ int wifi_encrypt_network_config(struct wifi_network_config *config);
 int wifi_add_network_to_list(struct wifi_device *wdev, struct wifi_network *network);
 int wifi_remove_network_from_list(struct wifi_device *wdev, const char *ssid);
 struct wifi_network *wifi_find_network(struct wifi_device *wdev, const char *ssid);
+void wifi_expire_networks(struct wifi_device *wdev, unsigned int max_age);
+
+/* 扫描/连接函数声明 */
+int wifi_scan_request(struct wifi_device *wdev, unsigned long delay_ms);
+void wifi_scan_report_result(struct wifi_device *wdev,
+                             const struct wifi_scan_result *result);
+void wifi_scan_done(struct wifi_device *wdev);
+int wifi_connect(struct wifi_device *wdev, struct wifi_connect_params *params);
+int wifi_disconnect(struct wifi_device *wdev);
+int wifi_pmksa_add(struct wifi_device *wdev, const u8 *bssid, const u8 *pmkid,
+                   const u8 *pmk, size_t pmk_len);
+void wifi_pmksa_flush(struct wifi_device *wdev);
 
 /* 事件处理函数声明 */
 void wifi_send_scan_complete_event(struct wifi_device *wdev);
 void wifi_send_connection_event(struct wifi_device *wdev, enum wifi_connection_state state);
 void wifi_send_disconnection_event(struct wifi_device *wdev);
 
+/* 统计函数声明 */
+void wifi_stats_get_totals(struct wifi_device *wdev, struct wifi_stats_totals *totals);
+
+/* 发送完成计数：bytes为帧长，retries为该帧的重传次数 */
+static inline void wifi_stats_tx_done(struct wifi_device *wdev, enum wifi_tx_queue queue,
+                                      unsigned int bytes, unsigned int retries, bool failed)
+{
+    struct wifi_pcpu_stats *s;
+    unsigned long flags;
+
+    s = get_cpu_ptr(wdev->pcpu_stats);
+    flags = u64_stats_update_begin_irqsave(&s->syncp);
+    if (failed) {
+        s->tx_failed++;
+    } else {
+        s->tx_packets++;
+        s->tx_bytes += bytes;
+    }
+    s->tx_retries += retries;
+    u64_stats_update_end_irqrestore(&s->syncp, flags);
+    put_cpu_ptr(wdev->pcpu_stats);
+
+    atomic_dec(&wdev->tx_pending[queue]);
+}
+
+/* 帧交给芯片前调用，与wifi_stats_tx_done()配对 */
+static inline void wifi_stats_tx_queued(struct wifi_device *wdev, enum wifi_tx_queue queue)
+{
+    atomic_inc(&wdev->tx_pending[queue]);
+}
+
+static inline void wifi_stats_rx(struct wifi_device *wdev, unsigned int bytes,
+                                 bool dropped)
+{
+    struct wifi_pcpu_stats *s;
+    unsigned long flags;
+
+    s = get_cpu_ptr(wdev->pcpu_stats);
+    flags = u64_stats_update_begin_irqsave(&s->syncp);
+    if (dropped) {
+        s->rx_dropped++;
+    } else {
+        s->rx_packets++;
+        s->rx_bytes += bytes;
+    }
+    u64_stats_update_end_irqrestore(&s->syncp, flags);
+    put_cpu_ptr(wdev->pcpu_stats);
+}
+
+/* 网络设备函数声明 */
+int wifi_netdev_create(struct wifi_device *wdev);
+int wifi_netdev_register(struct wifi_device *wdev);
+void wifi_netdev_unregister(struct wifi_device *wdev);
+void wifi_netdev_free(struct wifi_device *wdev);
+void wifi_tx_complete(struct wifi_device *wdev, enum wifi_tx_queue queue,
+                      unsigned int bytes, unsigned int retries, bool failed);
+void wifi_txq_set_blocked(struct wifi_device *wdev, enum wifi_tx_queue queue, bool blocked);
+
+/* 省电函数声明 */
+void wifi_ps_init(struct wifi_device *wdev);
+void wifi_ps_start(struct wifi_device *wdev);
+void wifi_ps_stop(struct wifi_device *wdev);
+
+/* 有实时事件待发时立即重新评估，不等下一个检测周期 */
+static inline void wifi_ps_kick(struct wifi_device *wdev)
+{
+    if (READ_ONCE(wdev->ps_mode) != WIFI_PS_ACTIVE && !READ_ONCE(wdev->removing))
+        mod_delayed_work(wdev->workqueue, &wdev->ps_work, 0);
+}
+
 /* 调试函数声明 */
 void wifi_debug_init(struct wifi_device *wdev);
 void wifi_debug_cleanup(struct wifi_device *wdev);
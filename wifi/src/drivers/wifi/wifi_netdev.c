@@ -0,0 +1,221 @@
+/*
+ * WiFi网络设备
+ *
+ * 为每个WiFi设备注册一个多队列以太网接口。ndo_select_queue按skb->priority
+ * 把流量分到事件/默认/大块三个子队列，每个子队列单独限制交给芯片的在途帧数，
+ * 达到上限时只停该子队列，事件包因此不会被排队中的快照上传堵住。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/pkt_sched.h>
+
+#include "wifi_driver.h"
+
+struct wifi_netdev_priv {
+    struct wifi_device *wdev;
+};
+
+static const int wifi_txq_limit[WIFI_TXQ_NUM] = {
+    [WIFI_TXQ_EVENT]   = WIFI_TXQ_EVENT_LIMIT,
+    [WIFI_TXQ_DEFAULT] = WIFI_TXQ_DEFAULT_LIMIT,
+    [WIFI_TXQ_BULK]    = WIFI_TXQ_BULK_LIMIT,
+};
+
+static inline struct wifi_device *wifi_ndev_to_wdev(struct net_device *ndev)
+{
+    struct wifi_netdev_priv *priv = netdev_priv(ndev);
+
+    return priv->wdev;
+}
+
+static enum wifi_tx_queue wifi_priority_to_queue(u32 priority)
+{
+    switch (priority) {
+    case TC_PRIO_CONTROL:
+    case TC_PRIO_INTERACTIVE:
+        return WIFI_TXQ_EVENT;
+    case TC_PRIO_BULK:
+    case TC_PRIO_FILLER:
+        return WIFI_TXQ_BULK;
+    default:
+        return WIFI_TXQ_DEFAULT;
+    }
+}
+
+static u16 wifi_ndo_select_queue(struct net_device *ndev, struct sk_buff *skb,
+                                 struct net_device *sb_dev)
+{
+    return wifi_priority_to_queue(skb->priority);
+}
+
+static netdev_tx_t wifi_ndo_start_xmit(struct sk_buff *skb, struct net_device *ndev)
+{
+    struct wifi_device *wdev = wifi_ndev_to_wdev(ndev);
+    u16 queue = skb_get_queue_mapping(skb);
+    atomic_t *pending = &wdev->tx_pending[queue];
+    unsigned int len = skb->len;
+    void (*coex_kick)(struct wifi_device *, enum wifi_tx_queue);
+
+    wifi_stats_tx_queued(wdev, queue);
+    if (queue == WIFI_TXQ_EVENT)
+        wifi_ps_kick(wdev);
+    coex_kick = READ_ONCE(wdev->coex_tx_kick);
+    if (coex_kick)
+        coex_kick(wdev, queue);
+    if (unlikely(!wdev->ops->xmit) || wdev->ops->xmit(wdev, skb, queue)) {
+        dev_kfree_skb_any(skb);
+        wifi_stats_tx_done(wdev, queue, len, 0, true);
+        return NETDEV_TX_OK;
+    }
+
+    if (atomic_read(pending) >= wifi_txq_limit[queue]) {
+        netif_stop_subqueue(ndev, queue);
+        /* 与wifi_tx_complete()配对，防止完成中断在停队列前已经把计数减下去 */
+        smp_mb__after_atomic();
+        if (atomic_read(pending) < wifi_txq_limit[queue] &&
+            !test_bit(queue, &wdev->txq_blocked))
+            netif_wake_subqueue(ndev, queue);
+    }
+
+    return NETDEV_TX_OK;
+}
+
+/* 芯片驱动在帧发送完成(或最终失败)时调用，可在中断上下文中调用 */
+void wifi_tx_complete(struct wifi_device *wdev, enum wifi_tx_queue queue,
+                      unsigned int bytes, unsigned int retries, bool failed)
+{
+    wifi_stats_tx_done(wdev, queue, bytes, retries, failed);
+
+    smp_mb__after_atomic();
+    if (wdev->ndev && __netif_subqueue_stopped(wdev->ndev, queue) &&
+        !test_bit(queue, &wdev->txq_blocked) &&
+        atomic_read(&wdev->tx_pending[queue]) < wifi_txq_limit[queue])
+        netif_wake_subqueue(wdev->ndev, queue);
+}
+EXPORT_SYMBOL_GPL(wifi_tx_complete);
+
+/* 共存调度在蓝牙时隙内暂停低优先级子队列，解除时仍受在途帧上限约束 */
+void wifi_txq_set_blocked(struct wifi_device *wdev, enum wifi_tx_queue queue, bool blocked)
+{
+    if (!wdev->ndev)
+        return;
+
+    if (blocked) {
+        set_bit(queue, &wdev->txq_blocked);
+        netif_stop_subqueue(wdev->ndev, queue);
+        return;
+    }
+
+    clear_bit(queue, &wdev->txq_blocked);
+    smp_mb__after_atomic();
+    if (atomic_read(&wdev->tx_pending[queue]) < wifi_txq_limit[queue])
+        netif_wake_subqueue(wdev->ndev, queue);
+}
+EXPORT_SYMBOL_GPL(wifi_txq_set_blocked);
+
+static int wifi_ndo_open(struct net_device *ndev)
+{
+    struct wifi_device *wdev = wifi_ndev_to_wdev(ndev);
+
+    if (READ_ONCE(wdev->status.state) == WIFI_STATE_CONNECTED)
+        netif_carrier_on(ndev);
+    else
+        netif_carrier_off(ndev);
+
+    netif_tx_start_all_queues(ndev);
+    return 0;
+}
+
+static int wifi_ndo_stop(struct net_device *ndev)
+{
+    netif_tx_stop_all_queues(ndev);
+    return 0;
+}
+
+static void wifi_ndo_get_stats64(struct net_device *ndev,
+                                 struct rtnl_link_stats64 *stats)
+{
+    struct wifi_device *wdev = wifi_ndev_to_wdev(ndev);
+    struct wifi_stats_totals t;
+
+    wifi_stats_get_totals(wdev, &t);
+
+    stats->tx_packets = t.tx_packets;
+    stats->tx_bytes = t.tx_bytes;
+    stats->tx_errors = t.tx_failed;
+    stats->rx_packets = t.rx_packets;
+    stats->rx_bytes = t.rx_bytes;
+    stats->rx_dropped = t.rx_dropped;
+}
+
+static const struct net_device_ops wifi_netdev_ops = {
+    .ndo_open = wifi_ndo_open,
+    .ndo_stop = wifi_ndo_stop,
+    .ndo_start_xmit = wifi_ndo_start_xmit,
+    .ndo_select_queue = wifi_ndo_select_queue,
+    .ndo_get_stats64 = wifi_ndo_get_stats64,
+    .ndo_set_mac_address = eth_mac_addr,
+    .ndo_validate_addr = eth_validate_addr,
+};
+
+/* 在芯片probe之前分配，芯片驱动可在init中写入MAC地址 */
+int wifi_netdev_create(struct wifi_device *wdev)
+{
+    struct wifi_netdev_priv *priv;
+    struct net_device *ndev;
+
+    ndev = alloc_etherdev_mqs(sizeof(*priv), WIFI_TXQ_NUM, 1);
+    if (!ndev)
+        return -ENOMEM;
+
+    priv = netdev_priv(ndev);
+    priv->wdev = wdev;
+
+    SET_NETDEV_DEV(ndev, wdev->dev);
+    ndev->netdev_ops = &wifi_netdev_ops;
+    eth_hw_addr_random(ndev);
+    netif_carrier_off(ndev);
+
+    wdev->ndev = ndev;
+    return 0;
+}
+
+int wifi_netdev_register(struct wifi_device *wdev)
+{
+    int ret;
+
+    ret = register_netdev(wdev->ndev);
+    if (ret)
+        dev_err(wdev->dev, "failed to register netdev: %d\n", ret);
+
+    return ret;
+}
+
+/* 注销后协议栈不再调用xmit，芯片驱动仍可对在途帧调用wifi_tx_complete() */
+void wifi_netdev_unregister(struct wifi_device *wdev)
+{
+    if (wdev->ndev && wdev->ndev->reg_state == NETREG_REGISTERED)
+        unregister_netdev(wdev->ndev);
+}
+
+/* 须在芯片驱动停止回调之后调用 */
+void wifi_netdev_free(struct wifi_device *wdev)
+{
+    struct net_device *ndev = wdev->ndev;
+
+    if (!ndev)
+        return;
+
+    wdev->ndev = NULL;
+    free_netdev(ndev);
+}
@@ -0,0 +1,157 @@
+/*
+ * WiFi省电策略
+ *
+ * 周期性检查收发计数：有流量时保持ACTIVE，刚空闲时进入SAVE，连续空闲
+ * 超过ps_idle_ms后进入DEEP_SAVE。事件队列有帧待发时由wifi_ps_kick()
+ * 立即切回ACTIVE。两种模式的listen interval分别由各自的延迟预算和AP的
+ * beacon间隔换算得到，保证下行延迟有上限；深度预算换算出的间隔不比
+ * SAVE长时不进入DEEP_SAVE，它不会更省电。
+ *
+ * Copyright (C) 2024 Linux Cool Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/jiffies.h>
+
+#include "wifi_driver.h"
+
+static bool ps_enable = true;
+module_param(ps_enable, bool, 0644);
+MODULE_PARM_DESC(ps_enable, "Enable adaptive power save");
+
+static unsigned int ps_max_wake_latency_ms = WIFI_PS_MAX_WAKE_LATENCY_MS;
+module_param(ps_max_wake_latency_ms, uint, 0444);
+MODULE_PARM_DESC(ps_max_wake_latency_ms, "Upper bound on downlink wake latency in power save (ms)");
+
+static unsigned int ps_deep_wake_latency_ms = WIFI_PS_DEEP_WAKE_LATENCY_MS;
+module_param(ps_deep_wake_latency_ms, uint, 0444);
+MODULE_PARM_DESC(ps_deep_wake_latency_ms, "Upper bound on downlink wake latency in deep power save (ms)");
+
+static unsigned int ps_idle_ms = WIFI_PS_IDLE_MS;
+module_param(ps_idle_ms, uint, 0444);
+MODULE_PARM_DESC(ps_idle_ms, "Idle time before entering deep power save (ms)");
+
+/* 延迟预算内能跳过的beacon个数，至少为1 */
+static unsigned int wifi_ps_listen_interval(struct wifi_device *wdev, u32 latency_ms)
+{
+    unsigned int beacon_tu = wdev->conn_info.beacon_interval ?: WIFI_DEFAULT_BEACON_TU;
+    unsigned int beacon_us = beacon_tu * 1024;
+
+    return max(1U, latency_ms * 1000 / beacon_us);
+}
+
+static void wifi_ps_set_mode(struct wifi_device *wdev, enum wifi_power_mode mode,
+                             unsigned int listen_interval)
+{
+    int ret;
+
+    if (mode == wdev->ps_mode &&
+        (mode == WIFI_PS_ACTIVE || listen_interval == wdev->ps_listen_interval))
+        return;
+
+    if (wdev->ops->set_power_save) {
+        ret = wdev->ops->set_power_save(wdev, mode, listen_interval);
+        if (ret) {
+            dev_warn(wdev->dev, "failed to set power save mode %d: %d\n", mode, ret);
+            return;
+        }
+    }
+
+    if (wdev->debug_enabled)
+        dev_info(wdev->dev, "power save %d -> %d (listen interval %u)\n",
+                 wdev->ps_mode, mode, listen_interval);
+
+    WRITE_ONCE(wdev->ps_mode, mode);
+    wdev->ps_listen_interval = listen_interval;
+    wdev->ps_transitions++;
+}
+
+static bool wifi_ps_tx_busy(struct wifi_device *wdev)
+{
+    int q;
+
+    for (q = 0; q < WIFI_TXQ_NUM; q++)
+        if (atomic_read(&wdev->tx_pending[q]) > 0)
+            return true;
+
+    return false;
+}
+
+static void wifi_ps_work(struct work_struct *work)
+{
+    struct wifi_device *wdev = container_of(to_delayed_work(work),
+                                            struct wifi_device, ps_work);
+    struct wifi_stats_totals t;
+    enum wifi_power_mode mode;
+    unsigned int save_interval, deep_interval;
+    unsigned long idle;
+    u64 packets;
+
+    wifi_stats_get_totals(wdev, &t);
+    packets = t.tx_packets + t.tx_failed + t.rx_packets;
+
+    if (packets != wdev->ps_last_packets || wifi_ps_tx_busy(wdev))
+        wdev->ps_last_active = jiffies;
+    wdev->ps_last_packets = packets;
+
+    mutex_lock(&wdev->lock);
+
+    save_interval = wifi_ps_listen_interval(wdev, wdev->ps_max_latency_ms);
+    deep_interval = wifi_ps_listen_interval(wdev, wdev->ps_deep_latency_ms);
+
+    if (!ps_enable || wdev->status.state != WIFI_STATE_CONNECTED) {
+        mode = WIFI_PS_ACTIVE;
+    } else {
+        idle = jiffies - wdev->ps_last_active;
+        if (atomic_read(&wdev->tx_pending[WIFI_TXQ_EVENT]) > 0 ||
+            idle < msecs_to_jiffies(WIFI_PS_CHECK_MS))
+            mode = WIFI_PS_ACTIVE;
+        else if (idle < msecs_to_jiffies(wdev->ps_idle_ms) || deep_interval <= save_interval)
+            mode = WIFI_PS_SAVE;
+        else
+            mode = WIFI_PS_DEEP_SAVE;
+    }
+
+    wifi_ps_set_mode(wdev, mode, mode == WIFI_PS_DEEP_SAVE ? deep_interval :
+                     mode == WIFI_PS_SAVE ? save_interval : 1);
+
+    mutex_unlock(&wdev->lock);
+
+    if (!READ_ONCE(wdev->removing))
+        queue_delayed_work(wdev->workqueue, &wdev->ps_work,
+                           msecs_to_jiffies(WIFI_PS_CHECK_MS));
+}
+
+void wifi_ps_init(struct wifi_device *wdev)
+{
+    wdev->ps_mode = WIFI_PS_ACTIVE;
+    wdev->ps_listen_interval = 1;
+    wdev->ps_max_latency_ms = ps_max_wake_latency_ms;
+    wdev->ps_deep_latency_ms = ps_deep_wake_latency_ms;
+    wdev->ps_idle_ms = ps_idle_ms;
+    wdev->ps_last_active = jiffies;
+    INIT_DELAYED_WORK(&wdev->ps_work, wifi_ps_work);
+}
+
+void wifi_ps_start(struct wifi_device *wdev)
+{
+    wdev->ps_last_active = jiffies;
+    queue_delayed_work(wdev->workqueue, &wdev->ps_work,
+                       msecs_to_jiffies(WIFI_PS_CHECK_MS));
+}
+
+/* 停止策略并让芯片回到ACTIVE，休眠和卸载前调用 */
+void wifi_ps_stop(struct wifi_device *wdev)
+{
+    cancel_delayed_work_sync(&wdev->ps_work);
+
+    mutex_lock(&wdev->lock);
+    wifi_ps_set_mode(wdev, WIFI_PS_ACTIVE, 1);
+    mutex_unlock(&wdev->lock);
+}